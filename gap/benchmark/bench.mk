@@ -37,26 +37,11 @@ $(RAW_GRAPH_DIR)/twitter.el: $(RAW_GRAPH_DIR)/twitter_rv.net
 	rm -f $@
 	ln -s twitter_rv.net $@
 
-$(GRAPH_DIR)/twitter.sg: $(RAW_GRAPH_DIR)/twitter.el converter
-	./converter -f $< -b $@
-
-$(GRAPH_DIR)/twitter.wsg: $(RAW_GRAPH_DIR)/twitter.el converter
-	./converter -f $< -wb $@
-
-$(GRAPH_DIR)/twitterU.sg: $(RAW_GRAPH_DIR)/twitter.el converter
-	./converter -sf $< -b $@
+GRAPH_RAW_twitter = $(RAW_GRAPH_DIR)/twitter.el
 
 # twitter-train
 TWITTER_SIM_ARGS = -g26 -k24
-$(GRAPH_DIR)/twitter-train.sg: converter
-	./converter $(TWITTER_SIM_ARGS) -b $@
-
-$(GRAPH_DIR)/twitter-train.wsg: converter
-	./converter $(TWITTER_SIM_ARGS) -wb $@
-
-$(GRAPH_DIR)/twitter-trainU.sg: $(GRAPH_DIR)/twitter-train.sg converter
-	rm -f $@
-	ln -s twitter-train.sg $@
+GRAPH_ARGS_twitter-train = $(TWITTER_SIM_ARGS)
 
 ROAD_URL = http://www.dis.uniroma1.it/challenge9/data/USA-road-d/USA-road-d.USA.gr.gz
 $(RAW_GRAPH_DIR)/USA-road-d.USA.gr.gz:
@@ -66,14 +51,7 @@ $(RAW_GRAPH_DIR)/USA-road-d.USA.gr: $(RAW_GRAPH_DIR)/USA-road-d.USA.gr.gz
 	cd $(RAW_GRAPH_DIR)
 	gunzip < $< > $@
 
-$(GRAPH_DIR)/road.sg: $(RAW_GRAPH_DIR)/USA-road-d.USA.gr converter
-	./converter -f $< -b $@
-
-$(GRAPH_DIR)/road.wsg: $(RAW_GRAPH_DIR)/USA-road-d.USA.gr converter
-	./converter -f $< -wb $@
-
-$(GRAPH_DIR)/roadU.sg: $(RAW_GRAPH_DIR)/USA-road-d.USA.gr converter
-	./converter -sf $< -b $@
+GRAPH_RAW_road = $(RAW_GRAPH_DIR)/USA-road-d.USA.gr
 
 # road-central
 ROAD_SIM_URL = http://www.diag.uniroma1.it/challenge9/data/USA-road-d/USA-road-d.CTR.gr.gz
@@ -84,14 +62,7 @@ $(RAW_GRAPH_DIR)/USA-road-d.CTR.gr: $(RAW_GRAPH_DIR)/USA-road-d.CTR.gr.gz
 	cd $(RAW_GRAPH_DIR)
 	gunzip < $< > $@
 
-$(GRAPH_DIR)/road-train.sg: $(RAW_GRAPH_DIR)/USA-road-d.CTR.gr converter
-	./converter -f $< -b $@
-
-$(GRAPH_DIR)/road-train.wsg: $(RAW_GRAPH_DIR)/USA-road-d.CTR.gr converter
-	./converter -f $< -wb $@
-
-$(GRAPH_DIR)/road-trainU.sg: $(RAW_GRAPH_DIR)/USA-road-d.CTR.gr converter
-	./converter -sf $< -b $@
+GRAPH_RAW_road-train = $(RAW_GRAPH_DIR)/USA-road-d.CTR.gr
 
 WEB_URL = https://sparse.tamu.edu/MM/LAW/sk-2005.tar.gz
 $(RAW_GRAPH_DIR)/sk-2005.tar.gz:
@@ -101,14 +72,7 @@ $(RAW_GRAPH_DIR)/sk-2005/sk-2005.mtx: $(RAW_GRAPH_DIR)/sk-2005.tar.gz
 	tar -zxvf $< -C $(RAW_GRAPH_DIR)
 	touch $@
 
-$(GRAPH_DIR)/web.sg: $(RAW_GRAPH_DIR)/sk-2005/sk-2005.mtx converter
-	./converter -f $< -b $@
-
-$(GRAPH_DIR)/web.wsg: $(RAW_GRAPH_DIR)/sk-2005/sk-2005.mtx converter
-	./converter -f $< -wb $@
-
-$(GRAPH_DIR)/webU.sg: $(RAW_GRAPH_DIR)/sk-2005/sk-2005.mtx converter
-	./converter -sf $< -b $@
+GRAPH_RAW_web = $(RAW_GRAPH_DIR)/sk-2005/sk-2005.mtx
 
 # WEB it-2004
 WEB_URL_it = https://sparse.tamu.edu/MM/LAW/it-2004.tar.gz
@@ -119,63 +83,48 @@ $(RAW_GRAPH_DIR)/it-2004/it-2004.mtx: $(RAW_GRAPH_DIR)/it-2004.tar.gz
 	tar -zxvf $< -C $(RAW_GRAPH_DIR)
 	touch $@
 
-$(GRAPH_DIR)/web-train.sg: $(RAW_GRAPH_DIR)/it-2004/it-2004.mtx converter
-	./converter -f $< -b $@
-
-$(GRAPH_DIR)/web-train.wsg: $(RAW_GRAPH_DIR)/it-2004/it-2004.mtx converter
-	./converter -f $< -wb $@
-
-$(GRAPH_DIR)/web-trainU.sg: $(RAW_GRAPH_DIR)/it-2004/it-2004.mtx converter
-	./converter -sf $< -b $@
+GRAPH_RAW_web-train = $(RAW_GRAPH_DIR)/it-2004/it-2004.mtx
 
 
 # Synthetic
 
 KRON_ARGS = -g27 -k16
-$(GRAPH_DIR)/kron.sg: converter
-	./converter $(KRON_ARGS) -b $@
-
-$(GRAPH_DIR)/kron.wsg: converter
-	./converter $(KRON_ARGS) -wb $@
-
-$(GRAPH_DIR)/kronU.sg: $(GRAPH_DIR)/kron.sg converter
-	rm -f $@
-	ln -s kron.sg $@
+GRAPH_ARGS_kron = $(KRON_ARGS)
 
 # kron-train
 KRON_SIM_ARGS = -g26 -k15
-$(GRAPH_DIR)/kron-train.sg: converter
-	./converter $(KRON_SIM_ARGS) -b $@
+GRAPH_ARGS_kron-train = $(KRON_SIM_ARGS)
 
-$(GRAPH_DIR)/kron-train.wsg: converter
-	./converter $(KRON_SIM_ARGS) -wb $@
+URAND_ARGS = -u27 -k16
+GRAPH_ARGS_urand = $(URAND_ARGS)
 
-$(GRAPH_DIR)/kron-trainU.sg: $(GRAPH_DIR)/kron-train.sg converter
-	rm -f $@
-	ln -s kron-train.sg $@
+# urand-train
+URAND_SIM_ARGS = -u26 -k15
+GRAPH_ARGS_urand-train = $(URAND_SIM_ARGS)
 
-URAND_ARGS = -u27 -k16
-$(GRAPH_DIR)/urand.sg: converter
-	./converter $(URAND_ARGS) -b $@
 
-$(GRAPH_DIR)/urand.wsg: converter
-	./converter $(URAND_ARGS) -wb $@
 
-$(GRAPH_DIR)/urandU.sg: $(GRAPH_DIR)/urand.sg converter
-	rm -f $@
-	ln -s urand.sg $@
 
-# urand-train
-URAND_SIM_ARGS = -u26 -k15
-$(GRAPH_DIR)/urand-train.sg: converter
-	./converter $(URAND_SIM_ARGS) -b $@
 
-$(GRAPH_DIR)/urand-train.wsg: converter
-	./converter $(URAND_SIM_ARGS) -wb $@
+# Cached build
 
-$(GRAPH_DIR)/urand-trainU.sg: $(GRAPH_DIR)/urand-train.sg converter
-	rm -f $@
-	ln -s urand-train.sg $@
+# A graph's .sg, .wsg and U.sg come from one converter run on its raw file
+# (GRAPH_RAW_*) or generator arguments (GRAPH_ARGS_*), kept in
+# GRAPH_CACHE_DIR under a hash of those and linked into GRAPH_DIR, so they
+# are only rebuilt when an input changes (see graph_cache.sh)
+GRAPH_CACHE_DIR ?= $(GRAPH_DIR)/cache
+GRAPH_CACHE = GRAPH_DIR=$(GRAPH_DIR) GRAPH_CACHE_DIR=$(GRAPH_CACHE_DIR) \
+	benchmark/graph_cache.sh
+
+.SECONDEXPANSION:
+$(GRAPH_DIR)/%U.sg $(GRAPH_DIR)/%.sg $(GRAPH_DIR)/%.wsg: \
+		$$(GRAPH_RAW_$$*) converter
+	$(GRAPH_CACHE) $* $(if $(GRAPH_RAW_$*),-f $(GRAPH_RAW_$*)) \
+		$(GRAPH_ARGS_$*)
+
+.PHONY: bench-graphs-prune
+bench-graphs-prune:
+	$(GRAPH_CACHE) --prune
 
 
 # Benchmark Execution --------------------------------------------------#
@@ -231,3 +180,198 @@ $(OUTPUT_DIR)/bc-%.out: $(GRAPH_DIR)/%.sg bc
 
 $(OUTPUT_DIR)/tc-%.out: $(GRAPH_DIR)/%U.sg tc
 	./tc -f $< -n3 > $@
+
+
+# Vertex Reordering Comparison -----------------------------------------#
+#-----------------------------------------------------------------------#
+
+# Each kernel under each order (-O), reorder time and kernel time side by
+# side; add the tpf kernels to REORDER_KERNELS to see if orders compound
+# with helper-thread prefetching
+REORDERS = none degree dbg hub rcm gorder
+REORDER_KERNELS = bfs pr cc bc
+REORDER_GRAPH ?= kron
+REORDER_ARGS_pr = -i1000 -t1e-4
+REORDER_ARGS_bc = -i4
+
+REORDER_OUTPUT_FILES = $(foreach k, $(REORDER_KERNELS), \
+	$(addprefix $(OUTPUT_DIR)/reorder-$(k)-, \
+		$(addsuffix -$(REORDER_GRAPH).out, $(REORDERS))))
+
+.PHONY: bench-reorder
+bench-reorder: $(OUTPUT_DIR) $(REORDER_OUTPUT_FILES)
+	@grep -H -E "Reorder Time|Average Time" $(REORDER_OUTPUT_FILES)
+
+$(OUTPUT_DIR)/reorder-%-$(REORDER_GRAPH).out: $(GRAPH_DIR)/$(REORDER_GRAPH).sg
+	./$(firstword $(subst -, ,$*)) -f $< -O $(lastword $(subst -, ,$*)) \
+		$(REORDER_ARGS_$(firstword $(subst -, ,$*))) -n16 > $@
+
+
+# 32 vs 64-bit Vertex IDs ----------------------------------------------#
+#-----------------------------------------------------------------------#
+
+# The same kernel on the same generated graph with 32-bit IDs and built
+# with NODEID64 (e.g. bfs and bfs64), for the bandwidth cost of wider IDs
+IDS_KERNELS = bfs pr cc sssp
+IDS_GRAPH ?= kron
+IDS_ARGS_pr = -i1000 -t1e-4
+IDS_ARGS_sssp = -d2
+
+IDS_OUTPUT_FILES = $(foreach k, $(IDS_KERNELS), \
+	$(OUTPUT_DIR)/ids-$(k)-32-$(IDS_GRAPH).out \
+	$(OUTPUT_DIR)/ids-$(k)-64-$(IDS_GRAPH).out)
+
+.PHONY: bench-ids
+bench-ids: $(OUTPUT_DIR) $(IDS_OUTPUT_FILES)
+	@grep -H "Average Time" $(IDS_OUTPUT_FILES)
+
+$(OUTPUT_DIR)/ids-%-32-$(IDS_GRAPH).out: %
+	./$* $(GRAPH_ARGS_$(IDS_GRAPH)) $(IDS_ARGS_$*) -n16 > $@
+
+$(OUTPUT_DIR)/ids-%-64-$(IDS_GRAPH).out: %64
+	./$*64 $(GRAPH_ARGS_$(IDS_GRAPH)) $(IDS_ARGS_$*) -n16 > $@
+
+
+# Multi-Source BFS Throughput ------------------------------------------#
+#-----------------------------------------------------------------------#
+
+# One batch of msbfs_tpf at each width against bfs run once per source;
+# compare Average Time per source (bfs: as is, msbfs: divided by -b)
+MSBFS_BATCHES = 64 128 256
+MSBFS_GRAPH ?= kron
+
+MSBFS_OUTPUT_FILES = $(OUTPUT_DIR)/msbfs-bfs-$(MSBFS_GRAPH).out \
+	$(addprefix $(OUTPUT_DIR)/msbfs-, \
+		$(addsuffix -$(MSBFS_GRAPH).out, $(MSBFS_BATCHES)))
+
+.PHONY: bench-msbfs
+bench-msbfs: $(OUTPUT_DIR) $(MSBFS_OUTPUT_FILES)
+	@grep -H "Average Time" $(MSBFS_OUTPUT_FILES)
+
+$(OUTPUT_DIR)/msbfs-bfs-$(MSBFS_GRAPH).out: $(GRAPH_DIR)/$(MSBFS_GRAPH).sg bfs
+	./bfs -f $< -n64 > $@
+
+$(OUTPUT_DIR)/msbfs-%-$(MSBFS_GRAPH).out: $(GRAPH_DIR)/$(MSBFS_GRAPH).sg \
+		msbfs_tpf
+	./msbfs_tpf -f $< -b$* -n16 > $@
+
+
+# Propagation Blocking vs Ghost Prefetching ----------------------------#
+#-----------------------------------------------------------------------#
+
+# PageRank to the same tolerance: pull with the helper (pr_tpf, ghost
+# build), plain SpMV pull (pr_spmv), and pr_pb at each bin width with and
+# without the helper on its accumulation, to pick one per graph (or both)
+PB_BIN_WIDTHS = 14 16 18 20 22
+PB_GRAPHS ?= kron urand
+PB_ARGS = -i1000 -t1e-4 -n16
+GHOST_BUILDS = pr_tpf-htpf pr_pb-htpf tc_tpf-htpf
+
+# ghost builds, like the ones test.sh compiles
+%-htpf : src/%.cc src/*.h
+	$(CXX) $(CXX_FLAGS) -DHTPF $< -o $@
+
+PB_OUTPUT_FILES = $(foreach g, $(PB_GRAPHS), \
+	$(OUTPUT_DIR)/pb-pr_tpf-htpf-$(g).out $(OUTPUT_DIR)/pb-pr_spmv-$(g).out \
+	$(foreach w, $(PB_BIN_WIDTHS), \
+		$(OUTPUT_DIR)/pb-pr_pb-B$(w)-$(g).out \
+		$(OUTPUT_DIR)/pb-pr_pb-htpf-B$(w)-$(g).out))
+
+.PHONY: bench-pb
+bench-pb: $(OUTPUT_DIR) $(PB_OUTPUT_FILES)
+	@grep -H "Average Time" $(PB_OUTPUT_FILES)
+
+$(OUTPUT_DIR)/pb-pr_tpf-htpf-%.out: $(GRAPH_DIR)/%.sg pr_tpf-htpf
+	./pr_tpf-htpf -f $< $(PB_ARGS) > $@
+
+$(OUTPUT_DIR)/pb-pr_spmv-%.out: $(GRAPH_DIR)/%.sg pr_spmv
+	./pr_spmv -f $< $(PB_ARGS) > $@
+
+$(OUTPUT_DIR)/pb-pr_pb-B%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*)).sg pr_pb
+	./pr_pb -f $< -B$(firstword $(subst -, ,$*)) $(PB_ARGS) > $@
+
+$(OUTPUT_DIR)/pb-pr_pb-htpf-B%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*)).sg pr_pb-htpf
+	./pr_pb-htpf -f $< -B$(firstword $(subst -, ,$*)) $(PB_ARGS) > $@
+
+
+# SIMD Gather Pull -----------------------------------------------------#
+#-----------------------------------------------------------------------#
+
+# pr_tpf's pull with each gather path (-I), on its own and with the helper
+# (ghost build), to see how much of the helper's gain gathers alone get
+GATHER_ISAS = scalar avx2 avx512
+GATHER_GRAPHS ?= kron twitter
+GATHER_ARGS = -i1000 -t1e-4 -n16
+
+GATHER_OUTPUT_FILES = $(foreach g, $(GATHER_GRAPHS), \
+	$(foreach i, $(GATHER_ISAS), \
+		$(OUTPUT_DIR)/gather-plain-$(i)-$(g).out \
+		$(OUTPUT_DIR)/gather-htpf-$(i)-$(g).out))
+
+.PHONY: bench-gather
+bench-gather: $(OUTPUT_DIR) $(GATHER_OUTPUT_FILES)
+	@grep -H "Average Time" $(GATHER_OUTPUT_FILES)
+
+$(OUTPUT_DIR)/gather-htpf-%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*)).sg pr_tpf-htpf
+	./pr_tpf-htpf -f $< -I $(firstword $(subst -, ,$*)) $(GATHER_ARGS) > $@
+
+$(OUTPUT_DIR)/gather-plain-%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*)).sg pr_tpf
+	./pr_tpf -f $< -I $(firstword $(subst -, ,$*)) $(GATHER_ARGS) > $@
+
+
+# SIMD Set Intersection ------------------------------------------------#
+#-----------------------------------------------------------------------#
+
+# tc and the ghost build of tc_tpf with each intersection (-I), scalar
+# being the original walk
+INTERSECT_ISAS = scalar avx2 avx512
+INTERSECT_GRAPHS ?= twitter web
+INTERSECT_ARGS = -n3
+
+INTERSECT_OUTPUT_FILES = $(foreach g, $(INTERSECT_GRAPHS), \
+	$(foreach i, $(INTERSECT_ISAS), \
+		$(OUTPUT_DIR)/intersect-plain-$(i)-$(g).out \
+		$(OUTPUT_DIR)/intersect-htpf-$(i)-$(g).out))
+
+.PHONY: bench-intersect
+bench-intersect: $(OUTPUT_DIR) $(INTERSECT_OUTPUT_FILES)
+	@grep -H "Average Time" $(INTERSECT_OUTPUT_FILES)
+
+$(OUTPUT_DIR)/intersect-plain-%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*))U.sg tc
+	./tc -f $< -I $(firstword $(subst -, ,$*)) $(INTERSECT_ARGS) > $@
+
+$(OUTPUT_DIR)/intersect-htpf-%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*))U.sg tc_tpf-htpf
+	./tc_tpf-htpf -f $< -I $(firstword $(subst -, ,$*)) $(INTERSECT_ARGS) > $@
+
+
+# Hub Bitmap Sets for TC -----------------------------------------------#
+#-----------------------------------------------------------------------#
+
+# tc_tpf at each hub threshold (-T, 0 is off), plain and the ghost build,
+# with -l for the share of pairs and list reads the hub sets took over
+HUB_DEGREES = 0 64 256 1024
+HUB_GRAPHS ?= kron twitter web
+HUB_ARGS = -n3 -l
+
+HUB_OUTPUT_FILES = $(foreach g, $(HUB_GRAPHS), \
+	$(foreach d, $(HUB_DEGREES), \
+		$(OUTPUT_DIR)/hubs-plain-T$(d)-$(g).out \
+		$(OUTPUT_DIR)/hubs-htpf-T$(d)-$(g).out))
+
+.PHONY: bench-hubs
+bench-hubs: $(OUTPUT_DIR) $(HUB_OUTPUT_FILES)
+	@grep -H -E "Average Time|Hub pairs|List reads" $(HUB_OUTPUT_FILES)
+
+$(OUTPUT_DIR)/hubs-plain-T%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*))U.sg tc_tpf
+	./tc_tpf -f $< -T $(firstword $(subst -, ,$*)) $(HUB_ARGS) > $@
+
+$(OUTPUT_DIR)/hubs-htpf-T%.out: \
+		$(GRAPH_DIR)/$$(lastword $$(subst -, ,$$*))U.sg tc_tpf-htpf
+	./tc_tpf-htpf -f $< -T $(firstword $(subst -, ,$*)) $(HUB_ARGS) > $@
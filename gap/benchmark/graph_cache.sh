@@ -0,0 +1,111 @@
+#!/usr/bin/bash
+
+# Content-addressed cache of built benchmark graphs
+#
+#   graph_cache.sh <name> [-f <raw file>] [converter/generator args]
+#   graph_cache.sh --prune
+#
+# Links <name>.sg, <name>.wsg and <name>U.sg in GRAPH_DIR to an entry of
+# GRAPH_CACHE_DIR named by a key, and runs converter (once, with -b -W -U)
+# only if no entry has that key yet. The key hashes the raw file contents,
+# the other arguments (e.g. -g27 -k16), the generator seed (kRandSeed) and
+# CACHE_FORMAT, so a rebuilt converter or a new host with the cache copied
+# over costs nothing. --prune deletes entries no graph links to anymore.
+
+# bump when converter output changes for the same inputs
+CACHE_FORMAT=1
+
+GRAPH_DIR=${GRAPH_DIR:-benchmark/graphs}
+GRAPH_CACHE_DIR=${GRAPH_CACHE_DIR:-$GRAPH_DIR/cache}
+CONVERTER=${CONVERTER:-./converter}
+SEED_SOURCE=${SEED_SOURCE:-src/util.h}
+
+mkdir -p "$GRAPH_CACHE_DIR/inputs" || exit 1
+
+if [ "$1" == "--prune" ]; then
+    for entry in "$GRAPH_CACHE_DIR"/*/KEY; do
+        entry=$(dirname "$entry")
+        used=0
+        for link in "$GRAPH_DIR"/*.sg "$GRAPH_DIR"/*.wsg; do
+            if [ "$(dirname "$(readlink -f "$link")")" == \
+                 "$(readlink -f "$entry")" ]; then
+                used=1
+                break
+            fi
+        done
+        if [ $used == 0 ]; then
+            echo "graph cache prune: $entry"
+            rm -rf "$entry"
+        fi
+    done
+    exit 0
+fi
+
+name=$1
+shift
+raw=""
+args=()
+while [ $# -gt 0 ]; do
+    if [ "$1" == "-f" ]; then
+        raw=$2
+        shift 2
+    else
+        args+=("$1")
+        shift
+    fi
+done
+
+# sha256 of a raw input, remembered by path, size and mtime since the raw
+# graphs are tens of GB
+input_hash() {
+    local stamp memo hash
+    stamp=$(stat -L -c "%s %Y" "$1") || exit 1
+    memo=$GRAPH_CACHE_DIR/inputs/$(readlink -f "$1" | sha256sum | cut -c1-16)
+    if [ -f "$memo" ] && [ "$(head -1 "$memo")" == "$stamp" ]; then
+        tail -1 "$memo"
+    else
+        hash=$(sha256sum < "$1" | cut -d' ' -f1)
+        printf "%s\n%s\n" "$stamp" "$hash" > "$memo"
+        echo "$hash"
+    fi
+}
+
+seed=$(sed -n 's/.*kRandSeed = \([0-9]*\);.*/\1/p' "$SEED_SOURCE")
+desc="format $CACHE_FORMAT
+seed $seed
+args ${args[*]}"
+if [ "$raw" != "" ]; then
+    desc="$desc
+input .${raw##*.} $(input_hash "$raw")"
+fi
+key=$(echo "$desc" | sha256sum | cut -c1-16)
+entry=$GRAPH_CACHE_DIR/$key
+outputs="$name.sg $name.wsg ${name}U.sg"
+
+if [ -f "$entry/KEY" ]; then
+    echo "graph cache hit: $name ($key)"
+else
+    echo "graph cache miss: $name ($key)"
+    tmp=$(mktemp -d "$GRAPH_CACHE_DIR/tmp.XXXXXX") || exit 1
+    if [ "$raw" != "" ]; then
+        $CONVERTER -f "$raw" "${args[@]}" -b "$tmp/$name.sg" \
+            -W "$tmp/$name.wsg" -U "$tmp/${name}U.sg"
+    else
+        # generated graphs are already undirected
+        $CONVERTER "${args[@]}" -b "$tmp/$name.sg" -W "$tmp/$name.wsg" &&
+        ln -s "$name.sg" "$tmp/${name}U.sg"
+    fi
+    if [ $? != 0 ]; then
+        rm -rf "$tmp"
+        exit 1
+    fi
+    echo "$desc" > "$tmp/KEY"
+    rm -rf "$entry"
+    mv "$tmp" "$entry" || exit 1
+fi
+
+for f in $outputs; do
+    # newer than converter, so make won't ask again until it changes
+    touch "$entry/$f"
+    ln -sfnr "$entry/$f" "$GRAPH_DIR/$f" || exit 1
+done
@@ -21,6 +21,7 @@
 #include "util.h"
 
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -52,7 +53,6 @@ propagation phase.
 #define ORDER_WRITE memory_order_relaxed
 
 // #define HTPF 
-// #define INNER 
 // #define OMP
 // #define TUNING
 
@@ -60,14 +60,6 @@ propagation phase.
 
 // #define KRON
 
-#if defined(HTPF) && !defined(URAND)
-#define INNER
-#endif 
-
-#if defined(KRON) || defined(TWITTER) || defined(ROAD)
-#define FIRST
-#endif 
-
 #ifdef WEB
 #define BEST
 #endif 
@@ -123,88 +115,59 @@ typedef double CountT;
 
 // static double loop_time; 
 
-// TimeDiff histogram; 
-OMPSyncAtomic time_diff(2); 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_pbfs; 
+GhostConfig ghost_backprop; 
 
-void PrefetchThread1_urand(const SlidingQueue<NodeID>* queue, const Graph* g,
-    NodeID* depths, CountT* path_counts, NodeID depth) {
-  #if !defined(TUNING)
+// PBFS runs the inner sync helper only for these, urand runs the outer one 
+bool PBFSInner(const GhostConfig &cfg) {
+  return cfg.is(kClassKron) || cfg.is(kClassTwitter) || cfg.is(kClassRoad); 
+}
+
+HyperParam_PfT HyperParam1_urand() {
   HyperParam_PfT hyperparam = {.sync_frequency = 2, .skip_offset = 8, 
                                .serialize_threshold = 50, .unserialize_threshold = 10}; 
-  #else
-  HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  bool serialize_flag = false; 
-  for (auto q_iter = queue->begin(); q_iter < queue->end(); q_iter++) { 
-    NodeID u = *q_iter;
-    // __builtin_prefetch(q_iter); 
-    // __builtin_prefetch(g->out_neigh(*(q_iter++)).end()); 
-    for (NodeID &v : g->out_neigh(u)) { // iter per invoc 32 
-      // v: 20 cpi, 20%; depths[v] 62 cpi, 58% 
-      __builtin_prefetch(&depths[v]); // prefetch depths[v]
-      // if (serialize_flag) {
-      //   asm volatile ("serialize\n\t"); 
-      // }
-    }
-    if (serialize_flag) {
-      asm volatile (
-        ".rept 100\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
-    }
-    sync<NodeID*>(q_iter, (int)sizeof(NodeID), (size_t) q_iter, false, time_diff, 0, ORDER_READ, serialize_flag, hyperparam); 
+  return ghost_pbfs.Or(hyperparam); 
+}
+
+void PrefetchThread1_urand(const Graph* g, NodeID* depths, const NodeID* q_iter) {
+  NodeID u = *q_iter;
+  // __builtin_prefetch(q_iter); 
+  // __builtin_prefetch(g->out_neigh(*(q_iter++)).end()); 
+  for (NodeID &v : g->out_neigh(u)) { // iter per invoc 32 
+    // v: 20 cpi, 20%; depths[v] 62 cpi, 58% 
+    ghost_prefetch(&depths[v]); // prefetch depths[v]
   }
 }
 
-// for kron and twitter 
-void PrefetchThread1_inner(const SlidingQueue<NodeID>* queue, const Graph* g,
-    NodeID* depths, CountT* path_counts, NodeID depth) {
-  #if defined(TWITTER) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 80, .skip_offset = 32, 
-                                .serialize_threshold = 150, .unserialize_threshold = 140}; 
-  #elif defined(KRON) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 80, .skip_offset = 32, 
-                                .serialize_threshold = 150, .unserialize_threshold = 50}; 
-  #else
+HyperParam_PfT HyperParam1_inner() {
   HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  bool serialize_flag = false; 
-  bool prefetch = true; 
-  size_t j = 0; 
-  for (auto q_iter = queue->begin(); q_iter < queue->end(); q_iter++) { 
-    NodeID u = *q_iter;
-    prefetch =  g->out_neigh(u).end() - g->out_neigh(u).begin() > hyperparam.skip_offset ? true : false; 
-    for (NodeID* v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
-      if (prefetch) {
-        #ifndef ROAD
+  if (ghost_pbfs.is(kClassTwitter))
+    hyperparam = {.sync_frequency = 80, .skip_offset = 32, 
+                  .serialize_threshold = 150, .unserialize_threshold = 140}; 
+  else if (ghost_pbfs.is(kClassKron))
+    hyperparam = {.sync_frequency = 80, .skip_offset = 32, 
+                  .serialize_threshold = 150, .unserialize_threshold = 50}; 
+  return ghost_pbfs.Or(hyperparam); 
+}
+
+// for kron, twitter and road 
+void PrefetchThread1_inner(const Graph* g, NodeID* depths, int32_t min_degree, 
+    bool road, const NodeID* q_iter, GhostLoop<NodeID*> &loop) {
+  NodeID u = *q_iter;
+  bool prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > min_degree ? true : false; 
+  for (NodeID* v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
+    if (prefetch) {
+      if (!road) {
         if (v + 64 < g->out_neigh(u).end())
-          __builtin_prefetch(v+64);
-        #else 
-        __builtin_prefetch(v);
-        #endif 
-        __builtin_prefetch(&depths[*v]);
+          ghost_prefetch(v+64);
+      } else {
+        ghost_prefetch(v);
       }
-      if (serialize_flag) {
-        asm volatile ("serialize\n\t"); 
-      }
-      /*---inner sync---*/
-      if (j % hyperparam.sync_frequency == 0 || serialize_flag) {
-        // asm volatile ("serialize\n\t"); 
-        size_t main_j = time_diff.read(0, ORDER_READ); 
-        // histogram.insert_into_atomic_histogram(main_j, j); 
-        if (main_j >= j) {
-          serialize_flag = false; 
-        } else if (j - main_j > hyperparam.serialize_threshold) {
-          serialize_flag = true; 
-        } else if (j - main_j < hyperparam.unserialize_threshold) {
-          serialize_flag = false; 
-        } 
-      }
-      j++; 
-      /*---inner sync---*/
+      ghost_prefetch(&depths[*v]);
     }
+    loop.Step(); // inner sync 
   }
 }
 
@@ -225,22 +188,42 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
     while (!queue.empty()) {
       depth++;
       // const auto start = chrono::high_resolution_clock::now();
-      #if defined(HTPF) && defined(URAND)
-      thread PF(PrefetchThread1_urand, &queue, &g, depths.begin(), path_counts.begin(), depth); 
-      #elif defined(HTPF) && defined(INNER) && defined(FIRST)
-      thread PF(PrefetchThread1_inner, &queue, &g, depths.begin(), path_counts.begin(), depth); 
-      time_diff.set(0, 0, ORDER_WRITE); // inner 
+      #ifdef HTPF
+      const bool inner = PBFSInner(ghost_pbfs); 
+      HyperParam_PfT hyperparam = inner ? HyperParam1_inner() : HyperParam1_urand(); 
+      GhostLoop<NodeID*> ghost(queue.begin(), queue.end(), hyperparam, 
+                               inner ? kSyncInner : kSyncOuter); 
+      #ifdef _OPENMP
+      ghost.set_slot(omp_get_thread_num()); // one helper per thread 
+      #endif 
+      GhostTuning::Attach(ghost, ghost_pbfs); 
+      const Graph *gp = &g; 
+      NodeID *dp = depths.begin(); 
+      if (ghost_pbfs.is(kClassUrand)) {
+        ghost.set_throttle(100); 
+        ghost.Launch([gp, dp] (NodeID *q_iter, GhostLoop<NodeID*> &loop) {
+          PrefetchThread1_urand(gp, dp, q_iter); 
+        }); 
+      } else if (inner) {
+        int32_t min_degree = hyperparam.skip_offset; 
+        bool road = ghost_pbfs.is(kClassRoad); 
+        ghost.Launch([gp, dp, min_degree, road] (NodeID *q_iter, GhostLoop<NodeID*> &loop) {
+          PrefetchThread1_inner(gp, dp, min_degree, road, q_iter, loop); 
+        }); 
+      }
       #endif 
-
       #ifdef BEST
       #pragma omp for schedule(dynamic, 64) nowait
       #endif 
       for (auto q_iter = queue.begin(); q_iter < queue.end(); q_iter++) { 
-        #if defined(HTPF) && defined(URAND)
-        time_diff.set(0, (size_t) q_iter, ORDER_WRITE); // for urand 
+        #ifdef HTPF
+        if (!inner)
+          ghost.Publish(q_iter); // for urand 
         #endif 
         NodeID u = *q_iter;
         for (NodeID &v : g.out_neigh(u)) { // iter per invoc 32 
+          ghost_load(&v); 
+          ghost_load(&depths[v]); 
           if ((depths[v] == -1) &&
               (compare_and_swap(depths[v], static_cast<NodeID>(-1), depth))) {
             lqueue.push_back(v);
@@ -250,9 +233,10 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
             #pragma omp atomic
             path_counts[v] += path_counts[u]; 
           }
-          #if defined(HTPF) && defined(INNER) && defined(FIRST)
-          time_diff.add(0, 1, ORDER_WRITE); // inner 
-          #endif // INNER 
+          #ifdef HTPF
+          if (inner)
+            ghost.Advance(); // inner 
+          #endif // HTPF 
           #ifdef TIME
           #ifdef OMP
           if (omp_get_thread_num() == 0) {
@@ -271,8 +255,8 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
       // const auto end = chrono::high_resolution_clock::now();
       // loop_time += chrono::duration_cast<chrono::microseconds>(end - start).count(); 
       lqueue.flush();
-      #if defined(HTPF) && (defined(FIRST) || defined(URAND))
-      PF.join(); 
+      #ifdef HTPF
+      ghost.Join(); 
       #endif 
       #pragma omp barrier
       #pragma omp single
@@ -285,106 +269,70 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
   depth_index.push_back(queue.begin());
 }
 
-void PrefetchThread2_urand(const int d, const NodeID* begin, const NodeID* end, 
-      const Graph* g, CountT* path_counts, const Bitmap* succ, 
-      const NodeID *g_out_start, ScoreT* deltas, ScoreT* scores) {
-  #ifndef TUNING
-  HyperParam_PfT hyperparam = {.sync_frequency = 0, .skip_offset = 8, 
-                                .serialize_threshold = 0, .unserialize_threshold = 0}; 
-  #else
-  // HyperParam_PfT hyperparam = hyper_param; 
-  HyperParam_PfT hyperparam = {.sync_frequency = 0, .skip_offset = 8, 
-                                .serialize_threshold = 0, .unserialize_threshold = 0}; 
-  #endif
-  // uint64_t local_counter = 0; // no sync here
-  bool serialize_flag = false; 
-  for (auto it = begin; it < end; it++) { // 16777216 iter per invoc 
-    NodeID u = *it;
-    // local_counter = (size_t) it; 
-    for (NodeID &v : g->out_neigh(u)) { // 32 iter per invoc 
-      if (succ->get_bit(&v - g_out_start)) {
-        __builtin_prefetch(&path_counts[v]);
-        __builtin_prefetch(&deltas[v]);
-      }
-      if (serialize_flag) {
-        asm volatile ("serialize\n\t"); 
-      }
+// no sync here: the helper always restarts ahead of main (kSyncFollow)
+void PrefetchThread2_urand(const Graph* g, CountT* path_counts, const Bitmap* succ, 
+      const NodeID *g_out_start, ScoreT* deltas, ScoreT* scores, const NodeID* it) {
+  NodeID u = *it; // 16777216 iter per invoc 
+  for (NodeID &v : g->out_neigh(u)) { // 32 iter per invoc 
+    if (succ->get_bit(&v - g_out_start)) {
+      ghost_prefetch(&path_counts[v]);
+      ghost_prefetch(&deltas[v]);
     }
-    __builtin_prefetch(&deltas[u]); // prefetch deltas[u] 
-    __builtin_prefetch(&scores[u]); // prefetch scores[u] 
-
-    /*-----sync-----*/
-    size_t main_counter = time_diff.read(1, ORDER_READ); 
-    it = (NodeID*) (main_counter + hyperparam.skip_offset*sizeof(NodeID)); // always jmp 
-    /*-----sync-----*/
   }
+  ghost_prefetch(&deltas[u]); // prefetch deltas[u] 
+  ghost_prefetch(&scores[u]); // prefetch scores[u] 
 }
 
-void PrefetchThread2_inner(const int d, const NodeID* begin, const NodeID* end, 
-      const Graph* g, CountT* path_counts, const Bitmap* succ, 
-      const NodeID *g_out_start, ScoreT* deltas, ScoreT* scores) {
-  #if defined(TWITTER) //&& !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 80, .skip_offset = 64, 
-                                .serialize_threshold = 800, .unserialize_threshold = 790}; 
-  #elif defined(KRON) //&& !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 80, .skip_offset = 128, 
-                                .serialize_threshold = 800, .unserialize_threshold = 770}; 
-  #elif defined(ROAD)
-  HyperParam_PfT hyperparam = {.sync_frequency = 80, .skip_offset = 128, 
-                               .serialize_threshold = 800, .unserialize_threshold = 770}; 
-  #elif defined(WEB)
-  HyperParam_PfT hyperparam = {.sync_frequency = 200, .skip_offset = 64, 
-                               .serialize_threshold = 600, .unserialize_threshold = 590}; 
-  #else
+HyperParam_PfT HyperParam2_urand() {
+  HyperParam_PfT hyperparam = {.sync_frequency = 0, .skip_offset = 8, 
+                                .serialize_threshold = 0, .unserialize_threshold = 0}; 
+  return ghost_backprop.Or(hyperparam); 
+}
+
+HyperParam_PfT HyperParam2_inner() {
   HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  uint64_t j = 0; 
-  bool serialize_flag = false; 
+  if (ghost_backprop.is(kClassTwitter))
+    hyperparam = {.sync_frequency = 80, .skip_offset = 64, 
+                  .serialize_threshold = 800, .unserialize_threshold = 790}; 
+  else if (ghost_backprop.is(kClassKron) || ghost_backprop.is(kClassRoad))
+    hyperparam = {.sync_frequency = 80, .skip_offset = 128, 
+                  .serialize_threshold = 800, .unserialize_threshold = 770}; 
+  else if (ghost_backprop.is(kClassWeb))
+    hyperparam = {.sync_frequency = 200, .skip_offset = 64, 
+                  .serialize_threshold = 600, .unserialize_threshold = 590}; 
+  return ghost_backprop.Or(hyperparam); 
+}
+
+void PrefetchThread2_inner(const Graph* g, CountT* path_counts, const Bitmap* succ, 
+      const NodeID *g_out_start, ScoreT* deltas, ScoreT* scores, 
+      int32_t min_degree, GraphClass graph_class, const NodeID* it, 
+      GhostLoop<NodeID*> &loop) {
+  NodeID u = *it;
+  const bool road = graph_class == kClassRoad; 
   bool prefetch = true; 
-  for (auto it = begin; it < end; it++) { 
-    NodeID u = *it;
-    #ifndef ROAD // filter for kron and twitter
-    prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > hyperparam.skip_offset ? true : false; 
-    #endif 
-    #if defined(ROAD) || defined(WEB)
+  if (!road) // filter for kron and twitter
+    prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > min_degree ? true : false; 
+  if (road || graph_class == kClassWeb)
     g->out_neigh(u).prefetch_end(); 
-    #endif 
-    for (NodeID* v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
-      if (prefetch) {  
-        #ifndef ROAD
+  // these are not mem-intensive for road 
+  const bool pf_data = graph_class == kClassKron || graph_class == kClassTwitter || 
+                       graph_class == kClassWeb; 
+  for (NodeID* v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
+    if (prefetch) {  
+      if (!road) {
         if (v +64 < g->out_neigh(u).end())
-          __builtin_prefetch(v + 64); 
-        #else
-        __builtin_prefetch(v); 
-        #endif 
-      }
-      #if defined(KRON) || defined(TWITTER) || defined(WEB) // these are not mem-intensive for web and road 
-      if (succ->get_bit(v - g_out_start) && prefetch) { 
-        __builtin_prefetch(&path_counts[*v]);
-        __builtin_prefetch(&deltas[*v]);
-      }
-      #endif 
-      if (serialize_flag) {
-        asm volatile ("serialize\n\t"); 
+          ghost_prefetch(v + 64); 
+      } else {
+        ghost_prefetch(v); 
       }
-      j++; 
-      /*---inner sync---*/
-      if (j % hyperparam.sync_frequency == 0 || serialize_flag) {
-        // asm volatile ("serialize\n\t"); 
-        size_t main_j = time_diff.read(1, ORDER_READ); 
-        // histogram.insert_into_atomic_histogram(main_j, j); 
-        if (main_j >= j) {
-          serialize_flag = false; 
-        } else if (j - main_j > hyperparam.serialize_threshold) {
-          serialize_flag = true; 
-        } else if (j - main_j < hyperparam.unserialize_threshold) {
-          serialize_flag = false; 
-        } 
-      }
-      /*---inner sync---*/
     }
-    __builtin_prefetch(&scores[u]); // prefetch scores[u] 
+    if (pf_data && succ->get_bit(v - g_out_start) && prefetch) { 
+      ghost_prefetch(&path_counts[*v]);
+      ghost_prefetch(&deltas[*v]);
+    }
+    loop.Step(); // inner sync 
   }
+  ghost_prefetch(&scores[u]); // prefetch scores[u] 
 }
 
 pvector<ScoreT> Brandes(const Graph &g, SourcePicker<Graph> &sp,
@@ -417,36 +365,57 @@ pvector<ScoreT> Brandes(const Graph &g, SourcePicker<Graph> &sp,
     t.Start();
     for (int d=depth_index.size()-2; d >= 0; d--) {
       #ifdef HTPF
-      #ifndef INNER
-      thread PF(PrefetchThread2_urand, d, depth_index[d], depth_index[d+1], &g, 
-          path_counts.begin(), &succ, g_out_start, deltas.begin(), scores.begin()); 
-      #else
-      thread PF(PrefetchThread2_inner, d, depth_index[d], depth_index[d+1], &g, 
-          path_counts.begin(), &succ, g_out_start, deltas.begin(), scores.begin()); 
-      time_diff.set(1, 0, ORDER_WRITE); 
-      #endif 
+      const Graph *gp = &g; 
+      CountT *pcp = path_counts.begin(); 
+      const Bitmap *sp = &succ; 
+      ScoreT *dp = deltas.begin(); 
+      ScoreT *scp = scores.begin(); 
+      const bool inner = !ghost_backprop.is(kClassUrand); 
+      HyperParam_PfT hyperparam = inner ? HyperParam2_inner() : HyperParam2_urand(); 
+      GhostLoop<NodeID*> ghost(depth_index[d], depth_index[d+1], hyperparam, 
+                               inner ? kSyncInner : kSyncFollow); 
+      GhostTuning::Attach(ghost, ghost_backprop); 
+      if (ghost_backprop.enabled() && !inner) {
+        ghost.Launch([gp, pcp, sp, g_out_start, dp, scp] (NodeID *it, GhostLoop<NodeID*> &loop) {
+          PrefetchThread2_urand(gp, pcp, sp, g_out_start, dp, scp, it); 
+        }); 
+      } else if (ghost_backprop.enabled()) {
+        int32_t min_degree = hyperparam.skip_offset; 
+        GraphClass graph_class = ghost_backprop.graph_class; 
+        ghost.Launch([gp, pcp, sp, g_out_start, dp, scp, min_degree, graph_class] 
+                     (NodeID *it, GhostLoop<NodeID*> &loop) {
+          PrefetchThread2_inner(gp, pcp, sp, g_out_start, dp, scp, min_degree, 
+                                graph_class, it, loop); 
+        }); 
+      }
       #endif 
       // const auto start = chrono::high_resolution_clock::now();
       // #pragma omp parallel for schedule(dynamic, 64)
       for (auto it = depth_index[d]; it < depth_index[d+1]; it++) { 
-        #if defined(HTPF) && !defined(INNER)
-        time_diff.set(1, (size_t) it, ORDER_WRITE); 
+        #ifdef HTPF
+        if (!inner)
+          ghost.Publish(it); 
         #endif 
         NodeID u = *it;
         ScoreT delta_u = 0;
         for (NodeID &v : g.out_neigh(u)) { // 32 iter per invoc 
-          #if defined(HTPF) && defined(INNER)
-          time_diff.add(1, 1, ORDER_WRITE); 
+          #ifdef HTPF
+          if (inner)
+            ghost.Advance(); 
           #endif 
+          ghost_load(&v); 
           if (succ.get_bit(&v - g_out_start)) {
+            ghost_load(&path_counts[v]); 
+            ghost_load(&deltas[v]); 
             delta_u += (path_counts[u] / path_counts[v]) * (1 + deltas[v]); // prefetch path_counts[v] and deltas[v] 
           }
         }
         deltas[u] = delta_u; 
+        ghost_load(&scores[u]); 
         scores[u] += delta_u; // prefetch scores[u] 
       }
       #ifdef HTPF
-      PF.join(); 
+      ghost.Join(); 
       #endif 
     }
     t.Stop();
@@ -461,6 +430,10 @@ pvector<ScoreT> Brandes(const Graph &g, SourcePicker<Graph> &sp,
   #pragma omp parallel for
   for (NodeID n=0; n < g.num_nodes(); n++)
     scores[n] = scores[n] / biggest_score;
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted(); 
+  #endif 
   return scores;
 }
 
@@ -549,7 +522,6 @@ int main(int argc, char* argv[]) {
   #ifdef OMP
   omp_set_num_threads(2); 
   #endif
-  // histogram.init_atomic_histogram(4223223502/2); 
   // loop_time = 0.0; 
   #ifdef TIME
   stamp_counter = 0; 
@@ -572,6 +544,11 @@ int main(int argc, char* argv[]) {
   
   Builder b(cli);
   Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("bc", g, cli, hyper_param); 
+  ghost_pbfs = ghost_tuning.Config("pbfs"); 
+  ghost_backprop = ghost_tuning.Config("backprop", false); 
+  #endif 
   SourcePicker<Graph> sp(g, cli.start_vertex());
   auto BCBound = [&sp, &cli] (const Graph &g) {
     return Brandes(g, sp, cli.num_iters(), cli.logging_en());
@@ -585,7 +562,6 @@ int main(int argc, char* argv[]) {
   auto kernel_start = chrono::high_resolution_clock::now();
   #endif 
   BenchmarkKernel(cli, g, BCBound, PrintTopScores, VerifierBound);
-  // histogram.print_atomic_histogram(); 
   // cout << "loop time = " << loop_time/1e6 << "s" << endl; 
   #ifdef TIME
   ofstream myout; 
@@ -24,6 +24,7 @@
 #include "util.h"
 
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -67,43 +68,27 @@ propagation phase.
 #endif 
 
 #define HTPF
-#define KRON
 
-#if defined(HTPF) && !defined(URAND)
-#define INNER
-#endif 
-
-// #if defined(KRON) || defined(TWITTER)
+// inner PBFS helper for kron and twitter, off by default 
 // #define FIRST
-// #endif 
 
 using namespace std;
 typedef float ScoreT;
 typedef double CountT;
 
 TimeDiff histogram; 
-OMPSyncAtomic time_diff1(NT); 
-OMPSyncAtomic time_diff1_outer(NT); 
-OMPSyncAtomic time_diff2(NT); 
-OMPSyncAtomic end_flag(NT); 
+// one progress record per main thread: outer is the queue position, inner
+// the edge count (FIRST), done replaces the old end flag
+GhostProgress pbfs_progress[NT];
+GhostProgress backprop_progress[NT];
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_pbfs;     // only urand has a helper unless FIRST 
+GhostConfig ghost_backprop; // urand splits statically, the rest run inner 
 
 void PrefetchThread1_urand(int me, const SlidingQueue<NodeID>* queue, const Graph* g,
     NodeID* depths, CountT* path_counts, NodeID depth, NodeID* start, NodeID* end) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  // GhostPool pins slot me once, to the helper CPU of GhostTopology pair me
   #if !defined(TUNING)
   HyperParam_PfT hyperparam = {.sync_frequency = 2, .skip_offset = 8, 
                                .serialize_threshold = 50, .unserialize_threshold = 10}; 
@@ -118,13 +103,9 @@ void PrefetchThread1_urand(int me, const SlidingQueue<NodeID>* queue, const Grap
       __builtin_prefetch(&depths[v]); // prefetch depths[v]
     }
     if (serialize_flag) {
-      asm volatile (
-        ".rept 100\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
+      ghost_throttle(100);
     }
-    sync<NodeID*>(q_iter, (int)sizeof(NodeID), (size_t) q_iter, false, time_diff1, me, ORDER_READ, serialize_flag, hyperparam); 
+    sync<NodeID*>(q_iter, (int)sizeof(NodeID), (size_t) q_iter, false, pbfs_progress[me], serialize_flag, hyperparam); 
   }
 }
 
@@ -132,20 +113,7 @@ void PrefetchThread1_urand(int me, const SlidingQueue<NodeID>* queue, const Grap
 // for kron and twitter 
 void PrefetchThread1_inner(int me, NodeID* start, NodeID* end, const SlidingQueue<NodeID>* queue, const Graph* g,
     NodeID* depths, CountT* path_counts, NodeID depth) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  // GhostPool pins slot me once, to the helper CPU of GhostTopology pair me
   HyperParam_PfT hyperparam = hyper_param; 
   bool serialize_flag = false; 
   bool prefetch = true; 
@@ -164,12 +132,12 @@ void PrefetchThread1_inner(int me, NodeID* start, NodeID* end, const SlidingQueu
       //   __builtin_prefetch(&path_counts[*v]); 
       // }
       if (serialize_flag) {
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
       }
       /*---inner sync---*/
       if (j % hyperparam.sync_frequency == 0 || serialize_flag) {
         // asm volatile ("serialize\n\t"); 
-        size_t main_j = time_diff1.read(me, ORDER_READ); 
+        size_t main_j = pbfs_progress[me].ReadInner(); 
         // histogram.insert_into_atomic_histogram(main_j, j); 
         if (main_j >= j) {
           serialize_flag = false; 
@@ -185,14 +153,16 @@ void PrefetchThread1_inner(int me, NodeID* start, NodeID* end, const SlidingQueu
   /*-------sleep stage-------*/
     local_counter++; 
     if (local_counter >= CHUNKSIZE1) {
+      GhostSnapshot main;
       while (true) { 
-        asm volatile ("serialize\n\t"); 
-        if (time_diff1_outer.read(me, ORDER_READ) >= (size_t) q_iter || end_flag.read(me, ORDER_READ)) 
+        ghost_throttle(1); 
+        main = pbfs_progress[me].Read();
+        if (main.outer >= (size_t) q_iter || main.done) 
           break; 
       } // wait until the main thread goes to next chunk 
-      if (end_flag.read(me, ORDER_READ))
+      if (main.done)
         break; 
-      q_iter = (NodeID*) time_diff1_outer.read(me, ORDER_READ); 
+      q_iter = (NodeID*) main.outer; 
       local_counter = 0; 
     }
   /*-------sleep stage-------*/
@@ -210,28 +180,24 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
   depth_index.push_back(queue.begin());
   queue.slide_window();
   const NodeID* g_out_start = g.out_neigh(0).begin();
+  const bool urand = ghost_pbfs.is(kClassUrand); 
+  #ifdef FIRST
+  const bool helper = ghost_pbfs.enabled(); 
+  #else
+  const bool helper = urand; 
+  #endif 
+  if (urand)
+    omp_set_schedule(omp_sched_static, 0); 
+  else
+    omp_set_schedule(omp_sched_dynamic, CHUNKSIZE1); 
   #pragma omp parallel
   {
     int me = omp_get_thread_num(); 
-    /*-----pin the main thread to specfic core-----*/ 
-    pthread_t self = pthread_self();
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    // CPU_SET(me, &cpuset);
-    CPU_SET(me*2, &cpuset); // beijing
-      
-    int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-    if (rc != 0)
-    {
-      printf("Failed to pin main thread.\n");
-      exit(1);
-    }
-    /*-----pin the main thread to specfic core-----*/
+    GhostTopology::Get().PinMain(me);
     NodeID depth = 0;
     QueueBuffer<NodeID> lqueue(queue);
     while (!queue.empty()) {
       depth++;
-      #ifdef URAND
       /*-----compute boundary for each pf thread-----*/
       size_t div = (queue.end() -  queue.begin()) / NT; 
       size_t mod = (queue.end() -  queue.begin()) % NT; 
@@ -252,27 +218,35 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
       NodeID* start_iter = queue.begin() + head; 
       NodeID* end_iter = queue.begin() + tail; 
       /*-----compute boundary for each pf thread-----*/
-      #endif 
 
-      #if defined(HTPF) && !defined(INNER)
-      thread PF(PrefetchThread1_urand, me, &queue, &g, depths.begin(), path_counts.begin(), depth, start_iter, end_iter); 
-      #elif defined(HTPF) && defined(INNER) && defined(FIRST)
-      NodeID* start_iter = queue.begin() + CHUNKSIZE1*me; 
-      thread PF(PrefetchThread1_inner, me, start_iter, queue.end(), &queue, &g, depths.begin(), path_counts.begin(), depth); 
-      time_diff1.set(me, (size_t) 0, ORDER_WRITE); // inner 
-      // time_diff1_outer.set(me, (size_t) start_iter, ORDER_WRITE); 
-      end_flag.set(me, 0, ORDER_WRITE); 
+      #ifdef HTPF
+      #ifdef FIRST
+      NodeID* inner_start = queue.begin() + CHUNKSIZE1*me; 
       #endif 
-      #ifdef URAND
-      #pragma omp for schedule(static) nowait
-      #else
-      #pragma omp for schedule(dynamic, CHUNKSIZE1) nowait
+      auto PF = [&] () {
+        #ifdef FIRST
+        if (!urand) {
+          PrefetchThread1_inner(me, inner_start, queue.end(), &queue, &g, depths.begin(), path_counts.begin(), depth); 
+          return; 
+        }
+        #endif 
+        PrefetchThread1_urand(me, &queue, &g, depths.begin(), path_counts.begin(), depth, start_iter, end_iter); 
+      }; 
+      if (urand) {
+        // thresholds here are in bytes of queue, keep K at a few vertices
+        pbfs_progress[me].Reset((size_t) start_iter, 4);
+        GhostPool::Get().Dispatch(me, PF); 
+      } else if (helper) {
+        pbfs_progress[me].Reset((size_t) queue.begin(), 
+                                hyper_param.unserialize_threshold / 2);
+        GhostPool::Get().Dispatch(me, PF); 
+      }
       #endif 
+      #pragma omp for schedule(runtime) nowait // static for urand 
       for (auto q_iter = queue.begin(); q_iter < queue.end(); q_iter++) { 
-        #if defined(HTPF) && !defined(INNER)
-        time_diff1.set(me, (size_t) q_iter, ORDER_WRITE); // for urand 
-        #elif defined(HTPF) && defined(INNER) && defined(FIRST)
-        time_diff1_outer.set(me, (size_t) q_iter, ORDER_WRITE); 
+        #ifdef HTPF
+        if (helper)
+          pbfs_progress[me].Outer((size_t) q_iter); 
         #endif 
         NodeID u = *q_iter;
         for (NodeID &v : g.out_neigh(u)) { 
@@ -285,15 +259,18 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
             #pragma omp atomic
             path_counts[v] += path_counts[u]; 
           }
-          #if defined(HTPF) && defined(INNER) && defined(FIRST)
-          time_diff1.add(me, 1, ORDER_WRITE); // inner 
-          #endif // INNER 
+          #if defined(HTPF) && defined(FIRST)
+          if (helper && !urand)
+            pbfs_progress[me].Inner(); // inner 
+          #endif // FIRST 
         }
       }
       lqueue.flush();
-      #if defined(HTPF) && (defined(FIRST) || defined(URAND))
-      end_flag.set(me, 1, ORDER_WRITE); 
-      PF.join(); 
+      #ifdef HTPF
+      if (helper) {
+        pbfs_progress[me].Finish(); 
+        GhostPool::Get().Wait(me); 
+      }
       #endif 
       #pragma omp barrier
       #pragma omp single
@@ -309,20 +286,7 @@ void PBFS(const Graph &g, NodeID source, pvector<CountT> &path_counts,
 void PrefetchThread2_urand(int me, const int d, const NodeID* begin, const NodeID* end, 
       const Graph* g, CountT* path_counts, const Bitmap* succ, 
       const NodeID *g_out_start, ScoreT* deltas, ScoreT* scores) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  // GhostPool pins slot me once, to the helper CPU of GhostTopology pair me
   #ifndef TUNING
   HyperParam_PfT hyperparam = {.sync_frequency = 0, .skip_offset = 9, 
                                 .serialize_threshold = 0, .unserialize_threshold = 0}; 
@@ -340,14 +304,14 @@ void PrefetchThread2_urand(int me, const int d, const NodeID* begin, const NodeI
         __builtin_prefetch(&deltas[v]);
       }
       if (serialize_flag) {
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
       }
     }
     __builtin_prefetch(&deltas[u]); // prefetch deltas[u] 
     __builtin_prefetch(&scores[u]); // prefetch scores[u] 
 
     /*-----sync-----*/
-    size_t main_counter = time_diff2.read(me, ORDER_READ); 
+    size_t main_counter = backprop_progress[me].ReadOuter(); 
     it = (NodeID*) (main_counter + hyperparam.skip_offset*sizeof(NodeID)); // always jmp 
     /*-----sync-----*/
   }
@@ -356,36 +320,24 @@ void PrefetchThread2_urand(int me, const int d, const NodeID* begin, const NodeI
 void PrefetchThread2_inner(int me, const int d, const NodeID* begin, const NodeID* end, 
       const Graph* g, CountT* path_counts, const Bitmap* succ, 
       const NodeID *g_out_start, ScoreT* deltas, ScoreT* scores) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
-  #if defined(TWITTER) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 20, .skip_offset = 32, 
-                                .serialize_threshold = 600, .unserialize_threshold = 50}; 
-  #elif defined(KRON) && !defined(TUNING)
+  // GhostPool pins slot me once, to the helper CPU of GhostTopology pair me
+  #ifndef TUNING
   HyperParam_PfT hyperparam = {.sync_frequency = 20, .skip_offset = 32, 
                                 .serialize_threshold = 400, .unserialize_threshold = 70}; 
+  if (ghost_backprop.is(kClassTwitter)) {
+    hyperparam.serialize_threshold = 600; 
+    hyperparam.unserialize_threshold = 50; 
+  }
   #else
   HyperParam_PfT hyperparam = hyper_param; 
   // HyperParam_PfT hyperparam = {.sync_frequency = 20, .skip_offset = 32, 
   //   .serialize_threshold = 400, .unserialize_threshold = 70}; 
   #endif 
   // uint64_t j = 0; 
-  uint32_t local_counter = 0; 
+  size_t local_counter = 0; 
   bool serialize_flag = false; 
   bool prefetch = true; 
-  begin = (NodeID*) time_diff2.read(me, ORDER_READ); 
+  begin = (NodeID*) backprop_progress[me].ReadOuter(); 
   for (auto it = begin; it < end; it++) { 
     local_counter = it - begin; 
     NodeID u = *it;
@@ -395,19 +347,17 @@ void PrefetchThread2_inner(int me, const int d, const NodeID* begin, const NodeI
       //   if (v +64 < g->out_neigh(u).end())
       //     __builtin_prefetch(v + 64); 
       // }
-      #if defined(KRON) || defined(TWITTER) // these are not mem-intensive for web and road 
       if (succ->get_bit(v - g_out_start) && prefetch) { 
         __builtin_prefetch(&path_counts[*v]);
         __builtin_prefetch(&deltas[*v]);
       }
-      #endif 
       if (serialize_flag) {
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
       }
       /*---inner sync---*/
       // j++; 
       // if (j % hyperparam.sync_frequency == 0 || serialize_flag) {
-      //   size_t main_j = time_diff2.read(me, ORDER_READ); 
+      //   size_t main_j = backprop_progress[me].ReadInner(); 
       //   if (main_j >= j) { // pf thread is too slow 
       //     serialize_flag = false; 
       //   } else if (j - main_j > hyperparam.serialize_threshold) { // too fast 
@@ -420,14 +370,16 @@ void PrefetchThread2_inner(int me, const int d, const NodeID* begin, const NodeI
     }
     __builtin_prefetch(&scores[u]); // prefetch scores[u] 
     if (local_counter >= CHUNKSIZE) {
+      GhostSnapshot main;
       while (true) { 
-        asm volatile ("serialize\n\t"); 
-        if (time_diff2.read(me, ORDER_READ) >= (size_t) it || end_flag.read(me, ORDER_READ)) 
+        ghost_throttle(1); 
+        main = backprop_progress[me].Read();
+        if (main.outer >= (size_t) it || main.done) 
           break; 
       } // wait until the main thread goes to next chunk 
-      if (end_flag.read(me, ORDER_READ))
+      if (main.done)
         break; 
-      it = (NodeID*) time_diff2.read(me, ORDER_READ); 
+      it = (NodeID*) main.outer; 
       begin = it; 
     }
   }
@@ -461,26 +413,17 @@ pvector<ScoreT> Brandes(const Graph &g, SourcePicker<Graph> &sp,
       PrintStep("b", t.Seconds());
     pvector<ScoreT> deltas(g.num_nodes(), 0);
     t.Start();
+    const bool urand = ghost_backprop.is(kClassUrand); 
+    if (urand)
+      omp_set_schedule(omp_sched_static, 0); 
+    else
+      omp_set_schedule(omp_sched_dynamic, CHUNKSIZE); 
     for (int d=depth_index.size()-2; d >= 0; d--) {
       #pragma omp parallel
       {
         int me = omp_get_thread_num(); 
-        /*-----pin the main thread to specfic core-----*/ 
-        pthread_t self = pthread_self();
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        // CPU_SET(me, &cpuset);
-        CPU_SET(me*2, &cpuset); // beijing
-          
-        int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-        if (rc != 0)
-        {
-          printf("Failed to pin main thread.\n");
-          exit(1);
-        }
-        /*-----pin the main thread to specfic core-----*/
+        GhostTopology::Get().PinMain(me);
 
-        #ifdef URAND
         /*-----compute boundary for each pf thread-----*/
         size_t div = (depth_index[d+1] -  depth_index[d]) / NT; 
         size_t mod = (depth_index[d+1] -  depth_index[d]) % NT; 
@@ -501,37 +444,36 @@ pvector<ScoreT> Brandes(const Graph &g, SourcePicker<Graph> &sp,
         NodeID* start_iter = depth_index[d] + head; 
         NodeID* end_iter = depth_index[d] + tail; 
         /*-----compute boundary for each pf thread-----*/
-        #endif 
 
         #ifdef HTPF
-        #ifndef INNER
-        thread PF(PrefetchThread2_urand, me, d, start_iter, end_iter, &g, 
-          path_counts.begin(), &succ, g_out_start, deltas.begin(), scores.begin()); 
-        #else
-        NodeID* start_iter = depth_index[d] + CHUNKSIZE*me; 
-        thread PF(PrefetchThread2_inner, me, d, start_iter, depth_index[d+1], &g, 
-            path_counts.begin(), &succ, g_out_start, deltas.begin(), scores.begin()); 
-        time_diff2.set(me, (size_t) start_iter, ORDER_WRITE);
-        // time_diff2.set(me, 0, ORDER_WRITE); 
-        end_flag.set(me, 0, ORDER_WRITE); 
-        #endif 
-        #endif 
-        #ifdef URAND
-        #pragma omp for schedule(static) // static scheduling
-        #else
-        #pragma omp for schedule(dynamic, CHUNKSIZE)
+        NodeID* inner_start = depth_index[d] + CHUNKSIZE*me; 
+        auto PF = [&] () {
+          if (urand)
+            PrefetchThread2_urand(me, d, start_iter, end_iter, &g, 
+              path_counts.begin(), &succ, g_out_start, deltas.begin(), scores.begin()); 
+          else
+            PrefetchThread2_inner(me, d, inner_start, depth_index[d+1], &g, 
+              path_counts.begin(), &succ, g_out_start, deltas.begin(), scores.begin()); 
+        }; 
+        if (urand) {
+          // this helper jumps to main after every vertex, publish eagerly
+          backprop_progress[me].Reset((size_t) start_iter, 1);
+        } else {
+          backprop_progress[me].Reset((size_t) inner_start);
+        }
+        if (ghost_backprop.enabled())
+          GhostPool::Get().Dispatch(me, PF); 
         #endif 
+        #pragma omp for schedule(runtime) // static for urand 
         for (auto it = depth_index[d]; it < depth_index[d+1]; it++) { 
-          #if defined(HTPF) && !defined(INNER)
-          time_diff2.set(me, (size_t) it, ORDER_WRITE); // urand 
-          #elif defined(HTPF) && defined(INNER)
-          time_diff2.set(me, (size_t) it, ORDER_WRITE); // iter counter for sleep stage  
+          #ifdef HTPF
+          backprop_progress[me].Outer((size_t) it); // iter counter for sleep stage 
           #endif 
           NodeID u = *it;
           ScoreT delta_u = 0;
           for (NodeID &v : g.out_neigh(u)) { 
             // #if defined(HTPF) && defined(INNER)
-            // time_diff2.add(me, 1, ORDER_WRITE); 
+            // backprop_progress[me].Inner(); 
             // #endif 
             if (succ.get_bit(&v - g_out_start)) {
               delta_u += (path_counts[u] / path_counts[v]) * (1 + deltas[v]); // prefetch path_counts[v] and deltas[v] 
@@ -541,8 +483,9 @@ pvector<ScoreT> Brandes(const Graph &g, SourcePicker<Graph> &sp,
           scores[u] += delta_u; // prefetch scores[u] 
         }
         #ifdef HTPF
-        end_flag.set(me, 1, ORDER_WRITE); 
-        PF.join(); 
+        backprop_progress[me].Finish(); 
+        if (ghost_backprop.enabled())
+          GhostPool::Get().Wait(me); 
         #endif 
       } // omp parallel 
     }
@@ -558,6 +501,9 @@ pvector<ScoreT> Brandes(const Graph &g, SourcePicker<Graph> &sp,
   #pragma omp parallel for
   for (NodeID n=0; n < g.num_nodes(); n++)
     scores[n] = scores[n] / biggest_score;
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  #endif 
   return scores;
 }
 
@@ -659,8 +605,14 @@ int main(int argc, char* argv[]) {
   cout << "sync frequency = " << hyper_param.sync_frequency << ", serialize threshold = " << hyper_param.serialize_threshold 
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
   
+  GhostThrottle::Get(); // calibrate before anything is timed
   Builder b(cli);
   Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("bc_paral", g, cli, hyper_param); 
+  ghost_pbfs = ghost_tuning.Config("pbfs"); 
+  ghost_backprop = ghost_tuning.Config("backprop"); 
+  #endif 
   SourcePicker<Graph> sp(g, cli.start_vertex());
   auto BCBound = [&sp, &cli] (const Graph &g) {
     return Brandes(g, sp, cli.num_iters(), cli.logging_en());
@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "builder.h"
+#include "compressed_graph.h"
 #include "graph.h"
 #include "timer.h"
 #include "util.h"
@@ -28,12 +29,19 @@ Various helper functions to ease writing of kernels
 
 
 // Default type signatures for commonly used types
+#ifdef NODEID64
+typedef int64_t NodeID;
+#else
 typedef int32_t NodeID;
+#endif
 typedef int32_t WeightT;
 typedef NodeWeight<NodeID, WeightT> WNode;
 
 typedef CSRGraph<NodeID> Graph;
 typedef CSRGraph<NodeID, WNode> WGraph;
+#ifndef NODEID64
+typedef CompressedGraph<NodeID> CGraph;
+#endif
 
 typedef BuilderBase<NodeID, NodeID, WeightT> Builder;
 typedef BuilderBase<NodeID, WNode, WeightT> WeightedBuilder;
@@ -43,6 +51,8 @@ typedef WriterBase<NodeID, WNode> WeightedWriter;
 
 
 // Used to pick random non-zero degree starting points for search algorithms
+// - Sources are drawn (or given by -r) as original IDs, so a reordered graph
+//   (-O) runs from the same vertices
 template<typename GraphT_>
 class SourcePicker { // @profile: TODO
  public:
@@ -52,10 +62,10 @@ class SourcePicker { // @profile: TODO
 
   NodeID PickNext() {
     if (given_source_ != -1)
-      return given_source_;
+      return g_.reordered_id(given_source_);
     NodeID source;
     do {
-      source = udist_();
+      source = g_.reordered_id(udist_());
     } while (g_.out_degree(source) == 0);
     return source;
   }
@@ -102,13 +112,21 @@ void BenchmarkKernel(const CLApp &cli, const GraphT_ &g,
                      VerifierFunc verify) {
   g.PrintStats();
   double total_seconds = 0;
+  int64_t total_tlb_misses = 0;
+  TLBCounter &tlb = TLBCounter::Get();
   Timer trial_timer;
   for (int iter=0; iter < cli.num_trials(); iter++) {
+    int64_t tlb_before = tlb.Read();
     trial_timer.Start();
     auto result = kernel(g);
     trial_timer.Stop();
     PrintTime("Trial Time", trial_timer.Seconds());
     total_seconds += trial_timer.Seconds();
+    if (tlb.enabled()) {
+      int64_t misses = tlb.Read() - tlb_before;
+      PrintStep("dTLB Misses", misses);
+      total_tlb_misses += misses;
+    }
     if (cli.do_analysis() && (iter == (cli.num_trials()-1)))
       stats(g, result);
     if (cli.do_verify()) {
@@ -120,6 +138,8 @@ void BenchmarkKernel(const CLApp &cli, const GraphT_ &g,
     }
   }
   PrintTime("Average Time", total_seconds / cli.num_trials());
+  if (tlb.enabled())
+    PrintStep("Avg dTLB Misses", total_tlb_misses / cli.num_trials());
 }
 
 #endif  // BENCHMARK_H_
@@ -17,6 +17,7 @@
 #include "sliding_queue.h"
 #include "timer.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -59,13 +60,6 @@ them in the parent array as negative numbers. Thus, the encoding of parent is:
 
 // #define ROAD
 
-#ifdef URAND
-#define FIRST
-#endif 
-
-#if defined(KRON) || defined(TWITTER) || defined(WEB) || defined(ROAD) 
-#define INNER
-#endif 
 
 #ifdef TIME
 #define TOTAL_ITER 2820221534
@@ -114,64 +108,49 @@ std::chrono::_V2::system_clock::time_point time_array[TOTAL_ITER/FREQ+100];
 
 using namespace std;
 
-TimeDiff histogram; 
-OMPSyncAtomic time_diff(2); 
 HyperParam_PfT hyper_param; 
-
-void PrefetchThread1_urand(const Graph *g, NodeID *parent, const Bitmap *front) { 
-  #ifdef TUNING
-  HyperParam_PfT hyperparam = hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_bu; 
+GhostConfig ghost_td; 
+
+// bottom-up steps only get a helper on urand unless FIRST asks for one 
+bool BUHelper(const GhostConfig &cfg) {
+  #ifdef FIRST
+  return cfg.enabled(); 
   #else
+  return cfg.enabled() && cfg.is(kClassUrand); 
+  #endif 
+}
+
+HyperParam_PfT HyperParam1_urand() {
   // HyperParam_PfT hyperparam = {.sync_frequency = 1, .skip_offset = 24, .serialize_threshold = 90, .unserialize_threshold = 66}; // beijing
   HyperParam_PfT hyperparam = {.sync_frequency = 1, .skip_offset = 13, .serialize_threshold = 60, .unserialize_threshold = 50}; 
-  #endif 
-  bool serialize_flag = false; 
-  for (NodeID u=0; u < g->num_nodes(); u++) { 
-    if (parent[u] < 0) {
-      for (NodeID *v = g->in_neigh(u).begin(); v < g->in_neigh(u).end(); v++) { 
-        if (front->get_bit_then_pf(*v)) { 
-          break;
-        }
+  return ghost_bu.Or(hyperparam); 
+}
+
+void PrefetchThread1_urand(const Graph *g, NodeID *parent, const Bitmap *front, NodeID u) { 
+  if (parent[u] < 0) {
+    for (NodeID *v = g->in_neigh(u).begin(); v < g->in_neigh(u).end(); v++) { 
+      if (front->get_bit_then_pf(*v)) { 
+        break;
       }
     }
-    if (serialize_flag)
-      asm volatile (
-        ".rept 30\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
-    
-    sync<NodeID>(u, 1, u, false, time_diff, 0, ORDER_READ, serialize_flag, hyperparam); 
   }
 }
 
-#if defined(HTPF) && defined(FIRST)
-void PrefetchThread1_kron_twitter(const Graph *g, NodeID *parent, const Bitmap *front) { // 80% coverage 
-  // HyperParam_PfT hyper_param_kron_twitter = {.sync_frequency = 20, .skip_offset = 50, 
-  //   .serialize_threshold = 200, .unserialize_threshold = 50}; 
-  HyperParam_PfT hyper_param_kron_twitter = hyper_param; 
-  bool serialize_flag = false; 
-  bool prefetch = true; 
-  for (NodeID u=0; u < g->num_nodes(); u++) { 
-    if (parent[u] < 0) {
-      prefetch = g->in_neigh(u).end() - g->in_neigh(u).begin() > 64 ? true : false; 
-      for (NodeID *v = g->in_neigh(u).begin(); v < g->in_neigh(u).end(); v++) { 
-        if (v +64 < g->in_neigh(u).end() && prefetch)
-          __builtin_prefetch(v + 64); 
-        if (front->get_bit(*v)) { 
-          if (prefetch)
-            front->prefetch_bit(*v); 
-          break;
-        }
+#ifdef HTPF
+void PrefetchThread1_kron_twitter(const Graph *g, NodeID *parent, const Bitmap *front, NodeID u) { // 80% coverage 
+  if (parent[u] < 0) {
+    bool prefetch = g->in_neigh(u).end() - g->in_neigh(u).begin() > 64 ? true : false; 
+    for (NodeID *v = g->in_neigh(u).begin(); v < g->in_neigh(u).end(); v++) { 
+      if (v +64 < g->in_neigh(u).end() && prefetch)
+        ghost_prefetch(v + 64); 
+      if (front->get_bit(*v)) { 
+        if (prefetch)
+          front->prefetch_bit(*v); 
+        break;
       }
     }
-    if (serialize_flag)
-      asm volatile (
-        ".rept 30\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
-    sync<NodeID>(u, 1, u, false, time_diff, 0, ORDER_READ, serialize_flag, hyper_param_kron_twitter); 
   }
 }
 #endif 
@@ -180,18 +159,34 @@ int64_t BUStep(const Graph &g, pvector<NodeID> &parent, Bitmap &front,
                Bitmap &next) { // 80% coverage 
   int64_t awake_count = 0;
   next.reset();
-  #if defined(HTPF) && defined(URAND) && !defined(BEST)
-  thread PF(PrefetchThread1_urand, &g, parent.begin(), &front); 
-  #elif defined(HTPF) && defined(INNER) && defined(FIRST)
-  thread PF(PrefetchThread1_kron_twitter, &g, parent.begin(), &front); 
+  #if defined(HTPF) && !defined(BEST)
+  // HyperParam_PfT hyper_param_kron_twitter = {.sync_frequency = 20, .skip_offset = 50, 
+  //   .serialize_threshold = 200, .unserialize_threshold = 50}; 
+  HyperParam_PfT hyperparam = ghost_bu.Or(hyper_param); 
+  auto slice = PrefetchThread1_kron_twitter; 
+  if (ghost_bu.is(kClassUrand)) {
+    hyperparam = HyperParam1_urand(); 
+    slice = PrefetchThread1_urand; 
+  }
+  GhostLoop<NodeID> ghost(0, g.num_nodes(), hyperparam); 
+  ghost.set_throttle(30); 
+  GhostTuning::Attach(ghost, ghost_bu); 
+  NodeID *pp = parent.begin(); 
+  const Bitmap *fp = &front; 
+  const bool bu_helper = BUHelper(ghost_bu); 
+  if (bu_helper)
+    ghost.Launch([&g, pp, fp, slice] (NodeID u, GhostLoop<NodeID> &loop) {
+      slice(&g, pp, fp, u); 
+    }); 
   #endif 
   #pragma omp parallel for reduction(+ : awake_count) schedule(dynamic, 1024)
   for (NodeID u=0; u < g.num_nodes(); u++) { 
-    #if defined(HTPF) && defined(FIRST) && !defined(BEST)
-    time_diff.set(0, (size_t) u, ORDER_WRITE); 
+    #if defined(HTPF) && !defined(BEST)
+    if (bu_helper)
+      ghost.Publish(u); 
     #endif 
     if (parent[u] < 0) {
-      for (NodeID v : g.in_neigh(u)) {
+      for (const NodeID &v : g.in_neigh(u)) {
         #if defined(TIME) && defined(LOOP1)
         #ifdef OMP
         if (omp_get_thread_num() == 0) {
@@ -205,6 +200,7 @@ int64_t BUStep(const Graph &g, pvector<NodeID> &parent, Bitmap &front,
         }
         #endif // OMP 
         #endif // TIME
+        ghost_load(&v); 
         if (front.get_bit(v)) { 
           parent[u] = v;
           awake_count++;
@@ -214,92 +210,62 @@ int64_t BUStep(const Graph &g, pvector<NodeID> &parent, Bitmap &front,
       }
     }
   }
-  #if defined(HTPF) && defined(FIRST) && !defined(BEST)
-  PF.join(); // wait PF thread 
+  #if defined(HTPF) && !defined(BEST)
+  ghost.Join(); // wait PF thread 
   #endif 
   return awake_count;
 }
 
-void PrefetchThread2_urand(const SlidingQueue<NodeID> *queue, const Graph *g, 
-  const NodeID *parent) {
-  #ifdef TUNING
-  HyperParam_PfT hyperparam = hyper_param; 
-  #else
+HyperParam_PfT HyperParam2_urand() {
   HyperParam_PfT hyperparam = {.sync_frequency = 15, .skip_offset = 5, 
                                .serialize_threshold = 16, .unserialize_threshold = 15}; 
-  #endif 
-  bool serialize_flag = false; 
-  for (auto q_iter = queue->begin(); q_iter < queue->end(); q_iter++) { // 192380 iter per invoc 
-    NodeID u = *q_iter;
-    for (NodeID *v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
-      __builtin_prefetch(&parent[*v]); 
-    }
-    if (serialize_flag)
-      asm volatile (
-        ".rept 50\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
-    sync<NodeID*>(q_iter, (int)sizeof(NodeID), (size_t) q_iter, false, time_diff, 1, ORDER_READ, serialize_flag, hyperparam); 
+  return ghost_td.Or(hyperparam); 
+}
+
+void PrefetchThread2_urand(const Graph *g, const NodeID *parent, 
+  const NodeID *q_iter) {
+  NodeID u = *q_iter; // 192380 iter per invoc 
+  for (NodeID *v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
+    ghost_prefetch(&parent[*v]); 
   }
 }
 
-void PrefetchThread2_kron_twitter(const SlidingQueue<NodeID> *queue, const Graph *g, 
-  const NodeID *parent) {
-  #ifdef TUNING
-  HyperParam_PfT hyperparam = hyper_param; 
-  #else
+HyperParam_PfT HyperParam2_kron_twitter() {
   // HyperParam_PfT hyper_param_kron_twitter = {.sync_frequency = 1, .skip_offset = 1, 
   //   .serialize_threshold = 10, .unserialize_threshold = 5}; // normal 
   HyperParam_PfT hyperparam = {.sync_frequency = 500, .skip_offset = 128, 
                                .serialize_threshold = 300, .unserialize_threshold = 290}; // membw for kron 
+  return ghost_td.Or(hyperparam); 
+}
+
+void PrefetchThread2_kron_twitter(const Graph *g, const NodeID *parent, 
+  int32_t min_degree, GraphClass graph_class, const NodeID *q_iter, 
+  GhostLoop<NodeID*> &loop) {
+  NodeID u = *q_iter;
+  bool prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > min_degree ? true : false; 
+  const bool road = graph_class == kClassRoad; 
+  #if defined(MEMBW)
+  const bool prefetch_index = true; 
+  #else
+  const bool prefetch_index = graph_class == kClassKron; 
   #endif 
-  bool serialize_flag = false; 
-  bool prefetch = true; 
-  size_t j = 0; 
-  for (auto q_iter = queue->begin(); q_iter < queue->end(); q_iter++) { 
-    NodeID u = *q_iter;
-    prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > hyperparam.skip_offset ? true : false; 
-    #if defined(ROAD) || defined(WEB)
+  if (road || graph_class == kClassWeb)
     g->out_neigh(u).prefetch_end(); 
-    #endif 
-    for (NodeID *v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
-      if (prefetch) {
-        #if defined(KRON) || defined(MEMBW)
-        #ifndef ROAD
-        if (v + 64 < g->out_neigh(u).end())
-          __builtin_prefetch(v + 64); // prefetch this for kron even in non-membw condition 
-        #else 
-        __builtin_prefetch(v); // for road 
-        #endif 
-        #endif 
-
-        #ifndef ROAD
-        __builtin_prefetch(&parent[*v]); // not prefetch for road 
-        #endif  
-      }
-      if (serialize_flag)
-        asm volatile (
-          ".rept 10\n\t" 
-          "serialize\n\t" 
-          ".endr" 
-        );
-        // asm volatile ("serialize\n\t"); 
-      /*-----inner sync-----*/
-      if (j % hyperparam.sync_frequency == 0 || serialize_flag) {
-        size_t main_j = time_diff.read(1, ORDER_READ); 
-        // histogram.insert_into_atomic_histogram(main_j, j); 
-        if (main_j >= j) {
-          serialize_flag = false; 
-        } else if (j - main_j > hyperparam.serialize_threshold) {
-          serialize_flag = true; 
-        } else if (j - main_j < hyperparam.unserialize_threshold) {
-          serialize_flag = false; 
-        } 
+  for (NodeID *v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
+    if (prefetch) {
+      if (prefetch_index) {
+        if (!road) {
+          if (v + 64 < g->out_neigh(u).end())
+            ghost_prefetch(v + 64); // prefetch this for kron even in non-membw condition 
+        } else {
+          ghost_prefetch(v); // for road 
+        }
       }
-      j++; 
-      /*-----inner sync-----*/
+
+      if (!road)
+        ghost_prefetch(&parent[*v]); // not prefetch for road 
     }
+    loop.Step(); // inner sync 
   }
 }
 
@@ -309,21 +275,33 @@ int64_t TDStep(const Graph &g, pvector<NodeID> &parent,
   // #pragma omp parallel
   // {
     #ifdef HTPF
-    #ifdef URAND
-    thread PF(PrefetchThread2_urand, &queue, &g, parent.begin()); 
-    #else
-    thread PF(PrefetchThread2_kron_twitter, &queue, &g, parent.begin()); 
-    time_diff.set(1, 0, ORDER_WRITE); 
-    #endif 
+    const Graph *gp = &g; 
+    const NodeID *pp = parent.begin(); 
+    const bool inner = !ghost_td.is(kClassUrand); 
+    HyperParam_PfT hyperparam = inner ? HyperParam2_kron_twitter() : HyperParam2_urand(); 
+    GhostLoop<NodeID*> ghost(queue.begin(), queue.end(), hyperparam, inner ? kSyncInner : kSyncOuter); 
+    ghost.set_throttle(inner ? 10 : 50); 
+    GhostTuning::Attach(ghost, ghost_td); 
+    int32_t min_degree = hyperparam.skip_offset; 
+    GraphClass graph_class = ghost_td.graph_class; 
+    if (ghost_td.enabled() && inner)
+      ghost.Launch([gp, pp, min_degree, graph_class] (NodeID *q_iter, GhostLoop<NodeID*> &loop) {
+        PrefetchThread2_kron_twitter(gp, pp, min_degree, graph_class, q_iter, loop); 
+      }); 
+    else if (ghost_td.enabled())
+      ghost.Launch([gp, pp] (NodeID *q_iter, GhostLoop<NodeID*> &loop) {
+        PrefetchThread2_urand(gp, pp, q_iter); 
+      }); 
     #endif 
     QueueBuffer<NodeID> lqueue(queue);
     // #pragma omp for reduction(+ : scout_count) nowait
     for (auto q_iter = queue.begin(); q_iter < queue.end(); q_iter++) {
       NodeID u = *q_iter;
-      #if defined(HTPF) && defined(URAND)
-      time_diff.set(1, (size_t) q_iter, ORDER_WRITE); 
+      #ifdef HTPF
+      if (!inner)
+        ghost.Publish(q_iter); 
       #endif 
-      for (NodeID v : g.out_neigh(u)) { 
+      for (const NodeID &v : g.out_neigh(u)) { 
         #if defined(TIME) && defined(LOOP2)
         #ifdef OMP
         if (omp_get_thread_num() == 0) {
@@ -337,6 +315,8 @@ int64_t TDStep(const Graph &g, pvector<NodeID> &parent,
         }
         #endif // OMP 
         #endif // TIME
+        ghost_load(&v); 
+        ghost_load(&parent[v]); 
         NodeID curr_val = parent[v]; 
         if (curr_val < 0) {
           if (compare_and_swap(parent[v], curr_val, u)) {
@@ -344,14 +324,15 @@ int64_t TDStep(const Graph &g, pvector<NodeID> &parent,
             scout_count += -curr_val;
           }
         }
-        #if defined(HTPF) && defined(INNER)
-        time_diff.add(1, 1, ORDER_WRITE); 
+        #ifdef HTPF
+        if (inner)
+          ghost.Advance(); 
         #endif 
       }
     }
     lqueue.flush();
     #ifdef HTPF
-    PF.join(); 
+    ghost.Join(); 
     #endif 
   // }
   return scout_count;
@@ -450,6 +431,10 @@ pvector<NodeID> DOBFS(const Graph &g, NodeID source, bool logging_enabled = fals
   for (NodeID n = 0; n < g.num_nodes(); n++)
     if (parent[n] < -1)
       parent[n] = -1;
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted(); 
+  #endif 
   return parent;
 }
 
@@ -524,7 +509,6 @@ bool BFSVerifier(const Graph &g, NodeID source,
 
 int main(int argc, char* argv[]) {
   // time_diff.init_atomic(); 
-  // histogram.init_atomic_histogram(268435456*2);
   // loop_time1 = 0; 
   // loop_time2 = 0; 
   #ifdef OMP
@@ -553,6 +537,11 @@ int main(int argc, char* argv[]) {
   /*-------set hyper parameters for inter-thread sync-------*/
   Builder b(cli);
   Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("bfs", g, cli, hyper_param); 
+  ghost_bu = ghost_tuning.Config("bu"); 
+  ghost_td = ghost_tuning.Config("td"); 
+  #endif 
   SourcePicker<Graph> sp(g, cli.start_vertex());
   auto BFSBound = [&sp,&cli] (const Graph &g) {
     return DOBFS(g, sp.PickNext(), cli.logging_en());
@@ -565,7 +554,6 @@ int main(int argc, char* argv[]) {
   auto kernel_start = chrono::high_resolution_clock::now();
   #endif 
   BenchmarkKernel(cli, g, BFSBound, PrintBFSStats, VerifierBound);
-  // histogram.print_atomic_histogram(); 
   // cout << "loop1 time = " << loop_time1/1e6 << "s, loop2 time = " << loop_time2/1e6 << "s\n"; 
   #ifdef TIME
   ofstream myout; 
@@ -20,6 +20,7 @@
 #include "sliding_queue.h"
 #include "timer.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -65,21 +66,14 @@ them in the parent array as negative numbers. Thus, the encoding of parent is:
 // #define OMP
 #define BEST
 
-// #define URAND
-
-#ifdef URAND
-#define FIRST
-#endif 
-
-#if defined(KRON) || defined(TWITTER) || defined(WEB) || defined(ROAD) 
-#define INNER
-#endif
- 
 using namespace std;
 
 TimeDiff histogram; 
 OMPSyncAtomic time_diff(NT); 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_bu; // urand runs the bottom-up helper 
+GhostConfig ghost_td; // urand prefetches per vertex, the rest per edge 
 
 #ifndef BEST
 void PrefetchThread1_urand(const Graph *g, NodeID *parent, const Bitmap *front) { 
@@ -99,17 +93,13 @@ void PrefetchThread1_urand(const Graph *g, NodeID *parent, const Bitmap *front)
       }
     }
     if (serialize_flag)
-      asm volatile (
-        ".rept 30\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
+      ghost_throttle(30);
     
     sync<NodeID>(u, 1, u, false, time_diff, 0, ORDER_READ, serialize_flag, hyperparam); 
   }
 }
 
-#if defined(HTPF) && defined(FIRST)
+#ifdef HTPF
 void PrefetchThread1_kron_twitter(const Graph *g, NodeID *parent, const Bitmap *front) { // 80% coverage 
   // HyperParam_PfT hyper_param_kron_twitter = {.sync_frequency = 20, .skip_offset = 50, 
   //   .serialize_threshold = 200, .unserialize_threshold = 50}; 
@@ -130,11 +120,7 @@ void PrefetchThread1_kron_twitter(const Graph *g, NodeID *parent, const Bitmap *
       }
     }
     if (serialize_flag)
-      asm volatile (
-        ".rept 30\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
+      ghost_throttle(30);
     sync<NodeID>(u, 1, u, false, time_diff, 0, ORDER_READ, serialize_flag, hyper_param_kron_twitter); 
   }
 }
@@ -145,15 +131,17 @@ int64_t BUStep(const Graph &g, pvector<NodeID> &parent, Bitmap &front,
                Bitmap &next) { // 80% coverage 
   int64_t awake_count = 0;
   next.reset();
-  #if defined(HTPF) && defined(URAND) && !defined(BEST)
-  thread PF(PrefetchThread1_urand, &g, parent.begin(), &front); 
-  #elif defined(HTPF) && defined(INNER) && defined(FIRST)
-  thread PF(PrefetchThread1_kron_twitter, &g, parent.begin(), &front); 
+  #if defined(HTPF) && !defined(BEST)
+  const bool first = ghost_bu.is(kClassUrand); 
+  auto PF = [&] () { PrefetchThread1_urand(&g, parent.begin(), &front); }; 
+  if (first)
+    GhostPool::Get().Dispatch(0, PF); 
   #endif 
   #pragma omp parallel for num_threads(NT*2) reduction(+ : awake_count) schedule(dynamic, 1024) 
   for (NodeID u=0; u < g.num_nodes(); u++) { 
-    #if defined(HTPF) && defined(FIRST) && !defined(BEST)
-    time_diff.set(0, (size_t) u, ORDER_WRITE); 
+    #if defined(HTPF) && !defined(BEST)
+    if (first)
+      time_diff.set(0, (size_t) u, ORDER_WRITE); 
     #endif 
     if (parent[u] < 0) {
       for (NodeID v : g.in_neigh(u)) {
@@ -166,28 +154,15 @@ int64_t BUStep(const Graph &g, pvector<NodeID> &parent, Bitmap &front,
       }
     }
   }
-  #if defined(HTPF) && defined(FIRST) && !defined(BEST)
-  PF.join(); // wait PF thread 
+  #if defined(HTPF) && !defined(BEST)
+  if (first)
+    GhostPool::Get().Wait(0); // wait PF thread 
   #endif 
   return awake_count;
 }
 
 void PrefetchThread2_urand(int me, const SlidingQueue<NodeID> *queue, const Graph *g, 
   const NodeID *parent, NodeID *start, NodeID *end) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  // pthread_t self = pthread_self();
-  // cpu_set_t cpuset;
-  // CPU_ZERO(&cpuset);
-  // // CPU_SET(me+64, &cpuset); // dublin 
-  // CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  // int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  // if (rc != 0)
-  // {
-  //   printf("Failed to pin main thread.\n");
-  //   exit(1);
-  // }
-  /*-----pin the pf thread to specfic core-----*/
 
   #ifdef TUNING
   HyperParam_PfT hyperparam = hyper_param; 
@@ -203,31 +178,13 @@ void PrefetchThread2_urand(int me, const SlidingQueue<NodeID> *queue, const Grap
       __builtin_prefetch(&parent[*v]); 
     }
     if (serialize_flag)
-      asm volatile (
-        ".rept 50\n\t" 
-        "serialize\n\t" 
-        ".endr" 
-      );
+      ghost_throttle(50);
     sync<NodeID*>(q_iter, (int)sizeof(NodeID), (size_t) q_iter, false, time_diff, me, ORDER_READ, serialize_flag, hyperparam); 
   }
 }
 
 void PrefetchThread2_kron_twitter(int me, const SlidingQueue<NodeID> *queue, const Graph *g, 
   const NodeID *parent, NodeID *start, NodeID *end) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  // pthread_t self = pthread_self();
-  // cpu_set_t cpuset;
-  // CPU_ZERO(&cpuset);
-  // // CPU_SET(me+64, &cpuset); // dublin 
-  // CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  // int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  // if (rc != 0)
-  // {
-  //   printf("Failed to pin main thread.\n");
-  //   exit(1);
-  // }
-  /*-----pin the pf thread to specfic core-----*/
 
   #ifdef TUNING
   HyperParam_PfT hyperparam = hyper_param; 
@@ -239,13 +196,13 @@ void PrefetchThread2_kron_twitter(int me, const SlidingQueue<NodeID> *queue, con
   #endif 
   bool serialize_flag = false; 
   bool prefetch = true; 
+  const bool prefetch_end = ghost_td.is(kClassRoad) || ghost_td.is(kClassWeb); 
   size_t j = 0; 
   for (auto q_iter = start; q_iter < end; q_iter++) { 
     NodeID u = *q_iter;
     prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > hyperparam.skip_offset ? true : false; 
-    #if defined(ROAD) || defined(WEB)
-    g->out_neigh(u).prefetch_end(); 
-    #endif 
+    if (prefetch_end)
+      g->out_neigh(u).prefetch_end(); 
     for (NodeID *v = g->out_neigh(u).begin(); v < g->out_neigh(u).end(); v++) { 
       if (prefetch) {
         if (v + 64 < g->out_neigh(u).end())
@@ -253,11 +210,7 @@ void PrefetchThread2_kron_twitter(int me, const SlidingQueue<NodeID> *queue, con
         __builtin_prefetch(&parent[*v]); 
       }
       if (serialize_flag)
-        asm volatile (
-          ".rept 10\n\t" 
-          "serialize\n\t" 
-          ".endr" 
-        );
+        ghost_throttle(10);
         // asm volatile ("serialize\n\t"); 
       /*-----inner sync-----*/
       // if (j % hyperparam.sync_frequency == 0 || serialize_flag) {
@@ -283,19 +236,7 @@ int64_t TDStep(const Graph &g, pvector<NodeID> &parent,
   #pragma omp parallel num_threads(NT)
   {
     int me = omp_get_thread_num(); 
-    /*-----pin the pf thread to specfic core-----*/ 
-    // pthread_t self = pthread_self();
-    // cpu_set_t cpuset;
-    // CPU_ZERO(&cpuset);
-    // // CPU_SET(me, &cpuset);
-    // CPU_SET(me*2, &cpuset); // beijing
-                    
-    // int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-    // if (rc != 0) {
-    //   printf("Failed to pin main thread.\n");
-    //   exit(1);
-    // }
-    /*-----pin the pf thread to specfic core-----*/
+    GhostTopology::Get().PinMain(me);
 
     /*-----compute boundary for each pf thread-----*/
     size_t div = (queue.end() - queue.begin()) / NT; 
@@ -318,19 +259,24 @@ int64_t TDStep(const Graph &g, pvector<NodeID> &parent,
     NodeID* end_iter = queue.begin() + tail; 
     /*-----compute boundary for each pf thread-----*/
     #ifdef HTPF
-    #ifdef URAND
-    thread PF(PrefetchThread2_urand, me, &queue, &g, parent.begin(), start_iter, end_iter); 
-    #else
-    thread PF(PrefetchThread2_kron_twitter, me, &queue, &g, parent.begin(), start_iter, end_iter); 
+    const bool urand = ghost_td.is(kClassUrand); 
+    auto PF = [&] () {
+      if (urand)
+        PrefetchThread2_urand(me, &queue, &g, parent.begin(), start_iter, end_iter); 
+      else
+        PrefetchThread2_kron_twitter(me, &queue, &g, parent.begin(), start_iter, end_iter); 
+    }; 
+    if (ghost_td.enabled())
+      GhostPool::Get().Dispatch(me, PF); 
     // time_diff.set(me, 0, ORDER_WRITE); 
     #endif 
-    #endif 
     QueueBuffer<NodeID> lqueue(queue);
     #pragma omp for reduction(+ : scout_count) schedule(static) nowait
     for (auto q_iter = queue.begin(); q_iter < queue.end(); q_iter++) {
       NodeID u = *q_iter;
-      #if defined(HTPF) && defined(URAND)
-      time_diff.set(me, (size_t) q_iter, ORDER_WRITE); 
+      #ifdef HTPF
+      if (urand)
+        time_diff.set(me, (size_t) q_iter, ORDER_WRITE); 
       #endif 
       for (NodeID v : g.out_neigh(u)) { 
         NodeID curr_val = parent[v]; 
@@ -340,14 +286,13 @@ int64_t TDStep(const Graph &g, pvector<NodeID> &parent,
             scout_count += -curr_val;
           }
         }
-        #if defined(HTPF) && defined(INNER)
         // time_diff.add(me, 1, ORDER_WRITE); 
-        #endif 
       }
     }
     lqueue.flush();
     #ifdef HTPF
-    PF.join(); 
+    if (ghost_td.enabled())
+      GhostPool::Get().Wait(me); 
     #endif 
   }
   return scout_count;
@@ -446,6 +391,9 @@ pvector<NodeID> DOBFS(const Graph &g, NodeID source, bool logging_enabled = fals
   for (NodeID n = 0; n < g.num_nodes(); n++)
     if (parent[n] < -1)
       parent[n] = -1;
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  #endif 
   return parent;
 }
 
@@ -533,8 +481,14 @@ int main(int argc, char* argv[]) {
   cout << "sync frequency = " << hyper_param.sync_frequency << ", serialize threshold = " << hyper_param.serialize_threshold 
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
   /*-------set hyper parameters for inter-thread sync-------*/
+  GhostThrottle::Get(); // calibrate before anything is timed
   Builder b(cli);
   Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("bfs_paral", g, cli, hyper_param); 
+  ghost_bu = ghost_tuning.Config("bu"); 
+  ghost_td = ghost_tuning.Config("td"); 
+  #endif 
   SourcePicker<Graph> sp(g, cli.start_vertex());
   auto BFSBound = [&sp,&cli] (const Graph &g) {
     return DOBFS(g, sp.PickNext(), cli.logging_en());
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cinttypes>
 
+#include "page_alloc.h"
 #include "platform_atomics.h"
 
 
@@ -24,12 +25,12 @@ class Bitmap {
  public:
   explicit Bitmap(size_t size) {
     uint64_t num_words = (size + kBitsPerWord - 1) / kBitsPerWord;
-    start_ = new uint64_t[num_words];
+    start_ = PageNew<uint64_t>(num_words);
     end_ = start_ + num_words;
   }
 
   ~Bitmap() {
-    delete[] start_;
+    PageDelete(start_);
   }
 
   void reset() {
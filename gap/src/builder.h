@@ -17,6 +17,7 @@
 #include "platform_atomics.h"
 #include "pvector.h"
 #include "reader.h"
+#include "reorder.h"
 #include "timer.h"
 #include "util.h"
 
@@ -31,6 +32,11 @@ Given arguments from the command line (cli), returns a built graph
    MakeGraphFromEL(edgelist) to perform the actual graph construction
  - edgelist can be from file (Reader) or synthetically generated (Generator)
  - Common case: BuilderBase typedef'd (w/ params) to be Builder (benchmark.h)
+ - MakeEdgeList() and FinishGraph() are the two halves of MakeGraph() around
+   MakeGraphFromEL(), for building several graphs from one edge list
+ - If a vertex order is given (-O), the graph is reordered (Reorderer) and
+   rebuilt (Relabel) before it is returned, the time both take is printed
+   as Reorder Time
 */
 
 
@@ -47,8 +53,11 @@ class BuilderBase {
   int64_t num_nodes_ = -1;
 
  public:
-  explicit BuilderBase(const CLBase &cli) : cli_(cli) {
-    symmetrize_ = cli_.symmetrize();
+  explicit BuilderBase(const CLBase &cli)
+      : BuilderBase(cli, cli.symmetrize()) {}
+
+  BuilderBase(const CLBase &cli, bool symmetrize) : cli_(cli) {
+    symmetrize_ = symmetrize;
     needs_weights_ = !std::is_same<NodeID_, DestID_>::value;
     in_place_ = cli_.in_place();
     if (in_place_ && needs_weights_) {
@@ -157,7 +166,7 @@ class BuilderBase {
       diffs[n] = new_end - n_start;
     }
     pvector<SGOffset> sq_offsets = ParallelPrefixSum(diffs);
-    *sq_neighs = new DestID_[sq_offsets[g.num_nodes()]];
+    *sq_neighs = PageNew<DestID_>(sq_offsets[g.num_nodes()]);
     *sq_index = CSRGraph<NodeID_, DestID_>::GenIndex(sq_offsets, *sq_neighs);
     #pragma omp parallel for private(n_start)
     for (NodeID_ n=0; n < g.num_nodes(); n++) {
@@ -216,12 +225,11 @@ class BuilderBase {
     for (NodeID_ n = num_nodes_; n >= 0; n--)
       offsets[n] = n != 0 ? offsets[n-1] : 0;
     if (!symmetrize_) {   // not going to symmetrize so no need to add edges
-      size_t new_size = num_edges * sizeof(DestID_);
-      *neighs = static_cast<DestID_*>(std::realloc(*neighs, new_size));
+      *neighs = PageRealloc(*neighs, num_edges);
       *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, *neighs);
       if (invert) {       // create inv_neighs & inv_index for incoming edges
         pvector<SGOffset> inoffsets = ParallelPrefixSum(indegrees);
-        *inv_neighs = new DestID_[inoffsets[num_nodes_]];
+        *inv_neighs = PageNew<DestID_>(inoffsets[num_nodes_]);
         *inv_index = CSRGraph<NodeID_, DestID_>::GenIndex(inoffsets,
                                                           *inv_neighs);
         for (NodeID_ u = 0; u < num_nodes_; u++) {
@@ -252,8 +260,7 @@ class BuilderBase {
         total_missing_inv += invs_needed[n];
       }
       offsets[num_nodes_] += total_missing_inv;
-      size_t newsize = (offsets[num_nodes_] * sizeof(DestID_));
-      *neighs = static_cast<DestID_*>(std::realloc(*neighs, newsize));
+      *neighs = PageRealloc(*neighs, offsets[num_nodes_]);
       if (*neighs == nullptr) {
         std::cout << "Call to realloc() failed" << std::endl;
         exit(-33);
@@ -301,7 +308,7 @@ class BuilderBase {
                DestID_** neighs) {
     pvector<NodeID_> degrees = CountDegrees(el, transpose);
     pvector<SGOffset> offsets = ParallelPrefixSum(degrees);
-    *neighs = new DestID_[offsets[num_nodes_]];
+    *neighs = PageNew<DestID_>(offsets[num_nodes_]);
     *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, *neighs);
     #pragma omp parallel for
     for (auto it = el.begin(); it < el.end(); it++) {
@@ -340,27 +347,116 @@ class BuilderBase {
                                                 inv_index, inv_neighs);
   }
 
+  // reads (non-serialized input) or generates the edge list
+  EdgeList MakeEdgeList() {
+    EdgeList el;
+    if (cli_.filename() != "") {
+      Reader<NodeID_, DestID_, WeightT_, invert> r(cli_.filename());
+      el = r.ReadFile(needs_weights_);
+    } else if (cli_.scale() != -1) {
+      Generator<NodeID_, DestID_> gen(cli_.scale(), cli_.degree());
+      el = gen.GenerateEL(cli_.uniform());
+    }
+    return el;
+  }
+
   CSRGraph<NodeID_, DestID_, invert> MakeGraph() {
     CSRGraph<NodeID_, DestID_, invert> g;
     {  // extra scope to trigger earlier deletion of el (save memory)
-      EdgeList el;
       if (cli_.filename() != "") {
         Reader<NodeID_, DestID_, WeightT_, invert> r(cli_.filename());
-        if ((r.GetSuffix() == ".sg") || (r.GetSuffix() == ".wsg")) {
-          return r.ReadSerializedGraph();
-        } else {
-          el = r.ReadFile(needs_weights_);
-        }
-      } else if (cli_.scale() != -1) {
-        Generator<NodeID_, DestID_> gen(cli_.scale(), cli_.degree());
-        el = gen.GenerateEL(cli_.uniform());
+        if (r.IsSerialized())
+          return Place(Reorder(r.ReadSerializedGraph()));
       }
+      EdgeList el = MakeEdgeList();
       g = MakeGraphFromEL(el);
     }
+    return FinishGraph(std::move(g));
+  }
+
+  // steps after MakeGraphFromEL: squish, reorder (-O) and place (-N)
+  CSRGraph<NodeID_, DestID_, invert> FinishGraph(
+      CSRGraph<NodeID_, DestID_, invert> g) {
     if (in_place_)
-      return g;
+      return Place(Reorder(std::move(g)));
     else
-      return SquishGraph(g);
+      return Place(Reorder(SquishGraph(g)));
+  }
+
+  // applies the vertex order of the command line (-O), if any
+  CSRGraph<NodeID_, DestID_, invert> Reorder(
+      CSRGraph<NodeID_, DestID_, invert> g) {
+    if (cli_.reorder() == kOrderNone)
+      return g;
+    Timer t;
+    t.Start();
+    pvector<NodeID_> new_ids =
+        Reorderer<NodeID_, DestID_, invert>(g).Order(cli_.reorder());
+    CSRGraph<NodeID_, DestID_, invert> reordered = Relabel(g, new_ids);
+    t.Stop();
+    PrintTime("Reorder Time", t.Seconds());
+    return reordered;
+  }
+
+  // applies the NUMA policy steps that need the finished graph
+  static
+  CSRGraph<NodeID_, DestID_, invert> Place(
+      CSRGraph<NodeID_, DestID_, invert> g) {
+    if (PageAlloc::Numa() == kNumaReplicate)
+      g.Replicate();
+    return g;
+  }
+
+  static NodeID_ RelabelDest(NodeID_ v, const pvector<NodeID_> &new_ids) {
+    return new_ids[v];
+  }
+
+  static NodeWeight<NodeID_, WeightT_> RelabelDest(
+      NodeWeight<NodeID_, WeightT_> v, const pvector<NodeID_> &new_ids) {
+    return NodeWeight<NodeID_, WeightT_>(new_ids[v.v], v.w);
+  }
+
+  // one direction of g with vertex n renamed new_ids[n]
+  static void RelabelCSR(const CSRGraph<NodeID_, DestID_, invert> &g,
+                         const pvector<NodeID_> &new_ids, bool transpose,
+                         DestID_*** index, DestID_** neighs) {
+    pvector<NodeID_> degrees(g.num_nodes());
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      degrees[new_ids[n]] = transpose ? g.in_degree(n) : g.out_degree(n);
+    pvector<SGOffset> offsets = ParallelPrefixSum(degrees);
+    *neighs = PageNew<DestID_>(offsets[g.num_nodes()]);
+    *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, *neighs);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (NodeID_ u=0; u < g.num_nodes(); u++) {
+      NodeID_ new_u = new_ids[u];
+      DestID_ *out = (*index)[new_u];
+      for (DestID_ v : transpose ? g.in_neigh(u) : g.out_neigh(u))
+        *(out++) = RelabelDest(v, new_ids);
+      std::sort((*index)[new_u], (*index)[new_u+1]);
+    }
+  }
+
+  // Rebuilds g with vertex n renamed new_ids[n], the graph keeps the
+  // permutation (composed with any earlier one) to map results back
+  static
+  CSRGraph<NodeID_, DestID_, invert> Relabel(
+      const CSRGraph<NodeID_, DestID_, invert> &g,
+      const pvector<NodeID_> &new_ids) {
+    DestID_ **index, *neighs, **inv_index = nullptr, *inv_neighs = nullptr;
+    RelabelCSR(g, new_ids, false, &index, &neighs);
+    if (g.directed())
+      RelabelCSR(g, new_ids, true, &inv_index, &inv_neighs);
+    pvector<NodeID_> original_ids(g.num_nodes());
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      original_ids[new_ids[n]] = g.original_id(n);
+    CSRGraph<NodeID_, DestID_, invert> relabeled = g.directed() ?
+        CSRGraph<NodeID_, DestID_, invert>(g.num_nodes(), index, neighs,
+                                           inv_index, inv_neighs) :
+        CSRGraph<NodeID_, DestID_, invert>(g.num_nodes(), index, neighs);
+    relabeled.SetOrder(std::move(original_ids));
+    return relabeled;
   }
 
   // Relabels (and rebuilds) graph by order of decreasing degree
@@ -388,7 +484,7 @@ class BuilderBase {
       new_ids[degree_id_pairs[n].second] = n;
     }
     pvector<SGOffset> offsets = ParallelPrefixSum(degrees);
-    DestID_* neighs = new DestID_[offsets[g.num_nodes()]];
+    DestID_* neighs = PageNew<DestID_>(offsets[g.num_nodes()]);
     DestID_** index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, neighs);
     #pragma omp parallel for
     for (NodeID_ u=0; u < g.num_nodes(); u++) {
@@ -398,7 +494,8 @@ class BuilderBase {
     }
     t.Stop();
     PrintTime("Relabel", t.Seconds());
-    return CSRGraph<NodeID_, DestID_, invert>(g.num_nodes(), index, neighs);
+    return Place(CSRGraph<NodeID_, DestID_, invert>(g.num_nodes(), index,
+                                                    neighs));
   }
 };
 
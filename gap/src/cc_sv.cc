@@ -46,7 +46,8 @@ using namespace std;
 // The hooking condition (comp_u < comp_v) may not coincide with the edge's
 // direction, so we use a min-max swap such that lower component IDs propagate
 // independent of the edge's direction.
-pvector<NodeID> ShiloachVishkin(const Graph &g) {
+template <typename GraphT_>
+pvector<NodeID> ShiloachVishkin(const GraphT_ &g) {
   pvector<NodeID> comp(g.num_nodes());
   #pragma omp parallel for
   for (NodeID n=0; n < g.num_nodes(); n++)
@@ -83,7 +84,8 @@ pvector<NodeID> ShiloachVishkin(const Graph &g) {
 }
 
 
-void PrintCompStats(const Graph &g, const pvector<NodeID> &comp) {
+template <typename GraphT_>
+void PrintCompStats(const GraphT_ &g, const pvector<NodeID> &comp) {
   cout << endl;
   unordered_map<NodeID, NodeID> count;
   for (NodeID comp_i : comp)
@@ -106,7 +108,8 @@ void PrintCompStats(const Graph &g, const pvector<NodeID> &comp) {
 // - Asserts search does not reach a vertex with a different component label
 // - If the graph is directed, it performs the search as if it was undirected
 // - Asserts every vertex is visited (degree-0 vertex should have own label)
-bool CCVerifier(const Graph &g, const pvector<NodeID> &comp) {
+template <typename GraphT_>
+bool CCVerifier(const GraphT_ &g, const pvector<NodeID> &comp) {
   unordered_map<NodeID, NodeID> label_to_source;
   for (NodeID n : g.vertices())
     label_to_source[comp[n]] = n;
@@ -155,6 +158,16 @@ int main(int argc, char* argv[]) {
     return -1;
   Builder b(cli);
   Graph g = b.MakeGraph();
-  BenchmarkKernel(cli, g, ShiloachVishkin, PrintCompStats, CCVerifier);
+  #ifndef NODEID64  // -C is refused with 64-bit IDs
+  if (cli.compressed()) {
+    CGraph cg(g);
+    g = Graph();
+    BenchmarkKernel(cli, cg, ShiloachVishkin<CGraph>, PrintCompStats<CGraph>,
+                    CCVerifier<CGraph>);
+  }
+  #endif
+  if (!cli.compressed())
+    BenchmarkKernel(cli, g, ShiloachVishkin<Graph>, PrintCompStats<Graph>,
+                    CCVerifier<Graph>);
   return 0;
 }
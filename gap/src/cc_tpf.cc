@@ -18,6 +18,7 @@
 #include "graph.h"
 #include "pvector.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -114,113 +115,91 @@ uint32_t array_counter;
 
 using namespace std;
 
-TimeDiff time_diff; 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_link; 
 
-void PrefetchThread_web(const Graph *g, int r, NodeID *comp, NodeID *end) {
-  #if defined(WEB) && !defined(TUNING)
+HyperParam_PfT HyperParam_web() {
   HyperParam_PfT hyperparam = {.sync_frequency = 800, .skip_offset = 130, 
                                .serialize_threshold = 150, .unserialize_threshold = 100}; 
-  #else
-  HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  bool serialize_flag = false; 
-  for (NodeID u = 0; u < g->num_nodes(); u++) { 
-    for (const NodeID &v : g->out_neigh(u, r)) { // 134217728 iter per invoc 
-      /*-------Link()-------*/
-      __builtin_prefetch(&v); 
-      if (serialize_flag)
-        asm volatile ("serialize\n\t"); 
-      /*-------Link()-------*/
-      break;
-    }
-    if (serialize_flag)
-      asm volatile ("serialize\n\t"); 
-    #ifdef TIMESTAMP
-    if (u % 100 == 0) {
-      int diff = u - time_diff.read_atomic_main(ORDER_READ); 
-      timestamp_array[array_counter] = diff; 
-      array_counter++; 
-    }
-    #endif 
-    sync<NodeID>(u, 1, u, true, time_diff, ORDER_READ, serialize_flag, hyperparam); 
+  return ghost_link.Or(hyperparam); 
+}
+
+void PrefetchThread_web(const Graph *g, int r, NodeID *comp, NodeID u, 
+                        GhostLoop<NodeID> &loop) {
+  for (const NodeID &v : g->out_neigh(u, r)) { // 134217728 iter per invoc 
+    /*-------Link()-------*/
+    ghost_prefetch(&v); 
+    loop.Pace(); 
+    /*-------Link()-------*/
+    break;
   }
+  #ifdef TIMESTAMP
+  if (u % 100 == 0) {
+    int diff = u - static_cast<NodeID>(loop.main_progress()); 
+    timestamp_array[array_counter] = diff; 
+    array_counter++; 
+  }
+  #endif 
 }
 
-void PrefetchThread_kron_twitter(const Graph *g, int r, NodeID *comp, NodeID *end) {
-  #if (defined(KRON) || defined(TWITTER)) && !defined(TUNING)
+HyperParam_PfT HyperParam_kron_twitter() {
   HyperParam_PfT hyperparam = {.sync_frequency = 800, .skip_offset = 450, 
                                .serialize_threshold = 800, .unserialize_threshold = 750}; 
-  #else
-  HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  bool serialize_flag = false; 
-  for (NodeID u = 0; u < g->num_nodes(); u++) { 
-    for (NodeID v : g->out_neigh(u, r)) { // 134217728 iter per invoc 
-      /*-------Link()-------*/
-      __builtin_prefetch(&comp[v]); 
-      if (serialize_flag)
-        asm volatile ("serialize\n\t"); 
-      /*-------Link()-------*/
-      break;
-    }
-    if (serialize_flag)
-      asm volatile ("serialize\n\t"); 
-    #ifdef TIMESTAMP
-    if (u % 100 == 0) {
-      int diff = u - time_diff.read_atomic_main(ORDER_READ); 
-      timestamp_array[array_counter] = diff; 
-      array_counter++; 
-    }
-    #endif 
-    sync<NodeID>(u, 1, u, true, time_diff, ORDER_READ, serialize_flag, hyperparam); 
+  return ghost_link.Or(hyperparam); 
+}
+
+void PrefetchThread_kron_twitter(const Graph *g, int r, NodeID *comp, NodeID u, 
+                                 GhostLoop<NodeID> &loop) {
+  for (NodeID v : g->out_neigh(u, r)) { // 134217728 iter per invoc 
+    /*-------Link()-------*/
+    ghost_prefetch(&comp[v]); 
+    loop.Pace(); 
+    /*-------Link()-------*/
+    break;
+  }
+  #ifdef TIMESTAMP
+  if (u % 100 == 0) {
+    int diff = u - static_cast<NodeID>(loop.main_progress()); 
+    timestamp_array[array_counter] = diff; 
+    array_counter++; 
   }
+  #endif 
 }
 
-void PrefetchThread_urand(const Graph *g, int r, NodeID *comp, NodeID *end) {
-  #if defined(URAND) && !defined(TUNING)
+HyperParam_PfT HyperParam_urand() {
   HyperParam_PfT hyperparam = {.sync_frequency = 20, .skip_offset = 20, 
                                .serialize_threshold = 45, .unserialize_threshold = 42}; 
-  #else
-  HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  #ifdef TIMESTAMP
-  uint32_t local_counter = 0; 
-  #endif 
-  bool serialize_flag = false; 
-  for (NodeID u = 0; u < g->num_nodes(); u++) { 
-    // NodeID tmp; 
-    for (NodeID v : g->out_neigh(u, r)) { // 134217728 iter per invoc 
-      /*-------Link()-------*/
-      NodeID p1 = comp[u];
-      NodeID p2 = comp[v]; // 142 cpi, 29.8 coverage 
-      while (p1 != p2) { // iter per invoc 3.3 
-        NodeID high = p1 > p2 ? p1 : p2;
-        NodeID low = p1 + (p2 - high);
-        NodeID p_high = comp[high]; // 50.5, 33.8% 
-        if ((p_high == low) || (p_high == high))
-          break;
-        p1 = comp[comp[high]]; // 39.3 cpi, 18.9% coverage, but prefetch both p1 and p2 
-        p2 = comp[low];
-        if (serialize_flag)
-          asm volatile ("serialize\n\t"); 
-      }
-      /*-------Link()-------*/
-      #ifdef TIMESTAMP
-      local_counter++; 
-      #endif 
-      break;
-    }
-    sync<NodeID>(u, 1, u, true, time_diff, ORDER_READ, serialize_flag, hyperparam); 
-    #ifdef TIMESTAMP
-    if (local_counter % 10 == 0) {
-      int diff = u - ((int) time_diff.read_atomic_main(ORDER_READ)); 
-      timestamp_array[array_counter] = diff; 
-      iter_number[array_counter] = u;
-      array_counter++; 
+  return ghost_link.Or(hyperparam); 
+}
+
+void PrefetchThread_urand(const Graph *g, int r, NodeID *comp, NodeID u, 
+                          GhostLoop<NodeID> &loop) {
+  for (NodeID v : g->out_neigh(u, r)) { // 134217728 iter per invoc 
+    /*-------Link()-------*/
+    NodeID p1 = comp[u];
+    NodeID p2 = comp[v]; // 142 cpi, 29.8 coverage 
+    while (p1 != p2) { // iter per invoc 3.3 
+      NodeID high = p1 > p2 ? p1 : p2;
+      NodeID low = p1 + (p2 - high);
+      NodeID p_high = comp[high]; // 50.5, 33.8% 
+      if ((p_high == low) || (p_high == high))
+        break;
+      p1 = comp[comp[high]]; // 39.3 cpi, 18.9% coverage, but prefetch both p1 and p2 
+      p2 = comp[low];
+      loop.Pace(); 
     }
-    #endif 
+    /*-------Link()-------*/
+    break;
   }
+  #ifdef TIMESTAMP
+  if (u % 10 == 0) {
+    int diff = u - static_cast<NodeID>(loop.main_progress()); 
+    timestamp_array[array_counter] = diff; 
+    iter_number[array_counter] = u;
+    array_counter++; 
+  }
+  #endif 
 }
 
 // Place nodes u and v in same component of lower component ID
@@ -291,21 +270,35 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
   // Sample by processing a fixed number of neighbors for each node (see paper)
   for (int r = 0; r < neighbor_rounds; ++r) {
     #ifdef HTPF
-    #if defined(URAND)
-    thread PF(PrefetchThread_urand, &g, r, comp.begin(), comp.end()); 
-    #elif defined(KRON) || defined(TWITTER) || defined(ROAD)
-    thread PF(PrefetchThread_kron_twitter, &g, r, comp.begin(), comp.end()); 
-    #elif defined(WEB)
-    thread PF(PrefetchThread_web, &g, r, comp.begin(), comp.end()); 
-    #endif 
+    HyperParam_PfT hyperparam = HyperParam_kron_twitter(); 
+    auto slice = PrefetchThread_kron_twitter; // kron, twitter and road 
+    if (ghost_link.is(kClassUrand)) {
+      hyperparam = HyperParam_urand(); 
+      slice = PrefetchThread_urand; 
+    } else if (ghost_link.is(kClassWeb)) {
+      hyperparam = HyperParam_web(); 
+      slice = PrefetchThread_web; 
+    } else if (ghost_link.is(kClassRoad) || ghost_link.is(kClassNone)) {
+      hyperparam = ghost_link.Or(hyper_param); // road has no tuned defaults 
+    }
+    GhostLoop<NodeID> ghost(0, g.num_nodes(), hyperparam); 
+    GhostTuning::Attach(ghost, ghost_link); 
+    ghost.set_accurate_sync(true); 
+    ghost.set_pace_slices(!ghost_link.is(kClassUrand)); // urand paces per hop 
+    if (ghost_link.enabled())
+      ghost.Launch([&g, r, &comp, slice] (NodeID u, GhostLoop<NodeID> &loop) {
+        slice(&g, r, comp.begin(), u, loop); 
+      }); 
     #endif 
   #pragma omp parallel for schedule(dynamic,16384)
     for (NodeID u = 0; u < g.num_nodes(); u++) { 
       #ifdef HTPF
-      time_diff.set_atomic_main((size_t) u, ORDER_WRITE); 
+      ghost.Publish(u); 
       #endif 
-      for (NodeID v : g.out_neigh(u, r)) { // 134217728 iter per invoc 
+      for (const NodeID &v : g.out_neigh(u, r)) { // 134217728 iter per invoc 
         // Link at most one time if neighbor available at offset r
+        ghost_load(&v); 
+        ghost_load(&comp[v]); 
         Link(u, v, comp);
         break;
       }
@@ -325,7 +318,7 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
     }
     Compress(g, comp);
     #ifdef HTPF
-    PF.join(); 
+    ghost.Join(); 
     #endif 
   }
 
@@ -361,6 +354,10 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
   }
   // Finally, 'compress' for final convergence
   Compress(g, comp);
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted(); 
+  #endif 
   return comp;
 }
 
@@ -445,8 +442,6 @@ int main(int argc, char* argv[]) {
   iter_number = new uint32_t[268435456];
   array_counter = 0; 
   #endif 
-  time_diff.init_atomic(); 
-  // time_diff.init_atomic_histogram(268435452); 
   CLApp cli(argc, argv, "connected-components-afforest");
   if (!cli.ParseArgs())
     return -1;
@@ -459,12 +454,15 @@ int main(int argc, char* argv[]) {
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
   Builder b(cli);
   Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("cc", g, cli, hyper_param); 
+  ghost_link = ghost_tuning.Config("link"); 
+  #endif 
   auto CCBound = [&cli](const Graph& gr){ return Afforest(gr, cli.logging_en()); };
   #ifdef TIME
   auto kernel_start = chrono::high_resolution_clock::now();
   #endif 
   BenchmarkKernel(cli, g, CCBound, PrintCompStats, CCVerifier);
-  // time_diff.print_atomic_histogram(); 
   #ifdef TIME
   ofstream myout; 
   myout.open(OUTPUT); 
@@ -18,6 +18,7 @@
 #include "graph.h"
 #include "pvector.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -56,22 +57,11 @@ using namespace std;
 OMPSyncAtomic time_diff(NT); 
 OMPSyncAtomic end_flag(NT); 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_link; // urand and web split the nodes statically 
 
 void PrefetchThread_web(int me, const Graph *g, int r, NodeID *comp, size_t start, size_t end) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin main thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  GhostTopology::Get().PinHelper(me);
   HyperParam_PfT hyperparam = hyper_param; 
   bool serialize_flag = false; 
   for (NodeID u = start; u < end; u++) { 
@@ -79,31 +69,18 @@ void PrefetchThread_web(int me, const Graph *g, int r, NodeID *comp, size_t star
       /*-------Link()-------*/
       __builtin_prefetch(&v); 
       if (serialize_flag)
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
       /*-------Link()-------*/
       break;
     }
     if (serialize_flag)
-      asm volatile ("serialize\n\t"); 
+      ghost_throttle(1); 
     sync<NodeID>(u, 1, u, true, time_diff, me, ORDER_READ, serialize_flag, hyperparam); 
   }
 }
 
 void PrefetchThread_kron_twitter(int me, const Graph *g, int r, NodeID *comp, size_t start, size_t end) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin main thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  GhostTopology::Get().PinHelper(me);
 
   HyperParam_PfT hyperparam = hyper_param; 
   bool serialize_flag = false; 
@@ -115,18 +92,18 @@ void PrefetchThread_kron_twitter(int me, const Graph *g, int r, NodeID *comp, si
       /*-------Link()-------*/
       __builtin_prefetch(&comp[v]); 
       if (serialize_flag)
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
       /*-------Link()-------*/
       break;
     }
     if (serialize_flag)
-      asm volatile ("serialize\n\t"); 
+      ghost_throttle(1); 
     sync<NodeID>(u, 1, u, true, time_diff, me, ORDER_READ, serialize_flag, hyperparam); 
     if (local_counter >= CHUNKSIZE) {
       while (true) { 
         if (time_diff.read(me, ORDER_READ) >= u || end_flag.read(me, ORDER_READ)) 
           break; 
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
       } // wait until the main thread goes to next chunk 
       if (end_flag.read(me, ORDER_READ))
         break; 
@@ -138,20 +115,7 @@ void PrefetchThread_kron_twitter(int me, const Graph *g, int r, NodeID *comp, si
 }
 
 void PrefetchThread_urand(int me, const Graph *g, int r, NodeID *comp, size_t start, size_t end) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin main thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  GhostTopology::Get().PinHelper(me);
   HyperParam_PfT hyperparam = hyper_param; 
   bool serialize_flag = false; 
   start = time_diff.read(me, ORDER_READ) + hyperparam.skip_offset; 
@@ -169,7 +133,7 @@ void PrefetchThread_urand(int me, const Graph *g, int r, NodeID *comp, size_t st
         p1 = comp[comp[high]]; 
         p2 = comp[low];
         if (serialize_flag)
-          asm volatile ("serialize\n\t"); 
+          ghost_throttle(1); 
       }
       /*-------Link()-------*/
       break;
@@ -244,26 +208,18 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
 
   // Process a sparse sampled subgraph first for approximating components.
   // Sample by processing a fixed number of neighbors for each node (see paper)
+    const bool split = ghost_link.is(kClassUrand) || ghost_link.is(kClassWeb); 
+    if (split)
+      omp_set_schedule(omp_sched_static, 0); 
+    else
+      omp_set_schedule(omp_sched_dynamic, CHUNKSIZE); 
     for (int r = 0; r < neighbor_rounds; ++r) {
     #pragma omp parallel
     {
         int me = omp_get_thread_num(); 
-        /*-----pin the pf thread to specfic core-----*/ 
-        pthread_t self = pthread_self();
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        // CPU_SET(me, &cpuset);
-        CPU_SET(me*2, &cpuset); // beijing
-                    
-        int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-        if (rc != 0) {
-            printf("Failed to pin main thread.\n");
-            exit(1);
-        }
-        /*-----pin the pf thread to specfic core-----*/
+        GhostTopology::Get().PinMain(me);
     
         /*-----compute boundary for each pf thread-----*/
-        #if defined(URAND) || defined(WEB)
         size_t div = g.num_nodes() / NT; 
         size_t mod = g.num_nodes() % NT; 
         size_t head, tail; 
@@ -280,26 +236,21 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
             head = (div+1) * (previous_me+1); 
         else 
             head = div*(previous_me+1) + mod; 
-        #endif 
         /*-----compute boundary for each pf thread-----*/
         #ifdef HTPF
-        #if defined(URAND)
-        thread PF(PrefetchThread_urand, me, &g, r, comp.begin(), head, tail); 
-        #elif defined(KRON) || defined(TWITTER) || defined(ROAD)
-        time_diff.set(me, 0, ORDER_WRITE); 
-        end_flag.set(me, 0, ORDER_WRITE); 
-        size_t head = 0 + me*CHUNKSIZE; 
-        thread PF(PrefetchThread_kron_twitter, me, &g, r, comp.begin(), head, 0); 
-        #elif defined(WEB)
-        thread PF(PrefetchThread_web, me, &g, r, comp.begin(), head, tail); 
-        #endif 
+        thread PF; 
+        if (ghost_link.is(kClassUrand)) {
+          PF = thread(PrefetchThread_urand, me, &g, r, comp.begin(), head, tail); 
+        } else if (ghost_link.is(kClassWeb)) {
+          PF = thread(PrefetchThread_web, me, &g, r, comp.begin(), head, tail); 
+        } else if (ghost_link.enabled()) { // kron, twitter, road 
+          time_diff.set(me, 0, ORDER_WRITE); 
+          end_flag.set(me, 0, ORDER_WRITE); 
+          PF = thread(PrefetchThread_kron_twitter, me, &g, r, comp.begin(), me*CHUNKSIZE, 0); 
+        }
         #endif 
         // #pragma omp parallel for schedule(dynamic,16384)
-        #if defined(URAND) || defined(WEB)
-        #pragma omp for schedule(static)
-        #else
-        #pragma omp for schedule(dynamic,CHUNKSIZE)
-        #endif 
+        #pragma omp for schedule(runtime) // static if split, else dynamic,CHUNKSIZE 
         for (NodeID u = 0; u < g.num_nodes(); u++) { 
           #ifdef HTPF
           time_diff.set(me, (size_t) u, ORDER_WRITE); 
@@ -311,10 +262,10 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
           }
         }
         #ifdef HTPF
-        #if defined(KRON) || defined(TWITTER) || defined(ROAD)
-        end_flag.set(me, 1, ORDER_WRITE); 
-        #endif 
-        PF.join(); 
+        if (!split)
+          end_flag.set(me, 1, ORDER_WRITE); 
+        if (PF.joinable())
+          PF.join(); 
         #endif 
     } // omp parallel 
         Compress(g, comp);
@@ -435,8 +386,13 @@ int main(int argc, char* argv[]) {
             cli.serialize_threshold() - cli.unserialize_threshold() : 0; 
   cout << "sync frequency = " << hyper_param.sync_frequency << ", serialize threshold = " << hyper_param.serialize_threshold 
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
+  GhostThrottle::Get(); // calibrate before anything is timed
   Builder b(cli);
   Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("cc_paral", g, cli, hyper_param); 
+  ghost_link = ghost_tuning.Config("link"); 
+  #endif 
   auto CCBound = [&cli](const Graph& gr){ return Afforest(gr, cli.logging_en()); };
   BenchmarkKernel(cli, g, CCBound, PrintCompStats, CCVerifier);
   // time_diff.print_atomic_histogram(); 
@@ -13,6 +13,9 @@
 #include <type_traits>
 #include <vector>
 
+#include "isa.h"
+#include "page_alloc.h"
+#include "reorder.h"
 
 /*
 GAP Benchmark Suite
@@ -30,7 +33,7 @@ class CLBase {
   int argc_;
   char** argv_;
   std::string name_;
-  std::string get_args_ = "f:g:hk:su:m";
+  std::string get_args_ = "f:g:hk:su:mH:N:O:";
   std::vector<std::string> help_strings_;
 
   int scale_ = -1;
@@ -39,6 +42,7 @@ class CLBase {
   bool symmetrize_ = false;
   bool uniform_ = false;
   bool in_place_ = false;
+  ReorderKind reorder_ = kOrderNone;
 
   void AddHelpLine(char opt, std::string opt_arg, std::string text,
                    std::string def = "") {
@@ -64,6 +68,12 @@ class CLBase {
     AddHelpLine('k', "degree", "average degree for synthetic graph",
                 std::to_string(degree_));
     AddHelpLine('m', "", "reduces memory usage during graph building", "false");
+    AddHelpLine('H', "pages", "page policy for arrays: 4k, thp or hugetlb",
+                "4k");
+    AddHelpLine('N', "numa", "none, interleave, owner or replicate (CSR)",
+                "none");
+    AddHelpLine('O', "order", "reorder: none, degree, dbg, hub, rcm or gorder",
+                "none");
   }
 
   bool ParseArgs() {
@@ -90,6 +100,25 @@ class CLBase {
       case 's': symmetrize_ = true;                         break;
       case 'u': uniform_ = true; scale_ = atoi(opt_arg);    break;
       case 'm': in_place_ = true;                           break;
+      case 'H':
+        if (!PageAlloc::ParsePolicy(opt_arg, &PageAlloc::Policy())) {
+          std::cout << "Unknown page policy: " << opt_arg << std::endl;
+          std::exit(-9);
+        }
+        TLBCounter::Get().Open();
+        break;
+      case 'N':
+        if (!PageAlloc::ParseNuma(opt_arg, &PageAlloc::Numa())) {
+          std::cout << "Unknown NUMA policy: " << opt_arg << std::endl;
+          std::exit(-9);
+        }
+        break;
+      case 'O':
+        if (!ParseOrder(opt_arg, &reorder_)) {
+          std::cout << "Unknown vertex order: " << opt_arg << std::endl;
+          std::exit(-9);
+        }
+        break;
     }
   }
 
@@ -107,6 +136,7 @@ class CLBase {
   bool symmetrize() const { return symmetrize_; }
   bool uniform() const { return uniform_; }
   bool in_place() const { return in_place_; }
+  ReorderKind reorder() const { return reorder_; }
 };
 
 // class CLPageRank : public CLApp {
@@ -144,10 +174,17 @@ class CLApp : public CLBase {
   int core_offset_ = 9; 
   int skip_offset_ = 17; 
   int unserialize_threshold_ = 3; 
+  std::string tuning_db_ = ""; 
+  std::string ghost_class_ = ""; 
+  int lead_lines_ = 0; 
+  int telemetry_period_ = 16; 
+  std::string telemetry_file_ = ""; 
+  bool compressed_ = false;
+  VectorISA isa_ = kISAAuto;
 
  public:
   CLApp(int argc, char** argv, std::string name) : CLBase(argc, argv, name) {
-    get_args_ += "an:r:vlp:o:j:q:";
+    get_args_ += "an:r:vlp:o:j:q:c:G:y:x:z:CI:";
     AddHelpLine('a', "", "output analysis of last run", "false");
     AddHelpLine('n', "n", "perform n trials", std::to_string(num_trials_));
     AddHelpLine('r', "node", "start from node r", "rand");
@@ -157,6 +194,16 @@ class CLApp : public CLBase {
     AddHelpLine('o', "o", "prefetch core offset", std::to_string(core_offset_));
     AddHelpLine('j', "j", "skip iteration offset", std::to_string(skip_offset_));
     AddHelpLine('q', "q", "unserialize threshold", std::to_string(unserialize_threshold_));
+    AddHelpLine('c', "file", "load ghost hyperparameters from tuning database");
+    AddHelpLine('G', "class", "ghost helper without a database match: kron, urand, twitter, road, web or off", "build");
+    AddHelpLine('y', "lines", "adapt ghost hyperparameters to keep lines in flight", "off");
+    AddHelpLine('x', "x", "sample ghost lead every x progress checks", std::to_string(telemetry_period_));
+    AddHelpLine('z', "file", "write ghost telemetry per phase (.json or csv)");
+    AddHelpLine('C', "", "run on varint-coded CSR (pr_spmv, cc_sv, pr_tpf)",
+                "false");
+    AddHelpLine('I', "isa",
+                "vector ISA (pr_tpf, tc, msbfs_tpf): avx512, avx2 or scalar",
+                "auto");
   }
 
   void HandleArg(signed char opt, char* opt_arg) override {
@@ -170,6 +217,24 @@ class CLApp : public CLBase {
       case 'o': core_offset_ = atoi(opt_arg);           break; 
       case 'j': skip_offset_ = atoi(opt_arg);           break; 
       case 'q': unserialize_threshold_ = atoi(opt_arg); break; 
+      case 'c': tuning_db_ = std::string(opt_arg);      break; 
+      case 'G': ghost_class_ = std::string(opt_arg);    break; 
+      case 'y': lead_lines_ = atoi(opt_arg);            break; 
+      case 'x': telemetry_period_ = atoi(opt_arg);      break; 
+      case 'z': telemetry_file_ = std::string(opt_arg); break; 
+      case 'C':
+        #ifdef NODEID64
+        std::cout << "varint-coded CSR (-C) needs 32-bit IDs" << std::endl;
+        std::exit(-14);
+        #endif
+        compressed_ = true;
+        break;
+      case 'I':
+        if (!ParseISA(opt_arg, &isa_)) {
+          std::cout << "Unknown vector ISA: " << opt_arg << std::endl;
+          std::exit(-17);
+        }
+        break;
       default: CLBase::HandleArg(opt, opt_arg);
     }
   }
@@ -183,6 +248,13 @@ class CLApp : public CLBase {
   int serialize_threshold() const { return core_offset_; } 
   int skip_offset() const { return skip_offset_; }
   int unserialize_threshold() const { return unserialize_threshold_; }
+  std::string tuning_db() const { return tuning_db_; }
+  std::string ghost_class() const { return ghost_class_; }
+  int lead_lines() const { return lead_lines_; }
+  int telemetry_period() const { return telemetry_period_; }
+  std::string telemetry_file() const { return telemetry_file_; }
+  bool compressed() const { return compressed_; }
+  VectorISA vector_isa() const { return ResolveISA(isa_); }
 };
 
 
@@ -237,6 +309,105 @@ class CLPageRank : public CLApp {
 
 
 
+class CLPageRankPB : public CLPageRank {
+  int bin_shift_ = 16;
+
+ public:
+  CLPageRankPB(int argc, char** argv, std::string name, double tolerance,
+               int max_iters)
+      : CLPageRank(argc, argv, name, tolerance, max_iters) {
+    get_args_ += "B:";
+    AddHelpLine('B', "B", "bins of 2^B destination vertices",
+                std::to_string(bin_shift_));
+  }
+
+  void HandleArg(signed char opt, char* opt_arg) override {
+    switch (opt) {
+      case 'B':
+        bin_shift_ = atoi(opt_arg);
+        if (bin_shift_ < 0 || bin_shift_ > 30) {
+          std::cout << "Bin width must be 2^0 to 2^30 vertices" << std::endl;
+          std::exit(-16);
+        }
+        break;
+      default: CLPageRank::HandleArg(opt, opt_arg);
+    }
+  }
+
+  int bin_shift() const { return bin_shift_; }
+};
+
+
+
+class CLMultiSource : public CLApp {
+  int batch_size_ = 64;
+
+ public:
+  CLMultiSource(int argc, char** argv, std::string name)
+      : CLApp(argc, argv, name) {
+    get_args_ += "b:";
+    AddHelpLine('b', "b", "sources per batch (64, 128 or 256)",
+                std::to_string(batch_size_));
+  }
+
+  void HandleArg(signed char opt, char* opt_arg) override {
+    switch (opt) {
+      case 'b':
+        batch_size_ = atoi(opt_arg);
+        if (batch_size_ != 64 && batch_size_ != 128 && batch_size_ != 256) {
+          std::cout << "Batch size must be 64, 128 or 256" << std::endl;
+          std::exit(-15);
+        }
+        break;
+      default: CLApp::HandleArg(opt, opt_arg);
+    }
+  }
+
+  int batch_size() const { return batch_size_; }
+};
+
+
+
+class CLTriangle : public CLApp {
+  int64_t hub_degree_ = 0;
+  int64_t hub_budget_mb_ = 256;
+
+ public:
+  CLTriangle(int argc, char** argv, std::string name)
+      : CLApp(argc, argv, name) {
+    get_args_ += "T:M:";
+    AddHelpLine('T', "degree", "bitmap sets for hubs above degree (0 is off)",
+                std::to_string(hub_degree_));
+    AddHelpLine('M', "MB", "memory for hub bitmap sets",
+                std::to_string(hub_budget_mb_));
+  }
+
+  void HandleArg(signed char opt, char* opt_arg) override {
+    switch (opt) {
+      case 'T':
+        hub_degree_ = atol(opt_arg);
+        if (hub_degree_ < 0) {
+          std::cout << "Hub degree must be 0 (off) or more" << std::endl;
+          std::exit(-18);
+        }
+        break;
+      case 'M':
+        hub_budget_mb_ = atol(opt_arg);
+        if (hub_budget_mb_ < 0 || hub_budget_mb_ > (INT64_MAX >> 20)) {
+          std::cout << "Hub set memory must be 0 to 2^43 MB" << std::endl;
+          std::exit(-18);
+        }
+        break;
+      default: CLApp::HandleArg(opt, opt_arg);
+    }
+  }
+
+  int64_t hub_degree() const { return hub_degree_; }
+  int64_t hub_budget() const { return hub_budget_mb_ << 20; }
+};
+
+
+
 template<typename WeightT_>
 class CLDelta : public CLApp {
   WeightT_ delta_ = 1;
@@ -269,12 +440,20 @@ class CLConvert : public CLBase {
   bool out_weighted_ = false;
   bool out_el_ = false;
   bool out_sg_ = false;
+  bool out_sg_v1_ = false;
+  std::string out_wsg_filename_ = "";
+  std::string out_usg_filename_ = "";
+  size_t mem_budget_ = 0;
 
  public:
   CLConvert(int argc, char** argv, std::string name)
       : CLBase(argc, argv, name) {
-    get_args_ += "e:b:w";
+    get_args_ += "e:b:wlM:W:U:";
     AddHelpLine('b', "file", "output serialized graph to file");
+    AddHelpLine('W', "file", "also output weighted serialized graph to file");
+    AddHelpLine('U', "file", "also output symmetrized serialized graph to file");
+    AddHelpLine('l', "", "serialize in legacy v1 layout (no mmap)", "false");
+    AddHelpLine('M', "MB", "build out of core within MB of memory (-f, -b)");
     AddHelpLine('e', "file", "output edge list to file");
     AddHelpLine('w', "file", "make output weighted");
   }
@@ -284,6 +463,10 @@ class CLConvert : public CLBase {
       case 'b': out_sg_ = true; out_filename_ = std::string(opt_arg);   break;
       case 'e': out_el_ = true; out_filename_ = std::string(opt_arg);   break;
       case 'w': out_weighted_ = true;                                   break;
+      case 'l': out_sg_v1_ = true;                                      break;
+      case 'M': mem_budget_ = atol(opt_arg) << 20;                      break;
+      case 'W': out_wsg_filename_ = std::string(opt_arg);              break;
+      case 'U': out_usg_filename_ = std::string(opt_arg);              break;
       default: CLBase::HandleArg(opt, opt_arg);
     }
   }
@@ -292,6 +475,10 @@ class CLConvert : public CLBase {
   bool out_weighted() const { return out_weighted_; }
   bool out_el() const { return out_el_; }
   bool out_sg() const { return out_sg_; }
+  bool out_sg_v1() const { return out_sg_v1_; }
+  std::string out_wsg_filename() const { return out_wsg_filename_; }
+  std::string out_usg_filename() const { return out_usg_filename_; }
+  size_t mem_budget() const { return mem_budget_; }
 };
 
 #endif  // COMMAND_LINE_H_
@@ -0,0 +1,454 @@
+#ifndef COMPRESSED_GRAPH_H_
+#define COMPRESSED_GRAPH_H_
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define GAP_VARINT_SIMD
+#endif
+
+#include "graph.h"
+#include "page_alloc.h"
+#include "timer.h"
+#include "util.h"
+
+
+/*
+GAP Benchmark Suite
+Class:  CompressedGraph
+
+Read-only copy of a CSRGraph whose neighbor lists are delta plus group varint
+coded, for kernels that are bound by streaming the neighbor arrays (-C)
+ - Same interface as CSRGraph for what the kernels use (degrees, out_neigh,
+   in_neigh, vertices), so a kernel templated on the graph type runs on both
+ - Each list is varint(degree), the first neighbor as a zigzag varint
+   relative to the vertex itself, then the gaps between consecutive
+   neighbors in groups of 4: one control byte (2 bits of length per gap)
+   followed by the gaps' 1-4 little endian bytes
+ - Gaps are taken modulo 2^32, so unsorted lists still round trip (sorted
+   ones just code smaller)
+ - Full groups are decoded 4 at a time with SSSE3 (pshufb plus a prefix sum)
+   when the CPU has it, picked once at startup; the rest is scalar
+ - Neighborhood::iterator decodes a block of kDecodeBlock neighbors at a
+   time into itself, so nested and concurrent iterations need no buffers;
+   Neighborhood::Decode() writes a whole list out in one call
+ - Per vertex the byte offset of its list is kept (8 B), which replaces the
+   CSR index; 32-bit vertex IDs only
+*/
+
+
+// Codes one list, returns its length in bytes (only counts if out is null)
+template <typename NodeID_>
+int64_t VarintEncode(NodeID_ n, const NodeID_ *begin, const NodeID_ *end,
+                     uint8_t *out) {
+  static_assert(sizeof(NodeID_) == 4, "varint lists hold 32-bit IDs");
+  int64_t bytes = 0;
+  auto put_varint = [&] (uint64_t x) {
+    do {
+      uint8_t b = x & 0x7f;
+      x >>= 7;
+      if (out != nullptr)
+        out[bytes] = b | (x != 0 ? 0x80 : 0);
+      bytes++;
+    } while (x != 0);
+  };
+  int64_t degree = end - begin;
+  put_varint(degree);
+  if (degree == 0)
+    return bytes;
+  int64_t first = static_cast<int64_t>(*begin) - n;
+  put_varint((static_cast<uint64_t>(first) << 1) ^ (first >> 63));
+  uint32_t prev = *begin;
+  for (const NodeID_ *group = begin + 1; group < end; group += 4) {
+    int64_t control_at = bytes++;
+    uint8_t control = 0;
+    for (int lane = 0; lane < 4 && group + lane < end; lane++) {
+      uint32_t gap = static_cast<uint32_t>(group[lane]) - prev;
+      prev = group[lane];
+      int len = gap < (1u << 8) ? 1 : gap < (1u << 16) ? 2 :
+                gap < (1u << 24) ? 3 : 4;
+      control |= (len - 1) << (2 * lane);
+      for (int b = 0; b < len; b++, gap >>= 8)
+        if (out != nullptr)
+          out[bytes + b] = gap & 0xff;
+      bytes += len;
+    }
+    if (out != nullptr)
+      out[control_at] = control;
+  }
+  return bytes;
+}
+
+
+inline uint64_t VarintRead(const uint8_t *&p) {
+  uint64_t x = 0;
+  int shift = 0;
+  uint8_t b;
+  do {
+    b = *p++;
+    x |= static_cast<uint64_t>(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return x;
+}
+
+
+// Byte lengths and (for SSSE3) shuffle masks of all 256 control bytes
+struct VarintTables {
+  uint8_t length[256];
+  alignas(16) uint8_t shuffle[256][16];
+
+  VarintTables() {
+    for (int control = 0; control < 256; control++) {
+      int at = 0;
+      for (int lane = 0; lane < 4; lane++) {
+        int len = ((control >> (2 * lane)) & 3) + 1;
+        for (int b = 0; b < 4; b++)
+          shuffle[control][4*lane + b] = b < len ? at + b : 0x80;
+        at += len;
+      }
+      length[control] = at;
+    }
+  }
+
+  static const VarintTables& Get() {
+    static const VarintTables tables;
+    return tables;
+  }
+};
+
+
+// Decodes count gaps following prev into out, returns the next byte
+// (loads 4 B per gap, so reads up to 3 bytes past the last one)
+inline const uint8_t* VarintDecodeScalar(const uint8_t *p, uint32_t prev,
+                                         int64_t count, uint32_t *out) {
+  for (int64_t i = 0; i < count; i += 4) {
+    uint8_t control = *p++;
+    for (int lane = 0; lane < 4 && i + lane < count; lane++) {
+      int len = ((control >> (2 * lane)) & 3) + 1;
+      uint32_t word;
+      std::memcpy(&word, p, sizeof(word));
+      p += len;
+      prev += word & (0xffffffffu >> (32 - 8 * len));
+      out[i + lane] = prev;
+    }
+  }
+  return p;
+}
+
+#ifdef GAP_VARINT_SIMD
+// Reads up to 15 bytes past the last group, lists are allocated with slack
+__attribute__((target("ssse3")))
+inline const uint8_t* VarintDecodeSSSE3(const uint8_t *p, uint32_t prev,
+                                        int64_t count, uint32_t *out) {
+  const VarintTables &tables = VarintTables::Get();
+  __m128i carry = _mm_set1_epi32(prev);
+  int64_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint8_t control = *p;
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    __m128i mask = _mm_load_si128(
+        reinterpret_cast<const __m128i*>(tables.shuffle[control]));
+    __m128i x = _mm_shuffle_epi8(data, mask);
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi32(x, carry);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+    carry = _mm_shuffle_epi32(x, 0xff);
+    p += 1 + tables.length[control];
+  }
+  if (i < count)
+    p = VarintDecodeScalar(p, _mm_cvtsi128_si32(carry), count - i, out + i);
+  return p;
+}
+#endif  // GAP_VARINT_SIMD
+
+
+typedef const uint8_t* (*VarintDecodeFn)(const uint8_t*, uint32_t, int64_t,
+                                         uint32_t*);
+
+inline VarintDecodeFn VarintDecoder() {
+  static const VarintDecodeFn decode = [] () -> VarintDecodeFn {
+    #ifdef GAP_VARINT_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+      return &VarintDecodeSSSE3;
+    #endif
+    return &VarintDecodeScalar;
+  }();
+  return decode;
+}
+
+
+
+template <class NodeID_>
+class CompressedGraph {
+  static_assert(sizeof(NodeID_) == 4, "varint lists hold 32-bit IDs");
+
+  // Slack past the last list for the 16 B loads of the SIMD decoder
+  static const int64_t kDecodeSlack = 16;
+  static const int kDecodeBlock = 32;
+
+  // Used for *non-negative* offsets within a neighborhood
+  typedef std::make_unsigned<std::ptrdiff_t>::type OffsetT;
+
+  class Neighborhood {
+    NodeID_ n_;
+    const uint8_t *list_;
+    OffsetT start_offset_;
+
+   public:
+    class iterator {
+      const uint8_t *p_;
+      uint32_t prev_;
+      int64_t left_;      // neighbors not yet decoded
+      int pos_;
+      int count_;
+      NodeID_ buf_[kDecodeBlock];
+
+      void Refill() {
+        pos_ = 0;
+        count_ = std::min(left_, static_cast<int64_t>(kDecodeBlock));
+        p_ = VarintDecoder()(p_, prev_, count_,
+                             reinterpret_cast<uint32_t*>(buf_));
+        prev_ = buf_[count_ - 1];
+        left_ -= count_;
+      }
+
+     public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef NodeID_ value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const NodeID_* pointer;
+      typedef const NodeID_& reference;
+
+      iterator() : p_(nullptr), prev_(0), left_(0), pos_(0), count_(0) {}
+
+      iterator(NodeID_ n, const uint8_t *list) : iterator() {
+        p_ = list;
+        int64_t degree = VarintRead(p_);
+        if (degree == 0)
+          return;
+        uint64_t zigzag = VarintRead(p_);
+        int64_t first = static_cast<int64_t>(zigzag >> 1) ^
+                        -static_cast<int64_t>(zigzag & 1);
+        buf_[0] = static_cast<NodeID_>(n + first);
+        prev_ = buf_[0];
+        left_ = degree - 1;
+        // rest of the first block, a whole number of groups
+        count_ = 1 + std::min(left_, static_cast<int64_t>(kDecodeBlock - 4));
+        p_ = VarintDecoder()(p_, prev_, count_ - 1,
+                             reinterpret_cast<uint32_t*>(buf_ + 1));
+        prev_ = buf_[count_ - 1];
+        left_ -= count_ - 1;
+      }
+
+      reference operator*() const { return buf_[pos_]; }
+
+      iterator& operator++() {
+        if (++pos_ == count_ && left_ != 0)
+          Refill();
+        return *this;
+      }
+
+      iterator operator++(int) {
+        iterator old(*this);
+        ++(*this);
+        return old;
+      }
+
+      int64_t remaining() const { return left_ + count_ - pos_; }
+
+      bool operator==(const iterator &other) const {
+        return remaining() == other.remaining();
+      }
+
+      bool operator!=(const iterator &other) const {
+        return remaining() != other.remaining();
+      }
+    };
+
+    Neighborhood(NodeID_ n, const uint8_t *list, OffsetT start_offset) :
+        n_(n), list_(list), start_offset_(start_offset) {}
+
+    iterator begin() const {
+      iterator it(n_, list_);
+      for (OffsetT i = 0; i < start_offset_ && it.remaining() != 0; i++)
+        ++it;
+      return it;
+    }
+
+    iterator end() const { return iterator(); }
+
+    // whole list (ignores start_offset), returns one past the last written
+    NodeID_* Decode(NodeID_ *out) const {
+      const uint8_t *p = list_;
+      int64_t degree = VarintRead(p);
+      if (degree == 0)
+        return out;
+      uint64_t zigzag = VarintRead(p);
+      out[0] = n_ + (static_cast<int64_t>(zigzag >> 1) ^
+                     -static_cast<int64_t>(zigzag & 1));
+      VarintDecoder()(p, out[0], degree - 1,
+                      reinterpret_cast<uint32_t*>(out + 1));
+      return out + degree;
+    }
+
+    void prefetch_begin() const { __builtin_prefetch(list_); }
+  };
+
+  // codes the lists neigh(n) returns into offsets/bytes
+  template <typename GraphT_, typename NeighFn>
+  static void Encode(const GraphT_ &g, NeighFn neigh, SGOffset **offsets,
+                     uint8_t **bytes) {
+    int64_t num_nodes = g.num_nodes();
+    SGOffset *offs = PageNew<SGOffset>(num_nodes + 1);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (NodeID_ n = 0; n < num_nodes; n++)
+      offs[n] = VarintEncode<NodeID_>(n, neigh(n).begin(), neigh(n).end(),
+                                      nullptr);
+    SGOffset total = 0;
+    for (int64_t n = 0; n < num_nodes; n++) {
+      SGOffset len = offs[n];
+      offs[n] = total;
+      total += len;
+    }
+    offs[num_nodes] = total;
+    uint8_t *out = PageNew<uint8_t>(total + kDecodeSlack);
+    std::memset(out + total, 0, kDecodeSlack);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (NodeID_ n = 0; n < num_nodes; n++)
+      VarintEncode<NodeID_>(n, neigh(n).begin(), neigh(n).end(),
+                            out + offs[n]);
+    *offsets = offs;
+    *bytes = out;
+  }
+
+  static int64_t ReadDegree(const uint8_t *list) {
+    return VarintRead(list);
+  }
+
+  void ReleaseResources() {
+    if (out_offsets_ != nullptr) {
+      PageDelete(out_offsets_);
+      PageDelete(out_bytes_);
+    }
+    if (directed_ && in_offsets_ != nullptr) {
+      PageDelete(in_offsets_);
+      PageDelete(in_bytes_);
+    }
+  }
+
+ public:
+  explicit CompressedGraph(const CSRGraph<NodeID_> &g) :
+      directed_(g.directed()), num_nodes_(g.num_nodes()),
+      num_edges_(g.num_edges()), out_offsets_(nullptr), out_bytes_(nullptr),
+      in_offsets_(nullptr), in_bytes_(nullptr) {
+    Timer t;
+    t.Start();
+    Encode(g, [&g] (NodeID_ n) { return g.out_neigh(n); },
+           &out_offsets_, &out_bytes_);
+    if (directed_) {
+      Encode(g, [&g] (NodeID_ n) { return g.in_neigh(n); },
+             &in_offsets_, &in_bytes_);
+    } else {
+      in_offsets_ = out_offsets_;
+      in_bytes_ = out_bytes_;
+    }
+    t.Stop();
+    PrintTime("Compress Time", t.Seconds());
+    int64_t csr_bytes = (directed_ ? 2 : 1) *
+                        ((num_nodes_ + 1) * sizeof(NodeID_*) +
+                         num_edges_directed() * sizeof(NodeID_));
+    PrintTime("Compression Ratio", static_cast<double>(csr_bytes) / bytes());
+  }
+
+  CompressedGraph(CompressedGraph &&other) :
+      directed_(other.directed_), num_nodes_(other.num_nodes_),
+      num_edges_(other.num_edges_),
+      out_offsets_(other.out_offsets_), out_bytes_(other.out_bytes_),
+      in_offsets_(other.in_offsets_), in_bytes_(other.in_bytes_) {
+    other.num_nodes_ = -1;
+    other.num_edges_ = -1;
+    other.out_offsets_ = other.in_offsets_ = nullptr;
+    other.out_bytes_ = other.in_bytes_ = nullptr;
+  }
+
+  CompressedGraph(const CompressedGraph &other) = delete;
+
+  ~CompressedGraph() {
+    ReleaseResources();
+  }
+
+  bool directed() const {
+    return directed_;
+  }
+
+  int64_t num_nodes() const {
+    return num_nodes_;
+  }
+
+  int64_t num_edges() const {
+    return num_edges_;
+  }
+
+  int64_t num_edges_directed() const {
+    return directed_ ? num_edges_ : 2*num_edges_;
+  }
+
+  int64_t out_degree(NodeID_ v) const {
+    return ReadDegree(out_bytes_ + out_offsets_[v]);
+  }
+
+  int64_t in_degree(NodeID_ v) const {
+    return ReadDegree(in_bytes_ + in_offsets_[v]);
+  }
+
+  Neighborhood out_neigh(NodeID_ n, OffsetT start_offset = 0) const {
+    return Neighborhood(n, out_bytes_ + out_offsets_[n], start_offset);
+  }
+
+  Neighborhood in_neigh(NodeID_ n, OffsetT start_offset = 0) const {
+    return Neighborhood(n, in_bytes_ + in_offsets_[n], start_offset);
+  }
+
+  // bytes of the coded lists and their offsets
+  int64_t bytes() const {
+    int64_t total = out_offsets_[num_nodes_] +
+                    (num_nodes_ + 1) * sizeof(SGOffset);
+    if (directed_)
+      total += in_offsets_[num_nodes_] + (num_nodes_ + 1) * sizeof(SGOffset);
+    return total;
+  }
+
+  void PrintStats() const {
+    std::cout << "Graph has " << num_nodes_ << " nodes and "
+              << num_edges_ << " ";
+    if (!directed_)
+      std::cout << "un";
+    std::cout << "directed edges for degree: ";
+    std::cout << num_edges_/num_nodes_ << std::endl;
+  }
+
+  Range<NodeID_> vertices() const {
+    return Range<NodeID_>(num_nodes());
+  }
+
+ private:
+  bool directed_;
+  int64_t num_nodes_;
+  int64_t num_edges_;
+  SGOffset *out_offsets_;
+  uint8_t  *out_bytes_;
+  SGOffset *in_offsets_;
+  uint8_t  *in_bytes_;
+};
+
+#endif  // COMPRESSED_GRAPH_H_
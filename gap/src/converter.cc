@@ -7,25 +7,82 @@
 #include "builder.h"
 #include "command_line.h"
 #include "graph.h"
+#include "ooc_builder.h"
 #include "writer.h"
 
 using namespace std;
 
+typedef EdgePair<NodeID> Edge;
+typedef EdgePair<NodeID, WNode> WEdge;
+
+
+// Builds the weighted (-W), plain (-b/-e) and symmetrized (-U) graphs from
+// one read or generation of the edge list, each freed once it is written
+void ConvertFromOneParse(const CLConvert &cli) {
+  if ((cli.mem_budget() != 0) ||
+      (cli.in_place() && (cli.out_usg_filename() != ""))) {
+    cout << "-W and -U build in memory, without -M, and -U without -m" << endl;
+    exit(-13);
+  }
+  if (cli.filename() != "") {
+    Reader<NodeID, NodeID, WeightT> r(cli.filename());
+    if (r.IsSerialized()) {
+      cout << "-W and -U need a text or generated input" << endl;
+      exit(-13);
+    }
+  }
+  WeightedBuilder bw(cli);
+  pvector<WEdge> wel = bw.MakeEdgeList();
+  if (cli.out_wsg_filename() != "") {
+    WGraph wg = bw.FinishGraph(bw.MakeGraphFromEL(wel));
+    wg.PrintStats();
+    WeightedWriter ww(wg);
+    ww.WriteGraph(cli.out_wsg_filename(), true, cli.out_sg_v1());
+  }
+  pvector<Edge> el(wel.size());
+  #pragma omp parallel for
+  for (size_t e=0; e < wel.size(); e++)
+    el[e] = Edge(wel[e].u, wel[e].v.v);
+  pvector<WEdge>().swap(wel);
+  if (cli.out_filename() != "") {
+    Builder b(cli);
+    Graph g = b.FinishGraph(b.MakeGraphFromEL(el));
+    g.PrintStats();
+    Writer w(g);
+    w.WriteGraph(cli.out_filename(), cli.out_sg(), cli.out_sg_v1());
+  }
+  if (cli.out_usg_filename() != "") {
+    Builder bu(cli, true);
+    Graph ug = bu.FinishGraph(bu.MakeGraphFromEL(el));
+    ug.PrintStats();
+    Writer wu(ug);
+    wu.WriteGraph(cli.out_usg_filename(), true, cli.out_sg_v1());
+  }
+}
+
+
 int main(int argc, char* argv[]) {
   CLConvert cli(argc, argv, "converter");
   cli.ParseArgs();
-  if (cli.out_weighted()) {
+  if (cli.out_wsg_filename() != "" || cli.out_usg_filename() != "") {
+    ConvertFromOneParse(cli);
+  } else if (cli.mem_budget() != 0) {
+    if (cli.out_weighted())
+      OutOfCoreBuilder<NodeID, WNode, WeightT>(cli).Build();
+    else
+      OutOfCoreBuilder<NodeID, NodeID, WeightT>(cli).Build();
+  } else if (cli.out_weighted()) {
     WeightedBuilder bw(cli);
     WGraph wg = bw.MakeGraph();
     wg.PrintStats();
     WeightedWriter ww(wg);
-    ww.WriteGraph(cli.out_filename(), cli.out_sg());
+    ww.WriteGraph(cli.out_filename(), cli.out_sg(), cli.out_sg_v1());
   } else {
     Builder b(cli);
     Graph g = b.MakeGraph();
     g.PrintStats();
     Writer w(g);
-    w.WriteGraph(cli.out_filename(), cli.out_sg());
+    w.WriteGraph(cli.out_filename(), cli.out_sg(), cli.out_sg_v1());
   }
   return 0;
 }
@@ -0,0 +1,287 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ghost_trace.h"
+
+
+/*
+GAP Benchmark Suite
+Kernel: ghost_replay
+
+Replays a trace recorded by a -DGHOST_TRACE tpf kernel through a
+set-associative LRU cache model, to screen helper slices and hyperparameters
+without the machine they are meant for
+ - Streams are merged by their timestamps; all of them share one cache, as
+   main and helper share the core's cache
+ - A prefetch that misses fills the line after the memory latency; a main
+   load that finds it still in flight counts as late, one that finds it
+   filled as timely
+ - The same loads are also run through the cache without prefetches, the
+   baseline the coverage and bandwidth numbers are relative to
+ - Prefetched lines evicted unused count as early/useless; main misses on
+   lines a prefetch evicted count as pollution
+*/
+
+
+using namespace std;
+
+struct ReplayEvent {
+  int64_t ns;
+  uint64_t line;
+  uint32_t iter;
+  GhostTraceKind kind;
+};
+
+struct ReplayStats {
+  uint64_t loads = 0, prefetches = 0;
+  uint64_t base_misses = 0, misses = 0;
+  uint64_t timely = 0, late = 0, late_ns = 0;
+  uint64_t redundant = 0, fills = 0, early = 0, pollution = 0;
+  uint64_t unused_at_end = 0;
+  int64_t lead_iters = 0;
+  uint64_t lead_samples = 0;
+};
+
+class CacheModel {
+ public:
+  CacheModel(size_t bytes, int ways, int line_bytes) : ways_(ways), clock_(0) {
+    num_sets_ = max<size_t>(1, bytes / (static_cast<size_t>(ways) * line_bytes));
+    lines_.resize(num_sets_ * ways_);
+  }
+
+  struct Line {
+    uint64_t tag = 0;
+    uint64_t lru = 0;
+    int64_t ready_ns = 0;
+    bool valid = false;
+    bool prefetched = false;  // filled by a prefetch, not used yet
+  };
+
+  // returns the resident line or nullptr, refreshes LRU on a hit if touch
+  Line* Find(uint64_t line, bool touch) {
+    Line *set = &lines_[(line % num_sets_) * ways_];
+    for (int w = 0; w < ways_; w++) {
+      if (set[w].valid && set[w].tag == line) {
+        if (touch)
+          set[w].lru = ++clock_;
+        return &set[w];
+      }
+    }
+    return nullptr;
+  }
+
+  // fills line, victim gets the line it replaced (valid == false if none)
+  Line* Fill(uint64_t line, Line *victim) {
+    Line *set = &lines_[(line % num_sets_) * ways_];
+    Line *slot = &set[0];
+    for (int w = 0; w < ways_; w++) {
+      if (!set[w].valid) {
+        slot = &set[w];
+        break;
+      }
+      if (set[w].lru < slot->lru)
+        slot = &set[w];
+    }
+    *victim = *slot;
+    slot->tag = line;
+    slot->valid = true;
+    slot->lru = ++clock_;
+    slot->prefetched = false;
+    return slot;
+  }
+
+  uint64_t CountUnusedPrefetched() const {
+    uint64_t n = 0;
+    for (const Line &l : lines_)
+      n += l.valid && l.prefetched;
+    return n;
+  }
+
+ private:
+  size_t num_sets_;
+  int ways_;
+  uint64_t clock_;
+  vector<Line> lines_;
+};
+
+vector<ReplayEvent> ReadTrace(const string &filename, int line_bytes) {
+  ifstream in(filename, ios::binary);
+  if (!in) {
+    cout << "Couldn't open trace " << filename << endl;
+    exit(-37);
+  }
+  char magic[8];
+  uint32_t header[2];
+  in.read(magic, 8);
+  in.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!in || memcmp(magic, GHOST_TRACE_MAGIC, 8) != 0) {
+    cout << filename << " is not a ghost trace" << endl;
+    exit(-37);
+  }
+  vector<ReplayEvent> events;
+  for (uint32_t s = 0; s < header[0]; s++) {
+    GhostTraceStreamHeader sh;
+    in.read(reinterpret_cast<char*>(&sh), sizeof(sh));
+    vector<GhostTraceRecord> records(sh.records);
+    in.read(reinterpret_cast<char*>(records.data()),
+            records.size() * sizeof(GhostTraceRecord));
+    if (!in) {
+      cout << filename << ": stream " << s << " is cut short" << endl;
+      exit(-37);
+    }
+    if (sh.truncated)
+      cout << "Stream " << s << " was truncated while recording" << endl;
+    int64_t ns = sh.start_ns;
+    for (const GhostTraceRecord &r : records) {
+      ns += r.delta_ns;
+      events.push_back({ns, r.address() / line_bytes, r.iter, r.kind()});
+    }
+  }
+  stable_sort(events.begin(), events.end(),
+              [](const ReplayEvent &a, const ReplayEvent &b) {
+    return a.ns < b.ns;
+  });
+  return events;
+}
+
+ReplayStats Replay(const vector<ReplayEvent> &events, size_t cache_bytes,
+                   int ways, int line_bytes, int64_t latency_ns) {
+  ReplayStats st;
+  CacheModel cache(cache_bytes, ways, line_bytes);
+  CacheModel baseline(cache_bytes, ways, line_bytes);
+  unordered_set<uint64_t> evicted_by_prefetch;
+  CacheModel::Line victim;
+  int64_t main_iter = -1;
+  for (const ReplayEvent &e : events) {
+    if (e.kind == kTraceLoad) {
+      st.loads++;
+      main_iter = e.iter;
+      if (baseline.Find(e.line, true) == nullptr) {
+        st.base_misses++;
+        baseline.Fill(e.line, &victim);
+      }
+      CacheModel::Line *l = cache.Find(e.line, true);
+      if (l != nullptr) {
+        if (l->prefetched) {
+          l->prefetched = false;
+          if (e.ns >= l->ready_ns) {
+            st.timely++;
+          } else {
+            st.late++;
+            st.late_ns += l->ready_ns - e.ns;
+          }
+        }
+        continue;
+      }
+      st.misses++;
+      if (evicted_by_prefetch.erase(e.line))
+        st.pollution++;
+      l = cache.Fill(e.line, &victim);
+      l->ready_ns = e.ns + latency_ns;
+      if (victim.valid && victim.prefetched)
+        st.early++;
+    } else {
+      st.prefetches++;
+      if (main_iter >= 0) {
+        st.lead_iters += static_cast<int64_t>(e.iter) - main_iter;
+        st.lead_samples++;
+      }
+      if (cache.Find(e.line, false) != nullptr) {
+        st.redundant++;
+        continue;
+      }
+      st.fills++;
+      evicted_by_prefetch.erase(e.line);
+      CacheModel::Line *l = cache.Fill(e.line, &victim);
+      l->prefetched = true;
+      l->ready_ns = e.ns + latency_ns;
+      if (victim.valid) {
+        if (victim.prefetched)
+          st.early++;
+        else
+          evicted_by_prefetch.insert(victim.tag);
+      }
+    }
+  }
+  st.unused_at_end = cache.CountUnusedPrefetched();
+  return st;
+}
+
+double Ratio(uint64_t num, uint64_t den) {
+  return den == 0 ? 0.0 : static_cast<double>(num) / den;
+}
+
+void PrintReplay(const ReplayStats &st) {
+  uint64_t useful = st.timely + st.late;
+  printf("%-21s%" PRIu64 "\n", "Main Loads:", st.loads);
+  printf("%-21s%" PRIu64 "\n", "Helper Prefetches:", st.prefetches);
+  printf("%-21s%" PRIu64 " -> %" PRIu64 " (%.1lf%% fewer)\n", "Main Misses:",
+         st.base_misses, st.misses,
+         100 * (1 - Ratio(st.misses, st.base_misses)));
+  printf("%-21s%.1lf%% (%.1lf%% timely)\n", "Coverage:",
+         100 * Ratio(useful, st.base_misses),
+         100 * Ratio(st.timely, st.base_misses));
+  printf("%-21s%.1lf%% of useful, %.0lf ns short on average\n", "Late:",
+         100 * Ratio(st.late, useful), Ratio(st.late_ns, st.late));
+  printf("%-21s%.1lf%% of fills\n", "Accuracy:", 100 * Ratio(useful, st.fills));
+  printf("%-21s%" PRIu64 " evicted unused, %" PRIu64 " unused at end\n",
+         "Early/Useless:", st.early, st.unused_at_end);
+  printf("%-21s%" PRIu64 " misses (%.1lf%% of baseline)\n", "Pollution:",
+         st.pollution, 100 * Ratio(st.pollution, st.base_misses));
+  printf("%-21s%.1lf%% redundant\n", "Prefetch Hits:",
+         100 * Ratio(st.redundant, st.prefetches));
+  printf("%-21s%" PRIu64 " -> %" PRIu64 " lines (%+.1lf%%)\n", "Memory Traffic:",
+         st.base_misses, st.misses + st.fills,
+         100 * (Ratio(st.misses + st.fills, st.base_misses) - 1));
+  printf("%-21s%.1lf iterations\n", "Average Lead:",
+         st.lead_samples ? static_cast<double>(st.lead_iters) / st.lead_samples
+                         : 0.0);
+}
+
+void PrintUsage() {
+  cout << "ghost_replay" << endl;
+  cout << " -h          : print this help message" << endl;
+  cout << " -f <file>   : trace to replay              [ghost.trace]" << endl;
+  cout << " -c <KiB>    : cache size                   [1024]" << endl;
+  cout << " -w <ways>   : associativity                [16]" << endl;
+  cout << " -b <bytes>  : line size                    [64]" << endl;
+  cout << " -l <ns>     : memory latency of a fill     [100]" << endl;
+}
+
+int main(int argc, char* argv[]) {
+  string filename = "ghost.trace";
+  size_t cache_kb = 1024;
+  int ways = 16, line_bytes = 64;
+  int64_t latency_ns = 100;
+  signed char c;
+  while ((c = getopt(argc, argv, "hf:c:w:b:l:")) != -1) {
+    switch (c) {
+      case 'h': PrintUsage(); return 0;
+      case 'f': filename = optarg; break;
+      case 'c': cache_kb = atol(optarg); break;
+      case 'w': ways = atoi(optarg); break;
+      case 'b': line_bytes = atoi(optarg); break;
+      case 'l': latency_ns = atol(optarg); break;
+      default: PrintUsage(); return -1;
+    }
+  }
+  if (cache_kb == 0 || ways <= 0 || line_bytes <= 0 || latency_ns < 0) {
+    PrintUsage();
+    return -1;
+  }
+  vector<ReplayEvent> events = ReadTrace(filename, line_bytes);
+  printf("%-21s%zu KiB, %d ways, %d B lines, %" PRId64 " ns fills\n", "Cache:",
+         cache_kb, ways, line_bytes, latency_ns);
+  PrintReplay(Replay(events, cache_kb << 10, ways, line_bytes, latency_ns));
+  return 0;
+}
@@ -0,0 +1,180 @@
+#ifndef GHOST_TRACE_H_
+#define GHOST_TRACE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/*
+GAP Benchmark Suite
+Class:  GhostTrace
+
+Record mode for the tpf kernels, built with -DGHOST_TRACE, so a ghost
+configuration can be judged offline by ghost_replay on any machine
+ - Main loops log their loads with ghost_load(), helper slices prefetch
+   through ghost_prefetch(); both are tagged with the iteration the thread
+   last published (main) or visited (helper), set by GhostLoop
+ - Every thread appends to its own stream, nothing is shared while recording
+ - A record is 16 bytes: the address with the kind in bit 63, the iteration
+   and the ns since the thread's previous record (saturating)
+ - A stream keeps at most GHOST_TRACE_MAX records and is flagged truncated
+ - At exit the streams are written to $GHOST_TRACE_FILE (ghost.trace):
+     "GHSTTRC1", uint32 streams, uint32 0
+     per stream: uint32 truncated, uint32 0, int64 start ns, uint64 records,
+                 then the records
+Without -DGHOST_TRACE ghost_prefetch() is __builtin_prefetch() and
+ghost_load()/ghost_trace_iter() compile to nothing. Timestamps cost about as
+much on main as on the helper, so their relative pace roughly holds.
+*/
+
+
+#define GHOST_TRACE_MAGIC "GHSTTRC1"
+
+#ifndef GHOST_TRACE_MAX
+#define GHOST_TRACE_MAX (1 << 24) // records per stream (256 MB)
+#endif
+
+enum GhostTraceKind { kTraceLoad = 0, kTracePrefetch = 1 };
+
+struct GhostTraceRecord {
+  uint64_t addr;      // bit 63: GhostTraceKind
+  uint32_t iter;
+  uint32_t delta_ns;  // since the previous record of the stream
+
+  GhostTraceKind kind() const {
+    return static_cast<GhostTraceKind>(addr >> 63);
+  }
+  uint64_t address() const { return addr & ~(1ULL << 63); }
+};
+
+struct GhostTraceStreamHeader {
+  uint32_t truncated;
+  uint32_t reserved;
+  int64_t start_ns;
+  uint64_t records;
+};
+
+static_assert(sizeof(GhostTraceRecord) == 16, "trace record is 16 bytes");
+
+class GhostTrace {
+ public:
+  static GhostTrace& Get() {
+    static GhostTrace trace;
+    return trace;
+  }
+
+  GhostTrace(const GhostTrace &other) = delete;
+
+  ~GhostTrace() { Write(); }
+
+  void Record(GhostTraceKind kind, const void *addr) {
+    Stream *s = Local();
+    if (s->records.size() >= GHOST_TRACE_MAX) {
+      s->truncated = true;
+      return;
+    }
+    int64_t now = NowNs();
+    uint64_t delta = static_cast<uint64_t>(now - s->last_ns);
+    s->last_ns = now;
+    GhostTraceRecord r;
+    r.addr = reinterpret_cast<uintptr_t>(addr) |
+             (static_cast<uint64_t>(kind) << 63);
+    r.iter = Iteration();
+    r.delta_ns = static_cast<uint32_t>(std::min<uint64_t>(delta, UINT32_MAX));
+    s->records.push_back(r);
+  }
+
+  // iteration that tags this thread's following records
+  static uint32_t& Iteration() {
+    static thread_local uint32_t iter = 0;
+    return iter;
+  }
+
+ private:
+  struct Stream {
+    std::vector<GhostTraceRecord> records;
+    int64_t start_ns;
+    int64_t last_ns;
+    bool truncated;
+  };
+
+  GhostTrace() {}
+
+  static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  Stream* Local() {
+    static thread_local Stream *local = nullptr;
+    if (local == nullptr) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      streams_.emplace_back(new Stream());
+      local = streams_.back().get();
+      local->start_ns = local->last_ns = NowNs();
+      local->truncated = false;
+    }
+    return local;
+  }
+
+  void Write() {
+    const char *env = getenv("GHOST_TRACE_FILE");
+    std::string filename = env != nullptr && env[0] != '\0' ? env : "ghost.trace";
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+      std::cout << "Couldn't write ghost trace " << filename << std::endl;
+      return;
+    }
+    uint32_t header[2] = {static_cast<uint32_t>(streams_.size()), 0};
+    out.write(GHOST_TRACE_MAGIC, 8);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    uint64_t total = 0;
+    for (const std::unique_ptr<Stream> &s : streams_) {
+      GhostTraceStreamHeader sh = {s->truncated, 0, s->start_ns,
+                                   s->records.size()};
+      out.write(reinterpret_cast<const char*>(&sh), sizeof(sh));
+      out.write(reinterpret_cast<const char*>(s->records.data()),
+                s->records.size() * sizeof(GhostTraceRecord));
+      total += s->records.size();
+    }
+    std::cout << "Ghost trace: " << total << " records in " << streams_.size()
+              << " streams written to " << filename << std::endl;
+  }
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Stream>> streams_;
+};
+
+
+// helper slices prefetch through this
+inline void ghost_prefetch(const void *addr) {
+  __builtin_prefetch(addr);
+  #ifdef GHOST_TRACE
+  GhostTrace::Get().Record(kTracePrefetch, addr);
+  #endif
+}
+
+// main loops mark the loads their helper targets
+inline void ghost_load(const void *addr) {
+  #ifdef GHOST_TRACE
+  GhostTrace::Get().Record(kTraceLoad, addr);
+  #endif
+}
+
+inline void ghost_trace_iter(size_t iter) {
+  #ifdef GHOST_TRACE
+  GhostTrace::Iteration() = static_cast<uint32_t>(iter);
+  #endif
+}
+
+#endif  // GHOST_TRACE_H_
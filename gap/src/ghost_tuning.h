@@ -0,0 +1,362 @@
+#ifndef GHOST_TUNING_H_
+#define GHOST_TUNING_H_
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "command_line.h"
+#include "pf_support.h"
+
+
+/*
+GAP Benchmark Suite
+Class:  GhostTuning
+
+Picks the ghost-thread helper variant and its HyperParam_PfT at runtime, so a
+single tpf binary per kernel can run every graph
+ - Graphs are identified by a GraphFingerprint (nodes, directed edges and the
+   share of degree held by the top 1% of a fixed vertex sample)
+ - TuningDB reads a whitespace separated file with one line per
+   (kernel, loop, fingerprint), '#' starts a comment:
+     kernel loop nodes edges skew class sync_freq skip ser_thresh unser_thresh
+   nodes, edges and skew may be '*' (unknown), the four hyperparameters may
+   all be '-' to select only the helper variant and keep kernel defaults
+ - The entry with an exact node/edge match wins, otherwise the nearest one in
+   (log2 nodes, log2 average degree, skew) space is used, with size weighted
+   down so smaller graphs of the same shape find their class; entries further
+   than kMaxTuningDistance are ignored rather than guessed from
+ - Without a matching entry the variant named with -G is used, or else the
+   one compiled in with -DKRON/-DURAND/...; -DTUNING takes the
+   hyperparameters from the command line
+ - With a lead band (-y) every loop also gets a GhostAdapt that retunes the
+   chosen hyperparameters online
+ - Init also sets up GhostTelemetry (-x sample period, -z output file) and
+   Attach labels each GhostLoop with its kernel/loop name
+*/
+
+
+// kClassNone runs the kernel's generic helper, kClassOff runs no helper
+enum GraphClass { kClassNone, kClassOff, kClassKron, kClassUrand,
+                  kClassTwitter, kClassRoad, kClassWeb };
+
+inline const char* GraphClassName(GraphClass graph_class) {
+  switch (graph_class) {
+    case kClassKron:    return "kron";
+    case kClassUrand:   return "urand";
+    case kClassTwitter: return "twitter";
+    case kClassRoad:    return "road";
+    case kClassWeb:     return "web";
+    case kClassOff:     return "off";
+    default:            return "none";
+  }
+}
+
+inline GraphClass ParseGraphClass(const std::string &name) {
+  for (int c = kClassNone; c <= kClassWeb; c++)
+    if (name == GraphClassName(static_cast<GraphClass>(c)))
+      return static_cast<GraphClass>(c);
+  std::cout << "Unknown graph class: " << name << std::endl;
+  std::exit(-40);
+}
+
+// helper variant selected at build time, if any
+inline GraphClass CompiledGraphClass() {
+#if defined(KRON) || defined(KRONU)
+  return kClassKron;
+#elif defined(URAND)
+  return kClassUrand;
+#elif defined(TWITTER) || defined(TWITTERU)
+  return kClassTwitter;
+#elif defined(ROAD) || defined(ROADU)
+  return kClassRoad;
+#elif defined(WEB) || defined(WEBU)
+  return kClassWeb;
+#else
+  return kClassNone;
+#endif
+}
+
+
+// nearest entries beyond this (e.g. 4x the nodes and a 0.1 higher skew) are
+// a different graph, not a differently sized one of the same kind
+const double kMaxTuningDistance = 1.5;
+
+
+struct GraphFingerprint {
+  int64_t num_nodes;
+  int64_t num_edges;    // directed edges, so symmetric graphs count twice
+  double degree_skew;   // < 0 if unknown
+
+  double avg_degree() const {
+    return num_nodes > 0 ? static_cast<double>(num_edges) / num_nodes : 0;
+  }
+};
+
+// samples a fixed stride of vertices so the fingerprint is deterministic
+template <typename GraphT_>
+GraphFingerprint MakeFingerprint(const GraphT_ &g) {
+  const int64_t kMaxSamples = 1 << 16;
+  GraphFingerprint fp;
+  fp.num_nodes = g.num_nodes();
+  fp.num_edges = g.num_edges_directed();
+  int64_t stride = std::max(int64_t(1), fp.num_nodes / kMaxSamples);
+  std::vector<int64_t> degrees;
+  for (int64_t n = 0; n < fp.num_nodes; n += stride)
+    degrees.push_back(g.out_degree(n));
+  std::sort(degrees.begin(), degrees.end(), std::greater<int64_t>());
+  int64_t total = 0, top = 0;
+  size_t num_top = std::max(size_t(1), degrees.size() / 100);
+  for (size_t i = 0; i < degrees.size(); i++) {
+    total += degrees[i];
+    if (i < num_top)
+      top += degrees[i];
+  }
+  fp.degree_skew = total > 0 ? static_cast<double>(top) / total : -1;
+  return fp;
+}
+
+
+struct GhostConfig {
+  GraphClass graph_class;       // selects the helper variant
+  bool tuned;                   // hyper_param overrides the kernel defaults
+  HyperParam_PfT hyper_param;
+  GhostAdapt *adapt;            // online controller, nullptr if fixed
+  std::string label;            // kernel/loop
+
+  bool enabled() const { return graph_class != kClassOff; }
+
+  bool is(GraphClass c) const { return graph_class == c; }
+
+  // tuned hyperparameters if there are any, else the kernel's defaults
+  HyperParam_PfT Or(const HyperParam_PfT &kernel_default) const {
+    return tuned ? hyper_param : kernel_default;
+  }
+};
+
+
+class TuningDB {
+ public:
+  struct Entry {
+    std::string kernel;
+    std::string loop;
+    GraphFingerprint fingerprint;
+    GraphClass graph_class;
+    bool has_params;
+    HyperParam_PfT hyper_param;
+  };
+
+  TuningDB() {}
+
+  explicit TuningDB(const std::string &filename) : filename_(filename) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+      std::cout << "Couldn't open tuning database: " << filename << std::endl;
+      std::exit(-41);
+    }
+    std::string line;
+    int line_num = 0;
+    while (std::getline(in, line)) {
+      line_num++;
+      line = line.substr(0, line.find('#'));
+      std::istringstream fields(line);
+      std::string tok[10];
+      int num_fields = 0;
+      while (num_fields < 10 && fields >> tok[num_fields])
+        num_fields++;
+      if (num_fields == 0)
+        continue;
+      if (num_fields != 10) {
+        std::cout << filename << ":" << line_num
+                  << ": expected 10 fields in tuning entry" << std::endl;
+        std::exit(-42);
+      }
+      Entry e;
+      e.kernel = tok[0];
+      e.loop = tok[1];
+      e.fingerprint.num_nodes = tok[2] == "*" ? -1 : std::stoll(tok[2]);
+      e.fingerprint.num_edges = tok[3] == "*" ? -1 : std::stoll(tok[3]);
+      e.fingerprint.degree_skew = tok[4] == "*" ? -1 : std::stod(tok[4]);
+      e.graph_class = ParseGraphClass(tok[5]);
+      e.has_params = tok[6] != "-";
+      if (e.has_params) {
+        e.hyper_param.sync_frequency = std::stoi(tok[6]);
+        e.hyper_param.skip_offset = std::stoi(tok[7]);
+        e.hyper_param.serialize_threshold = std::stoi(tok[8]);
+        e.hyper_param.unserialize_threshold = std::stoi(tok[9]);
+      }
+      entries_.push_back(e);
+    }
+  }
+
+  bool empty() const { return entries_.empty(); }
+
+  const std::string& filename() const { return filename_; }
+
+  // closest entry for (kernel, loop), nullptr if there is none; distance
+  // leaves out the wildcard fields
+  const Entry* Lookup(const std::string &kernel, const std::string &loop,
+                      const GraphFingerprint &fp, double *distance) const {
+    const Entry *best = nullptr;
+    double best_dist = 0;
+    for (const Entry &e : entries_) {
+      if (e.kernel != kernel || e.loop != loop)
+        continue;
+      double dist = Distance(fp, e.fingerprint);
+      if (best == nullptr || dist < best_dist) {
+        best = &e;
+        best_dist = dist;
+      }
+    }
+    if (best != nullptr)
+      *distance = Distance(fp, best->fingerprint, 0);
+    return best;
+  }
+
+  // wildcard fields add unknown, so those entries only win when nothing
+  // else is there
+  static double Distance(const GraphFingerprint &fp,
+                         const GraphFingerprint &ref, double unknown = 64) {
+    if (fp.num_nodes == ref.num_nodes && fp.num_edges == ref.num_edges)
+      return 0;
+    const double kSizeWeight = 0.25; // shape matters more than scale
+    double dist = 0;
+    if (ref.num_nodes > 0)
+      dist += kSizeWeight *
+              std::fabs(std::log2((double) fp.num_nodes / ref.num_nodes));
+    else
+      dist += unknown;
+    if (ref.num_nodes > 0 && ref.num_edges > 0 && fp.avg_degree() > 0)
+      dist += std::fabs(std::log2(fp.avg_degree() / ref.avg_degree()));
+    else
+      dist += unknown;
+    if (ref.degree_skew >= 0 && fp.degree_skew >= 0)
+      dist += 10 * std::fabs(fp.degree_skew - ref.degree_skew);
+    return dist;
+  }
+
+ private:
+  std::string filename_;
+  std::vector<Entry> entries_;
+};
+
+
+class GhostTuning {
+ public:
+  // cli_param holds the -p/-o/-j/-q values, used for every loop with TUNING
+  template <typename GraphT_>
+  void Init(const std::string &kernel, const GraphT_ &g, const CLApp &cli,
+            const HyperParam_PfT &cli_param) {
+    GhostThrottle::Get(); // calibrate before anything is timed
+    #ifndef OMP
+    GhostTopology::Get().PinMain(0); // helper 0 goes on its sibling
+    #endif
+    GhostTelemetry::Get().set_sample_period(cli.telemetry_period());
+    GhostTelemetry::Get().set_output(cli.telemetry_file());
+    kernel_ = kernel;
+    cli_param_ = cli_param;
+    cli_class_ = CompiledGraphClass();
+    class_source_ = "build";
+    if (!cli.ghost_class().empty()) {
+      cli_class_ = ParseGraphClass(cli.ghost_class());
+      class_source_ = "-G";
+    }
+    lead_lines_ = cli.lead_lines();
+    const std::string db_filename = cli.tuning_db();
+    fingerprint_ = MakeFingerprint(g);
+    std::cout << "Graph fingerprint: " << fingerprint_.num_nodes << " "
+              << fingerprint_.num_edges << " " << fingerprint_.degree_skew
+              << std::endl;
+    if (!db_filename.empty())
+      db_ = TuningDB(db_filename);
+  }
+
+  // loops whose defaults must survive -DTUNING pass cli_tuning = false
+  GhostConfig Config(const std::string &loop, bool cli_tuning = true) {
+    GhostConfig cfg;
+    cfg.graph_class = cli_class_;
+    cfg.tuned = false;
+    cfg.adapt = nullptr;
+    cfg.label = kernel_ + "/" + loop;
+    if (lead_lines_ > 0) {
+      adapts_.emplace_back(loop, std::unique_ptr<GhostAdapt>(
+                                     new GhostAdapt(lead_lines_)));
+      cfg.adapt = adapts_.back().second.get();
+    }
+    std::string source = class_source_;
+    double distance;
+    const TuningDB::Entry *e = db_.Lookup(kernel_, loop, fingerprint_,
+                                          &distance);
+    if (e != nullptr && distance > kMaxTuningDistance) {
+      std::ostringstream ss;
+      ss << source << " (nearest in " << db_.filename() << " at distance "
+         << distance << ")";
+      source = ss.str();
+    } else if (e != nullptr) {
+      cfg.graph_class = e->graph_class;
+      cfg.tuned = e->has_params;
+      if (e->has_params)
+        cfg.hyper_param = e->hyper_param;
+      std::ostringstream ss;
+      ss << db_.filename() << " (distance " << distance << ")";
+      source = ss.str();
+    }
+    #ifdef TUNING
+    if (cli_tuning) {
+      cfg.tuned = true;
+      cfg.hyper_param = cli_param_;
+      source = "command line";
+    }
+    #endif
+    std::cout << "Ghost " << kernel_ << "/" << loop << ": "
+              << GraphClassName(cfg.graph_class) << " helper";
+    if (cfg.tuned)
+      std::cout << ", sync frequency = " << cfg.hyper_param.sync_frequency
+                << ", skip offset = " << cfg.hyper_param.skip_offset
+                << ", serialize threshold = "
+                << cfg.hyper_param.serialize_threshold
+                << ", unserialize threshold = "
+                << cfg.hyper_param.unserialize_threshold;
+    std::cout << " from " << source;
+    if (cfg.adapt != nullptr)
+      std::cout << ", adapting to " << cfg.adapt->band_lo() << "-"
+                << cfg.adapt->band_hi() << " lines in flight";
+    std::cout << std::endl;
+    return cfg;
+  }
+
+  // hands the loop its adaptive controller and telemetry label, the config
+  // must outlive the loop
+  template <typename IterT>
+  static void Attach(GhostLoop<IterT> &ghost, const GhostConfig &cfg) {
+    ghost.set_label(cfg.label.c_str());
+    ghost.set_adaptive(cfg.adapt);
+  }
+
+  // where the adaptive loops ended up
+  void PrintAdapted() {
+    for (auto &a : adapts_)
+      a.second->Print(kernel_ + "/" + a.first);
+  }
+
+  const GraphFingerprint& fingerprint() const { return fingerprint_; }
+
+ private:
+  std::string kernel_;
+  HyperParam_PfT cli_param_;
+  GraphClass cli_class_ = kClassNone;
+  std::string class_source_;
+  int lead_lines_ = 0;
+  GraphFingerprint fingerprint_;
+  TuningDB db_;
+  std::vector<std::pair<std::string, std::unique_ptr<GhostAdapt>>> adapts_;
+};
+
+#endif  // GHOST_TUNING_H_
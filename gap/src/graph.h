@@ -7,9 +7,15 @@
 #include <algorithm>
 #include <cinttypes>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <type_traits>
+#include <vector>
 
+#include "page_alloc.h"
 #include "pvector.h"
 #include "util.h"
 
@@ -23,6 +29,13 @@ Simple container for graph in CSR format
  - Intended to be constructed by a Builder
  - To make weighted, set DestID_ template type to NodeWeight
  - MakeInverse parameter controls whether graph stores incoming edges
+ - Arrays come from PageNew() and follow the page and NUMA policies (-H, -N)
+ - If given storage, the neighbor arrays live in it (e.g. a mapped file) and
+   are released with it instead of PageDelete()
+ - The index layout is chosen at build time, the default is a pointer per
+   vertex (CSRPointerIndex), -DCOMPACT_INDEX selects CSRBlockIndex
+ - A reordered graph (-O) keeps its permutation, original_id() and
+   reordered_id() map vertex IDs between the two numberings
 */
 
 
@@ -89,24 +102,185 @@ struct EdgePair {
 };
 
 // SG = serialized graph, these types are for writing graph to file
+//  - NODEID64 builds (make NODEID64=1) use 64-bit vertex IDs for graphs past
+//    2^31 vertices, and serialize them as .sg64/.wsg64 instead of .sg/.wsg
+#ifdef NODEID64
+typedef int64_t SGID;
+#else
 typedef int32_t SGID;
+#endif
 typedef EdgePair<SGID> SGEdge;
 typedef int64_t SGOffset;
 
+// v2 serialized layout: this header fills the first page and every section
+// starts on a page boundary, so a mapping of the file is used in place
+//  - Sections (byte offsets, 0 if absent): out offsets (num_nodes+1 SGOffset),
+//    out neighbors, then in offsets and in neighbors if directed, then the
+//    original ID of every vertex (num_nodes SGID) if it was reordered (-O)
+//  - A v1 file starts with its directed bool, so the magic can't collide
+#define SG_V2_MAGIC "GAPSG\0v2"
+const SGOffset kSGPageBytes = 4096;
+
+struct SGHeaderV2 {
+  char magic[8];
+  uint32_t directed;
+  uint32_t dest_bytes;    // 4 for .sg, 8 for .wsg (.sg64 8, .wsg64 16)
+  SGOffset num_nodes;
+  SGOffset num_edges;     // edges stored per direction
+  SGOffset out_offsets, out_neighs;
+  SGOffset in_offsets, in_neighs;
+  SGOffset original_ids;
+  uint32_t id_bytes;      // 8 for .sg64/.wsg64, 4 (0 in older files) else
+  uint32_t reserved;
+};
+
+inline SGOffset SGPageAlign(SGOffset bytes) {
+  return (bytes + kSGPageBytes - 1) / kSGPageBytes * kSGPageBytes;
+}
+
+// ID bytes a serialized graph suffix stands for, 0 if it isn't one
+inline int SGSuffixIDBytes(const std::string &suffix) {
+  if (suffix == ".sg" || suffix == ".wsg")
+    return 4;
+  if (suffix == ".sg64" || suffix == ".wsg64")
+    return 8;
+  return 0;
+}
+
+
+
+/*
+Index of one CSR direction: where each vertex's neighbors start, vertex n's
+neighbors are [index[n], index[n+1]). Both layouts are built from the pointer
+array GenIndex() returns (which they take over) and are used alike by
+CSRGraph and its Neighborhood
+ - CSRPointerIndex: that pointer array, 8 B per vertex
+ - CSRBlockIndex:   a 64-bit base per kIndexBlock vertices plus a 32-bit
+                    offset from it per vertex, 4.125 B per vertex, so twice
+                    as much of the index stays cached and a helper's
+                    prefetch_begin() covers 16 vertices instead of 8
+*/
+
+template <class DestID_>
+class CSRPointerIndex {
+  DestID_** index_;
+
+ public:
+  CSRPointerIndex() : index_(nullptr) {}
+
+  CSRPointerIndex(DestID_** index, int64_t num_nodes) : index_(index) {}
+
+  DestID_* operator[](int64_t n) const { return index_[n]; }
+
+  // where n's entry lives, for prefetching it
+  const void* slot(int64_t n) const { return index_ + n; }
+
+  bool empty() const { return index_ == nullptr; }
+
+  void Free() {
+    PageDelete(index_);
+    index_ = nullptr;
+  }
+
+  void MoveToNode(int node) { PageAlloc::MoveToNode(index_, node); }
+
+  // same index on node, pointing into neighs (a copy of the neighbors)
+  CSRPointerIndex CopyOn(DestID_* neighs, int64_t num_nodes, int node) const {
+    DestID_** copy = static_cast<DestID_**>(
+        PageAlloc::Allocate((num_nodes+1) * sizeof(DestID_*), node));
+    #pragma omp parallel for schedule(static)
+    for (int64_t n = 0; n < num_nodes+1; n++)
+      copy[n] = neighs + (index_[n] - index_[0]);
+    return CSRPointerIndex(copy, num_nodes);
+  }
+};
+
+
+template <class DestID_>
+class CSRBlockIndex {
+  static const int kIndexBlockBits = 6;
+  static const int64_t kIndexBlock = 1 << kIndexBlockBits;
+
+  DestID_* neighs_;       // neighbors of vertex 0
+  SGOffset* bases_;       // per block, from neighs_
+  uint32_t* offsets_;     // per vertex, from its block's base
+
+ public:
+  CSRBlockIndex() : neighs_(nullptr), bases_(nullptr), offsets_(nullptr) {}
+
+  CSRBlockIndex(DestID_** index, int64_t num_nodes) {
+    int64_t num_blocks = num_nodes / kIndexBlock + 1;
+    neighs_ = index[0];
+    bases_ = PageNew<SGOffset>(num_blocks);
+    offsets_ = PageNew<uint32_t>(num_nodes+1);
+    bool overflow = false;
+    #pragma omp parallel for reduction(|| : overflow)
+    for (int64_t b = 0; b < num_blocks; b++) {
+      DestID_* base = index[b * kIndexBlock];
+      bases_[b] = base - neighs_;
+      int64_t last = std::min((b+1) * kIndexBlock, num_nodes+1);
+      for (int64_t n = b * kIndexBlock; n < last; n++) {
+        overflow = overflow || index[n] - base > UINT32_MAX;
+        offsets_[n] = index[n] - base;
+      }
+    }
+    if (overflow) {
+      std::cout << "Over 2^32 edges within " << kIndexBlock
+                << " vertices, rebuild without COMPACT_INDEX" << std::endl;
+      std::exit(-10);
+    }
+    PageDelete(index);
+  }
+
+  DestID_* operator[](int64_t n) const {
+    return neighs_ + bases_[n >> kIndexBlockBits] + offsets_[n];
+  }
+
+  const void* slot(int64_t n) const { return offsets_ + n; }
+
+  bool empty() const { return offsets_ == nullptr; }
+
+  void Free() {
+    PageDelete(bases_);
+    PageDelete(offsets_);
+    bases_ = nullptr;
+    offsets_ = nullptr;
+  }
+
+  void MoveToNode(int node) {
+    PageAlloc::MoveToNode(bases_, node);
+    PageAlloc::MoveToNode(offsets_, node);
+  }
+
+  CSRBlockIndex CopyOn(DestID_* neighs, int64_t num_nodes, int node) const {
+    CSRBlockIndex copy;
+    copy.neighs_ = neighs;
+    copy.bases_ = PageCopyToNode(bases_, num_nodes / kIndexBlock + 1, node);
+    copy.offsets_ = PageCopyToNode(offsets_, num_nodes+1, node);
+    return copy;
+  }
+};
+
 
 
 template <class NodeID_, class DestID_ = NodeID_, bool MakeInverse = true>
 class CSRGraph {
+ #ifdef COMPACT_INDEX
+  typedef CSRBlockIndex<DestID_> IndexT;
+ #else
+  typedef CSRPointerIndex<DestID_> IndexT;
+ #endif
+
   // Used for *non-negative* offsets within a neighborhood
   typedef std::make_unsigned<std::ptrdiff_t>::type OffsetT;
 
   // Used to access neighbors of vertex, basically sugar for iterators
   class Neighborhood {
     NodeID_ n_;
-    DestID_** g_index_;
+    IndexT g_index_;
     OffsetT start_offset_;
    public:
-    Neighborhood(NodeID_ n, DestID_** g_index, OffsetT start_offset) :
+    Neighborhood(NodeID_ n, const IndexT &g_index, OffsetT start_offset) :
         n_(n), g_index_(g_index), start_offset_(0) {
       OffsetT max_offset = end() - begin();
       start_offset_ = std::min(start_offset, max_offset);
@@ -114,54 +288,94 @@ class CSRGraph {
     typedef DestID_* iterator;
     iterator begin() { return g_index_[n_] + start_offset_; }
     iterator end()   { return g_index_[n_+1]; }
-    void prefetch_begin() { __builtin_prefetch((void*)(g_index_+n_)); }
-    void prefetch_end() { __builtin_prefetch((void*)(g_index_ + (n_+1))); }
+    void prefetch_begin() { __builtin_prefetch(g_index_.slot(n_)); }
+    void prefetch_end() { __builtin_prefetch(g_index_.slot(n_+1)); }
   };
 
   void ReleaseResources() {
-    if (out_index_ != nullptr)
-      delete[] out_index_;
-    if (out_neighbors_ != nullptr)
-      delete[] out_neighbors_;
+    if (!out_index_.empty())
+      out_index_.Free();
+    if (out_neighbors_ != nullptr && storage_ == nullptr)
+      PageDelete(out_neighbors_);
     if (directed_) {
-      if (in_index_ != nullptr)
-        delete[] in_index_;
-      if (in_neighbors_ != nullptr)
-        delete[] in_neighbors_;
+      if (!in_index_.empty())
+        in_index_.Free();
+      if (in_neighbors_ != nullptr && storage_ == nullptr)
+        PageDelete(in_neighbors_);
+    }
+    storage_.reset();
+    for (size_t node = 1; node < out_by_node_.size(); node++) {
+      out_by_node_[node].Free();
+      if (directed_)
+        in_by_node_[node].Free();
     }
+    for (DestID_ *neighs : replica_neighs_)
+      PageDelete(neighs);
+    out_by_node_.clear();
+    in_by_node_.clear();
+    replica_neighs_.clear();
+  }
+
+  const IndexT& out_index() const {
+    return out_by_node_.empty() ? out_index_
+                                : out_by_node_[NumaTopology::LocalNode()];
+  }
+
+  const IndexT& in_index() const {
+    return in_by_node_.empty() ? in_index_
+                               : in_by_node_[NumaTopology::LocalNode()];
+  }
+
+  // copy of index/neighs on node, the index pointing into the copy
+  IndexT ReplicateOn(const IndexT &index, int node) {
+    int64_t num_neighs = index[num_nodes_] - index[0];
+    DestID_ *neighs = PageCopyToNode(index[0], num_neighs, node);
+    replica_neighs_.push_back(neighs);
+    return index.CopyOn(neighs, num_nodes_, node);
   }
 
 
  public:
   CSRGraph() : directed_(false), num_nodes_(-1), num_edges_(-1),
-    out_index_(nullptr), out_neighbors_(nullptr),
-    in_index_(nullptr), in_neighbors_(nullptr) {}
+    out_neighbors_(nullptr), in_neighbors_(nullptr) {}
 
-  CSRGraph(int64_t num_nodes, DestID_** index, DestID_* neighs) :
+  CSRGraph(int64_t num_nodes, DestID_** index, DestID_* neighs,
+           std::shared_ptr<void> storage = nullptr) :
     directed_(false), num_nodes_(num_nodes),
-    out_index_(index), out_neighbors_(neighs),
-    in_index_(index), in_neighbors_(neighs) {
+    out_index_(index, num_nodes), out_neighbors_(neighs),
+    in_index_(out_index_), in_neighbors_(neighs), storage_(storage) {
       num_edges_ = (out_index_[num_nodes_] - out_index_[0]) / 2;
     }
 
   CSRGraph(int64_t num_nodes, DestID_** out_index, DestID_* out_neighs,
-        DestID_** in_index, DestID_* in_neighs) :
+        DestID_** in_index, DestID_* in_neighs,
+        std::shared_ptr<void> storage = nullptr) :
     directed_(true), num_nodes_(num_nodes),
-    out_index_(out_index), out_neighbors_(out_neighs),
-    in_index_(in_index), in_neighbors_(in_neighs) {
+    out_index_(out_index, num_nodes), out_neighbors_(out_neighs),
+    in_index_(in_index, num_nodes), in_neighbors_(in_neighs),
+    storage_(storage) {
       num_edges_ = out_index_[num_nodes_] - out_index_[0];
     }
 
   CSRGraph(CSRGraph&& other) : directed_(other.directed_),
     num_nodes_(other.num_nodes_), num_edges_(other.num_edges_),
     out_index_(other.out_index_), out_neighbors_(other.out_neighbors_),
-    in_index_(other.in_index_), in_neighbors_(other.in_neighbors_) {
+    in_index_(other.in_index_), in_neighbors_(other.in_neighbors_),
+    storage_(std::move(other.storage_)),
+    original_ids_(std::move(other.original_ids_)),
+    reordered_ids_(std::move(other.reordered_ids_)),
+    out_by_node_(std::move(other.out_by_node_)),
+    in_by_node_(std::move(other.in_by_node_)),
+    replica_neighs_(std::move(other.replica_neighs_)) {
       other.num_edges_ = -1;
       other.num_nodes_ = -1;
-      other.out_index_ = nullptr;
+      other.out_index_ = IndexT();
       other.out_neighbors_ = nullptr;
-      other.in_index_ = nullptr;
+      other.in_index_ = IndexT();
       other.in_neighbors_ = nullptr;
+      other.out_by_node_.clear();
+      other.in_by_node_.clear();
+      other.replica_neighs_.clear();
   }
 
   ~CSRGraph() {
@@ -178,11 +392,20 @@ class CSRGraph {
       out_neighbors_ = other.out_neighbors_;
       in_index_ = other.in_index_;
       in_neighbors_ = other.in_neighbors_;
+      storage_ = std::move(other.storage_);
+      original_ids_ = std::move(other.original_ids_);
+      reordered_ids_ = std::move(other.reordered_ids_);
+      out_by_node_ = std::move(other.out_by_node_);
+      in_by_node_ = std::move(other.in_by_node_);
+      replica_neighs_ = std::move(other.replica_neighs_);
+      other.out_by_node_.clear();
+      other.in_by_node_.clear();
+      other.replica_neighs_.clear();
       other.num_edges_ = -1;
       other.num_nodes_ = -1;
-      other.out_index_ = nullptr;
+      other.out_index_ = IndexT();
       other.out_neighbors_ = nullptr;
-      other.in_index_ = nullptr;
+      other.in_index_ = IndexT();
       other.in_neighbors_ = nullptr;
     }
     return *this;
@@ -214,12 +437,12 @@ class CSRGraph {
   }
 
   Neighborhood out_neigh(NodeID_ n, OffsetT start_offset = 0) const {
-    return Neighborhood(n, out_index_, start_offset);
+    return Neighborhood(n, out_index(), start_offset);
   }
 
   Neighborhood in_neigh(NodeID_ n, OffsetT start_offset = 0) const {
     static_assert(MakeInverse, "Graph inversion disabled but reading inverse");
-    return Neighborhood(n, in_index_, start_offset);
+    return Neighborhood(n, in_index(), start_offset);
   }
 
   void PrintStats() const {
@@ -242,8 +465,12 @@ class CSRGraph {
   }
 
   static DestID_** GenIndex(const pvector<SGOffset> &offsets, DestID_* neighs) {
-    NodeID_ length = offsets.size();
-    DestID_** index = new DestID_*[length];
+    return GenIndex(offsets.data(), offsets.size(), neighs);
+  }
+
+  static DestID_** GenIndex(const SGOffset* offsets, NodeID_ length,
+                            DestID_* neighs) {
+    DestID_** index = PageNew<DestID_*>(length);
     #pragma omp parallel for
     for (NodeID_ n=0; n < length; n++)
       index[n] = neighs + offsets[n];
@@ -260,6 +487,53 @@ class CSRGraph {
     return offsets;
   }
 
+  // one read-only copy of the CSR per NUMA node (-N replicate), node 0
+  // keeps the original, moved there if it is a mapped block; neighborhoods
+  // then come from the copy on the calling thread's node
+  void Replicate() {
+    int nodes = NumaTopology::Get().nodes();
+    if (nodes < 2 || !out_by_node_.empty() || num_nodes_ < 0)
+      return;
+    out_index_.MoveToNode(0);
+    if (storage_ == nullptr)
+      PageAlloc::MoveToNode(out_neighbors_, 0);
+    out_by_node_.push_back(out_index_);
+    if (directed_) {
+      in_index_.MoveToNode(0);
+      if (storage_ == nullptr)
+        PageAlloc::MoveToNode(in_neighbors_, 0);
+      in_by_node_.push_back(in_index_);
+    }
+    for (int node = 1; node < nodes; node++) {
+      out_by_node_.push_back(ReplicateOn(out_index_, node));
+      if (directed_)
+        in_by_node_.push_back(ReplicateOn(in_index_, node));
+    }
+    if (!directed_)
+      in_by_node_ = out_by_node_;
+  }
+
+  // records that vertex n was vertex original_ids[n] before reordering
+  void SetOrder(pvector<NodeID_> &&original_ids) {
+    original_ids_ = std::move(original_ids);
+    reordered_ids_ = pvector<NodeID_>(num_nodes_);
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < num_nodes_; n++)
+      reordered_ids_[original_ids_[n]] = n;
+  }
+
+  bool reordered() const {
+    return original_ids_.size() != 0;
+  }
+
+  NodeID_ original_id(NodeID_ n) const {
+    return reordered() ? original_ids_[n] : n;
+  }
+
+  NodeID_ reordered_id(NodeID_ original) const {
+    return reordered() ? reordered_ids_[original] : original;
+  }
+
   Range<NodeID_> vertices() const {
     return Range<NodeID_>(num_nodes());
   }
@@ -268,10 +542,16 @@ class CSRGraph {
   bool directed_;
   int64_t num_nodes_;
   int64_t num_edges_;
-  DestID_** out_index_;
+  IndexT    out_index_;
   DestID_*  out_neighbors_;
-  DestID_** in_index_;
+  IndexT    in_index_;
   DestID_*  in_neighbors_;
+  std::shared_ptr<void> storage_;
+  pvector<NodeID_> original_ids_;     // empty unless reordered
+  pvector<NodeID_> reordered_ids_;
+  std::vector<IndexT> out_by_node_;   // per NUMA node, if replicated
+  std::vector<IndexT> in_by_node_;
+  std::vector<DestID_*> replica_neighs_;
 };
 
 #endif  // GRAPH_H_
@@ -0,0 +1,151 @@
+#ifndef INTERSECT_H_
+#define INTERSECT_H_
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+
+#include "isa.h"
+
+
+/*
+GAP Benchmark Suite
+Class:  IntersectCount
+
+Counts the common elements of two sorted lists of distinct IDs (neighbor
+lists), for tc's inner loop
+ - Lists more than kGallopRatio times apart in length gallop: each element
+   of the short one is found in the long one by exponential then binary
+   search from where the previous one landed, O(short * log(long / short))
+ - Otherwise they are merged, with AVX2 or AVX-512 (see isa.h) a block of 8
+   or 16 from each list at a time: every pair is compared by rotating one
+   block through all lanes, and the block with the smaller last element is
+   consumed (both if equal); what's left of the shorter side is merged scalar
+ - The vector merges are for 32-bit IDs, IntersectISA() turns them off for
+   NODEID64 builds
+*/
+
+
+const size_t kGallopRatio = 32;
+
+template <typename NodeID_>
+size_t MergeCount(const NodeID_ *a, size_t na, const NodeID_ *b, size_t nb) {
+  size_t i = 0, j = 0, count = 0;
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      count++;
+      i++;
+      j++;
+    }
+  }
+  return count;
+}
+
+template <typename NodeID_>
+size_t GallopCount(const NodeID_ *small, size_t ns, const NodeID_ *large,
+                   size_t nl) {
+  size_t count = 0, lo = 0;
+  for (size_t i = 0; i < ns && lo < nl; i++) {
+    NodeID_ x = small[i];
+    size_t bound = 1;
+    while (lo + bound < nl && large[lo + bound] < x)
+      bound *= 2;
+    const NodeID_ *p = std::lower_bound(large + lo + bound / 2,
+                                        large + std::min(lo + bound + 1, nl),
+                                        x);
+    lo = p - large;
+    if (lo < nl && *p == x) {
+      count++;
+      lo++;
+    }
+  }
+  return count;
+}
+
+#ifdef GAP_X86_SIMD
+__attribute__((target("avx2")))
+inline size_t MergeCountAVX2(const int32_t *a, size_t na, const int32_t *b,
+                             size_t nb) {
+  const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+  size_t i = 0, j = 0, count = 0;
+  while (i + 8 <= na && j + 8 <= nb) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+    __m256i match = _mm256_cmpeq_epi32(va, vb);
+    for (int k = 1; k < 8; k++) {
+      vb = _mm256_permutevar8x32_epi32(vb, rotate);
+      match = _mm256_or_si256(match, _mm256_cmpeq_epi32(va, vb));
+    }
+    count += __builtin_popcount(
+        _mm256_movemask_ps(_mm256_castsi256_ps(match)));
+    int32_t a_last = a[i + 7], b_last = b[j + 7];
+    if (a_last <= b_last)
+      i += 8;
+    if (b_last <= a_last)
+      j += 8;
+  }
+  return count + MergeCount(a + i, na - i, b + j, nb - j);
+}
+
+__attribute__((target("avx512f")))
+inline size_t MergeCountAVX512(const int32_t *a, size_t na, const int32_t *b,
+                               size_t nb) {
+  size_t i = 0, j = 0, count = 0;
+  while (i + 16 <= na && j + 16 <= nb) {
+    __m512i va = _mm512_loadu_si512(a + i);
+    __m512i vb = _mm512_loadu_si512(b + j);
+    __mmask16 match = _mm512_cmpeq_epi32_mask(va, vb);
+    for (int k = 1; k < 16; k++) {
+      vb = _mm512_alignr_epi32(vb, vb, 1);
+      match |= _mm512_cmpeq_epi32_mask(va, vb);
+    }
+    count += __builtin_popcount(match);
+    int32_t a_last = a[i + 15], b_last = b[j + 15];
+    if (a_last <= b_last)
+      i += 16;
+    if (b_last <= a_last)
+      j += 16;
+  }
+  return count + MergeCountAVX2(a + i, na - i, b + j, nb - j);
+}
+#endif  // GAP_X86_SIMD
+
+// the merge IntersectCount will use, scalar for 64-bit IDs
+inline VectorISA IntersectISA(VectorISA isa) {
+  #ifdef NODEID64
+  return kISAScalar;
+  #else
+  return isa;
+  #endif
+}
+
+template <typename NodeID_>
+size_t IntersectCount(VectorISA isa, const NodeID_ *a, size_t na,
+                      const NodeID_ *b, size_t nb) {
+  if (nb > kGallopRatio * na)
+    return GallopCount(a, na, b, nb);
+  if (na > kGallopRatio * nb)
+    return GallopCount(b, nb, a, na);
+  return MergeCount(a, na, b, nb);
+}
+
+inline size_t IntersectCount(VectorISA isa, const int32_t *a, size_t na,
+                             const int32_t *b, size_t nb) {
+  if (nb > kGallopRatio * na)
+    return GallopCount(a, na, b, nb);
+  if (na > kGallopRatio * nb)
+    return GallopCount(b, nb, a, na);
+  #ifdef GAP_X86_SIMD
+  if (isa == kISAAVX512)
+    return MergeCountAVX512(a, na, b, nb);
+  if (isa == kISAAVX2)
+    return MergeCountAVX2(a, na, b, nb);
+  #endif
+  return MergeCount(a, na, b, nb);
+}
+
+#endif  // INTERSECT_H_
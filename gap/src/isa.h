@@ -0,0 +1,66 @@
+#ifndef ISA_H_
+#define ISA_H_
+
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define GAP_X86_SIMD
+#endif
+
+
+/*
+GAP Benchmark Suite
+Class:  VectorISA
+
+Vector instruction sets that kernels with hand vectorized loops pick from at
+runtime, so one build runs the widest path the CPU has
+ - DetectISA() asks CPUID once (through __builtin_cpu_supports, which also
+   checks the OS saves the wider registers); avx512 means F plus VL, so
+   those paths can mix in masked 256-bit ops
+ - -I caps the choice (e.g. -I scalar for the baseline in the same binary),
+   a request the CPU can't run falls back to the widest it can
+ - The vectorized functions are compiled with target attributes, so the rest
+   of the build keeps its baseline ISA
+*/
+
+
+enum VectorISA { kISAScalar, kISAAVX2, kISAAVX512, kISAAuto };
+
+inline const char* ISAName(VectorISA isa) {
+  const char *names[] = {"scalar", "avx2", "avx512", "auto"};
+  return names[isa];
+}
+
+inline bool ParseISA(const std::string &name, VectorISA *isa) {
+  for (int i = kISAScalar; i <= kISAAuto; i++) {
+    if (name == ISAName(static_cast<VectorISA>(i))) {
+      *isa = static_cast<VectorISA>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+inline VectorISA DetectISA() {
+  static const VectorISA detected = [] () {
+    #ifdef GAP_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512vl"))
+      return kISAAVX512;
+    if (__builtin_cpu_supports("avx2"))
+      return kISAAVX2;
+    #endif
+    return kISAScalar;
+  }();
+  return detected;
+}
+
+// the requested ISA if the CPU runs it, otherwise the widest it does
+inline VectorISA ResolveISA(VectorISA requested) {
+  VectorISA detected = DetectISA();
+  return requested < detected ? requested : detected;
+}
+
+#endif  // ISA_H_
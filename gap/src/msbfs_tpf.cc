@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <cinttypes>
+#include <iostream>
+#include <vector>
+
+#include "omp.h"
+
+#include "benchmark.h"
+#include "builder.h"
+#include "command_line.h"
+#include "graph.h"
+#include "isa.h"
+#include "platform_atomics.h"
+#include "pvector.h"
+#include "timer.h"
+#include "pf_support.h"
+#include "ghost_tuning.h"
+
+
+/*
+GAP Benchmark Suite
+Kernel: Multi-Source Breadth-First Search (MS-BFS)
+
+Will return, for each of a batch of sources, how many vertices its BFS
+reaches and the sum of their depths (the closeness numerator)
+
+This implementation runs a batch of 64, 128 or 256 BFSs (-b) at once in the
+style of MS-BFS [1]: every vertex holds one bit per source in its seen, visit
+(frontier) and next sets, so a single pass over an adjacency list advances
+every traversal that has it in its frontier. Each level is either a top-down
+step (push visit[u] into next[v] of the out-neighbors, atomic OR) or, once
+the frontier's edges pass m / alpha, a bottom-up step (OR the visit sets of
+the in-neighbors of every vertex some source hasn't seen yet, no atomics).
+ - Sources come from SourcePicker, batch_size per trial
+ - A source set is W 64-bit words, the word loops are left to the compiler
+   to vectorize; with -b256 the pull and push (the per-edge set ops) have
+   AVX2 versions picked at runtime (-I, see isa.h), one 256-bit op per set,
+   and the push skips the atomic OR when nothing is new
+ - HTPF: a ghost helper runs ahead of the main loop of each step and
+   prefetches the sets the step reads at random: visit[] of the in-neighbors
+   (bottom-up) or next[] of the out-neighbors (top-down)
+
+[1] Manuel Then, Moritz Kaufmann, Fernando Chirigati, Tuan-Anh Hoang-Vu,
+    Kien Pham, Alfons Kemper, Thomas Neumann, and Huy T. Vo. "The More the
+    Merrier: Efficient Multi-Source Graph Traversal." VLDB, 2014.
+*/
+
+
+// #define HTPF
+
+using namespace std;
+
+HyperParam_PfT hyper_param;
+GhostTuning ghost_tuning;
+GhostConfig ghost_bu;
+GhostConfig ghost_td;
+
+
+template <int W>
+struct SourceSet {
+  uint64_t words[W];
+
+  bool any() const {
+    uint64_t acc = 0;
+    for (int i=0; i < W; i++)
+      acc |= words[i];
+    return acc != 0;
+  }
+
+  bool full() const {
+    uint64_t acc = ~0ul;
+    for (int i=0; i < W; i++)
+      acc &= words[i];
+    return acc == ~0ul;
+  }
+};
+
+template <int W>
+SourceSet<W> EmptySet() {
+  SourceSet<W> s;
+  for (int i=0; i < W; i++)
+    s.words[i] = 0;
+  return s;
+}
+
+// dest |= add one word at a time, for the parallel top-down step
+template <int W>
+void AtomicOr(SourceSet<W> &dest, const SourceSet<W> &add) {
+  for (int i=0; i < W; i++) {
+    if (add.words[i] == 0)
+      continue;
+    uint64_t old_val, new_val;
+    do {
+      old_val = dest.words[i];
+      new_val = old_val | add.words[i];
+    } while (old_val != new_val &&
+             !compare_and_swap(dest.words[i], old_val, new_val));
+  }
+}
+
+
+// next = OR of visit[] over the in-neighbors, minus seen (bottom-up pull)
+template <int W, typename NeighborhoodT>
+void PullScalar(NeighborhoodT in, const SourceSet<W> *visit,
+                const SourceSet<W> &seen, SourceSet<W> &next) {
+  SourceSet<W> acc = EmptySet<W>();
+  for (NodeID u : in) {
+    ghost_load(&visit[u]);
+    for (int i=0; i < W; i++)
+      acc.words[i] |= visit[u].words[i];
+  }
+  for (int i=0; i < W; i++)
+    next.words[i] = acc.words[i] & ~seen.words[i];
+}
+
+// next[v] |= visit minus seen[v] for each out-neighbor v (top-down push)
+template <int W, typename NeighborhoodT>
+void PushScalar(NeighborhoodT out, const SourceSet<W> &visit,
+                const SourceSet<W> *seen, SourceSet<W> *next) {
+  for (NodeID v : out) {
+    ghost_load(&next[v]);
+    SourceSet<W> add;
+    for (int i=0; i < W; i++)
+      add.words[i] = visit.words[i] & ~seen[v].words[i];
+    AtomicOr(next[v], add);
+  }
+}
+
+#ifdef GAP_X86_SIMD
+__attribute__((target("avx2")))
+inline __m256i LoadSet(const SourceSet<4> &s) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s.words));
+}
+
+template <typename NeighborhoodT>
+__attribute__((target("avx2")))
+void PullAVX2(NeighborhoodT in, const SourceSet<4> *visit,
+              const SourceSet<4> &seen, SourceSet<4> &next) {
+  __m256i acc = _mm256_setzero_si256();
+  for (NodeID u : in) {
+    ghost_load(&visit[u]);
+    acc = _mm256_or_si256(acc, LoadSet(visit[u]));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(next.words),
+                      _mm256_andnot_si256(LoadSet(seen), acc));
+}
+
+template <typename NeighborhoodT>
+__attribute__((target("avx2")))
+void PushAVX2(NeighborhoodT out, const SourceSet<4> &visit,
+              const SourceSet<4> *seen, SourceSet<4> *next) {
+  __m256i vis = LoadSet(visit);
+  for (NodeID v : out) {
+    ghost_load(&next[v]);
+    __m256i fresh = _mm256_andnot_si256(LoadSet(seen[v]), vis);
+    if (_mm256_testz_si256(fresh, fresh))
+      continue;
+    SourceSet<4> add;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(add.words), fresh);
+    AtomicOr(next[v], add);
+  }
+}
+#endif  // GAP_X86_SIMD
+
+template <int W, typename NeighborhoodT>
+void Pull(VectorISA isa, NeighborhoodT in, const SourceSet<W> *visit,
+          const SourceSet<W> &seen, SourceSet<W> &next) {
+  PullScalar(in, visit, seen, next);
+}
+
+template <typename NeighborhoodT>
+void Pull(VectorISA isa, NeighborhoodT in, const SourceSet<4> *visit,
+          const SourceSet<4> &seen, SourceSet<4> &next) {
+  #ifdef GAP_X86_SIMD
+  if (isa != kISAScalar)
+    return PullAVX2(in, visit, seen, next);
+  #endif
+  PullScalar(in, visit, seen, next);
+}
+
+template <int W, typename NeighborhoodT>
+void Push(VectorISA isa, NeighborhoodT out, const SourceSet<W> &visit,
+          const SourceSet<W> *seen, SourceSet<W> *next) {
+  PushScalar(out, visit, seen, next);
+}
+
+template <typename NeighborhoodT>
+void Push(VectorISA isa, NeighborhoodT out, const SourceSet<4> &visit,
+          const SourceSet<4> *seen, SourceSet<4> *next) {
+  #ifdef GAP_X86_SIMD
+  if (isa != kISAScalar)
+    return PushAVX2(out, visit, seen, next);
+  #endif
+  PushScalar(out, visit, seen, next);
+}
+
+// the ISA of the set ops, AVX2 only has a version for the four-word sets
+inline VectorISA SetISA(int batch_size, VectorISA isa) {
+  return batch_size == 256 && isa != kISAScalar ? kISAAVX2 : kISAScalar;
+}
+
+
+struct MultiSourceResult {
+  vector<NodeID> sources;
+  vector<int64_t> reached;      // including the source itself
+  vector<int64_t> depth_sum;
+};
+
+
+HyperParam_PfT HyperParamBU() {
+  HyperParam_PfT hyperparam = {.sync_frequency = 1, .skip_offset = 16,
+                               .serialize_threshold = 64,
+                               .unserialize_threshold = 48};
+  return ghost_bu.Or(hyperparam);
+}
+
+HyperParam_PfT HyperParamTD() {
+  HyperParam_PfT hyperparam = {.sync_frequency = 4, .skip_offset = 32,
+                               .serialize_threshold = 128,
+                               .unserialize_threshold = 96};
+  return ghost_td.Or(hyperparam);
+}
+
+
+template <int W>
+void BUStep(const Graph &g, const pvector<SourceSet<W>> &seen,
+            const pvector<SourceSet<W>> &visit, pvector<SourceSet<W>> &next,
+            VectorISA isa) {
+  #ifdef HTPF
+  GhostLoop<NodeID> ghost(0, g.num_nodes(), HyperParamBU());
+  GhostTuning::Attach(ghost, ghost_bu);
+  const Graph *gp = &g;
+  const SourceSet<W> *sp = seen.data(), *vp = visit.data();
+  if (ghost_bu.enabled())
+    ghost.Launch([gp, sp, vp] (NodeID v, GhostLoop<NodeID> &loop) {
+      if (!sp[v].full())
+        for (NodeID u : gp->in_neigh(v))
+          ghost_prefetch(&vp[u]);
+    });
+  #endif
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (NodeID v=0; v < g.num_nodes(); v++) {
+    #ifdef HTPF
+    ghost.Publish(v);
+    #endif
+    if (seen[v].full())
+      continue;
+    Pull(isa, g.in_neigh(v), visit.data(), seen[v], next[v]);
+  }
+  #ifdef HTPF
+  ghost.Join();
+  #endif
+}
+
+
+template <int W>
+void TDStep(const Graph &g, const pvector<SourceSet<W>> &seen,
+            const pvector<SourceSet<W>> &visit, pvector<SourceSet<W>> &next,
+            VectorISA isa) {
+  #ifdef HTPF
+  GhostLoop<NodeID> ghost(0, g.num_nodes(), HyperParamTD());
+  GhostTuning::Attach(ghost, ghost_td);
+  const Graph *gp = &g;
+  const SourceSet<W> *vp = visit.data(), *np = next.data();
+  if (ghost_td.enabled())
+    ghost.Launch([gp, vp, np] (NodeID u, GhostLoop<NodeID> &loop) {
+      if (vp[u].any())
+        for (NodeID v : gp->out_neigh(u))
+          ghost_prefetch(&np[v]);
+    });
+  #endif
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (NodeID u=0; u < g.num_nodes(); u++) {
+    #ifdef HTPF
+    ghost.Publish(u);
+    #endif
+    if (!visit[u].any())
+      continue;
+    Push(isa, g.out_neigh(u), visit[u], seen.data(), next.data());
+  }
+  #ifdef HTPF
+  ghost.Join();
+  #endif
+}
+
+
+// visit <- next minus seen, seen |= visit, next <- 0; tallies the newly
+// reached vertices per source and returns the out-degree of the frontier
+template <int W>
+int64_t Advance(const Graph &g, int depth, pvector<SourceSet<W>> &seen,
+                pvector<SourceSet<W>> &visit, pvector<SourceSet<W>> &next,
+                MultiSourceResult &result) {
+  int64_t frontier_edges = 0;
+  #pragma omp parallel reduction(+ : frontier_edges)
+  {
+    vector<int64_t> reached(64 * W, 0);
+    #pragma omp for schedule(dynamic, 1024) nowait
+    for (NodeID v=0; v < g.num_nodes(); v++) {
+      bool active = false;
+      for (int i=0; i < W; i++) {
+        uint64_t fresh = next[v].words[i] & ~seen[v].words[i];
+        visit[v].words[i] = fresh;
+        seen[v].words[i] |= fresh;
+        next[v].words[i] = 0;
+        active |= fresh != 0;
+        while (fresh != 0) {
+          reached[64 * i + __builtin_ctzll(fresh)]++;
+          fresh &= fresh - 1;
+        }
+      }
+      if (active)
+        frontier_edges += g.out_degree(v);
+    }
+    #pragma omp critical
+    for (int b=0; b < 64 * W; b++) {
+      result.reached[b] += reached[b];
+      result.depth_sum[b] += reached[b] * depth;
+    }
+  }
+  return frontier_edges;
+}
+
+
+template <int W>
+MultiSourceResult MSBFS(const Graph &g, const vector<NodeID> &sources,
+                        bool logging_enabled = false, int alpha = 15,
+                        VectorISA isa = kISAScalar) {
+  const int kBatch = 64 * W;
+  MultiSourceResult result;
+  result.sources = sources;
+  result.reached.assign(kBatch, 1);
+  result.depth_sum.assign(kBatch, 0);
+  pvector<SourceSet<W>> seen(g.num_nodes()), visit(g.num_nodes()),
+                        next(g.num_nodes());
+  #pragma omp parallel for
+  for (NodeID n=0; n < g.num_nodes(); n++) {
+    seen[n] = EmptySet<W>();
+    visit[n] = EmptySet<W>();
+    next[n] = EmptySet<W>();
+  }
+  int64_t frontier_edges = 0;
+  for (int b=0; b < kBatch; b++) {
+    NodeID s = sources[b];
+    uint64_t bit = 1ul << (b % 64);
+    if (!visit[s].any())
+      frontier_edges += g.out_degree(s);
+    seen[s].words[b / 64] |= bit;
+    visit[s].words[b / 64] |= bit;
+  }
+  Timer t;
+  for (int depth=1; frontier_edges != 0; depth++) {
+    t.Start();
+    bool bottom_up = frontier_edges > g.num_edges_directed() / alpha;
+    if (bottom_up)
+      BUStep(g, seen, visit, next, isa);
+    else
+      TDStep(g, seen, visit, next, isa);
+    frontier_edges = Advance(g, depth, seen, visit, next, result);
+    t.Stop();
+    if (logging_enabled)
+      PrintStep(bottom_up ? "bu" : "td", t.Seconds(), frontier_edges);
+  }
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted();
+  #endif
+  return result;
+}
+
+
+void PrintMSBFSStats(const Graph &g, const MultiSourceResult &result) {
+  int64_t total_reached = 0, total_depth = 0;
+  for (size_t b=0; b < result.sources.size(); b++) {
+    total_reached += result.reached[b];
+    total_depth += result.depth_sum[b];
+  }
+  cout << "MS-BFS from " << result.sources.size() << " sources reached ";
+  cout << total_reached / result.sources.size() << " nodes on average, ";
+  cout << "mean depth " << static_cast<double>(total_depth) / total_reached;
+  cout << endl;
+}
+
+
+// Verifier does a serial BFS from each source of the batch and compares
+// the number of vertices it reaches and the sum of their depths
+bool MSBFSVerifier(const Graph &g, const MultiSourceResult &result) {
+  pvector<int> depth(g.num_nodes());
+  vector<NodeID> to_visit;
+  to_visit.reserve(g.num_nodes());
+  for (size_t b=0; b < result.sources.size(); b++) {
+    NodeID source = result.sources[b];
+    depth.fill(-1);
+    depth[source] = 0;
+    to_visit.clear();
+    to_visit.push_back(source);
+    int64_t depth_sum = 0;
+    for (size_t i=0; i < to_visit.size(); i++) {
+      NodeID u = to_visit[i];
+      depth_sum += depth[u];
+      for (NodeID v : g.out_neigh(u)) {
+        if (depth[v] == -1) {
+          depth[v] = depth[u] + 1;
+          to_visit.push_back(v);
+        }
+      }
+    }
+    if (static_cast<int64_t>(to_visit.size()) != result.reached[b] ||
+        depth_sum != result.depth_sum[b]) {
+      cout << "Source " << source << " reached " << result.reached[b]
+           << " (depth sum " << result.depth_sum[b] << ") instead of "
+           << to_visit.size() << " (" << depth_sum << ")" << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+
+template <int W>
+void RunBenchmark(const CLMultiSource &cli, const Graph &g) {
+  SourcePicker<Graph> sp(g, cli.start_vertex());
+  VectorISA isa = SetISA(64 * W, cli.vector_isa());
+  cout << "Set ops: " << ISAName(isa) << endl;
+  auto MSBFSBound = [&sp, &cli, isa] (const Graph &g) {
+    vector<NodeID> sources(64 * W);
+    for (NodeID &s : sources)
+      s = sp.PickNext();
+    return MSBFS<W>(g, sources, cli.logging_en(), 15, isa);
+  };
+  BenchmarkKernel(cli, g, MSBFSBound, PrintMSBFSStats, MSBFSVerifier);
+}
+
+
+int main(int argc, char* argv[]) {
+  CLMultiSource cli(argc, argv, "multi-source breadth-first search");
+  if (!cli.ParseArgs())
+    return -1;
+  hyper_param.sync_frequency = cli.sync_frequency();
+  hyper_param.skip_offset = cli.skip_offset();
+  hyper_param.serialize_threshold = cli.serialize_threshold();
+  hyper_param.unserialize_threshold =
+      cli.serialize_threshold() > cli.unserialize_threshold() ?
+      cli.serialize_threshold() - cli.unserialize_threshold() : 0;
+  Builder b(cli);
+  Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("msbfs", g, cli, hyper_param);
+  ghost_bu = ghost_tuning.Config("bu");
+  ghost_td = ghost_tuning.Config("td");
+  #endif
+  switch (cli.batch_size()) {
+    case 64:  RunBenchmark<1>(cli, g); break;
+    case 128: RunBenchmark<2>(cli, g); break;
+    case 256: RunBenchmark<4>(cli, g); break;
+  }
+  return 0;
+}
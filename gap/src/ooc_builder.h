@@ -0,0 +1,345 @@
+#ifndef OOC_BUILDER_H_
+#define OOC_BUILDER_H_
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "command_line.h"
+#include "graph.h"
+#include "platform_atomics.h"
+#include "pvector.h"
+#include "reader.h"
+#include "timer.h"
+#include "util.h"
+
+
+/*
+GAP Benchmark Suite
+Class:  OutOfCoreBuilder
+
+Builds a v2 serialized graph (.sg/.wsg) straight from a text edge list with
+memory bounded by a budget (converter -M <MB>), for graphs whose EdgeList,
+CSR and inverse don't fit in memory together
+ - Pass 1 parses the input window by window and counts raw degrees
+ - Vertices are split into ranges whose raw neighbors fit half the budget
+ - Pass 2 parses the input again and appends every edge to the run file of
+   its source's range, its inverse to the inverse runs if directed
+ - Each range is then bucketed by source and squished like SquishCSR
+   (sorted, deduplicated, self loops removed), and its offsets and
+   neighbors are written to their place in the output; the inverse
+   sections follow once the out sections fix where they start
+ - The raw degrees (4 B per vertex and direction) are held throughout
+ - Runs are written next to the output (<out>.out<i>, <out>.in<i>) and
+   removed once their range is written
+Random weights (-w on an unweighted input) need the whole EdgeList, so they
+are not supported out of core.
+*/
+
+
+template <typename NodeID_, typename DestID_ = NodeID_,
+          typename WeightT_ = NodeID_>
+class OutOfCoreBuilder {
+  typedef EdgePair<NodeID_, DestID_> Edge;
+  typedef pvector<Edge> EdgeList;
+  typedef Reader<NodeID_, DestID_, WeightT_> ReaderT;
+  typedef typename ReaderT::TextFormat TextFormat;
+
+  // vertex ranges and their run files
+  struct Runs {
+    std::vector<NodeID_> bounds;
+    std::vector<FILE*> files;
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<char[]>> buffers;
+  };
+
+  const CLConvert &cli_;
+  size_t budget_;
+  bool symmetrize_;
+  ReaderT reader_;
+  TextFormat format_;
+  bool weighted_, symmetric_;
+  size_t start_;
+  int64_t num_nodes_ = 0;
+  std::vector<NodeID_> out_degrees_, in_degrees_;   // raw, before squishing
+  int fd_ = -1;
+
+ public:
+  explicit OutOfCoreBuilder(const CLConvert &cli)
+      : cli_(cli), budget_(cli.mem_budget()), symmetrize_(cli.symmetrize()),
+        reader_(cli.filename()) {
+    if (cli_.filename() == "" || !cli_.out_sg() || cli_.out_sg_v1()) {
+      std::cout << "Out-of-core building (-M) needs an edge list file (-f) "
+                << "and a v2 serialized output (-b)" << std::endl;
+      std::exit(-12);
+    }
+    start_ = reader_.TextLayout(format_, weighted_, symmetric_);
+    if (!std::is_same<NodeID_, DestID_>::value && !weighted_) {
+      std::cout << "Out-of-core building (-M) can't add random weights to "
+                << "an unweighted input" << std::endl;
+      std::exit(-12);
+    }
+  }
+
+  void Build() {
+    Timer t;
+    t.Start();
+    CountDegrees();
+    Runs out_runs = OpenRuns(out_degrees_, ".out");
+    Runs in_runs;
+    if (!symmetrize_)
+      in_runs = OpenRuns(in_degrees_, ".in");
+    Spill(out_runs, in_runs);
+    t.Stop();
+    PrintTime("Spill Time", t.Seconds());
+    t.Start();
+    fd_ = open(cli_.out_filename().c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+               0644);
+    if (fd_ < 0) {
+      std::cout << "Couldn't write to file " << cli_.out_filename()
+                << std::endl;
+      std::exit(-5);
+    }
+    SGHeaderV2 header = {};
+    std::copy(SG_V2_MAGIC, SG_V2_MAGIC + 8, header.magic);
+    header.directed = !symmetrize_;
+    header.dest_bytes = sizeof(DestID_);
+    header.id_bytes = sizeof(NodeID_);
+    header.num_nodes = num_nodes_;
+    SGOffset index_bytes = (num_nodes_ + 1) * sizeof(SGOffset);
+    header.out_offsets = kSGPageBytes;
+    header.out_neighs = header.out_offsets + SGPageAlign(index_bytes);
+    header.num_edges = BuildSection(out_runs, out_degrees_, header.out_offsets,
+                                    header.out_neighs);
+    SGOffset end = header.out_neighs + header.num_edges * sizeof(DestID_);
+    if (header.directed) {
+      header.in_offsets = header.out_neighs +
+                          SGPageAlign(header.num_edges * sizeof(DestID_));
+      header.in_neighs = header.in_offsets + SGPageAlign(index_bytes);
+      SGOffset in_edges = BuildSection(in_runs, in_degrees_,
+                                       header.in_offsets, header.in_neighs);
+      end = header.in_neighs + in_edges * sizeof(DestID_);
+    }
+    WriteAt(&header, sizeof(header), 0);
+    if (ftruncate(fd_, end) != 0) {
+      std::cout << "Couldn't write to file " << cli_.out_filename()
+                << std::endl;
+      std::exit(-5);
+    }
+    close(fd_);
+    t.Stop();
+    PrintTime("Build Time", t.Seconds());
+    int64_t num_edges = header.directed ? header.num_edges
+                                        : header.num_edges / 2;
+    std::cout << "Graph has " << num_nodes_ << " nodes and " << num_edges
+              << " " << (header.directed ? "" : "un")
+              << "directed edges for degree: " << num_edges / num_nodes_
+              << std::endl;
+  }
+
+ private:
+  static DestID_ GetSource(EdgePair<NodeID_, NodeID_> e) {
+    return e.u;
+  }
+
+  static DestID_ GetSource(EdgePair<NodeID_, NodeWeight<NodeID_, WeightT_>> e) {
+    return NodeWeight<NodeID_, WeightT_>(e.u, e.v.w);
+  }
+
+  // parses the input a window at a time (1/16 of the budget) and calls op
+  // with each window's edges, dropping the window's pages after
+  template <typename OpT>
+  void ForEachWindow(OpT op) {
+    size_t bytes;
+    std::shared_ptr<void> mapping = reader_.MapFile(MAP_PRIVATE, bytes, -2);
+    char *base = static_cast<char*>(mapping.get());
+    size_t window = std::max<size_t>(budget_ / 16, 1 << 20);
+    size_t pos = start_;
+    while (base != nullptr && pos < bytes) {
+      size_t end = std::min(bytes, pos + window);
+      const void *nl = std::memchr(base + end - 1, '\n', bytes - end + 1);
+      end = nl == nullptr ? bytes : static_cast<const char*>(nl) - base + 1;
+      EdgeList el = reader_.ParseText(base + pos, base + end, format_,
+                                      weighted_, symmetric_);
+      op(el);
+      size_t page_start = pos / kSGPageBytes * kSGPageBytes;
+      madvise(base + page_start, end - page_start, MADV_DONTNEED);
+      pos = end;
+    }
+  }
+
+  void CountDegrees() {
+    ForEachWindow([this](EdgeList &el) {
+      NodeID_ max_seen = 0;
+      #pragma omp parallel for reduction(max : max_seen)
+      for (auto it = el.begin(); it < el.end(); it++) {
+        Edge e = *it;
+        max_seen = std::max(max_seen, e.u);
+        max_seen = std::max(max_seen, (NodeID_) e.v);
+      }
+      if (max_seen >= num_nodes_) {
+        num_nodes_ = static_cast<int64_t>(max_seen) + 1;
+        out_degrees_.resize(num_nodes_, 0);
+        if (!symmetrize_)
+          in_degrees_.resize(num_nodes_, 0);
+      }
+      #pragma omp parallel for
+      for (auto it = el.begin(); it < el.end(); it++) {
+        Edge e = *it;
+        fetch_and_add(out_degrees_[e.u], 1);
+        if (symmetrize_)
+          fetch_and_add(out_degrees_[(NodeID_) e.v], 1);
+        else
+          fetch_and_add(in_degrees_[(NodeID_) e.v], 1);
+      }
+    });
+    if (num_nodes_ == 0) {
+      num_nodes_ = 1;
+      out_degrees_.resize(1, 0);
+      in_degrees_.resize(symmetrize_ ? 0 : 1, 0);
+    }
+  }
+
+  // per vertex, SquishRange holds its raw neighbors plus about 32 B
+  Runs OpenRuns(const std::vector<NodeID_> &degrees, const std::string &tag) {
+    Runs runs;
+    runs.bounds.push_back(0);
+    size_t limit = budget_ / 2, used = 0;
+    for (int64_t n = 0; n < num_nodes_; n++) {
+      size_t cost = degrees[n] * sizeof(DestID_) + 32;
+      if (used != 0 && used + cost > limit) {
+        runs.bounds.push_back(n);
+        used = 0;
+      }
+      used += cost;
+    }
+    runs.bounds.push_back(num_nodes_);
+    size_t num_runs = runs.bounds.size() - 1;
+    size_t buffer_bytes = std::min<size_t>(
+        std::max<size_t>(budget_ / 8 / num_runs, 1 << 16), 1 << 24);
+    for (size_t r = 0; r < num_runs; r++) {
+      runs.names.push_back(cli_.out_filename() + tag + std::to_string(r));
+      runs.files.push_back(fopen(runs.names.back().c_str(), "w+b"));
+      if (runs.files.back() == nullptr) {
+        std::cout << "Couldn't create run " << runs.names.back() << std::endl;
+        std::exit(-5);
+      }
+      runs.buffers.emplace_back(new char[buffer_bytes]);
+      setvbuf(runs.files.back(), runs.buffers.back().get(), _IOFBF,
+              buffer_bytes);
+    }
+    PrintStep(tag.substr(1) + " runs", static_cast<int64_t>(num_runs));
+    return runs;
+  }
+
+  static void Append(Runs &runs, NodeID_ u, DestID_ v) {
+    size_t r = std::upper_bound(runs.bounds.begin(), runs.bounds.end(), u) -
+               runs.bounds.begin() - 1;
+    Edge e(u, v);
+    fwrite(&e, sizeof(Edge), 1, runs.files[r]);
+  }
+
+  void Spill(Runs &out_runs, Runs &in_runs) {
+    ForEachWindow([&](EdgeList &el) {
+      for (Edge e : el) {
+        Append(out_runs, e.u, e.v);
+        if (symmetrize_)
+          Append(out_runs, (NodeID_) e.v, GetSource(e));
+        else
+          Append(in_runs, (NodeID_) e.v, GetSource(e));
+      }
+    });
+  }
+
+  void WriteAt(const void *data, size_t bytes, SGOffset pos) {
+    const char *p = static_cast<const char*>(data);
+    while (bytes > 0) {
+      ssize_t done = pwrite(fd_, p, bytes, pos);
+      if (done <= 0) {
+        std::cout << "Couldn't write to file " << cli_.out_filename()
+                  << std::endl;
+        std::exit(-5);
+      }
+      p += done;
+      bytes -= done;
+      pos += done;
+    }
+  }
+
+  // squishes the edges of run into [lo, hi) and writes them out, edges
+  // counts the neighbors written by earlier ranges
+  void SquishRange(FILE *run, NodeID_ lo, NodeID_ hi,
+                   const std::vector<NodeID_> &degrees, SGOffset offsets_at,
+                   SGOffset neighs_at, SGOffset &edges) {
+    int64_t n = hi - lo;
+    pvector<SGOffset> starts(n + 1), cursor(n);
+    starts[0] = 0;
+    for (int64_t i = 0; i < n; i++)
+      starts[i+1] = starts[i] + degrees[lo + i];
+    std::copy(starts.begin(), starts.begin() + n, cursor.begin());
+    pvector<DestID_> neighs(starts[n]);
+    {
+      pvector<Edge> block(std::max<size_t>(budget_ / 16 / sizeof(Edge), 4096));
+      rewind(run);
+      size_t got;
+      while ((got = fread(block.data(), sizeof(Edge), block.size(), run)) > 0) {
+        #pragma omp parallel for
+        for (size_t i = 0; i < got; i++) {
+          Edge e = block[i];
+          neighs[fetch_and_add(cursor[e.u - lo], 1)] = e.v;
+        }
+      }
+    }
+    pvector<NodeID_> diffs(n);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int64_t i = 0; i < n; i++) {
+      DestID_ *n_start = neighs.data() + starts[i];
+      DestID_ *n_end = neighs.data() + starts[i+1];
+      std::sort(n_start, n_end);
+      DestID_ *new_end = std::unique(n_start, n_end);
+      new_end = std::remove(n_start, new_end, static_cast<NodeID_>(lo + i));
+      diffs[i] = new_end - n_start;
+    }
+    SGOffset kept = 0;
+    for (int64_t i = 0; i < n; i++) {
+      std::copy(neighs.data() + starts[i], neighs.data() + starts[i] + diffs[i],
+                neighs.data() + kept);
+      cursor[i] = edges + kept;
+      kept += diffs[i];
+    }
+    WriteAt(cursor.data(), n * sizeof(SGOffset),
+            offsets_at + lo * sizeof(SGOffset));
+    WriteAt(neighs.data(), kept * sizeof(DestID_),
+            neighs_at + edges * sizeof(DestID_));
+    edges += kept;
+  }
+
+  // writes one direction's offsets and neighbors, returns its edge count
+  SGOffset BuildSection(Runs &runs, std::vector<NodeID_> &degrees,
+                        SGOffset offsets_at, SGOffset neighs_at) {
+    SGOffset edges = 0;
+    for (size_t r = 0; r < runs.files.size(); r++) {
+      fflush(runs.files[r]);
+      SquishRange(runs.files[r], runs.bounds[r], runs.bounds[r+1], degrees,
+                  offsets_at, neighs_at, edges);
+      fclose(runs.files[r]);
+      std::remove(runs.names[r].c_str());
+    }
+    WriteAt(&edges, sizeof(SGOffset),
+            offsets_at + num_nodes_ * sizeof(SGOffset));
+    std::vector<NodeID_>().swap(degrees);
+    return edges;
+  }
+};
+
+#endif  // OOC_BUILDER_H_
@@ -0,0 +1,427 @@
+#ifndef PAGE_ALLOC_H_
+#define PAGE_ALLOC_H_
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+/*
+GAP Benchmark Suite
+Class:  PageAlloc
+
+Page size policy for the large arrays of a run (pvector, Bitmap and the CSR
+index/neighbor arrays), chosen with -H, so the TLB reach of the random
+property accesses the helpers prefetch (parent[v], dist[v], contributions)
+can be compared
+ - 4k:      heap, as before (huge pages only if THP is set to always)
+ - thp:     2 MB aligned anonymous mappings advised MADV_HUGEPAGE
+ - hugetlb: MAP_HUGETLB from the hugetlbfs pool, falls back to thp (and
+            says so once) when the pool runs short
+ - Arrays under 2 MB stay on the heap under every policy
+ - Every block starts with a 64 B header recording where it came from and
+   its size, so PageDelete()/PageRealloc() handle whatever PageNew()
+   returned, whatever the policy was at the time
+NUMA placement of the same arrays is chosen with -N:
+ - none:       first touch, as before
+ - interleave: pages interleaved over all nodes (MPOL_INTERLEAVE)
+ - owner:      every element is first touched by the thread that owns it
+               under an OpenMP static partition, before anything else
+               writes the array
+ - replicate:  CSR arrays get a read-only copy per node, each thread reads
+               the copy of the node it runs on (CSRGraph::Replicate);
+               vertex state is written, so it is placed as with owner
+ Only arrays of 2 MB or more are placed; they are mapped for it even
+ with 4k pages. A thread's node is looked up once, so threads should be
+ pinned (the _paral kernels are, OMP_PROC_BIND for the rest).
+TLBCounter counts the dTLB load misses of the process through
+perf_event_open. It is opened with -H, before any worker thread exists, so
+it inherits into all of them; BenchmarkKernel reports it per trial.
+*/
+
+
+enum PagePolicy { kPages4K, kPagesTHP, kPagesHugeTLB };
+
+enum NumaPolicy { kNumaNone, kNumaInterleave, kNumaOwner, kNumaReplicate };
+
+
+class NumaTopology {
+ public:
+  static NumaTopology& Get() {
+    static NumaTopology topology;
+    return topology;
+  }
+
+  int nodes() const { return num_nodes_; }
+
+  int node_of_cpu(int cpu) const {
+    if (cpu < 0 || cpu >= static_cast<int>(cpu_node_.size()))
+      return 0;
+    return cpu_node_[cpu];
+  }
+
+  // node the calling thread runs on, looked up on its first call
+  static int LocalNode() {
+    static thread_local int node = -1;
+    if (node < 0)
+      node = Get().node_of_cpu(sched_getcpu());
+    return node;
+  }
+
+  // binds [addr, addr+bytes) to mode over the nodes in mask, flags as mbind,
+  // the pages stay where they are (and it says so once) if mbind fails
+  static void Bind(void *addr, size_t bytes, int mode, unsigned long mask,
+                   unsigned flags = 0) {
+    if (syscall(__NR_mbind, addr, bytes, mode, &mask, sizeof(mask) * 8 + 1,
+                flags) == 0)
+      return;
+    static bool warned = false;
+    if (!warned) {
+      warned = true;
+      printf("mbind failed (%s), NUMA placement ignored\n", strerror(errno));
+    }
+  }
+
+  // nodemask for dense node index node, built from its sysfs id
+  unsigned long node_mask(int node) const {
+    return 1UL << node_ids_[node];
+  }
+
+  unsigned long all_nodes() const {
+    unsigned long mask = 0;
+    for (int id : node_ids_)
+      mask |= 1UL << id;
+    return mask;
+  }
+
+ private:
+  // nodes are renumbered densely, so sparse sysfs node ids still work,
+  // node_ids_ maps them back for nodemasks (ids past 63 are left out)
+  NumaTopology() : num_nodes_(0) {
+    DIR *dir = opendir("/sys/devices/system/node");
+    std::vector<int> ids;
+    if (dir != nullptr) {
+      while (dirent *entry = readdir(dir)) {
+        int id;
+        char tail;
+        if (sscanf(entry->d_name, "node%d%c", &id, &tail) == 1)
+          ids.push_back(id);
+      }
+      closedir(dir);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (int id : ids) {
+      std::ifstream in("/sys/devices/system/node/node" + std::to_string(id) +
+                       "/cpulist");
+      std::string list;
+      if (!in || !std::getline(in, list) || id >= 64)
+        continue;
+      for (int cpu : ParseList(list)) {
+        if (cpu >= static_cast<int>(cpu_node_.size()))
+          cpu_node_.resize(cpu + 1, 0);
+        cpu_node_[cpu] = num_nodes_;
+      }
+      node_ids_.push_back(id);
+      num_nodes_++;
+    }
+    if (num_nodes_ == 0) {
+      node_ids_.push_back(0);
+      num_nodes_ = 1;
+    }
+  }
+
+  // "0-3,8-11" -> {0, 1, 2, 3, 8, 9, 10, 11}
+  static std::vector<int> ParseList(const std::string &list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+      size_t comma = list.find(',', pos);
+      if (comma == std::string::npos)
+        comma = list.size();
+      int lo, hi;
+      int n = sscanf(list.c_str() + pos, "%d-%d", &lo, &hi);
+      if (n >= 1) {
+        for (int c = lo; c <= (n == 2 ? hi : lo); c++)
+          cpus.push_back(c);
+      }
+      pos = comma + 1;
+    }
+    return cpus;
+  }
+
+  int num_nodes_;
+  std::vector<int> cpu_node_;
+  std::vector<int> node_ids_;   // dense node -> sysfs node id
+};
+
+
+class PageAlloc {
+ public:
+  static const size_t kHugePageBytes = 2 << 20;
+  static const size_t kHeaderBytes = 64;
+
+  static PagePolicy& Policy() {
+    static PagePolicy policy = kPages4K;
+    return policy;
+  }
+
+  static NumaPolicy& Numa() {
+    static NumaPolicy numa = kNumaNone;
+    return numa;
+  }
+
+  static bool ParseNuma(const std::string &name, NumaPolicy *numa) {
+    if (name == "none")
+      *numa = kNumaNone;
+    else if (name == "interleave")
+      *numa = kNumaInterleave;
+    else if (name == "owner")
+      *numa = kNumaOwner;
+    else if (name == "replicate")
+      *numa = kNumaReplicate;
+    else
+      return false;
+    return true;
+  }
+
+  static bool ParsePolicy(const std::string &name, PagePolicy *policy) {
+    if (name == "4k")
+      *policy = kPages4K;
+    else if (name == "thp")
+      *policy = kPagesTHP;
+    else if (name == "hugetlb")
+      *policy = kPagesHugeTLB;
+    else
+      return false;
+    return true;
+  }
+
+  // node >= 0 maps and binds the block to that node whatever the size
+  static void* Allocate(size_t bytes, int node = -1) {
+    size_t total = bytes + kHeaderBytes;
+    Header *h = nullptr;
+    bool mapped = node >= 0 || (total >= kHugePageBytes &&
+                                (Policy() != kPages4K || Numa() != kNumaNone));
+    if (!mapped) {
+      if (posix_memalign(reinterpret_cast<void**>(&h), kHeaderBytes, total))
+        throw std::bad_alloc();
+      h->map_bytes = 0;
+    } else {
+      size_t len = RoundUp(total);
+      if (Policy() == kPagesHugeTLB)
+        h = MapHugeTLB(len);
+      if (h == nullptr)
+        h = MapAligned(len, Policy() != kPages4K);
+      h->map_bytes = len;
+      if (node >= 0)
+        NumaTopology::Bind(h, len, MPOL_BIND,
+                           NumaTopology::Get().node_mask(node));
+      else if (Numa() == kNumaInterleave)
+        NumaTopology::Bind(h, len, MPOL_INTERLEAVE,
+                           NumaTopology::Get().all_nodes());
+    }
+    h->bytes = bytes;
+    return reinterpret_cast<char*>(h) + kHeaderBytes;
+  }
+
+  static bool Mapped(const void *p) {
+    return p != nullptr && GetHeader(const_cast<void*>(p))->map_bytes != 0;
+  }
+
+  // moves the pages of a mapped block to node, nothing for heap blocks
+  static void MoveToNode(void *p, int node) {
+    if (!Mapped(p))
+      return;
+    Header *h = GetHeader(p);
+    NumaTopology::Bind(h, h->map_bytes, MPOL_BIND,
+                       NumaTopology::Get().node_mask(node), MPOL_MF_MOVE);
+  }
+
+  // realloc() for blocks from Allocate(), keeps the policy for the new size
+  static void* Reallocate(void *p, size_t bytes) {
+    if (p == nullptr)
+      return Allocate(bytes);
+    Header *h = GetHeader(p);
+    size_t total = bytes + kHeaderBytes;
+    if (h->map_bytes == 0 && (total < kHugePageBytes ||
+        (Policy() == kPages4K && Numa() == kNumaNone))) {
+      h = static_cast<Header*>(realloc(h, total));
+      if (h == nullptr)
+        return nullptr;
+      h->bytes = bytes;
+      return reinterpret_cast<char*>(h) + kHeaderBytes;
+    }
+    if (total <= h->map_bytes) {
+      h->bytes = bytes;
+      return p;
+    }
+    void *moved = Allocate(bytes);
+    memcpy(moved, p, std::min(bytes, h->bytes));
+    Free(p);
+    return moved;
+  }
+
+  static void Free(void *p) {
+    if (p == nullptr)
+      return;
+    Header *h = GetHeader(p);
+    if (h->map_bytes == 0)
+      free(h);
+    else
+      munmap(h, h->map_bytes);
+  }
+
+ private:
+  struct Header {
+    size_t map_bytes;   // 0 if from the heap
+    size_t bytes;       // as requested
+  };
+
+  static Header* GetHeader(void *p) {
+    return reinterpret_cast<Header*>(static_cast<char*>(p) - kHeaderBytes);
+  }
+
+  static size_t RoundUp(size_t bytes) {
+    return (bytes + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+  }
+
+  static Header* MapHugeTLB(size_t len) {
+    #ifdef MAP_HUGETLB
+    void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+      return static_cast<Header*>(p);
+    #endif
+    static bool warned = false;
+    if (!warned) {
+      warned = true;
+      printf("MAP_HUGETLB failed (hugetlbfs pool short?), using thp\n");
+    }
+    return nullptr;
+  }
+
+  // over-maps by a huge page and trims, so the block is 2 MB aligned
+  static Header* MapAligned(size_t len, bool huge) {
+    size_t span = len + kHugePageBytes;
+    void *p = mmap(nullptr, span, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+    uintptr_t start = reinterpret_cast<uintptr_t>(p);
+    uintptr_t aligned = (start + kHugePageBytes - 1) & ~(kHugePageBytes - 1);
+    if (aligned != start)
+      munmap(p, aligned - start);
+    if (aligned + len != start + span)
+      munmap(reinterpret_cast<void*>(aligned + len), start + span - aligned - len);
+    #ifdef MADV_HUGEPAGE
+    if (huge)
+      madvise(reinterpret_cast<void*>(aligned), len, MADV_HUGEPAGE);
+    #endif
+    return reinterpret_cast<Header*>(aligned);
+  }
+};
+
+
+// new T_[num_elements] under the page and NUMA policies, elements
+// default-initialized
+template <typename T_>
+T_* PageNew(size_t num_elements) {
+  T_ *p = static_cast<T_*>(PageAlloc::Allocate(num_elements * sizeof(T_)));
+  NumaPolicy numa = PageAlloc::Numa();
+  if ((numa == kNumaOwner || numa == kNumaReplicate) && PageAlloc::Mapped(p)) {
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < num_elements; i++)
+      *reinterpret_cast<volatile char*>(p + i) = 0;
+  }
+  if (!std::is_trivially_default_constructible<T_>::value) {
+    for (size_t i = 0; i < num_elements; i++)
+      new (p + i) T_;
+  }
+  return p;
+}
+
+// copy of [src, src+num_elements) bound to node
+template <typename T_>
+T_* PageCopyToNode(const T_ *src, size_t num_elements, int node) {
+  T_ *p = static_cast<T_*>(PageAlloc::Allocate(num_elements * sizeof(T_),
+                                               node));
+  #pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < num_elements; i++)
+    p[i] = src[i];
+  return p;
+}
+
+// only for trivially copyable T_, new elements are uninitialized
+template <typename T_>
+T_* PageRealloc(T_ *p, size_t num_elements) {
+  return static_cast<T_*>(
+      PageAlloc::Reallocate(p, num_elements * sizeof(T_)));
+}
+
+template <typename T_>
+void PageDelete(T_ *p) {
+  static_assert(std::is_trivially_destructible<T_>::value,
+                "PageDelete() does not run destructors");
+  PageAlloc::Free(p);
+}
+
+
+class TLBCounter {
+ public:
+  static TLBCounter& Get() {
+    static TLBCounter counter;
+    return counter;
+  }
+
+  // counts this thread and every thread it creates from now on
+  void Open() {
+    if (fd_ >= 0)
+      return;
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd_ < 0)
+      printf("dTLB miss counter unavailable (perf_event_paranoid?)\n");
+  }
+
+  bool enabled() const { return fd_ >= 0; }
+
+  int64_t Read() const {
+    uint64_t count = 0;
+    if (fd_ < 0 || read(fd_, &count, sizeof(count)) != sizeof(count))
+      return -1;
+    return count;
+  }
+
+ private:
+  TLBCounter() : fd_(-1) {}
+
+  int fd_;
+};
+
+#endif  // PAGE_ALLOC_H_
@@ -6,6 +6,28 @@
 #include <chrono>
 #include <map>
 #include <atomic> 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cpuid.h>
+#include <x86intrin.h>
+#include <new>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#include <cassert>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ghost_trace.h"
 
 #define ALIGN_NUM 64
 
@@ -44,6 +66,220 @@ typedef struct HyperParam_PfT {
   size_t padding[6]; // padding to 64 bytes (i.e., one cache line)
 } HyperParam_PfT __attribute__ ((aligned (64))); 
 
+/*
+GhostThrottle: portable helper-thread throttling
+
+Helpers used to stall with `serialize`, which raises SIGILL on CPUs without
+the SERIALIZE instruction. Throttling now goes through one of these backends:
+ - serialize, tpause (WAITPKG, light C0.1 wait), pause, lfence, and spin
+   (busy-waits on the TSC)
+ - The first of serialize, tpause and pause that CPUID reports is used. The
+   GHOST_THROTTLE environment variable (a backend name) overrides the choice
+ - Each backend is calibrated once at startup from the fastest of
+   GHOST_CALIBRATE_RUNS timings. A throttle rep is GHOST_THROTTLE_UNIT_NS
+   nanoseconds on every host (the environment variable of the same name
+   overrides it), so the .rept 30 of the tuned kernels means the same delay
+   everywhere. An instruction slower than a rep counts as several reps, with
+   the remainder carried to the thread's next call
+ - ghost_fence() orders progress reads with serialize if present, else lfence
+*/
+
+#ifndef GHOST_THROTTLE_UNIT_NS
+#define GHOST_THROTTLE_UNIT_NS 20     // delay of one throttle rep
+#endif
+#define GHOST_CALIBRATE_ITERS (1 << 12)
+#define GHOST_CALIBRATE_RUNS 16
+
+enum GhostThrottleKind { kThrottleSerialize, kThrottleTpause, kThrottlePause,
+                         kThrottleLfence, kThrottleSpin };
+
+inline bool ghost_cpu_has_serialize() {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return false;
+  return edx & (1u << 14);
+}
+
+inline bool ghost_cpu_has_waitpkg() {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return false;
+  return ecx & (1u << 5);
+}
+
+inline void ghost_tpause(uint64_t deadline) {
+  // tpause ecx with ecx = 1 (C0.1), deadline in edx:eax
+  asm volatile (".byte 0x66, 0x0f, 0xae, 0xf1"
+                : : "c"(1), "a"((uint32_t) deadline),
+                    "d"((uint32_t) (deadline >> 32)) : "cc", "memory");
+}
+
+class GhostThrottle {
+ public:
+  static const GhostThrottle& Get() {
+    static GhostThrottle throttle;
+    return throttle;
+  }
+
+  GhostThrottle(const GhostThrottle &other) = delete;
+
+  // stalls the calling thread for reps throttle units
+  void Throttle(int reps) const {
+    switch (kind_) {
+      case kThrottleSerialize:
+        for (int64_t i = Count(reps); i > 0; i--)
+          asm volatile ("serialize\n\t");
+        break;
+      case kThrottlePause:
+        for (int64_t i = Count(reps); i > 0; i--)
+          asm volatile ("pause\n\t");
+        break;
+      case kThrottleLfence:
+        for (int64_t i = Count(reps); i > 0; i--)
+          asm volatile ("lfence\n\t");
+        break;
+      case kThrottleTpause:
+        ghost_tpause(__rdtsc() + reps * unit_tsc_);
+        break;
+      case kThrottleSpin: {
+        uint64_t deadline = __rdtsc() + reps * unit_tsc_;
+        while (__rdtsc() < deadline) {}
+        break;
+      }
+    }
+  }
+
+  // makes a following progress read see an up-to-date counter
+  void Fence() const {
+    if (has_serialize_)
+      asm volatile ("serialize\n\t");
+    else
+      asm volatile ("lfence\n\t");
+  }
+
+  GhostThrottleKind kind() const { return kind_; }
+
+  // delay of one throttle rep
+  double unit_ns() const { return unit_ns_; }
+
+  // measured delay of one backend instruction (or TSC-timed rep)
+  double call_ns() const { return call_ns_; }
+
+  static const char* Name(GhostThrottleKind kind) {
+    switch (kind) {
+      case kThrottleSerialize: return "serialize";
+      case kThrottleTpause:    return "tpause";
+      case kThrottlePause:     return "pause";
+      case kThrottleLfence:    return "lfence";
+      default:                 return "spin";
+    }
+  }
+
+ private:
+  GhostThrottle() : has_serialize_(ghost_cpu_has_serialize()),
+                    per_unit_(1), unit_tsc_(1),
+                    unit_ns_(GHOST_THROTTLE_UNIT_NS) {
+    bool has_waitpkg = ghost_cpu_has_waitpkg();
+    if (has_serialize_)
+      kind_ = kThrottleSerialize;
+    else if (has_waitpkg)
+      kind_ = kThrottleTpause;
+    else
+      kind_ = kThrottlePause;
+    const char *env = std::getenv("GHOST_THROTTLE");
+    if (env != nullptr && *env != '\0') {
+      bool found = false;
+      for (int k = kThrottleSerialize; k <= kThrottleSpin; k++) {
+        if (std::strcmp(env, Name(static_cast<GhostThrottleKind>(k))) == 0) {
+          kind_ = static_cast<GhostThrottleKind>(k);
+          found = true;
+        }
+      }
+      if (!found || (kind_ == kThrottleSerialize && !has_serialize_) ||
+          (kind_ == kThrottleTpause && !has_waitpkg)) {
+        std::cout << "GHOST_THROTTLE=" << env
+                  << " is unknown or not supported by this CPU" << std::endl;
+        std::exit(-34);
+      }
+    }
+    const char *unit = std::getenv("GHOST_THROTTLE_UNIT_NS");
+    if (unit != nullptr && *unit != '\0') {
+      unit_ns_ = std::atof(unit);
+      if (unit_ns_ <= 0) {
+        std::cout << "GHOST_THROTTLE_UNIT_NS=" << unit
+                  << " is not a positive delay" << std::endl;
+        std::exit(-34);
+      }
+    }
+    Calibrate();
+    std::cout << "Ghost throttle: " << Name(kind_) << ", 1 rep = "
+              << unit_ns_ << " ns (" << per_unit_ << " x " << call_ns_
+              << " ns)" << std::endl;
+  }
+
+  // instructions for reps, a fraction left over is owed by the next call
+  int64_t Count(int reps) const {
+    static thread_local double carry = 0;
+    double want = reps * per_unit_ + carry;
+    int64_t count = (int64_t) want;
+    carry = want - count;
+    return count;
+  }
+
+  static double NowNs() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void Calibrate() {
+    if (kind_ == kThrottleTpause || kind_ == kThrottleSpin) {
+      // time based, only the TSC rate is needed
+      double start = NowNs();
+      uint64_t tsc_start = __rdtsc();
+      while (NowNs() - start < 1e6) {}
+      double tsc_per_ns = (__rdtsc() - tsc_start) / (NowNs() - start);
+      unit_tsc_ = std::max<uint64_t>(1, unit_ns_ * tsc_per_ns);
+      call_ns_ = unit_tsc_ / tsc_per_ns;
+      return;
+    }
+    // a single timing swings with frequency and interrupts (one serialize
+    // read 41-132 ns across runs), the fastest run is the instruction's cost
+    const int n = GHOST_CALIBRATE_ITERS;
+    call_ns_ = std::numeric_limits<double>::max();
+    for (int run = 0; run < GHOST_CALIBRATE_RUNS; run++) {
+      double start = NowNs();
+      switch (kind_) {
+        case kThrottleSerialize:
+          for (int i = 0; i < n; i++) asm volatile ("serialize\n\t");
+          break;
+        case kThrottlePause:
+          for (int i = 0; i < n; i++) asm volatile ("pause\n\t");
+          break;
+        default:
+          for (int i = 0; i < n; i++) asm volatile ("lfence\n\t");
+          break;
+      }
+      call_ns_ = std::min(call_ns_, (NowNs() - start) / n);
+    }
+    per_unit_ = unit_ns_ / call_ns_; // below 1 if an instruction outlasts a rep
+  }
+
+  GhostThrottleKind kind_;
+  bool has_serialize_;
+  double per_unit_;    // instructions per rep (instruction backends)
+  uint64_t unit_tsc_;  // TSC ticks per rep (tpause, spin)
+  double unit_ns_;     // target delay of one rep
+  double call_ns_;     // fastest measured instruction
+};
+
+inline void ghost_throttle(int reps) {
+  GhostThrottle::Get().Throttle(reps);
+}
+
+inline void ghost_fence() {
+  GhostThrottle::Get().Fence();
+}
+
 class TimeDiff {
     public: 
         TimeDiff() : 
@@ -462,7 +698,7 @@ template <typename T> inline void sync(T &iterator, int stride, size_t i,
     bool &serialize_flag, const HyperParam_PfT &hyper_param) {
     if (i % hyper_param.sync_frequency == 0 || serialize_flag) { // when serialize enabled, check more often 
         if (accurate_sync)
-            asm volatile ("serialize\n\t"); // a serialize here to make sure the counter is most up-to-date 
+            ghost_fence(); // make sure the counter is most up-to-date 
         size_t main_counter = time_diff.read_atomic_main(read_order); 
         // time_diff.insert_into_atomic_histogram(main_counter, i); 
         if (main_counter >= i) { // if pf thread is too slow 
@@ -481,7 +717,7 @@ template <typename T> inline bool sync_jump(T &iterator, int stride, size_t i,
     bool &serialize_flag, const HyperParam_PfT &hyper_param) {
     if (i % hyper_param.sync_frequency == 0 || serialize_flag) { // when serialize enabled, check more often 
         if (accurate_sync)
-            asm volatile ("serialize\n\t"); // a serialize here to make sure the counter is most up-to-date 
+            ghost_fence(); // make sure the counter is most up-to-date 
         size_t main_counter = time_diff.read_atomic_main(read_order); 
         if (main_counter >= i) { // if pf thread is too slow 
             serialize_flag = false; 
@@ -501,7 +737,7 @@ template <typename T> inline void sync(T &iterator, int stride, size_t i,
     bool &serialize_flag, const HyperParam_PfT &hyper_param) {
     if (i % hyper_param.sync_frequency == 0 || serialize_flag) { // when serialize enabled, check more often 
         if (accurate_sync)
-            asm volatile ("serialize\n\t"); // a serialize here to make sure the counter is most up-to-date 
+            ghost_fence(); // make sure the counter is most up-to-date 
         size_t main_counter = time_diff.read(tid, read_order); 
         // time_diff.insert_into_atomic_histogram(main_counter, local_counter); 
         if (main_counter >= i) { // if pf thread is too slow 
@@ -515,4 +751,1166 @@ template <typename T> inline void sync(T &iterator, int stride, size_t i,
     }
 }
 
+/*
+GhostTopology: main/helper CPU pairs from the sysfs SMT topology
+
+The _paral kernels used to pin main k to CPU 2k and its helper to 2k+1,
+which is only right on hosts that number SMT siblings adjacently.
+ - Each CPU of the process affinity mask is grouped with its SMT siblings
+   (cpuN/topology/thread_siblings_list) and ordered by package and core id
+ - Slot k gets the k-th core with two allowed siblings: main on the first,
+   helper on the second; SMT4 siblings beyond the second are left idle
+ - Without SMT (or sysfs) the remaining CPUs are paired across cores of the
+   same package (so main and helper share a NUMA node), an odd one out per
+   package shares its CPU with its helper; slots beyond the pairs wrap
+ - GHOST_CPUS="m0:h0,m1:h1,..." overrides the discovered pairs
+*/
+
+struct GhostCpuPair {
+  int main;
+  int helper;
+  bool smt;    // helper is an SMT sibling of main
+};
+
+class GhostTopology {
+ public:
+  static GhostTopology& Get() {
+    static GhostTopology topology;
+    return topology;
+  }
+
+  GhostTopology(const GhostTopology &other) = delete;
+
+  int pairs() const { return pairs_.size(); }
+  bool smt() const { return !pairs_.empty() && pairs_[0].smt; }
+
+  const GhostCpuPair& pair(int slot) const {
+    return pairs_[slot % pairs_.size()];
+  }
+
+  int main_cpu(int slot) const { return pair(slot).main; }
+  int helper_cpu(int slot) const { return pair(slot).helper; }
+
+  // pins the calling thread as the main thread of slot
+  void PinMain(int slot) {
+    if (slot >= pairs() && !warned_) {
+      warned_ = true;
+      std::cout << "Ghost topology: slot " << slot << " exceeds the "
+                << pairs() << " cpu pairs, main threads will share" << std::endl;
+    }
+    if (!PinSelf(main_cpu(slot))) {
+      printf("Failed to pin main thread.\n");
+      exit(1);
+    }
+  }
+
+  // pins the calling thread as the helper of slot (helpers not on GhostPool)
+  void PinHelper(int slot) {
+    if (!PinSelf(helper_cpu(slot))) {
+      printf("Failed to pin pf thread.\n");
+      exit(1);
+    }
+  }
+
+  void Print() const {
+    std::cout << "Ghost topology: " << pairs_.size() << " pair(s)";
+    for (const GhostCpuPair &p : pairs_) // + sibling, / other core, = shared
+      std::cout << " " << p.main
+                << (p.smt ? "+" : p.main == p.helper ? "=" : "/") << p.helper;
+    std::cout << (smt() ? "" : " (no SMT siblings)") << std::endl;
+  }
+
+ private:
+  struct Core {
+    int package;
+    int core;
+    std::vector<int> cpus;   // allowed siblings, ascending
+  };
+
+  GhostTopology() : warned_(false) {
+    std::vector<int> allowed;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &mask) == 0) {
+      for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &mask))
+          allowed.push_back(c);
+    }
+    if (allowed.empty())
+      allowed.push_back(0);
+    const char *env = getenv("GHOST_CPUS");
+    if (env != nullptr && env[0] != '\0')
+      ParseOverride(env);
+    else
+      Discover(allowed);
+    Print();
+  }
+
+  static std::string ReadTopology(int cpu, const char *file) {
+    std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                     "/topology/" + file);
+    std::string line;
+    if (!in || !std::getline(in, line))
+      return "";
+    return line;
+  }
+
+  // "0-1,64-65" -> {0, 1, 64, 65}
+  static std::vector<int> ParseList(const std::string &list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+      size_t comma = list.find(',', pos);
+      if (comma == std::string::npos)
+        comma = list.size();
+      std::string range = list.substr(pos, comma - pos);
+      size_t dash = range.find('-');
+      int lo = atoi(range.c_str());
+      int hi = dash == std::string::npos ? lo : atoi(range.c_str() + dash + 1);
+      for (int c = lo; c <= hi; c++)
+        cpus.push_back(c);
+      pos = comma + 1;
+    }
+    return cpus;
+  }
+
+  void Discover(const std::vector<int> &allowed) {
+    std::map<int, Core> cores;   // keyed by the first sibling
+    for (int c : allowed) {
+      std::vector<int> siblings = ParseList(ReadTopology(c, "thread_siblings_list"));
+      int key = siblings.empty() ? c : siblings[0];
+      Core &core = cores[key];
+      if (core.cpus.empty()) {
+        std::string package = ReadTopology(c, "physical_package_id");
+        std::string core_id = ReadTopology(c, "core_id");
+        core.package = package.empty() ? 0 : atoi(package.c_str());
+        core.core = core_id.empty() ? key : atoi(core_id.c_str());
+      }
+      core.cpus.push_back(c);
+    }
+    std::vector<const Core*> order;
+    for (const auto &kv : cores)
+      order.push_back(&kv.second);
+    std::stable_sort(order.begin(), order.end(),
+                     [](const Core *a, const Core *b) {
+      return a->package != b->package ? a->package < b->package
+                                      : a->core < b->core;
+    });
+    std::vector<const Core*> singles;
+    for (const Core *core : order) {
+      if (core->cpus.size() >= 2)
+        pairs_.push_back({core->cpus[0], core->cpus[1], true});
+      else
+        singles.push_back(core);
+    }
+    // cross-core pairs stay within a package, near the data main placed
+    size_t i = 0;
+    while (i < singles.size()) {
+      if (i + 1 < singles.size() &&
+          singles[i]->package == singles[i+1]->package) {
+        pairs_.push_back({singles[i]->cpus[0], singles[i+1]->cpus[0], false});
+        i += 2;
+      } else {
+        pairs_.push_back({singles[i]->cpus[0], singles[i]->cpus[0], false});
+        i++;
+      }
+    }
+  }
+
+  void ParseOverride(const char *env) {
+    std::string list(env);
+    size_t pos = 0;
+    while (pos < list.size()) {
+      size_t comma = list.find(',', pos);
+      if (comma == std::string::npos)
+        comma = list.size();
+      std::string item = list.substr(pos, comma - pos);
+      int main_cpu, helper_cpu;
+      char tail;
+      if (sscanf(item.c_str(), "%d:%d%c", &main_cpu, &helper_cpu, &tail) != 2 ||
+          main_cpu < 0 || helper_cpu < 0 ||
+          main_cpu >= CPU_SETSIZE || helper_cpu >= CPU_SETSIZE) {
+        std::cout << "GHOST_CPUS: bad pair \"" << item
+                  << "\", expected main:helper[,main:helper...]" << std::endl;
+        std::exit(-36);
+      }
+      pairs_.push_back({main_cpu, helper_cpu, SameCore(main_cpu, helper_cpu)});
+      pos = comma + 1;
+    }
+  }
+
+  static bool SameCore(int a, int b) {
+    if (a == b)
+      return false;
+    std::vector<int> siblings = ParseList(ReadTopology(a, "thread_siblings_list"));
+    return std::find(siblings.begin(), siblings.end(), b) != siblings.end();
+  }
+
+  static bool PinSelf(int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0;
+  }
+
+  std::vector<GhostCpuPair> pairs_;
+  bool warned_;
+};
+
+/*
+GhostPool: persistent, pinned helper threads for ghost-thread phases
+
+Kernels hand a helper one phase of work (a BFS level, a bin, a loop) instead
+of creating and joining a std::thread for it.
+ - One helper per slot, created on the first dispatch to that slot and pinned
+   once; slot k defaults to the helper CPU of GhostTopology pair k, so
+   `taskset -c main,sibling` still puts the helper on the main's sibling
+ - Work is handed over through a cache-line-aligned GhostTask descriptor;
+   between phases the helper spins for a while, then parks on a condvar
+ - Dispatch latency (hand-over to helper start) is accumulated per slot and
+   printed by PrintDispatchStats()
+*/
+
+#define GHOST_MAX_SLOTS 256
+#define GHOST_SPIN_ITERS (1 << 16) // pause loops before a helper parks
+
+typedef struct GhostTask {
+  std::atomic<uint64_t> seq;   // bumped by main to hand over a phase
+  std::atomic<uint64_t> done;  // set to seq by the helper when it finishes
+  void (*fn)(void*);
+  void *arg;
+  int64_t issue_ns;            // when main handed the phase over
+  size_t padding[3]; // padding to 64 bytes (i.e., one cache line)
+} GhostTask __attribute__ ((aligned (64)));
+
+typedef struct DispatchStats {
+  uint64_t phases;
+  int64_t total_ns;
+  int64_t max_ns;
+  size_t padding[5]; // padding to 64 bytes (i.e., one cache line)
+} DispatchStats __attribute__ ((aligned (64)));
+
+inline int64_t ghost_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class GhostPool {
+ public:
+  static GhostPool& Get() {
+    static GhostPool pool;
+    return pool;
+  }
+
+  GhostPool(const GhostPool &other) = delete;
+
+  ~GhostPool() {
+    for (int s = 0; s < GHOST_MAX_SLOTS; s++) {
+      Worker *w = workers_[s];
+      if (w == nullptr)
+        continue;
+      w->stop = true;
+      Hand(w);
+      w->thread.join();
+      w->~Worker();
+      free(w);
+    }
+  }
+
+  // pins the helper of slot to cpu (applied now or when it is created)
+  void Pin(int slot, int cpu) {
+    if (cpus_[slot] == cpu)
+      return;
+    cpus_[slot] = cpu;
+    if (workers_[slot] != nullptr)
+      PinThread(workers_[slot]->thread.native_handle(), cpu);
+  }
+
+  // runs fn(arg) on the helper of slot, returns without waiting for it
+  void Dispatch(int slot, void (*fn)(void*), void *arg) {
+    Worker *w = GetWorker(slot);
+    w->task.fn = fn;
+    w->task.arg = arg;
+    w->task.issue_ns = ghost_now_ns();
+    Hand(w);
+  }
+
+  // runs fn() on the helper of slot, fn must stay alive until Wait(slot)
+  template <typename FuncT>
+  void Dispatch(int slot, FuncT &fn) {
+    Dispatch(slot, &GhostPool::Trampoline<FuncT>, (void*) &fn);
+  }
+
+  // blocks until the phase last dispatched to slot has finished
+  void Wait(int slot) {
+    Worker *w = workers_[slot];
+    if (w == nullptr)
+      return;
+    uint64_t seq = w->task.seq.load(std::memory_order_relaxed);
+    while (w->task.done.load(std::memory_order_acquire) != seq)
+      asm volatile ("pause\n\t");
+  }
+
+  // prints dispatch latency over all slots since the last call, then resets
+  void PrintDispatchStats() {
+    uint64_t phases = 0;
+    int64_t total_ns = 0, max_ns = 0;
+    for (int s = 0; s < GHOST_MAX_SLOTS; s++) {
+      Worker *w = workers_[s];
+      if (w == nullptr)
+        continue;
+      Wait(s);
+      phases += w->stats.phases;
+      total_ns += w->stats.total_ns;
+      max_ns = std::max(max_ns, w->stats.max_ns);
+      w->stats.phases = 0;
+      w->stats.total_ns = 0;
+      w->stats.max_ns = 0;
+    }
+    printf("%-21s%3.5lf\n", "Ghost Dispatch Time:", total_ns / 1e9);
+    printf("%-21s%lu phases, avg %.0lf ns, max %ld ns\n", "Ghost Dispatch:",
+           (unsigned long) phases, phases ? (double) total_ns / phases : 0.0,
+           (long) max_ns);
+  }
+
+ private:
+  struct Worker {
+    GhostTask task;
+    DispatchStats stats;
+    std::atomic<bool> parked;
+    bool stop;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+  };
+
+  GhostPool() {
+    const GhostTopology &topology = GhostTopology::Get();
+    for (int s = 0; s < GHOST_MAX_SLOTS; s++) {
+      workers_[s] = nullptr;
+      cpus_[s] = topology.helper_cpu(s);
+    }
+  }
+
+  template <typename FuncT>
+  static void Trampoline(void *fn) {
+    (*static_cast<FuncT*>(fn))();
+  }
+
+  static void PinThread(pthread_t thread, int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset) != 0)
+      std::cout << "Failed to pin helper thread to cpu " << cpu << std::endl;
+  }
+
+  Worker* GetWorker(int slot) {
+    if (slot < 0 || slot >= GHOST_MAX_SLOTS) {
+      std::cout << "Ghost slot " << slot << " out of range" << std::endl;
+      std::exit(-33);
+    }
+    Worker *w = workers_[slot];
+    if (w != nullptr)
+      return w;
+    std::lock_guard<std::mutex> lock(create_mutex_);
+    void *mem;
+    if (posix_memalign(&mem, ALIGN_NUM, sizeof(Worker))) {
+      std::cout << "Error: failed to allocate ghost helper" << std::endl;
+      std::exit(-33);
+    }
+    w = new (mem) Worker();
+    w->task.seq.store(0, std::memory_order_relaxed);
+    w->task.done.store(0, std::memory_order_relaxed);
+    w->stats.phases = 0;
+    w->stats.total_ns = 0;
+    w->stats.max_ns = 0;
+    w->parked.store(false);
+    w->stop = false;
+    w->thread = std::thread(&GhostPool::HelperMain, w);
+    if (cpus_[slot] >= 0)
+      PinThread(w->thread.native_handle(), cpus_[slot]);
+    workers_[slot] = w;
+    return w;
+  }
+
+  // publishes the descriptor, wakes the helper only if it has parked
+  static void Hand(Worker *w) {
+    w->task.seq.store(w->task.seq.load(std::memory_order_relaxed) + 1);
+    if (w->parked.load()) {
+      std::lock_guard<std::mutex> lock(w->mutex);
+      w->wake.notify_one();
+    }
+  }
+
+  static void HelperMain(Worker *w) {
+    uint64_t seen = 0;
+    while (true) {
+      uint64_t seq;
+      int spins = 0;
+      while ((seq = w->task.seq.load(std::memory_order_acquire)) == seen) {
+        if (spins++ < GHOST_SPIN_ITERS) {
+          asm volatile ("pause\n\t");
+        } else {
+          std::unique_lock<std::mutex> lock(w->mutex);
+          w->parked.store(true);
+          w->wake.wait(lock, [w, seen]() { return w->task.seq.load() != seen; });
+          w->parked.store(false);
+        }
+      }
+      seen = seq;
+      if (w->stop)
+        break;
+      int64_t latency = ghost_now_ns() - w->task.issue_ns;
+      w->stats.phases++;
+      w->stats.total_ns += latency;
+      w->stats.max_ns = std::max(w->stats.max_ns, latency);
+      w->task.fn(w->task.arg);
+      w->task.done.store(seq, std::memory_order_release);
+    }
+  }
+
+  Worker *workers_[GHOST_MAX_SLOTS];
+  int cpus_[GHOST_MAX_SLOTS];
+  std::mutex create_mutex_;
+};
+
+/*
+GhostProgress: main thread's progress record for one helper
+
+Publishing on every iteration keeps a line shared with the SMT sibling
+bouncing between the two threads.
+ - outer and inner progress and a done flag are packed into one cache line
+   written only by main; the helper takes a consistent snapshot of all
+   three through a seqlock (ReadOuter/ReadInner read a single field)
+ - main counts updates in its own line and only publishes every K-th; every
+   GHOST_PUBLISH_WINDOW publications it compares them with the helper's
+   reads (kept on the helper's line): K doubles while the helper reads less
+   than once per two publications and halves while it reads more than
+   twice per publication, within [1, max_every]
+ - Finish() publishes immediately, so the final state is never held back
+ - -DGHOST_EAGER_PUBLISH pins K to 1, the old publish-every-iteration scheme
+ - The main side is not atomic: after Reset, only the first thread to write
+   a record may update it (asserted), so OpenMP teams need one record per
+   thread (see GhostLoop)
+*/
+
+#define GHOST_PUBLISH_MAX 16      // default bound on K
+#define GHOST_PUBLISH_WINDOW 64   // publications between adjustments of K
+
+struct GhostSnapshot {
+  size_t outer;
+  size_t inner;
+  bool done;
+};
+
+class GhostProgress {
+ public:
+  GhostProgress() { Reset(0); }
+
+  GhostProgress(const GhostProgress &other) = delete;
+
+  /*-----main thread side-----*/
+  // starts a phase at outer, publishes at most every max_every updates,
+  // call before handing the phase to the helper
+  void Reset(size_t outer, int max_every = GHOST_PUBLISH_MAX) {
+    main_.outer = outer;
+    main_.inner = 0;
+    main_.pending = 0;
+    main_.publications = 0;
+    main_.last_reads = helper_.reads.load(std::memory_order_relaxed);
+    #ifdef GHOST_EAGER_PUBLISH
+    main_.max_every = 1;
+    #else
+    main_.max_every = std::max(1, max_every);
+    #endif
+    main_.every = 1;
+    Write(false);
+    main_.writer = std::thread::id(); // claimed by the next write
+  }
+
+  void Outer(size_t outer) {
+    main_.outer = outer;
+    Update();
+  }
+
+  void Inner(size_t n = 1) {
+    main_.inner += n;
+    Update();
+  }
+
+  void Finish() { Write(true); }
+
+  size_t outer() const { return main_.outer; }
+  size_t inner() const { return main_.inner; }
+
+  /*-----helper thread side-----*/
+  GhostSnapshot Read() {
+    GhostSnapshot snap;
+    uint32_t before, after;
+    do {
+      before = shared_.seq.load(std::memory_order_acquire);
+      snap.outer = shared_.outer.load(std::memory_order_relaxed);
+      snap.inner = shared_.inner.load(std::memory_order_relaxed);
+      snap.done = shared_.done.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = shared_.seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    CountRead();
+    return snap;
+  }
+
+  size_t ReadOuter() {
+    CountRead();
+    return shared_.outer.load(std::memory_order_relaxed);
+  }
+
+  size_t ReadInner() {
+    CountRead();
+    return shared_.inner.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void Update() {
+    if (++main_.pending >= main_.every)
+      Write(false);
+  }
+
+  void Write(bool done) {
+    std::thread::id self = std::this_thread::get_id();
+    if (main_.writer == std::thread::id())
+      main_.writer = self;
+    assert(main_.writer == self && "GhostProgress has a single writer");
+    uint32_t seq = shared_.seq.load(std::memory_order_relaxed);
+    shared_.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shared_.outer.store(main_.outer, std::memory_order_relaxed);
+    shared_.inner.store(main_.inner, std::memory_order_relaxed);
+    shared_.done.store(done, std::memory_order_relaxed);
+    shared_.seq.store(seq + 2, std::memory_order_release);
+    main_.pending = 0;
+    if (++main_.publications == GHOST_PUBLISH_WINDOW)
+      AdjustEvery();
+  }
+
+  void AdjustEvery() {
+    uint64_t reads = helper_.reads.load(std::memory_order_relaxed);
+    uint64_t window_reads = reads - main_.last_reads;
+    if (window_reads * 2 < GHOST_PUBLISH_WINDOW)
+      main_.every = std::min(main_.every * 2, main_.max_every);
+    else if (window_reads > 2 * GHOST_PUBLISH_WINDOW)
+      main_.every = std::max(main_.every / 2, 1);
+    main_.last_reads = reads;
+    main_.publications = 0;
+  }
+
+  void CountRead() {
+    helper_.reads.store(helper_.reads.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+  }
+
+  struct alignas(64) Shared {     // written by main, read by the helper
+    std::atomic<uint32_t> seq{0};
+    std::atomic<bool> done{false};
+    std::atomic<size_t> outer{0};
+    std::atomic<size_t> inner{0};
+  } shared_;
+  struct alignas(64) MainSide {   // main only
+    size_t outer;
+    size_t inner;
+    int pending;
+    int every;
+    int max_every;
+    int publications;
+    uint64_t last_reads;
+    std::thread::id writer;       // the one thread allowed to publish
+  } main_;
+  struct alignas(64) HelperSide { // written by the helper, sampled by main
+    std::atomic<uint64_t> reads{0};
+  } helper_;
+};
+
+template <typename T> inline void sync(T &iterator, int stride, size_t i,
+    bool accurate_sync, GhostProgress &progress,
+    bool &serialize_flag, const HyperParam_PfT &hyper_param) {
+    if (i % hyper_param.sync_frequency == 0 || serialize_flag) { // when serialize enabled, check more often
+        if (accurate_sync)
+            ghost_fence(); // make sure the counter is most up-to-date
+        size_t main_counter = progress.ReadOuter();
+        if (main_counter >= i) { // if pf thread is too slow
+            serialize_flag = false;
+            iterator = (T) (main_counter + hyper_param.skip_offset*stride);
+        } else if (i - main_counter > hyper_param.serialize_threshold) { // pf thread is too fast
+            serialize_flag = true;
+        } else if (i - main_counter < hyper_param.unserialize_threshold) {
+            serialize_flag = false;
+        }
+    }
+}
+
+/*
+GhostTelemetry: always-on, allocation-free helper telemetry
+
+Replaces the TimeDiff stamp buffers and std::map histograms for ghost loops.
+ - One cache-line-aligned GhostCounters block per GhostPool slot, written
+   only by that slot's helper, so counting needs no atomics or allocation
+ - Every progress check counts; every sample_period-th check also bins the
+   lead (helper index - main index) into a log2 histogram, buckets
+   [GHOST_LEAD_BUCKETS - 1 - k] hold leads in (-2^(k+1), -2^k] (helper
+   behind), [GHOST_LEAD_BUCKETS] a lead of 0 and [GHOST_LEAD_BUCKETS + 1 + k]
+   leads in [2^k, 2^(k+1)); the outermost buckets also take everything beyond
+ - Also counts throttles (serialize events), skip-ahead jumps and prefetch
+   steps (slices plus Pace()/Step() calls, one per prefetch site visit)
+ - At the end of each phase (GhostLoop::Join) the block is appended to the
+   output file, as CSV or one JSON object per line if it ends in .json, and
+   cleared; without an output file nothing is written
+*/
+
+#define GHOST_LEAD_BUCKETS 16
+#define GHOST_LEAD_BINS (2 * GHOST_LEAD_BUCKETS + 1)
+
+typedef struct GhostCounters {
+  uint64_t lead[GHOST_LEAD_BINS];
+  uint64_t checks;
+  uint64_t samples;
+  uint64_t throttles;
+  uint64_t jumps;
+  uint64_t prefetch_steps;
+  size_t padding[2]; // padding to 320 bytes (i.e., five cache lines)
+} GhostCounters __attribute__ ((aligned (64)));
+
+inline int ghost_lead_bin(size_t helper_i, size_t main_i) {
+  if (helper_i == main_i)
+    return GHOST_LEAD_BUCKETS;
+  bool ahead = helper_i > main_i;
+  uint64_t d = ahead ? helper_i - main_i : main_i - helper_i;
+  int k = std::min(63 - __builtin_clzll(d), GHOST_LEAD_BUCKETS - 1);
+  return ahead ? GHOST_LEAD_BUCKETS + 1 + k : GHOST_LEAD_BUCKETS - 1 - k;
+}
+
+class GhostTelemetry {
+ public:
+  static GhostTelemetry& Get() {
+    static GhostTelemetry telemetry;
+    return telemetry;
+  }
+
+  GhostTelemetry(const GhostTelemetry &other) = delete;
+
+  // bin the lead every period progress checks, 0 only counts
+  void set_sample_period(int period) { sample_period_ = std::max(0, period); }
+  int sample_period() const { return sample_period_; }
+
+  // phases are appended to filename, JSON lines if it ends in .json
+  void set_output(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (out_.is_open())
+      out_.close();
+    if (filename.empty())
+      return;
+    json_ = filename.size() > 5 &&
+            filename.compare(filename.size() - 5, 5, ".json") == 0;
+    out_.open(filename);
+    if (!out_.is_open()) {
+      std::cout << "Couldn't open telemetry output: " << filename << std::endl;
+      std::exit(-35);
+    }
+    if (!json_)
+      WriteCSVHeader();
+  }
+
+  GhostCounters& slot(int slot) { return counters_[slot]; }
+
+  // called by main after the slot's helper finished the phase
+  void EndPhase(int slot, const char *label) {
+    GhostCounters &c = counters_[slot];
+    if (out_.is_open()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (json_)
+        WriteJSON(slot, label, c);
+      else
+        WriteCSV(slot, label, c);
+      phase_++;
+    }
+    c = GhostCounters();
+  }
+
+ private:
+  GhostTelemetry() : sample_period_(16), json_(false), phase_(0) {
+    for (int s = 0; s < GHOST_MAX_SLOTS; s++)
+      counters_[s] = GhostCounters();
+  }
+
+  void WriteCSVHeader() {
+    out_ << "phase,label,slot,checks,samples,throttles,jumps,prefetch_steps";
+    for (int b = 0; b < GHOST_LEAD_BINS; b++)
+      out_ << ",lead" << BinName(b);
+    out_ << "\n";
+  }
+
+  void WriteCSV(int slot, const char *label, const GhostCounters &c) {
+    out_ << phase_ << "," << label << "," << slot << "," << c.checks << ","
+         << c.samples << "," << c.throttles << "," << c.jumps << ","
+         << c.prefetch_steps;
+    for (int b = 0; b < GHOST_LEAD_BINS; b++)
+      out_ << "," << c.lead[b];
+    out_ << "\n";
+  }
+
+  void WriteJSON(int slot, const char *label, const GhostCounters &c) {
+    out_ << "{\"phase\": " << phase_ << ", \"label\": \"" << label
+         << "\", \"slot\": " << slot << ", \"checks\": " << c.checks
+         << ", \"samples\": " << c.samples << ", \"throttles\": "
+         << c.throttles << ", \"jumps\": " << c.jumps
+         << ", \"prefetch_steps\": " << c.prefetch_steps << ", \"lead\": {";
+    bool first = true;
+    for (int b = 0; b < GHOST_LEAD_BINS; b++) {
+      if (c.lead[b] == 0)
+        continue;
+      out_ << (first ? "" : ", ") << "\"" << BinName(b) << "\": " << c.lead[b];
+      first = false;
+    }
+    out_ << "}}\n";
+  }
+
+  // lower edge of the bin: -2^k (behind), 0, +2^k (ahead)
+  static std::string BinName(int b) {
+    if (b == GHOST_LEAD_BUCKETS)
+      return "0";
+    int k = b > GHOST_LEAD_BUCKETS ? b - GHOST_LEAD_BUCKETS - 1
+                                   : GHOST_LEAD_BUCKETS - 1 - b;
+    return (b > GHOST_LEAD_BUCKETS ? "+" : "-") + std::to_string(1ull << k);
+  }
+
+  GhostCounters counters_[GHOST_MAX_SLOTS];
+  int sample_period_;
+  bool json_;
+  uint64_t phase_;
+  std::ofstream out_;
+  std::mutex mutex_;
+};
+
+/*
+GhostAdapt: online controller for the HyperParam_PfT of one ghost loop
+
+Replaces the offline-tuned thresholds with a target lead band, expressed in
+cache lines the helper has in flight ahead of main.
+ - The helper samples its lead (or that it fell behind and jumped) at every
+   progress check and re-evaluates every GHOST_ADAPT_WINDOW checks
+ - Lines per iteration are measured as Pace()/Step() calls per slice in
+   kSyncOuter and are 1 in kSyncInner, so the serialize/unserialize
+   thresholds (the band edges in iterations) follow the local degree
+ - Frequent jumps double skip_offset and halve sync_frequency; a window spent
+   inside the band without jumps doubles sync_frequency (up to the low edge)
+ - The adapted parameters carry over to the next phase of the same loop;
+   kSyncFollow loops never check progress and are left as they are
+*/
+
+#define GHOST_ADAPT_WINDOW 64       // progress checks per adaptation step
+#define GHOST_ADAPT_MAX_PARAM 65536 // bound on any adapted parameter
+
+class GhostAdapt {
+ public:
+  // keeps between lead_lines/2 and lead_lines cache lines in flight
+  explicit GhostAdapt(int lead_lines) :
+      band_lo_(std::max(1, lead_lines / 2)), band_hi_(std::max(2, lead_lines)),
+      seeded_(false), windows_(0), jumps_(0) {}
+
+  GhostAdapt(const GhostAdapt &other) = delete;
+
+  int band_lo() const { return band_lo_; }
+  int band_hi() const { return band_hi_; }
+
+  // parameters to start a phase with, the first phase starts from initial
+  HyperParam_PfT Load(const HyperParam_PfT &initial) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!seeded_) {
+      hyper_param_ = initial;
+      seeded_ = true;
+    }
+    return hyper_param_;
+  }
+
+  // records where a phase left the parameters
+  void Store(const HyperParam_PfT &hyper_param, uint64_t windows,
+             uint64_t jumps) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hyper_param_ = hyper_param;
+    windows_ += windows;
+    jumps_ += jumps;
+  }
+
+  void Print(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << "Ghost adapt " << name << ": " << windows_ << " windows, "
+              << jumps_ << " jumps, sync frequency = "
+              << hyper_param_.sync_frequency << ", skip offset = "
+              << hyper_param_.skip_offset << ", serialize threshold = "
+              << hyper_param_.serialize_threshold
+              << ", unserialize threshold = "
+              << hyper_param_.unserialize_threshold << std::endl;
+  }
+
+ private:
+  int band_lo_;
+  int band_hi_;
+  bool seeded_;
+  HyperParam_PfT hyper_param_;
+  uint64_t windows_;
+  uint64_t jumps_;
+  std::mutex mutex_;
+};
+
+/*
+GhostLoop: reusable ghost-thread (helper-thread prefetching) runtime
+
+Drives the pooled helper (see GhostPool) that runs ahead of one main-thread
+loop over [begin, end) and owns the progress counter the main thread
+publishes to, the serialize/unserialize hysteresis, throttling and skip-ahead.
+ - Kernels only supply the address slice: a callable invoked by the helper as
+   slice(i, loop) for every iteration i it visits; in kSyncOuter the runtime
+   throttles after each slice (unless set_pace_slices(false) leaves all
+   throttling to the slice), slices may also call Pace() in inner loops
+ - Progress is measured in iterations since begin (elements, not bytes, when
+   IterT is a pointer)
+ - kSyncOuter: main calls Publish(i) per outer iteration, helper checks after
+   each slice and jumps to main + skip_offset when it has fallen behind
+ - kSyncInner: main calls Advance() per inner iteration, slice calls Step()
+   per inner iteration (Step() returns how far the helper trails main)
+ - kSyncFollow: helper restarts at main + skip_offset after every slice
+ - set_adaptive() lets a GhostAdapt retune the hyperparameters as it runs
+ - Launched outside a parallel region, each thread of the OpenMP team that
+   runs the loop publishes to its own GhostProgress (one writer per record),
+   the helper follows the furthest outer and the summed inner progress;
+   launched inside one, only the launching thread may publish; without a
+   Launch, Publish and Advance do nothing
+*/
+
+#define GHOST_MAX_LANES 64        // OpenMP threads that can publish to a loop
+
+enum GhostSync { kSyncOuter, kSyncInner, kSyncFollow };
+
+template <typename IterT>
+class GhostLoop {
+ public:
+  GhostLoop(IterT begin, IterT end, const HyperParam_PfT &hyper_param,
+            GhostSync mode = kSyncOuter) :
+      begin_(begin), end_(end), hyper_param_(hyper_param), mode_(mode),
+      throttle_(GhostThrottle::Get()), throttle_reps_(1), pace_slices_(true), accurate_sync_(false), poll_while_behind_(false),
+      serialize_flag_(false), behind_(false), inner_(0), lanes_(0), slot_(0),
+      adapt_(nullptr), checks_(0), jumps_(0), lead_sum_(0), slices_(0),
+      paces_(0), windows_(0), total_jumps_(0), label_("loop"),
+      stats_(nullptr), sample_period_(0), sample_countdown_(0),
+      destroy_job_(nullptr) {}
+
+  // don't want this to be copied or moved, helper holds a pointer to it
+  GhostLoop(const GhostLoop &other) = delete;
+
+  ~GhostLoop() {
+    Join();
+  }
+
+  // throttle reps (see GhostThrottle) each time the helper is throttled
+  void set_throttle(int reps) { throttle_reps_ = reps; }
+
+  // throttle after every kSyncOuter slice, off for slices that only pace
+  // inside their inner loop
+  void set_pace_slices(bool pace) { pace_slices_ = pace; }
+
+  // fence before every progress read so the counter is up-to-date
+  void set_accurate_sync(bool accurate) { accurate_sync_ = accurate; }
+
+  // keep checking progress every step while the helper is behind main
+  void set_poll_while_behind(bool poll) { poll_while_behind_ = poll; }
+
+  // GhostPool slot whose helper runs this loop
+  void set_slot(int slot) { slot_ = slot; }
+
+  // names the loop in the telemetry output
+  void set_label(const char *label) { label_ = label; }
+
+  // lets adapt tune the hyperparameters (nullptr keeps them fixed), call
+  // before Launch
+  void set_adaptive(GhostAdapt *adapt) {
+    adapt_ = adapt;
+    if (adapt_ != nullptr)
+      hyper_param_ = adapt_->Load(hyper_param_);
+  }
+
+  // hands the loop to the pooled helper, the slice is kept in the loop object
+  template <typename SliceT>
+  void Launch(SliceT slice) {
+    typedef Job<SliceT> JobT;
+    static_assert(sizeof(JobT) <= sizeof(job_buf_), "slice captures too much");
+    JobT *job = new (job_buf_) JobT(this, slice);
+    destroy_job_ = &GhostLoop::DestroyJob<SliceT>;
+    stats_ = &GhostTelemetry::Get().slot(slot_);
+    sample_period_ = GhostTelemetry::Get().sample_period();
+    sample_countdown_ = sample_period_;
+    lanes_ = 1;
+    #ifdef _OPENMP
+    if (!omp_in_parallel())
+      lanes_ = std::min(omp_get_max_threads(), GHOST_MAX_LANES);
+    #endif
+    // a stale progress value must not look like a whole unserialize window
+    for (int l = 0; l < lanes_; l++)
+      progress_[l].Reset(0, std::min<int>(GHOST_PUBLISH_MAX,
+                                          hyper_param_.unserialize_threshold / 2));
+    GhostPool::Get().Dispatch(slot_, &JobT::Run, job);
+  }
+
+  void Join() {
+    if (destroy_job_ == nullptr)
+      return;
+    GhostPool::Get().Wait(slot_);
+    destroy_job_(job_buf_);
+    destroy_job_ = nullptr;
+    if (adapt_ != nullptr)
+      adapt_->Store(hyper_param_, windows_, total_jumps_);
+    GhostTelemetry::Get().EndPhase(slot_, label_);
+  }
+
+  /*-----main thread side-----*/
+  // both are batched, see GhostProgress
+  void Publish(IterT i) {
+    GhostProgress *progress = Lane();
+    if (progress == nullptr)
+      return;
+    progress->Outer(static_cast<size_t>(i - begin_));
+    ghost_trace_iter(static_cast<size_t>(i - begin_));
+  }
+
+  void Advance(size_t n = 1) {
+    GhostProgress *progress = Lane();
+    if (progress == nullptr)
+      return;
+    progress->Inner(n);
+    ghost_trace_iter(progress->inner());
+  }
+
+  /*-----helper thread side-----*/
+  const HyperParam_PfT& hyper_param() const { return hyper_param_; }
+
+  bool serializing() const { return serialize_flag_; }
+
+  // true if the last progress check found the helper trailing main
+  bool behind() const { return behind_; }
+
+  size_t main_progress() { return ReadMain(); }
+
+  void Throttle() {
+    stats_->throttles++;
+    throttle_.Throttle(throttle_reps_);
+  }
+
+  // throttles only while the helper is too far ahead
+  void Pace() {
+    paces_++;
+    stats_->prefetch_steps++;
+    if (serialize_flag_)
+      Throttle();
+  }
+
+  // counts one inner iteration (kSyncInner), returns how many inner
+  // iterations the helper trails main by (0 if not behind or not checked)
+  size_t Step() {
+    Pace();
+    size_t lag = 0;
+    if (inner_ % hyper_param_.sync_frequency == 0 || serialize_flag_ ||
+        (poll_while_behind_ && behind_)) {
+      size_t main_j = ReadMain();
+      behind_ = main_j >= inner_;
+      if (behind_)
+        lag = main_j - inner_;
+      Hysteresis(main_j, inner_);
+      Sample(main_j, inner_);
+      if (adapt_ != nullptr)
+        Observe(main_j, inner_);
+    }
+    inner_++;
+    ghost_trace_iter(inner_);
+    return lag;
+  }
+
+  // accounts for inner iterations the helper chose not to visit
+  void Skip(size_t n) {
+    stats_->jumps++;
+    inner_ += n;
+  }
+
+ private:
+  template <typename SliceT>
+  struct Job {
+    GhostLoop *loop;
+    SliceT slice;
+    Job(GhostLoop *l, const SliceT &sl) : loop(l), slice(sl) {}
+    static void Run(void *job) {
+      Job *j = static_cast<Job*>(job);
+      j->loop->HelperLoop(j->slice);
+    }
+  };
+
+  template <typename SliceT>
+  static void DestroyJob(void *job) {
+    static_cast<Job<SliceT>*>(job)->~Job<SliceT>();
+  }
+
+  // the calling thread's progress record, nullptr past GHOST_MAX_LANES or
+  // if no helper was launched
+  GhostProgress* Lane() {
+    #ifdef _OPENMP
+    if (lanes_ > 1) {
+      int lane = omp_get_thread_num();
+      return lane < lanes_ ? &progress_[lane] : nullptr;
+    }
+    #endif
+    return lanes_ == 1 ? &progress_[0] : nullptr;
+  }
+
+  size_t ReadMain() {
+    if (accurate_sync_)
+      throttle_.Fence(); // make sure the counter is up-to-date
+    return mode_ == kSyncInner ? ReadInner() : ReadOuter();
+  }
+
+  // furthest outer iteration any main thread has reached
+  size_t ReadOuter() {
+    size_t outer = progress_[0].ReadOuter();
+    for (int l = 1; l < lanes_; l++)
+      outer = std::max(outer, progress_[l].ReadOuter());
+    return outer;
+  }
+
+  // inner iterations all main threads have done together
+  size_t ReadInner() {
+    size_t inner = progress_[0].ReadInner();
+    for (int l = 1; l < lanes_; l++)
+      inner += progress_[l].ReadInner();
+    return inner;
+  }
+
+  // telemetry for one progress check
+  void Sample(size_t main_i, size_t i) {
+    stats_->checks++;
+    if (sample_period_ > 0 && --sample_countdown_ <= 0) {
+      sample_countdown_ = sample_period_;
+      stats_->samples++;
+      stats_->lead[ghost_lead_bin(i, main_i)]++;
+    }
+  }
+
+  // samples the lead at a progress check, adapts once per window
+  void Observe(size_t main_i, size_t i) {
+    if (main_i >= i)
+      jumps_++;
+    else
+      lead_sum_ += i - main_i;
+    if (++checks_ == GHOST_ADAPT_WINDOW)
+      Adapt();
+  }
+
+  void Adapt() {
+    double lines_per_iter = 1;
+    if (mode_ == kSyncOuter && slices_ > 0)
+      lines_per_iter = std::max(1.0, (double) paces_ / slices_);
+    auto bound = [] (double x) {
+      return (int32_t) std::min<double>(std::max(1.0, x),
+                                        GHOST_ADAPT_MAX_PARAM);
+    };
+    HyperParam_PfT &hp = hyper_param_;
+    // a lead of one iteration must be able to unserialize
+    hp.serialize_threshold = std::max(2, bound(adapt_->band_hi() / lines_per_iter));
+    hp.unserialize_threshold = std::min(
+        bound(adapt_->band_lo() / lines_per_iter), hp.serialize_threshold - 1);
+    size_t ahead = checks_ - jumps_;
+    double lead_lines = ahead ? lines_per_iter * lead_sum_ / ahead : 0;
+    if (jumps_ * 4 > checks_) { // helper keeps falling behind
+      hp.skip_offset = std::min(bound(2.0 * hp.skip_offset),
+                                hp.serialize_threshold);
+      hp.sync_frequency = bound(hp.sync_frequency / 2);
+    } else if (lead_lines > adapt_->band_hi()) { // serialize sooner
+      hp.sync_frequency = bound(hp.sync_frequency / 2);
+    } else if (jumps_ == 0 && lead_lines >= adapt_->band_lo()) {
+      hp.sync_frequency = std::min(bound(2.0 * hp.sync_frequency),
+                                   std::max(1, hp.unserialize_threshold));
+    }
+    windows_++;
+    total_jumps_ += jumps_;
+    checks_ = jumps_ = lead_sum_ = slices_ = paces_ = 0;
+  }
+
+  void Hysteresis(size_t main_i, size_t i) {
+    if (main_i >= i) { // helper is too slow
+      serialize_flag_ = false;
+    } else if (i - main_i > (size_t) hyper_param_.serialize_threshold) {
+      serialize_flag_ = true; // helper is too fast
+    } else if (i - main_i < (size_t) hyper_param_.unserialize_threshold) {
+      serialize_flag_ = false;
+    }
+  }
+
+  template <typename SliceT>
+  void HelperLoop(SliceT &slice) {
+    const size_t total = static_cast<size_t>(end_ - begin_);
+    for (size_t i = ReadOuter(); i < total; i++) {
+      if (mode_ != kSyncInner)
+        ghost_trace_iter(i);
+      slice(begin_ + i, *this);
+      if (mode_ == kSyncOuter) {
+        slices_++;
+        if (pace_slices_)
+          Pace();
+        else
+          stats_->prefetch_steps++;
+        if (i % hyper_param_.sync_frequency == 0 || serialize_flag_) {
+          size_t main_i = ReadMain();
+          Sample(main_i, i);
+          if (adapt_ != nullptr)
+            Observe(main_i, i);
+          if (main_i >= i) { // skip ahead of main
+            stats_->jumps++;
+            serialize_flag_ = false;
+            i = main_i + hyper_param_.skip_offset;
+          } else {
+            Hysteresis(main_i, i);
+          }
+        }
+      } else if (mode_ == kSyncFollow) {
+        stats_->prefetch_steps++;
+        i = ReadMain() + hyper_param_.skip_offset;
+      }
+    }
+  }
+
+  IterT begin_;
+  IterT end_;
+  HyperParam_PfT hyper_param_;
+  GhostSync mode_;
+  const GhostThrottle &throttle_;
+  int throttle_reps_;
+  bool pace_slices_;
+  bool accurate_sync_;
+  bool poll_while_behind_;
+  bool serialize_flag_;
+  bool behind_;
+  size_t inner_;
+  GhostProgress progress_[GHOST_MAX_LANES]; // one per publishing thread
+  int lanes_;
+  int slot_;
+  GhostAdapt *adapt_;
+  size_t checks_;       // adaptation window, helper side only
+  size_t jumps_;
+  size_t lead_sum_;
+  size_t slices_;
+  size_t paces_;
+  uint64_t windows_;
+  uint64_t total_jumps_;
+  const char *label_;
+  GhostCounters *stats_;  // telemetry of slot_, written by the helper only
+  int sample_period_;
+  int sample_countdown_;
+  void (*destroy_job_)(void*);
+  alignas(16) unsigned char job_buf_[256];
+};
+
 #endif // TIMEDIFF_H_
\ No newline at end of file
@@ -78,7 +78,7 @@ pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
 void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
   vector<pair<NodeID, ScoreT>> score_pairs(g.num_nodes());
   for (NodeID n=0; n < g.num_nodes(); n++) {
-    score_pairs[n] = make_pair(n, scores[n]);
+    score_pairs[n] = make_pair(g.original_id(n), scores[n]);
   }
   int k = 5;
   vector<pair<ScoreT, NodeID>> top_k = TopK(score_pairs, k);
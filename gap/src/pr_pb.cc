@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "omp.h"
+
+#include "benchmark.h"
+#include "builder.h"
+#include "command_line.h"
+#include "graph.h"
+#include "pvector.h"
+#include "timer.h"
+#include "pf_support.h"
+#include "ghost_tuning.h"
+
+
+/*
+GAP Benchmark Suite
+Kernel: PageRank (PR)
+
+Will return pagerank scores for all vertices once total change < epsilon
+
+This PR implementation uses propagation blocking [1], the alternative to
+hiding the random outgoing_contrib[] reads of the pull direction (pr_tpf)
+with a helper thread. Each iteration pushes in two phases:
+ - binning: every vertex appends its contribution, once per out-edge, to the
+   bin of the destination; a bin covers 2^B destination vertices (-B)
+ - accumulation: each bin is summed into its destinations, which fit in
+   cache if 2^B scores do, then their scores are updated
+The destinations are binned once per trial, so binning only rewrites the
+contributions, in the same order (deterministic PB in [1]). The sources are
+split into a few chunks per thread with a slice of every bin each, so both
+phases run in parallel without atomics. Updates are visible only in the next
+iteration (like pr_spmv).
+ - HTPF: a ghost helper runs ahead of the accumulation and prefetches the
+   sums it adds into, which pays off once -B is wider than the cache; fewer,
+   wider bins make binning cheaper, so the two can be combined
+
+[1] Scott Beamer, Krste Asanovic, and David Patterson. "Reducing PageRank
+    Communication via Propagation Blocking." IPDPS, 2017.
+*/
+
+
+// #define HTPF
+
+using namespace std;
+
+typedef float ScoreT;
+const float kDamp = 0.85;
+
+HyperParam_PfT hyper_param;
+GhostTuning ghost_tuning;
+GhostConfig ghost_accum;
+
+
+// Edges grouped by bin of the destination and, within a bin, by chunk of
+// the source, bin b chunk c holding entries starts[b*num_chunks + c] on
+class PropagationBins {
+ public:
+  PropagationBins(const Graph &g, int bin_shift, int64_t num_chunks) :
+      g_(g), bin_shift_(bin_shift), num_chunks_(num_chunks),
+      num_bins_(((g.num_nodes() - 1) >> bin_shift) + 1),
+      chunk_size_((g.num_nodes() + num_chunks - 1) / num_chunks),
+      starts_(num_bins_ * num_chunks + 1, 0),
+      dest_(g.num_edges_directed()), contrib_(g.num_edges_directed()) {
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int64_t c=0; c < num_chunks_; c++) {
+      for (NodeID u=ChunkBegin(c); u < ChunkEnd(c); u++)
+        for (NodeID v : g_.out_neigh(u))
+          starts_[Slice(v >> bin_shift_, c) + 1]++;
+    }
+    for (int64_t i=0; i < num_bins_ * num_chunks_; i++)
+      starts_[i + 1] += starts_[i];
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int64_t c=0; c < num_chunks_; c++) {
+      vector<int64_t> cursor = ChunkCursors(c);
+      for (NodeID u=ChunkBegin(c); u < ChunkEnd(c); u++)
+        for (NodeID v : g_.out_neigh(u))
+          dest_[cursor[v >> bin_shift_]++] = v;
+    }
+  }
+
+  // rewrites every contribution, in the order the destinations were binned
+  void Bin(const pvector<ScoreT> &scores) {
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int64_t c=0; c < num_chunks_; c++) {
+      vector<int64_t> cursor = ChunkCursors(c);
+      for (NodeID u=ChunkBegin(c); u < ChunkEnd(c); u++) {
+        ScoreT outgoing_contrib = scores[u] / g_.out_degree(u);
+        for (NodeID v : g_.out_neigh(u))
+          contrib_[cursor[v >> bin_shift_]++] = outgoing_contrib;
+      }
+    }
+  }
+
+  int64_t num_bins() const { return num_bins_; }
+  int64_t num_entries() const { return starts_[num_bins_ * num_chunks_]; }
+  int64_t bin_begin(int64_t b) const { return starts_[Slice(b, 0)]; }
+  int64_t bin_end(int64_t b) const { return starts_[Slice(b + 1, 0)]; }
+  NodeID vertex_begin(int64_t b) const { return b << bin_shift_; }
+  NodeID vertex_end(int64_t b) const {
+    return min((b + 1) << bin_shift_, g_.num_nodes());
+  }
+  const NodeID* dest() const { return dest_.data(); }
+  const ScoreT* contrib() const { return contrib_.data(); }
+
+ private:
+  int64_t Slice(int64_t b, int64_t c) const { return b * num_chunks_ + c; }
+  NodeID ChunkBegin(int64_t c) const {
+    return min(c * chunk_size_, g_.num_nodes());
+  }
+  NodeID ChunkEnd(int64_t c) const { return ChunkBegin(c + 1); }
+
+  vector<int64_t> ChunkCursors(int64_t c) const {
+    vector<int64_t> cursor(num_bins_);
+    for (int64_t b=0; b < num_bins_; b++)
+      cursor[b] = starts_[Slice(b, c)];
+    return cursor;
+  }
+
+  const Graph &g_;
+  const int bin_shift_;
+  const int64_t num_chunks_;
+  const int64_t num_bins_;
+  const int64_t chunk_size_;
+  pvector<int64_t> starts_;
+  pvector<NodeID> dest_;
+  pvector<ScoreT> contrib_;
+};
+
+
+pvector<ScoreT> PageRankPB(const Graph &g, int bin_shift, int max_iters,
+                           double epsilon = 0, bool logging_enabled = false) {
+  const ScoreT init_score = 1.0f / g.num_nodes();
+  const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
+  pvector<ScoreT> scores(g.num_nodes(), init_score);
+  pvector<ScoreT> sums(g.num_nodes());
+  int64_t num_chunks = 1;
+  #ifdef _OPENMP
+  num_chunks = 4 * omp_get_max_threads();
+  #endif
+  Timer t;
+  t.Start();
+  PropagationBins bins(g, bin_shift, num_chunks);
+  t.Stop();
+  if (logging_enabled)
+    PrintStep("Bins", t.Seconds(), bins.num_bins());
+  for (int iter=0; iter < max_iters; iter++) {
+    double error = 0;
+    bins.Bin(scores);
+    #ifdef HTPF
+    GhostLoop<int64_t> ghost(0, bins.num_entries(), ghost_accum.Or(hyper_param));
+    GhostTuning::Attach(ghost, ghost_accum);
+    const NodeID *dp = bins.dest();
+    ScoreT *sp = sums.data();
+    if (ghost_accum.enabled())
+      ghost.Launch([dp, sp] (int64_t i, GhostLoop<int64_t> &loop) {
+        ghost_prefetch(&sp[dp[i]]);
+      });
+    #endif
+    const NodeID *dest = bins.dest();
+    const ScoreT *contrib = bins.contrib();
+    #pragma omp parallel for reduction(+ : error) schedule(dynamic, 1)
+    for (int64_t b=0; b < bins.num_bins(); b++) {
+      for (NodeID n=bins.vertex_begin(b); n < bins.vertex_end(b); n++)
+        sums[n] = 0;
+      for (int64_t i=bins.bin_begin(b); i < bins.bin_end(b); i++) {
+        #ifdef HTPF
+        ghost.Publish(i);
+        #endif
+        ghost_load(&sums[dest[i]]);
+        sums[dest[i]] += contrib[i];
+      }
+      for (NodeID n=bins.vertex_begin(b); n < bins.vertex_end(b); n++) {
+        ScoreT old_score = scores[n];
+        scores[n] = base_score + kDamp * sums[n];
+        error += fabs(scores[n] - old_score);
+      }
+    }
+    #ifdef HTPF
+    ghost.Join();
+    #endif
+    if (logging_enabled)
+      PrintStep(iter, error);
+    if (error < epsilon)
+      break;
+  }
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted();
+  #endif
+  return scores;
+}
+
+
+void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
+  vector<pair<NodeID, ScoreT>> score_pairs(g.num_nodes());
+  for (NodeID n=0; n < g.num_nodes(); n++) {
+    score_pairs[n] = make_pair(n, scores[n]);
+  }
+  int k = 5;
+  vector<pair<ScoreT, NodeID>> top_k = TopK(score_pairs, k);
+  for (auto kvp : top_k)
+    cout << kvp.second << ":" << kvp.first << endl;
+}
+
+
+// Verifies by asserting a single serial iteration in push direction has
+//   error < target_error
+bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
+                        double target_error) {
+  const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
+  pvector<ScoreT> incoming_sums(g.num_nodes(), 0);
+  double error = 0;
+  for (NodeID u : g.vertices()) {
+    ScoreT outgoing_contrib = scores[u] / g.out_degree(u);
+    for (NodeID v : g.out_neigh(u))
+      incoming_sums[v] += outgoing_contrib;
+  }
+  for (NodeID n : g.vertices()) {
+    error += fabs(base_score + kDamp * incoming_sums[n] - scores[n]);
+    incoming_sums[n] = 0;
+  }
+  PrintTime("Total Error", error);
+  return error < target_error;
+}
+
+
+int main(int argc, char* argv[]) {
+  CLPageRankPB cli(argc, argv, "pagerank", 1e-4, 20);
+  if (!cli.ParseArgs())
+    return -1;
+  hyper_param.sync_frequency = cli.sync_frequency();
+  hyper_param.skip_offset = cli.skip_offset();
+  hyper_param.serialize_threshold = cli.serialize_threshold();
+  hyper_param.unserialize_threshold =
+      cli.serialize_threshold() > cli.unserialize_threshold() ?
+      cli.serialize_threshold() - cli.unserialize_threshold() : 0;
+  Builder b(cli);
+  Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("pr_pb", g, cli, hyper_param);
+  ghost_accum = ghost_tuning.Config("accum");
+  #endif
+  auto PRBound = [&cli] (const Graph &g) {
+    return PageRankPB(g, cli.bin_shift(), cli.max_iters(), cli.tolerance(),
+                      cli.logging_en());
+  };
+  auto VerifierBound = [&cli] (const Graph &g, const pvector<ScoreT> &scores) {
+    return PRVerifier(g, scores, cli.tolerance());
+  };
+  BenchmarkKernel(cli, g, PRBound, PrintTopScores, VerifierBound);
+  return 0;
+}
@@ -32,7 +32,8 @@ using namespace std;
 typedef float ScoreT;
 const float kDamp = 0.85;
 
-pvector<ScoreT> PageRankPull(const Graph &g, int max_iters, double epsilon = 0,
+template <typename GraphT_>
+pvector<ScoreT> PageRankPull(const GraphT_ &g, int max_iters, double epsilon = 0,
                              bool logging_enabled = false) {
   const ScoreT init_score = 1.0f / g.num_nodes();
   const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
@@ -61,7 +62,8 @@ pvector<ScoreT> PageRankPull(const Graph &g, int max_iters, double epsilon = 0,
 }
 
 
-void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
+template <typename GraphT_>
+void PrintTopScores(const GraphT_ &g, const pvector<ScoreT> &scores) {
   vector<pair<NodeID, ScoreT>> score_pairs(g.num_nodes());
   for (NodeID n=0; n < g.num_nodes(); n++) {
     score_pairs[n] = make_pair(n, scores[n]);
@@ -75,7 +77,8 @@ void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
 
 // Verifies by asserting a single serial iteration in push direction has
 //   error < target_error
-bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
+template <typename GraphT_>
+bool PRVerifier(const GraphT_ &g, const pvector<ScoreT> &scores,
                         double target_error) {
   const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
   pvector<ScoreT> incoming_sums(g.num_nodes(), 0);
@@ -94,18 +97,33 @@ bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
 }
 
 
+template <typename GraphT_>
+void RunBenchmark(const CLPageRank &cli, const GraphT_ &g) {
+  auto PRBound = [&cli] (const GraphT_ &g) {
+    return PageRankPull(g, cli.max_iters(), cli.tolerance(), cli.logging_en());
+  };
+  auto VerifierBound = [&cli] (const GraphT_ &g,
+                               const pvector<ScoreT> &scores) {
+    return PRVerifier(g, scores, cli.tolerance());
+  };
+  BenchmarkKernel(cli, g, PRBound, PrintTopScores<GraphT_>, VerifierBound);
+}
+
+
 int main(int argc, char* argv[]) {
   CLPageRank cli(argc, argv, "pagerank", 1e-4, 20);
   if (!cli.ParseArgs())
     return -1;
   Builder b(cli);
   Graph g = b.MakeGraph();
-  auto PRBound = [&cli] (const Graph &g) {
-    return PageRankPull(g, cli.max_iters(), cli.tolerance(), cli.logging_en());
-  };
-  auto VerifierBound = [&cli] (const Graph &g, const pvector<ScoreT> &scores) {
-    return PRVerifier(g, scores, cli.tolerance());
-  };
-  BenchmarkKernel(cli, g, PRBound, PrintTopScores, VerifierBound);
+  #ifndef NODEID64  // -C is refused with 64-bit IDs
+  if (cli.compressed()) {
+    CGraph cg(g);
+    g = Graph();
+    RunBenchmark(cli, cg);
+  }
+  #endif
+  if (!cli.compressed())
+    RunBenchmark(cli, g);
   return 0;
 }
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include <vector>
 #include <thread>
 #include <chrono>
@@ -14,8 +15,10 @@
 #include "builder.h"
 #include "command_line.h"
 #include "graph.h"
+#include "isa.h"
 #include "pvector.h"
 #include "pf_support.h" 
+#include "ghost_tuning.h"
 
 /*
 GAP Benchmark Suite
@@ -28,6 +31,12 @@ This PR implementation uses the traditional iterative approach. It performs
 updates in the pull direction to remove the need for atomics, and it allows
 new values to be immediately visible (like Gauss-Seidel method). The prior PR
 implementation is still available in src/pr_spmv.cc.
+
+On a plain CSR the sum over the in-neighbors can use AVX2 or AVX-512 gathers
+(8 or 16 neighbors a load, masked for the tail and short lists), picked at
+runtime from what the CPU has (-I to cap it), which keeps many contribution
+misses in flight even without the helper. A CGraph (-C), 64-bit IDs, inner
+sync and the ghost trace stay scalar.
 */
 
 #define ORDER_READ memory_order_relaxed
@@ -94,68 +103,148 @@ std::chrono::_V2::system_clock::time_point time_array[TOTAL_ITER/FREQ+100];
 #endif 
 #endif // TIME 
 
-TimeDiff time_diff; 
 HyperParam_PfT hyper_param; 
-
-void PfThread(const Graph* g, ScoreT* const outgoing_contrib) {
-    size_t local_counter = 0; 
-    bool serialize_flag = false; 
-    NodeID start_iter = time_diff.read_atomic_main(ORDER_READ); //0; 
-    for (NodeID u=start_iter; u < g->num_nodes(); u++) {
-      local_counter = u; 
-      for (NodeID v : g->in_neigh(u)) {
-        __builtin_prefetch(&outgoing_contrib[v]); // 0 for read, 2 for stay pos 
-        // *(volatile ScoreT*)&outgoing_contrib[v]; // load 
-
-        if (serialize_flag) {
-          asm volatile ("serialize\n\t"); 
-        }
-      }
-      sync<NodeID>(u, 1, u, false, time_diff, ORDER_READ, serialize_flag, hyper_param); 
-    }
+GhostTuning ghost_tuning; 
+GhostConfig ghost_pull; 
+
+// slice for outer sync: prefetch contributions of u's in-neighbors; on a
+// CGraph (-C) the helper decodes u's list ahead of main, which leaves the
+// coded bytes in cache for main's own decode
+template <typename GraphT_>
+void PfThread(const GraphT_* g, ScoreT* const outgoing_contrib, NodeID u,
+              GhostLoop<NodeID> &loop) {
+  for (NodeID v : g->in_neigh(u)) {
+    ghost_prefetch(&outgoing_contrib[v]); // 0 for read, 2 for stay pos 
+    loop.Pace(); 
+  }
 }
 
 #ifdef INNER
-void PfThread_inner(const Graph* g, ScoreT* const outgoing_contrib) {
-    size_t local_counter = 0; 
-    bool serialize_flag = false; 
-    NodeID start_iter = time_diff.read_atomic_main(ORDER_READ); //0; 
-    for (NodeID u=start_iter; u < g->num_nodes(); u++) {
-      // uint32_t iter = g->in_neigh(u).end() - g->in_neigh(u).begin(); 
-      for (NodeID* v = g->in_neigh(u).begin(); v < g->in_neigh(u).end(); v++) {
-      // for (NodeID v : g->in_neigh(u)) {
-        __builtin_prefetch(&outgoing_contrib[*v]); 
-        // *(volatile ScoreT*)&outgoing_contrib[*v]; // load 
-        if (serialize_flag) {
-          asm volatile ("serialize\n\t"); 
-        }
-        /*----inner sync----*/
-        local_counter++; 
-        if (local_counter % hyper_param.sync_frequency == 0 || serialize_flag) { // when serialize enabled, check more often 
-          // asm volatile ("serialize\n\t"); // a serialize here to make sure the counter is most up-to-date 
-          size_t main_counter = time_diff.read_atomic_main(ORDER_READ); 
-          if (main_counter >= local_counter) { // if pf thread is too slow 
-            serialize_flag = false; 
-            uint32_t remian_iter = g->in_neigh(u).end() - v; 
-            if (main_counter - local_counter >= remian_iter) {
-              break; 
-            } else {
-              v = v + (main_counter - local_counter) + hyper_param.skip_offset; 
-            }
-          } else if (local_counter - main_counter > hyper_param.serialize_threshold) { // pf thread is too fast 
-            serialize_flag = true; 
-          } else if (local_counter - main_counter < hyper_param.unserialize_threshold) {
-            serialize_flag = false; 
-          }
-        }
-        /*----inner sync----*/
+// slice for inner sync: skips ahead within the neighborhood when behind
+template <typename GraphT_>
+void PfThread_inner(const GraphT_* g, ScoreT* const outgoing_contrib, NodeID u,
+                    GhostLoop<NodeID> &loop) {
+  auto v = g->in_neigh(u).begin();
+  for (size_t left = g->in_degree(u); left > 0; left--, ++v) {
+    ghost_prefetch(&outgoing_contrib[*v]); 
+    size_t behind = loop.Step(); 
+    if (behind) { // if pf thread is too slow 
+      size_t remain_iter = left - 1; 
+      size_t jump = behind + loop.hyper_param().skip_offset; 
+      if (jump >= remain_iter) {
+        loop.Skip(remain_iter); 
+        break; 
       }
+      std::advance(v, jump); // decodes through on a CGraph
+      left -= jump; 
+      loop.Skip(jump); 
     }
+  }
 }
 #endif 
 
-pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
-                               bool logging_enabled = false) {
+// Sums contrib[] over a list of count IDs
+typedef ScoreT (*GatherSumFn)(const NodeID*, int64_t, const ScoreT*);
+
+#if defined(GAP_X86_SIMD) && !defined(NODEID64)
+__attribute__((target("avx2")))
+ScoreT GatherSumAVX2(const NodeID *ids, int64_t count, const ScoreT *contrib) {
+  __m256 acc = _mm256_setzero_ps();
+  int64_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+    acc = _mm256_add_ps(acc, _mm256_i32gather_ps(contrib, idx, 4));
+  }
+  if (i < count) {
+    __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i),
+                                      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i idx = _mm256_maskload_epi32(ids + i, mask);
+    acc = _mm256_add_ps(acc, _mm256_mask_i32gather_ps(
+        _mm256_setzero_ps(), contrib, idx, _mm256_castsi256_ps(mask), 4));
+  }
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+                          _mm256_extractf128_ps(acc, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx512f,avx512vl")))
+ScoreT GatherSumAVX512(const NodeID *ids, int64_t count,
+                       const ScoreT *contrib) {
+  __m512 acc = _mm512_setzero_ps();
+  int64_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m512i idx = _mm512_loadu_si512(ids + i);
+    acc = _mm512_add_ps(acc, _mm512_i32gather_ps(idx, contrib, 4));
+  }
+  if (i + 8 < count) {
+    __mmask16 mask = (1u << (count - i)) - 1;
+    __m512i idx = _mm512_maskz_loadu_epi32(mask, ids + i);
+    acc = _mm512_add_ps(acc, _mm512_mask_i32gather_ps(
+        _mm512_setzero_ps(), mask, idx, contrib, 4));
+    i = count;
+  }
+  __m256 half = _mm256_add_ps(_mm512_castps512_ps256(acc),
+      _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1)));
+  if (i < count) {
+    __mmask8 mask = (1u << (count - i)) - 1;
+    __m256i idx = _mm256_maskz_loadu_epi32(mask, ids + i);
+    half = _mm256_add_ps(half, _mm256_mmask_i32gather_ps(
+        _mm256_setzero_ps(), mask, idx, contrib, 4));
+  }
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(half),
+                          _mm256_extractf128_ps(half, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+}
+#endif
+
+// the ISA the pull will use on g, scalar where the gathers don't apply
+template <typename GraphT_>
+VectorISA GatherISA(const GraphT_ &g, VectorISA isa) {
+  return kISAScalar;
+}
+
+VectorISA GatherISA(const Graph &g, VectorISA isa) {
+  #if defined(GAP_X86_SIMD) && !defined(NODEID64) && !defined(GHOST_TRACE)
+  return isa;
+  #else
+  return kISAScalar;
+  #endif
+}
+
+GatherSumFn GatherSum(VectorISA isa) {
+  #if defined(GAP_X86_SIMD) && !defined(NODEID64)
+  if (isa == kISAAVX512)
+    return &GatherSumAVX512;
+  if (isa == kISAAVX2)
+    return &GatherSumAVX2;
+  #endif
+  return nullptr;
+}
+
+template <typename GraphT_>
+ScoreT GatherInNeigh(const GraphT_ &g, NodeID u, const ScoreT *contrib,
+                     GatherSumFn gather_sum) {
+  ScoreT total = 0;
+  for (NodeID v : g.in_neigh(u))
+    total += contrib[v];
+  return total;
+}
+
+ScoreT GatherInNeigh(const Graph &g, NodeID u, const ScoreT *contrib,
+                     GatherSumFn gather_sum) {
+  auto neigh = g.in_neigh(u);
+  return gather_sum(neigh.begin(), neigh.end() - neigh.begin(), contrib);
+}
+
+template <typename GraphT_>
+pvector<ScoreT> PageRankPullGS(const GraphT_ &g, int max_iters, double epsilon=0,
+                               bool logging_enabled = false,
+                               VectorISA isa = kISAScalar) {
+  GatherSumFn gather_sum = GatherSum(GatherISA(g, isa));
   const ScoreT init_score = 1.0f / g.num_nodes();
   const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
   pvector<ScoreT> scores(g.num_nodes(), init_score);
@@ -166,31 +255,41 @@ pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
   for (int iter=0; iter < max_iters; iter++) {
     double error = 0;
 
-    const auto gp = &g; 
-    const auto op = outgoing_contrib.begin(); 
-    // const auto start = chrono::high_resolution_clock::now();
     #ifdef HTPF
     #ifdef INNER
-    thread PF(PfThread_inner, gp, op); 
-    time_diff.set_atomic_main(0, ORDER_WRITE); // inner sync
+    GhostLoop<NodeID> ghost(0, g.num_nodes(), ghost_pull.Or(hyper_param), kSyncInner); 
+    GhostTuning::Attach(ghost, ghost_pull); 
+    if (ghost_pull.enabled())
+      ghost.Launch([&g, &outgoing_contrib] (NodeID u, GhostLoop<NodeID> &loop) {
+        PfThread_inner(&g, outgoing_contrib.begin(), u, loop); 
+      }); 
     #else
-    thread PF(PfThread, gp, op); // outer 
+    GhostLoop<NodeID> ghost(0, g.num_nodes(), ghost_pull.Or(hyper_param)); 
+    GhostTuning::Attach(ghost, ghost_pull); 
+    ghost.set_pace_slices(false); // PfThread paces per in-neighbor 
+    if (ghost_pull.enabled())
+      ghost.Launch([&g, &outgoing_contrib] (NodeID u, GhostLoop<NodeID> &loop) {
+        PfThread(&g, outgoing_contrib.begin(), u, loop); 
+      }); 
     #endif // INNER
     #endif // HTPF
-    // const auto end = chrono::high_resolution_clock::now();
-    // auto us_int = chrono::duration_cast<chrono::microseconds>(end - start);
-    // cout << "thread setup time: " << us_int.count() << "us" << endl; 
-    // sum_setup_time += us_int.count(); 
     #pragma omp parallel for reduction(+ : error) schedule(dynamic, 16384)
     for (NodeID u=0; u < g.num_nodes(); u++) {
       #if defined(HTPF) && !defined(INNER)
-      time_diff.set_atomic_main(u, ORDER_WRITE); // not inner sync 
+      ghost.Publish(u); // not inner sync 
       #endif 
       ScoreT incoming_total = 0;
+      #if !defined(INNER) && !defined(TIME)
+      if (gather_sum != nullptr)
+        incoming_total = GatherInNeigh(g, u, outgoing_contrib.begin(),
+                                       gather_sum);
+      else
+      #endif
       for (NodeID v : g.in_neigh(u)) {
+        ghost_load(&outgoing_contrib[v]); 
         incoming_total += outgoing_contrib[v];
         #if defined(HTPF) && defined(INNER)
-        time_diff.add_atomic_main(1, ORDER_WRITE); // inner sync
+        ghost.Advance(); // inner sync
         #endif 
         #ifdef TIME
         #ifdef OMP
@@ -212,7 +311,7 @@ pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
       outgoing_contrib[u] = scores[u] / g.out_degree(u);
     }
     #ifdef HTPF
-    PF.join(); 
+    ghost.Join(); 
     #endif 
 
     if (logging_enabled)
@@ -220,11 +319,16 @@ pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
     if (error < epsilon)
       break;
   }
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted(); 
+  #endif 
   return scores;
 }
 
 
-void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
+template <typename GraphT_>
+void PrintTopScores(const GraphT_ &g, const pvector<ScoreT> &scores) {
   vector<pair<NodeID, ScoreT>> score_pairs(g.num_nodes());
   for (NodeID n=0; n < g.num_nodes(); n++) {
     score_pairs[n] = make_pair(n, scores[n]);
@@ -238,7 +342,8 @@ void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
 
 // Verifies by asserting a single serial iteration in push direction has
 //   error < target_error
-bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
+template <typename GraphT_>
+bool PRVerifier(const GraphT_ &g, const pvector<ScoreT> &scores,
                         double target_error) {
   const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
   pvector<ScoreT> incoming_sums(g.num_nodes(), 0);
@@ -257,13 +362,27 @@ bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
 }
 
 
+template <typename GraphT_>
+void RunBenchmark(const CLPageRank &cli, const GraphT_ &g) {
+  VectorISA isa = GatherISA(g, cli.vector_isa());
+  cout << "Pull gather: " << ISAName(isa) << endl;
+  auto PRBound = [&cli, isa] (const GraphT_ &g) {
+    return PageRankPullGS(g, cli.max_iters(), cli.tolerance(), cli.logging_en(),
+                          isa);
+  };
+  auto VerifierBound = [&cli] (const GraphT_ &g,
+                               const pvector<ScoreT> &scores) {
+    return PRVerifier(g, scores, cli.tolerance());
+  };
+  BenchmarkKernel(cli, g, PRBound, PrintTopScores<GraphT_>, VerifierBound);
+}
+
+
 int main(int argc, char* argv[]) {
   #ifdef OMP
   omp_set_num_threads(2); 
   #endif
 
-  time_diff.init_atomic(); 
-  // time_diff.init_atomic_histogram(751619276); 
   #ifdef TIME
   stamp_counter = 0; 
   array_counter = 0; 
@@ -284,21 +403,26 @@ int main(int argc, char* argv[]) {
   
   Builder b(cli);
   Graph g = b.MakeGraph();
-  auto PRBound = [&cli] (const Graph &g) {
-    return PageRankPullGS(g, cli.max_iters(), cli.tolerance(), cli.logging_en());
-  };
-  auto VerifierBound = [&cli] (const Graph &g, const pvector<ScoreT> &scores) {
-    return PRVerifier(g, scores, cli.tolerance());
-  };
+  #ifdef HTPF
+  ghost_tuning.Init("pr", g, cli, hyper_param); 
+  ghost_pull = ghost_tuning.Config("pull"); 
+  #endif 
   #ifdef TIME
   auto kernel_start = chrono::high_resolution_clock::now();
   #endif 
-  BenchmarkKernel(cli, g, PRBound, PrintTopScores, VerifierBound);
+  #ifndef NODEID64  // -C is refused with 64-bit IDs
+  if (cli.compressed()) {
+    CGraph cg(g);
+    g = Graph();
+    RunBenchmark(cli, cg);
+  }
+  #endif
+  if (!cli.compressed())
+    RunBenchmark(cli, g);
 
   // cout << "total thread setup time = " << sum_setup_time << "us" << endl; 
   // cout << "total thread wait join time = " << sum_wait_join_time << "us" << endl; 
 
-  // time_diff.print_atomic_histogram(); 
   #ifdef TIME
   ofstream myout; 
   myout.open(OUTPUT); 
@@ -48,26 +48,14 @@ HyperParam_PfT hyper_param;
 // TimeDiff histogram; 
 
 void PfThread(int me, const Graph* g, int64_t start, int64_t end, ScoreT* const outgoing_contrib) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  CPU_SET(me*2+1, &cpuset);
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin main thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/ 
+  GhostTopology::Get().PinHelper(me);
   bool serialize_flag = false; 
   for (NodeID u=start; u < end; u++) {
     for (NodeID v : g->in_neigh(u)) {
       __builtin_prefetch(&outgoing_contrib[v]); 
       // *(volatile ScoreT*)&outgoing_contrib[v]; // load 
       if (serialize_flag) 
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
     }
     sync<NodeID>(u, 1, u, true, time_diff, me, ORDER_READ, serialize_flag, hyper_param); 
     // if (u % 4 == 0 && me == 0)
@@ -90,18 +78,7 @@ pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
     #pragma omp parallel 
     {
     int me = omp_get_thread_num(); 
-    /*-----pin the pf thread to specfic core-----*/ 
-    pthread_t self = pthread_self();
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(me*2, &cpuset);
-          
-    int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-    if (rc != 0) {
-      printf("Failed to pin main thread.\n");
-      exit(1);
-    }
-    /*-----pin the pf thread to specfic core-----*/ 
+    GhostTopology::Get().PinMain(me);
     // vector<thread> pf_threads; 
     size_t div = g.num_nodes() / NT; 
     size_t mod = g.num_nodes() % NT; 
@@ -201,6 +178,7 @@ int main(int argc, char* argv[]) {
   cout << "sync frequency = " << hyper_param.sync_frequency << ", serialize threshold = " << hyper_param.serialize_threshold 
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
   
+  GhostThrottle::Get(); // calibrate before anything is timed
   Builder b(cli);
   Graph g = b.MakeGraph();
   auto PRBound = [&cli] (const Graph &g) {
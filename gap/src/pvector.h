@@ -6,6 +6,8 @@
 
 #include <algorithm>
 
+#include "page_alloc.h"
+
 
 /*
 GAP Benchmark Suite
@@ -16,6 +18,7 @@ Vector class with ability to not initialize or do initialization in parallel
  - std::vector (when resizing) will always initialize, and does so serially
  - When pvector is resized, new elements are uninitialized
  - Resizing is not thread-safe
+ - Storage comes from PageNew(), so it follows the page policy (-H)
 */
 
 
@@ -27,7 +30,7 @@ class pvector {
   pvector() : start_(nullptr), end_size_(nullptr), end_capacity_(nullptr) {}
 
   explicit pvector(size_t num_elements) {
-    start_ = new T_[num_elements];
+    start_ = PageNew<T_>(num_elements);
     end_size_ = start_ + num_elements;
     end_capacity_ = end_size_;
   }
@@ -71,7 +74,7 @@ class pvector {
 
   void ReleaseResources(){
     if (start_ != nullptr) {
-      delete[] start_;
+      PageDelete(start_);
     }
   }
 
@@ -82,12 +85,12 @@ class pvector {
   // not thread-safe
   void reserve(size_t num_elements) {
     if (num_elements > capacity()) {
-      T_ *new_range = new T_[num_elements];
+      T_ *new_range = PageNew<T_>(num_elements);
       #pragma omp parallel for
       for (size_t i=0; i < size(); i++)
         new_range[i] = start_[i];
       end_size_ = new_range + size();
-      delete[] start_;
+      PageDelete(start_);
       start_ = new_range;
       end_capacity_ = start_ + num_elements;
     }
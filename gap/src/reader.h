@@ -4,11 +4,22 @@
 #ifndef READER_H_
 #define READER_H_
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #include "pvector.h"
 #include "util.h"
@@ -22,9 +33,26 @@ Author: Scott Beamer
 Given filename, returns an edgelist or the entire graph (if serialized)
  - Intended to be called from Builder
  - Determines file format from the filename's suffix
- - If the input graph is serialized (.sg or .wsg), reads the graph
+ - If the input graph is serialized (.sg or .wsg, .sg64 or .wsg64 for
+   NODEID64 builds), reads the graph
    directly into the returned graph instance
  - Otherwise, reads the file and returns an edgelist
+ - Text edge lists (.el, .wel, .gr and the body of .mtx) are parsed in
+   parallel: the mapped file is split into newline-aligned chunks, each
+   chunk counts its edges, a prefix sum places every chunk in a presized
+   edgelist, then the chunks parse their lines into it. They are line
+   oriented: one edge per line, lines not starting with a number (with
+   'a' for .gr) are skipped. -DSERIAL_READ keeps the istream readers.
+ - v2 serialized graphs are mapped and used in place: only the pointer index
+   is built, the neighbor arrays stay in the (shared) page cache. The
+   mapping is read-only: kernels must not write to a loaded graph.
+   $GAP_SG_MMAP takes comma-separated hints for it:
+     populate   - fault the whole file in up front (MAP_POPULATE)
+     willneed   - start readahead of the whole file (MADV_WILLNEED)
+     sequential - MADV_SEQUENTIAL
+     random     - MADV_RANDOM, no readahead
+     hugepage   - MADV_HUGEPAGE, if the page cache supports it
+     off        - copy the sections into the heap instead and unmap
 */
 
 
@@ -47,6 +75,208 @@ class Reader {
     return filename_.substr(suff_pos);
   }
 
+  bool IsSerialized() {
+    return SGSuffixIDBytes(GetSuffix()) != 0;
+  }
+
+  enum TextFormat { kTextEL, kTextWEL, kTextGR, kTextMTX };
+
+  static bool IsBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  static bool ScanInt(const char *&p, const char *end, int64_t &x) {
+    while (p < end && IsBlank(*p))
+      p++;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+      p++;
+    const char *digits = p;
+    int64_t value = 0;
+    while (p < end && static_cast<unsigned>(*p - '0') < 10)
+      value = value * 10 + (*p++ - '0');
+    x = negative ? -value : value;
+    return p != digits;
+  }
+
+  // integers take the fast path, reals are accumulated in a double
+  static bool ScanWeight(const char *&p, const char *end, WeightT_ &w) {
+    int64_t whole;
+    const char *start = p;
+    if (!ScanInt(p, end, whole))
+      return false;
+    if (p == end || (*p != '.' && *p != 'e' && *p != 'E')) {
+      w = static_cast<WeightT_>(whole);
+      return true;
+    }
+    while (*start != '-' && *start != '+' &&
+           static_cast<unsigned>(*start - '0') >= 10)
+      start++;
+    bool negative = *start == '-';
+    double value = std::abs(static_cast<double>(whole));
+    if (p < end && *p == '.') {
+      double scale = 0.1;
+      for (p++; p < end && static_cast<unsigned>(*p - '0') < 10; p++) {
+        value += (*p - '0') * scale;
+        scale *= 0.1;
+      }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      int64_t exponent;
+      p++;
+      if (!ScanInt(p, end, exponent))
+        return false;
+      value *= std::pow(10.0, static_cast<double>(exponent));
+    }
+    w = static_cast<WeightT_>(negative ? -value : value);
+    return true;
+  }
+
+  // edges the line [p, eol) yields; parses them into out unless it is
+  // nullptr, returns -1 for a malformed edge line
+  static int ParseLine(const char *p, const char *eol, TextFormat format,
+                       bool weighted, bool symmetric, Edge *out) {
+    while (p < eol && IsBlank(*p))
+      p++;
+    if (p == eol)
+      return 0;
+    if (format == kTextGR) {
+      if (*p != 'a')
+        return 0;
+      p++;
+    } else if (*p != '-' && *p != '+' &&
+               static_cast<unsigned>(*p - '0') >= 10) {
+      return 0;
+    }
+    int num_edges = format == kTextMTX && symmetric ? 2 : 1;
+    if (out == nullptr)
+      return num_edges;
+    int64_t u, v;
+    WeightT_ w = 1;
+    if (!ScanInt(p, eol, u) || !ScanInt(p, eol, v) ||
+        (weighted && !ScanWeight(p, eol, w)))
+      return -1;
+    if (format == kTextGR || format == kTextMTX) {
+      u--;
+      v--;
+    }
+    if (weighted) {
+      NodeWeight<NodeID_, WeightT_> nw(v, w);
+      out[0] = Edge(u, nw);
+      if (num_edges == 2) {
+        NodeWeight<NodeID_, WeightT_> rev(u, w);
+        out[1] = Edge(v, rev);
+      }
+    } else {
+      out[0] = Edge(u, v);
+      if (num_edges == 2)
+        out[1] = Edge(v, u);
+    }
+    return num_edges;
+  }
+
+  // parses [begin, end) of the mapped file, see above
+  EdgeList ParseText(const char *begin, const char *end, TextFormat format,
+                     bool weighted, bool symmetric = false) {
+    const size_t kChunkBytes = 1 << 22;
+    size_t bytes = end - begin;
+    size_t num_chunks = bytes / kChunkBytes + 1;
+    std::vector<const char*> bounds(num_chunks + 1);
+    bounds[0] = begin;
+    bounds[num_chunks] = end;
+    for (size_t c = 1; c < num_chunks; c++) {
+      const char *p = begin + c * (bytes / num_chunks);
+      const char *nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      bounds[c] = nl == nullptr ? end : nl + 1;
+    }
+    pvector<int64_t> offsets(num_chunks + 1);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t c = 0; c < num_chunks; c++) {
+      int64_t count = 0;
+      const char *p = bounds[c];
+      while (p < bounds[c+1]) {
+        const char *eol = static_cast<const char*>(
+            std::memchr(p, '\n', bounds[c+1] - p));
+        if (eol == nullptr)
+          eol = bounds[c+1];
+        count += ParseLine(p, eol, format, weighted, symmetric, nullptr);
+        p = eol + 1;
+      }
+      offsets[c+1] = count;
+    }
+    offsets[0] = 0;
+    for (size_t c = 0; c < num_chunks; c++)
+      offsets[c+1] += offsets[c];
+    EdgeList el(offsets[num_chunks]);
+    int64_t malformed = 0;
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+ : malformed)
+    for (size_t c = 0; c < num_chunks; c++) {
+      Edge *out = el.data() + offsets[c];
+      const char *p = bounds[c];
+      while (p < bounds[c+1]) {
+        const char *eol = static_cast<const char*>(
+            std::memchr(p, '\n', bounds[c+1] - p));
+        if (eol == nullptr)
+          eol = bounds[c+1];
+        int n = ParseLine(p, eol, format, weighted, symmetric, out);
+        if (n < 0) {
+          malformed++;
+          n = ParseLine(p, eol, format, weighted, symmetric, nullptr);
+          std::fill(out, out + n, Edge(0, 0));
+        }
+        out += n;
+        p = eol + 1;
+      }
+    }
+    if (malformed != 0) {
+      std::cout << malformed << " malformed edge lines in " << filename_
+                << std::endl;
+      std::exit(-27);
+    }
+    return el;
+  }
+
+  EdgeList ReadInText(std::ifstream &in, TextFormat format, bool weighted,
+                      bool symmetric = false) {
+    std::streamoff start = in.tellg();
+    size_t bytes;
+    std::shared_ptr<void> mapping = MapFile(MAP_PRIVATE, bytes, -2);
+    const char *base = static_cast<const char*>(mapping.get());
+    if (base == nullptr || start < 0 || static_cast<size_t>(start) >= bytes)
+      return EdgeList();
+    madvise(mapping.get(), bytes, MADV_SEQUENTIAL);
+    return ParseText(base + start, base + bytes, format, weighted, symmetric);
+  }
+
+  // format of a text edge list and the offset its edges start at, for
+  // callers that parse the mapped file in windows (OutOfCoreBuilder)
+  size_t TextLayout(TextFormat &format, bool &weighted, bool &symmetric) {
+    std::string suffix = GetSuffix();
+    symmetric = false;
+    weighted = suffix != ".el";
+    if (suffix == ".el") {
+      format = kTextEL;
+    } else if (suffix == ".wel") {
+      format = kTextWEL;
+    } else if (suffix == ".gr") {
+      format = kTextGR;
+    } else if (suffix == ".mtx") {
+      format = kTextMTX;
+      std::ifstream file(filename_);
+      if (!file.is_open()) {
+        std::cout << "Couldn't open file " << filename_ << std::endl;
+        std::exit(-2);
+      }
+      ReadMTXHeader(file, weighted, symmetric);
+      std::streamoff start = file.tellg();
+      return start < 0 ? SIZE_MAX : start;
+    } else {
+      std::cout << "Can't stream " << suffix << " files" << std::endl;
+      std::exit(-3);
+    }
+    return 0;
+  }
+
   EdgeList ReadInEL(std::ifstream &in) {
     EdgeList el;
     NodeID_ u, v;
@@ -142,11 +372,9 @@ class Reader {
     return el;
   }
 
-  // Note: converts vertex numbering from 1..N to 0..N-1
-  // Note: weights casted to type WeightT_
-  EdgeList ReadInMTX(std::ifstream &in, bool &needs_weights) {
-    EdgeList el;
-    std::string start, object, format, field, symmetry, line;
+  // parses the banner and size line, leaves in at the first entry
+  void ReadMTXHeader(std::ifstream &in, bool &read_weights, bool &undirected) {
+    std::string start, object, format, field, symmetry;
     in >> start >> object >> format >> field >> symmetry >> std::ws;
     if (start != "%%MatrixMarket") {
       std::cout << ".mtx file did not start with %%MatrixMarket" << std::endl;
@@ -160,7 +388,6 @@ class Reader {
       std::cout << "do not support complex weights for .mtx" << std::endl;
       std::exit(-23);
     }
-    bool read_weights;
     if (field == "pattern") {
       read_weights = false;
     } else if ((field == "real") || (field == "double") ||
@@ -170,7 +397,6 @@ class Reader {
       std::cout << "unrecognized field type for .mtx" << std::endl;
       std::exit(-24);
     }
-    bool undirected;
     if (symmetry == "symmetric") {
       undirected = true;
     } else if ((symmetry == "general") || (symmetry == "skew-symmetric")) {
@@ -194,6 +420,16 @@ class Reader {
       std::cout << "matrix must be square for .mtx" << std::endl;
       std::exit(-26);
     }
+  }
+
+  // Note: converts vertex numbering from 1..N to 0..N-1
+  // Note: weights casted to type WeightT_
+  EdgeList ReadInMTX(std::ifstream &in, bool &needs_weights) {
+    EdgeList el;
+    std::string line;
+    bool read_weights, undirected;
+    ReadMTXHeader(in, read_weights, undirected);
+    #ifdef SERIAL_READ
     while (std::getline(in, line)) {
       if (line.empty())
         continue;
@@ -215,6 +451,9 @@ class Reader {
           el.push_back(Edge(v - 1, u - 1));
       }
     }
+    #else
+    el = ReadInText(in, kTextMTX, read_weights, undirected);
+    #endif
     needs_weights = !read_weights;
     return el;
   }
@@ -229,6 +468,7 @@ class Reader {
       std::cout << "Couldn't open file " << filename_ << std::endl;
       std::exit(-2);
     }
+    #ifdef SERIAL_READ
     if (suffix == ".el") {
       el = ReadInEL(file);
     } else if (suffix == ".wel") {
@@ -237,6 +477,16 @@ class Reader {
     } else if (suffix == ".gr") {
       needs_weights = false;
       el = ReadInGR(file);
+    #else
+    if (suffix == ".el") {
+      el = ReadInText(file, kTextEL, false);
+    } else if (suffix == ".wel") {
+      needs_weights = false;
+      el = ReadInText(file, kTextWEL, true);
+    } else if (suffix == ".gr") {
+      needs_weights = false;
+      el = ReadInText(file, kTextGR, true);
+    #endif
     } else if (suffix == ".graph") {
       el = ReadInMetis(file, needs_weights);
     } else if (suffix == ".mtx") {
@@ -252,9 +502,17 @@ class Reader {
   }
 
   CSRGraph<NodeID_, DestID_, invert> ReadSerializedGraph() {
-    bool weighted = GetSuffix() == ".wsg";
+    std::string suffix = GetSuffix();
+    bool weighted = (suffix == ".wsg") || (suffix == ".wsg64");
     if (!std::is_same<NodeID_, SGID>::value) {
-      std::cout << "serialized graphs only allowed for 32bit" << std::endl;
+      std::cout << "serialized graphs only allowed for 32bit (64bit with "
+                << "NODEID64)" << std::endl;
+      std::exit(-5);
+    }
+    if (SGSuffixIDBytes(suffix) != sizeof(SGID)) {
+      std::cout << suffix << " graphs need a build "
+                << (sizeof(SGID) == 8 ? "without" : "with") << " NODEID64"
+                << std::endl;
       std::exit(-5);
     }
     if (!weighted && !std::is_same<NodeID_, DestID_>::value) {
@@ -265,7 +523,7 @@ class Reader {
       std::cout << ".wsg only allowed for weighted graphs" << std::endl;
       std::exit(-5);
     }
-    if (weighted && !std::is_same<WeightT_, SGID>::value) {
+    if (weighted && !std::is_same<WeightT_, int32_t>::value) {
       std::cout << ".wsg only allowed for int32_t weights" << std::endl;
       std::exit(-5);
     }
@@ -274,6 +532,14 @@ class Reader {
       std::cout << "Couldn't open file " << filename_ << std::endl;
       std::exit(-6);
     }
+    char magic[8] = {};
+    file.read(magic, sizeof(magic));
+    if (file && std::memcmp(magic, SG_V2_MAGIC, sizeof(magic)) == 0) {
+      file.close();
+      return MapSerializedGraph();
+    }
+    file.clear();
+    file.seekg(0);
     Timer t;
     t.Start();
     bool directed;
@@ -284,14 +550,14 @@ class Reader {
     file.read(reinterpret_cast<char*>(&num_edges), sizeof(SGOffset));
     file.read(reinterpret_cast<char*>(&num_nodes), sizeof(SGOffset));
     pvector<SGOffset> offsets(num_nodes+1);
-    neighs = new DestID_[num_edges];
+    neighs = PageNew<DestID_>(num_edges);
     std::streamsize num_index_bytes = (num_nodes+1) * sizeof(SGOffset);
     std::streamsize num_neigh_bytes = num_edges * sizeof(DestID_);
     file.read(reinterpret_cast<char*>(offsets.data()), num_index_bytes);
     file.read(reinterpret_cast<char*>(neighs), num_neigh_bytes);
     index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, neighs);
     if (directed && invert) {
-      inv_neighs = new DestID_[num_edges];
+      inv_neighs = PageNew<DestID_>(num_edges);
       file.read(reinterpret_cast<char*>(offsets.data()), num_index_bytes);
       file.read(reinterpret_cast<char*>(inv_neighs), num_neigh_bytes);
       inv_index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, inv_neighs);
@@ -305,6 +571,156 @@ class Reader {
     else
       return CSRGraph<NodeID_, DestID_, invert>(num_nodes, index, neighs);
   }
+
+  // maps the whole file read-only, nullptr if it is empty
+  std::shared_ptr<void> MapFile(int flags, size_t &bytes, int exit_code) {
+    int fd = open(filename_.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      std::cout << "Couldn't open file " << filename_ << std::endl;
+      std::exit(exit_code);
+    }
+    bytes = st.st_size;
+    void *addr = bytes == 0 ? nullptr :
+                 mmap(nullptr, bytes, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      std::cout << "Couldn't map file " << filename_ << std::endl;
+      std::exit(exit_code);
+    }
+    size_t len = bytes;
+    return std::shared_ptr<void>(addr, [len](void *p) {
+      if (p != nullptr)
+        munmap(p, len);
+    });
+  }
+
+  struct MapHints {
+    bool populate = false, willneed = false, sequential = false;
+    bool random = false, hugepage = false, off = false;
+  };
+
+  static MapHints GetMapHints() {
+    MapHints hints;
+    const char *env = std::getenv("GAP_SG_MMAP");
+    if (env == nullptr)
+      return hints;
+    std::stringstream ss(env);
+    std::string hint;
+    while (std::getline(ss, hint, ',')) {
+      if (hint == "populate") {
+        hints.populate = true;
+      } else if (hint == "willneed") {
+        hints.willneed = true;
+      } else if (hint == "sequential") {
+        hints.sequential = true;
+      } else if (hint == "random") {
+        hints.random = true;
+      } else if (hint == "hugepage") {
+        hints.hugepage = true;
+      } else if (hint == "off") {
+        hints.off = true;
+      } else if (hint != "") {
+        std::cout << "Unknown GAP_SG_MMAP hint: " << hint << std::endl;
+        std::exit(-7);
+      }
+    }
+    return hints;
+  }
+
+  static void Advise(char *base, size_t bytes, const MapHints &hints) {
+    if (hints.willneed)
+      madvise(base, bytes, MADV_WILLNEED);
+    if (hints.sequential)
+      madvise(base, bytes, MADV_SEQUENTIAL);
+    if (hints.random)
+      madvise(base, bytes, MADV_RANDOM);
+    #ifdef MADV_HUGEPAGE
+    if (hints.hugepage)
+      madvise(base, bytes, MADV_HUGEPAGE);
+    #endif
+  }
+
+  static DestID_* CopyNeighs(const char *base, SGOffset offset,
+                             SGOffset num_edges) {
+    DestID_ *neighs = PageNew<DestID_>(num_edges);
+    std::memcpy(neighs, base + offset, num_edges * sizeof(DestID_));
+    return neighs;
+  }
+
+  CSRGraph<NodeID_, DestID_, invert> MapSerializedGraph() {
+    Timer t;
+    t.Start();
+    MapHints hints = GetMapHints();
+    int flags = MAP_PRIVATE;
+    #ifdef MAP_POPULATE
+    if (hints.populate)
+      flags |= MAP_POPULATE;
+    #endif
+    size_t bytes;
+    std::shared_ptr<void> mapping = MapFile(flags, bytes, -6);
+    if (bytes < sizeof(SGHeaderV2)) {
+      std::cout << filename_ << " is not a valid v2 serialized graph"
+                << std::endl;
+      std::exit(-5);
+    }
+    char *base = static_cast<char*>(mapping.get());
+    Advise(base, bytes, hints);
+    const SGHeaderV2 &h = *reinterpret_cast<SGHeaderV2*>(base);
+    SGOffset index_bytes = (h.num_nodes+1) * sizeof(SGOffset);
+    SGOffset neigh_bytes = h.num_edges * sizeof(DestID_);
+    SGOffset end = h.directed ? h.in_neighs : h.out_neighs;
+    uint32_t id_bytes = h.id_bytes == 0 ? 4 : h.id_bytes;
+    if (h.dest_bytes != sizeof(DestID_) || id_bytes != sizeof(SGID) ||
+        h.num_nodes < 0 ||
+        h.num_edges < 0 || end + neigh_bytes > static_cast<SGOffset>(bytes) ||
+        (h.directed && h.in_offsets + index_bytes > h.in_neighs) ||
+        h.out_offsets + index_bytes > h.out_neighs ||
+        (h.original_ids != 0 && h.original_ids + h.num_nodes *
+         static_cast<SGOffset>(sizeof(SGID)) > static_cast<SGOffset>(bytes))) {
+      std::cout << filename_ << " is not a valid v2 serialized graph"
+                << std::endl;
+      std::exit(-5);
+    }
+    const SGOffset *offsets =
+        reinterpret_cast<const SGOffset*>(base + h.out_offsets);
+    DestID_ *neighs = reinterpret_cast<DestID_*>(base + h.out_neighs);
+    DestID_ **index = nullptr, **inv_index = nullptr;
+    DestID_ *inv_neighs = nullptr;
+    if (hints.off)
+      neighs = CopyNeighs(base, h.out_neighs, h.num_edges);
+    index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, h.num_nodes+1,
+                                                 neighs);
+    bool directed = h.directed;
+    if (directed && invert) {
+      offsets = reinterpret_cast<const SGOffset*>(base + h.in_offsets);
+      inv_neighs = reinterpret_cast<DestID_*>(base + h.in_neighs);
+      if (hints.off)
+        inv_neighs = CopyNeighs(base, h.in_neighs, h.num_edges);
+      inv_index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, h.num_nodes+1,
+                                                       inv_neighs);
+    }
+    int64_t num_nodes = h.num_nodes;
+    pvector<NodeID_> original_ids;
+    if (h.original_ids != 0) {
+      const SGID *ids = reinterpret_cast<const SGID*>(base + h.original_ids);
+      original_ids = pvector<NodeID_>(num_nodes);
+      #pragma omp parallel for
+      for (int64_t n = 0; n < num_nodes; n++)
+        original_ids[n] = ids[n];
+    }
+    if (hints.off)
+      mapping.reset();
+    CSRGraph<NodeID_, DestID_, invert> g = directed ?
+        CSRGraph<NodeID_, DestID_, invert>(num_nodes, index, neighs,
+                                           inv_index, inv_neighs, mapping) :
+        CSRGraph<NodeID_, DestID_, invert>(num_nodes, index, neighs, mapping);
+    if (original_ids.size() != 0)
+      g.SetOrder(std::move(original_ids));
+    t.Stop();
+    PrintTime("Read Time", t.Seconds());
+    return g;
+  }
 };
 
 #endif  // READER_H_
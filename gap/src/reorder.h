@@ -0,0 +1,280 @@
+#ifndef REORDER_H_
+#define REORDER_H_
+
+#include <algorithm>
+#include <cinttypes>
+#include <functional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "pvector.h"
+
+
+/*
+GAP Benchmark Suite
+Class:  Reorderer
+
+Locality improving vertex orders, chosen with -O and applied by BuilderBase
+to the built (or loaded) graph, so they can be compared with and combined
+with the helper-thread prefetching
+ - Order() returns new_ids (new_ids[n] is the new ID of vertex n), which
+   BuilderBase::Relabel() rebuilds the graph with
+ - degree: decreasing degree, as tc's RelabelByDegree
+ - dbg:    degree-based grouping [1], vertices in geometric degree groups
+           around the average degree, hottest group first, original order
+           kept within a group
+ - hub:    hub sorting [2], vertices above the average degree by decreasing
+           degree, then the rest in original order
+ - rcm:    reverse Cuthill-McKee, a BFS from a lowest degree vertex of every
+           component visiting neighbors by increasing degree, reversed
+ - gorder: greedy window in the style of Gorder [3], the next vertex is the
+           unplaced one with the most neighbors and shared in-neighbors
+           among the last kGorderWindow placed; in-neighbors of more than
+           kGorderHub degree aren't expanded, which bounds the cost
+ - Degrees are out plus in degree for directed graphs; rcm and gorder are
+   serial, the others parallel
+
+[1] Priyank Faldu, Jeff Diamond, and Boris Grot. "A Closer Look at
+    Lightweight Graph Reordering." IISWC, 2019.
+[2] Yunming Zhang et al. "Making Caches Work for Graph Analytics." IEEE
+    BigData, 2017.
+[3] Hao Wei, Jeffrey Xu Yu, Can Lu, and Xuemin Lin. "Speedup Graph
+    Processing by Graph Ordering." SIGMOD, 2016.
+*/
+
+
+enum ReorderKind {
+  kOrderNone, kOrderDegree, kOrderDBG, kOrderHub, kOrderRCM, kOrderGorder
+};
+
+inline bool ParseOrder(const std::string &name, ReorderKind *kind) {
+  const char *names[] = {"none", "degree", "dbg", "hub", "rcm", "gorder"};
+  for (int k = kOrderNone; k <= kOrderGorder; k++) {
+    if (name == names[k]) {
+      *kind = static_cast<ReorderKind>(k);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+template <typename NodeID_, typename DestID_ = NodeID_, bool invert = true>
+class Reorderer {
+  typedef CSRGraph<NodeID_, DestID_, invert> GraphT;
+
+  static const int kGorderWindow = 5;
+  static const int64_t kGorderHub = 32;
+  static const int kDBGGroups = 8;
+
+  const GraphT &g_;
+  pvector<int64_t> degrees_;
+
+  // calls f on the out- and (if directed) in-neighbors of u
+  template <typename F>
+  void ForEachNeighbor(NodeID_ u, F f) const {
+    for (DestID_ v : g_.out_neigh(u))
+      f(static_cast<NodeID_>(v));
+    if (g_.directed())
+      for (DestID_ v : g_.in_neigh(u))
+        f(static_cast<NodeID_>(v));
+  }
+
+  // new IDs from a list of the vertices in their new order
+  pvector<NodeID_> FromSequence(const pvector<NodeID_> &sequence) const {
+    pvector<NodeID_> new_ids(g_.num_nodes());
+    #pragma omp parallel for
+    for (NodeID_ i=0; i < g_.num_nodes(); i++)
+      new_ids[sequence[i]] = i;
+    return new_ids;
+  }
+
+  pvector<NodeID_> ByDegree() const {
+    pvector<NodeID_> sequence(g_.num_nodes());
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < g_.num_nodes(); n++)
+      sequence[n] = n;
+    std::stable_sort(sequence.begin(), sequence.end(),
+                     [this] (NodeID_ a, NodeID_ b) {
+                       return degrees_[a] > degrees_[b];
+                     });
+    return FromSequence(sequence);
+  }
+
+  double AverageDegree() const {
+    return static_cast<double>(g_.num_edges_directed()) *
+           (g_.directed() ? 2 : 1) / g_.num_nodes();
+  }
+
+  // group 0 holds degrees of 32x the average and up, each next one half
+  // that, the last everything under half the average
+  pvector<NodeID_> DegreeGrouping() const {
+    double avg = AverageDegree();
+    pvector<int> group(g_.num_nodes());
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < g_.num_nodes(); n++) {
+      int k = 0;
+      double bound = avg * (1 << (kDBGGroups - 3));
+      while (k < kDBGGroups - 1 && degrees_[n] < bound) {
+        k++;
+        bound /= 2;
+      }
+      group[n] = k;
+    }
+    std::vector<int64_t> starts(kDBGGroups + 1, 0);
+    for (NodeID_ n=0; n < g_.num_nodes(); n++)
+      starts[group[n] + 1]++;
+    for (int k = 0; k < kDBGGroups; k++)
+      starts[k + 1] += starts[k];
+    pvector<NodeID_> new_ids(g_.num_nodes());
+    for (NodeID_ n=0; n < g_.num_nodes(); n++)
+      new_ids[n] = starts[group[n]]++;
+    return new_ids;
+  }
+
+  pvector<NodeID_> HubSort() const {
+    double avg = AverageDegree();
+    pvector<NodeID_> sequence(g_.num_nodes());
+    NodeID_ num_hubs = 0;
+    for (NodeID_ n=0; n < g_.num_nodes(); n++)
+      if (degrees_[n] > avg)
+        sequence[num_hubs++] = n;
+    NodeID_ tail = num_hubs;
+    for (NodeID_ n=0; n < g_.num_nodes(); n++)
+      if (degrees_[n] <= avg)
+        sequence[tail++] = n;
+    std::stable_sort(sequence.begin(), sequence.begin() + num_hubs,
+                     [this] (NodeID_ a, NodeID_ b) {
+                       return degrees_[a] > degrees_[b];
+                     });
+    return FromSequence(sequence);
+  }
+
+  pvector<NodeID_> ReverseCuthillMcKee() const {
+    const NodeID_ num_nodes = g_.num_nodes();
+    pvector<NodeID_> by_degree(num_nodes);
+    for (NodeID_ n=0; n < num_nodes; n++)
+      by_degree[n] = n;
+    std::stable_sort(by_degree.begin(), by_degree.end(),
+                     [this] (NodeID_ a, NodeID_ b) {
+                       return degrees_[a] < degrees_[b];
+                     });
+    pvector<NodeID_> sequence(num_nodes);
+    std::vector<bool> visited(num_nodes, false);
+    std::vector<NodeID_> children;
+    NodeID_ tail = 0;
+    for (NodeID_ source : by_degree) {
+      if (visited[source])
+        continue;
+      visited[source] = true;
+      NodeID_ head = tail;
+      sequence[tail++] = source;
+      while (head < tail) {
+        NodeID_ u = sequence[head++];
+        children.clear();
+        ForEachNeighbor(u, [&] (NodeID_ v) {
+          if (!visited[v]) {
+            visited[v] = true;
+            children.push_back(v);
+          }
+        });
+        std::stable_sort(children.begin(), children.end(),
+                         [this] (NodeID_ a, NodeID_ b) {
+                           return degrees_[a] < degrees_[b];
+                         });
+        for (NodeID_ v : children)
+          sequence[tail++] = v;
+      }
+    }
+    std::reverse(sequence.begin(), sequence.end());
+    return FromSequence(sequence);
+  }
+
+  pvector<NodeID_> GreedyWindow() const {
+    const NodeID_ num_nodes = g_.num_nodes();
+    pvector<NodeID_> by_degree(num_nodes);
+    for (NodeID_ n=0; n < num_nodes; n++)
+      by_degree[n] = n;
+    std::stable_sort(by_degree.begin(), by_degree.end(),
+                     [this] (NodeID_ a, NodeID_ b) {
+                       return degrees_[a] > degrees_[b];
+                     });
+    std::vector<int32_t> score(num_nodes, 0);
+    std::vector<bool> placed(num_nodes, false);
+    // lazy max-heap, an entry is stale once its score or placed changed; a
+    // vertex whose score only dropped waits for its next increase to return
+    std::priority_queue<std::pair<int32_t, NodeID_>> heap;
+    auto bump = [&] (NodeID_ v, int32_t delta) {
+      if (placed[v])
+        return;
+      score[v] += delta;
+      if (delta > 0)
+        heap.push(std::make_pair(score[v], v));
+    };
+    auto update = [&] (NodeID_ u, int32_t delta) {
+      ForEachNeighbor(u, [&] (NodeID_ v) { bump(v, delta); });
+      auto siblings = [&] (NodeID_ x) {
+        if (degrees_[x] <= kGorderHub)
+          for (DestID_ v : g_.out_neigh(x))
+            bump(static_cast<NodeID_>(v), delta);
+      };
+      if (g_.directed()) {
+        for (DestID_ x : g_.in_neigh(u))
+          siblings(static_cast<NodeID_>(x));
+      } else {
+        for (DestID_ x : g_.out_neigh(u))
+          siblings(static_cast<NodeID_>(x));
+      }
+    };
+    pvector<NodeID_> sequence(num_nodes);
+    NodeID_ next_seed = 0;
+    for (NodeID_ i=0; i < num_nodes; i++) {
+      NodeID_ u = -1;
+      while (!heap.empty() && u == -1) {
+        std::pair<int32_t, NodeID_> top = heap.top();
+        heap.pop();
+        if (!placed[top.second] && score[top.second] == top.first)
+          u = top.second;
+      }
+      if (u == -1) {
+        while (placed[by_degree[next_seed]])
+          next_seed++;
+        u = by_degree[next_seed];
+      }
+      placed[u] = true;
+      sequence[i] = u;
+      update(u, 1);
+      if (i >= kGorderWindow)
+        update(sequence[i - kGorderWindow], -1);
+    }
+    return FromSequence(sequence);
+  }
+
+ public:
+  explicit Reorderer(const GraphT &g) : g_(g), degrees_(g.num_nodes()) {
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      degrees_[n] = g.out_degree(n) + (g.directed() ? g.in_degree(n) : 0);
+  }
+
+  pvector<NodeID_> Order(ReorderKind kind) const {
+    switch (kind) {
+      case kOrderDegree: return ByDegree();
+      case kOrderDBG:    return DegreeGrouping();
+      case kOrderHub:    return HubSort();
+      case kOrderRCM:    return ReverseCuthillMcKee();
+      case kOrderGorder: return GreedyWindow();
+      default:           break;
+    }
+    pvector<NodeID_> new_ids(g_.num_nodes());
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < g_.num_nodes(); n++)
+      new_ids[n] = n;
+    return new_ids;
+  }
+};
+
+#endif  // REORDER_H_
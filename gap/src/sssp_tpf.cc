@@ -25,6 +25,7 @@
 
 // #include "ctpl_stl.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -85,9 +86,10 @@ const size_t kBinSizeThreshold = 1000;
 
 // static double loop_time; 
 
-TimeDiff time_diff; 
 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_relax; 
 
 // #define HTPF
 // #define INNER 
@@ -96,9 +98,15 @@ HyperParam_PfT hyper_param;
 
 // #define URAND
 
-#if defined(KRON) || defined(TWITTER)
-#define INNER
-#endif 
+// kron and twitter sync per edge, urand and web per frontier vertex 
+bool InnerSync(const GhostConfig &cfg) {
+  return cfg.is(kClassKron) || cfg.is(kClassTwitter); 
+}
+
+// there is no helper for road 
+bool RunsHelper(const GhostConfig &cfg) {
+  return cfg.enabled() && (InnerSync(cfg) || cfg.is(kClassUrand) || cfg.is(kClassWeb)); 
+}
 
 #ifdef TIME
 #define TOTAL_ITER 4294966740
@@ -146,111 +154,72 @@ std::chrono::_V2::system_clock::time_point time_array[TOTAL_ITER/FREQ+100];
 #endif 
 
 void PrefetchThread_urand(const WGraph* g, const WeightT* dist, const WeightT delta, 
-  const NodeID* frontier, const size_t curr_frontier_tail, const size_t curr_bin_index) 
+  const NodeID* frontier, const size_t curr_bin_index, size_t i, 
+  GhostLoop<size_t> &loop) 
 {
-  bool serialize_flag = false; 
-  size_t start_iter = time_diff.read_atomic_main(ORDER_READ); //0; 
-  for (size_t i=start_iter; i < curr_frontier_tail; i++) {
-    NodeID u = frontier[i];
-    if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
-      for (WNode* wn = g->out_neigh(u).begin(); wn < g->out_neigh(u).end(); wn++) {
-        #if defined(MEMBW)
-        if (wn + 64 < g->out_neigh(u).end())
-            __builtin_prefetch(wn+64); // prefetch index in membw hungry condition
-        #endif 
-        __builtin_prefetch(&dist[wn->v]); // prefetch 
-      }
-    } 
-    if (serialize_flag) {
-        asm volatile (
-          ".rept 115\n\t" 
-          "serialize\n\t" 
-          ".endr" 
-        );
+  NodeID u = frontier[i];
+  if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
+    for (WNode* wn = g->out_neigh(u).begin(); wn < g->out_neigh(u).end(); wn++) {
+      #if defined(MEMBW)
+      if (wn + 64 < g->out_neigh(u).end())
+          ghost_prefetch(wn+64); // prefetch index in membw hungry condition
+      #endif 
+      ghost_prefetch(&dist[wn->v]); // prefetch 
     }
-    sync<size_t>(i, 1, i, true, time_diff, ORDER_READ, serialize_flag, hyper_param); 
-  }
+  } 
 }
 
-void PrefetchThread_web(const WGraph* g, const WeightT* dist, const WeightT delta, 
-  const NodeID* frontier, const size_t curr_frontier_tail, const size_t curr_bin_index) 
-{
-  #ifdef TUNING
-  HyperParam_PfT hyperparam = hyper_param; 
-  #else
+HyperParam_PfT HyperParam_web() {
   HyperParam_PfT hyperparam = {.sync_frequency = 14, .skip_offset = 46, 
                                .serialize_threshold = 100, .unserialize_threshold = 95}; 
-  #endif 
-  bool serialize_flag = false; 
-  size_t start_iter = time_diff.read_atomic_main(ORDER_READ); //0; 
-  for (size_t i=start_iter; i < curr_frontier_tail; i++) {
-    NodeID u = frontier[i];
-    __builtin_prefetch(&frontier[i]); 
-    if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
-      g->out_neigh(u).prefetch_begin(); 
-      for (WNode wn : g->out_neigh(u)) {
-        // prefetching index here do not make a difference
-        __builtin_prefetch(&dist[wn.v]); // prefetch 
-        // *(volatile WeightT*)&dist[wn.v]; // load 
-
-        if (serialize_flag) {
-          asm volatile ("serialize\n\t"); 
-        }
-      }
-    } 
-    sync<size_t>(i, 1, i, true, time_diff, ORDER_READ, serialize_flag, hyperparam); 
-  }
+  return ghost_relax.Or(hyperparam); 
+}
+
+void PrefetchThread_web(const WGraph* g, const WeightT* dist, const WeightT delta, 
+  const NodeID* frontier, const size_t curr_bin_index, size_t i, 
+  GhostLoop<size_t> &loop) 
+{
+  NodeID u = frontier[i];
+  ghost_prefetch(&frontier[i]); 
+  if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
+    g->out_neigh(u).prefetch_begin(); 
+    for (WNode wn : g->out_neigh(u)) {
+      // prefetching index here do not make a difference
+      ghost_prefetch(&dist[wn.v]); // prefetch 
+      // *(volatile WeightT*)&dist[wn.v]; // load 
+      loop.Pace(); 
+    }
+  } 
 }
 
 // for kron and twitter 
 void PrefetchThread_inner(const WGraph* g, const WeightT* dist, const WeightT delta, 
-  const NodeID* frontier, const size_t curr_frontier_tail, const size_t curr_bin_index) 
+  const NodeID* frontier, const size_t curr_bin_index, size_t i, 
+  GhostLoop<size_t> &loop) 
 {
-  size_t j = 0; 
-  bool serialize_flag = false; 
-  for (size_t i=0; i < curr_frontier_tail; i++) {
-    NodeID u = frontier[i];
-    if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
-      bool prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > hyper_param.skip_offset ? true : false; 
-      for (WNode* wn = g->out_neigh(u).begin(); wn < g->out_neigh(u).end(); wn++) {
-        if (prefetch) {
-          #if defined(MEMBW)
-          if (wn + 64 < g->out_neigh(u).end())
-            __builtin_prefetch(wn+64);
-          #endif 
-          __builtin_prefetch(&dist[wn->v]); // best for kron and twitter 
-        }
-        if (serialize_flag) {
-          asm volatile (
-            ".rept 1\n\t" 
-            "serialize\n\t" 
-            ".endr" 
-          );
-        }
-        /*---inner sync---*/
-        if (j % hyper_param.sync_frequency == 0 || serialize_flag) {
-          // asm volatile ("serialize\n\t"); 
-          size_t main_j = time_diff.read_atomic_main(ORDER_READ); 
-          // time_diff.insert_into_atomic_histogram(main_j, j); 
-          if (main_j >= j) {
-            serialize_flag = false; 
-          } else if (j - main_j > hyper_param.serialize_threshold) {
-            serialize_flag = true; 
-          } else if (j - main_j < hyper_param.unserialize_threshold) {
-            serialize_flag = false; 
-          } 
-        }
-        /*---inner sync---*/
-        j++; 
-      } // inner loop 
-    } // if 
-  } // outer loop 
+  NodeID u = frontier[i];
+  if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
+    bool prefetch = g->out_neigh(u).end() - g->out_neigh(u).begin() > loop.hyper_param().skip_offset ? true : false; 
+    for (WNode* wn = g->out_neigh(u).begin(); wn < g->out_neigh(u).end(); wn++) {
+      if (prefetch) {
+        #if defined(MEMBW)
+        if (wn + 64 < g->out_neigh(u).end())
+          ghost_prefetch(wn+64);
+        #endif 
+        ghost_prefetch(&dist[wn->v]); // best for kron and twitter 
+      }
+      loop.Step(); // inner sync 
+    } // inner loop 
+  } // if 
 }
 
 inline
 void RelaxEdges(const WGraph &g, NodeID u, WeightT delta,
-                pvector<WeightT> &dist, vector <vector<NodeID>> &local_bins) {
-  for (WNode wn : g.out_neigh(u)) { 
+                pvector<WeightT> &dist, vector <vector<NodeID>> &local_bins,
+                GhostLoop<size_t> *ghost = nullptr) {
+  for (const WNode &wn : g.out_neigh(u)) { 
+    ghost_load(&wn); 
+    ghost_load(&dist[wn.v]); 
     WeightT old_dist = dist[wn.v];
     WeightT new_dist = dist[u] + wn.w;
     while (new_dist < old_dist) {
@@ -263,8 +232,9 @@ void RelaxEdges(const WGraph &g, NodeID u, WeightT delta,
       }
       old_dist = dist[wn.v];      // swap failed, recheck dist update & retry
     }
-    #if defined(HTPF) && defined(INNER)
-    time_diff.add_atomic_main(1, ORDER_WRITE); // for inner sync
+    #ifdef HTPF
+    if (ghost != nullptr)
+      ghost->Advance(); // for inner sync
     #endif 
 
     #ifdef TIME
@@ -305,32 +275,51 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
       size_t &next_frontier_tail = frontier_tails[(iter+1)&1];
       
       #ifdef HTPF
-      #ifdef INNER
-      thread PF(PrefetchThread_inner, &g, dist.begin(), delta, frontier.begin(), 
-                curr_frontier_tail, curr_bin_index); // issue PF thread 
-      time_diff.set_atomic_main(0, ORDER_WRITE); 
-      #else // not inner 
-      #if defined(URAND)
-      thread PF(PrefetchThread_urand, &g, dist.begin(), delta, frontier.begin(), 
-                curr_frontier_tail, curr_bin_index); // issue PF thread 
-      #elif defined(WEB)
-      thread PF(PrefetchThread_web, &g, dist.begin(), delta, frontier.begin(), 
-                curr_frontier_tail, curr_bin_index); // issue PF thread 
+      const bool inner = InnerSync(ghost_relax); 
+      HyperParam_PfT hyperparam = ghost_relax.Or(hyper_param); 
+      auto slice = PrefetchThread_inner; 
+      if (ghost_relax.is(kClassUrand)) {
+        slice = PrefetchThread_urand; 
+      } else if (ghost_relax.is(kClassWeb)) {
+        hyperparam = HyperParam_web(); 
+        slice = PrefetchThread_web; 
+      }
+      GhostLoop<size_t> ghost(0, curr_frontier_tail, hyperparam, inner ? kSyncInner : kSyncOuter); 
+      GhostTuning::Attach(ghost, ghost_relax); 
+      #ifdef _OPENMP
+      ghost.set_slot(omp_get_thread_num()); 
       #endif 
-      #endif // INNER
+      if (ghost_relax.is(kClassUrand))
+        ghost.set_throttle(115); 
+      ghost.set_accurate_sync(!inner); 
+      ghost.set_pace_slices(!ghost_relax.is(kClassWeb)); // web paces per edge 
+      const WGraph* gp = &g; 
+      const WeightT* dp = dist.begin(); 
+      const NodeID* fp = frontier.begin(); 
+      const size_t bin = curr_bin_index; 
+      if (RunsHelper(ghost_relax))
+        ghost.Launch([gp, dp, delta, fp, bin, slice] (size_t i, GhostLoop<size_t> &loop) {
+          slice(gp, dp, delta, fp, bin, i, loop); 
+        }); // issue PF thread 
       #endif // HTPF 
       #pragma omp for nowait schedule(dynamic, 64)
       for (size_t i=0; i < curr_frontier_tail; i++) {
+        ghost_load(&frontier[i]); 
         NodeID u = frontier[i];
         if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
+          #ifdef HTPF
+          RelaxEdges(g, u, delta, dist, local_bins, inner ? &ghost : nullptr);
+          #else
           RelaxEdges(g, u, delta, dist, local_bins);
+          #endif 
         } 
-        #if defined(HTPF) && !defined(INNER)
-        time_diff.set_atomic_main(i, ORDER_WRITE); // for outer sync 
+        #ifdef HTPF
+        if (!inner)
+          ghost.Publish(i); // for outer sync 
         #endif 
       }
       #ifdef HTPF
-      PF.join(); // wait PF thread 
+      ghost.Join(); // wait PF thread 
       #endif 
 
       while (curr_bin_index < local_bins.size() &&
@@ -374,6 +363,10 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
     if (logging_enabled)
       cout << "took " << iter << " iterations" << endl;
   }
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted(); 
+  #endif 
   return dist;
 }
 
@@ -445,8 +438,6 @@ int main(int argc, char* argv[]) {
 
   // loop_time = 0.0; 
 
-  time_diff.init_atomic(); 
-  // time_diff.init_atomic_histogram(405062551); // 1203
 
   printf("main thread Running: CPU %d\n", sched_getcpu());
   CLDelta<WeightT> cli(argc, argv, "single-source shortest-path");
@@ -461,6 +452,10 @@ int main(int argc, char* argv[]) {
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
   WeightedBuilder b(cli);
   WGraph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("sssp", g, cli, hyper_param); 
+  ghost_relax = ghost_tuning.Config("relax"); 
+  #endif 
   SourcePicker<WGraph> sp(g, cli.start_vertex());
   auto SSSPBound = [&sp, &cli] (const WGraph &g) {
     return DeltaStep(g, sp.PickNext(), cli.delta(), cli.logging_en());
@@ -476,7 +471,6 @@ int main(int argc, char* argv[]) {
   // cout << "loop time = " << loop_time << "s\n"; 
   
   // print time difference between main and pf_thread 
-  // time_diff.print_atomic_histogram(); 
   #ifdef TIME
   ofstream myout; 
   myout.open(OUTPUT); 
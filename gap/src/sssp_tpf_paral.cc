@@ -26,6 +26,7 @@
 
 // #include "ctpl_stl.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 
 /*
@@ -74,10 +75,6 @@ execution order, leading to significant speedup on large diameter road networks.
 #define NT 2
 #endif 
 
-#if defined(KRON) || defined(TWITTER)
-#define INNER
-#endif
-
 #define ORDER_READ memory_order_relaxed
 #define ORDER_WRITE memory_order_relaxed
 
@@ -96,24 +93,13 @@ static uint64_t wait_join_time;
 OMPSyncAtomic time_diff(NT); 
 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_relax; // kron and twitter sync per edge, none runs no helper 
 
 void PrefetchThread_urand_paral(int me, const WGraph* g, const WeightT* dist, const WeightT delta, 
   const NodeID* frontier, const size_t curr_frontier_tail, const size_t curr_bin_index) 
 {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  // GhostPool pins slot me once, to the helper CPU of GhostTopology pair me
 
   size_t local_counter = 0; 
   bool serialize_flag = false; 
@@ -129,12 +115,7 @@ void PrefetchThread_urand_paral(int me, const WGraph* g, const WeightT* dist, co
       }
     } 
     if (serialize_flag) {
-        asm volatile (
-          ".rept 150\n\t" 
-          // ".rept 115\n\t" 
-          "serialize\n\t" 
-          ".endr" 
-        );
+        ghost_throttle(150); // ghost_throttle(115)
     }
     sync<size_t>(i, 1, i, true, time_diff, me, ORDER_READ, serialize_flag, hyper_param); 
   }
@@ -144,20 +125,7 @@ void PrefetchThread_inner_paral(int me, const WGraph* g, const WeightT* dist, co
   const NodeID* frontier, const size_t start, const size_t curr_frontier_tail, 
   const size_t curr_bin_index) 
 {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  // GhostPool pins slot me once, to the helper CPU of GhostTopology pair me
 
   size_t j = 0; 
   bool serialize_flag = false; 
@@ -172,11 +140,7 @@ void PrefetchThread_inner_paral(int me, const WGraph* g, const WeightT* dist, co
           __builtin_prefetch(&dist[wn->v], 0, 2); // best for kron and twitter 
         }
         if (serialize_flag) {
-          asm volatile (
-            ".rept 1\n\t" 
-            "serialize\n\t" 
-            ".endr" 
-          );
+          ghost_throttle(1);
         }
         /*---inner sync---*/
         if (j % hyper_param.sync_frequency == 0 || serialize_flag) {
@@ -201,20 +165,7 @@ void PrefetchThread_inner_paral(int me, const WGraph* g, const WeightT* dist, co
 void PrefetchThread_web_paral(int me, const WGraph* g, const WeightT* dist, const WeightT delta, 
   const NodeID* frontier, const size_t curr_frontier_tail, const size_t curr_bin_index) 
 {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
+  // GhostPool pins slot me once, to the helper CPU of GhostTopology pair me
   bool serialize_flag = false; 
   size_t start_iter = time_diff.read(me, ORDER_READ); 
   for (size_t i=start_iter; i < curr_frontier_tail; i++) {
@@ -227,7 +178,7 @@ void PrefetchThread_web_paral(int me, const WGraph* g, const WeightT* dist, cons
         __builtin_prefetch(&dist[wn.v]); // prefetch 
 
         if (serialize_flag) {
-          asm volatile ("serialize\n\t"); 
+          ghost_throttle(1); 
         }
       }
     } 
@@ -235,10 +186,10 @@ void PrefetchThread_web_paral(int me, const WGraph* g, const WeightT* dist, cons
   }
 }
 
-#ifdef INNER
 inline
 void RelaxEdges(int me, const WGraph &g, NodeID u, WeightT delta,
-                pvector<WeightT> &dist, vector <vector<NodeID>> &local_bins) {
+                pvector<WeightT> &dist, vector <vector<NodeID>> &local_bins,
+                bool inner) {
   for (WNode wn : g.out_neigh(u)) { 
     WeightT old_dist = dist[wn.v];
     WeightT new_dist = dist[u] + wn.w;
@@ -252,30 +203,10 @@ void RelaxEdges(int me, const WGraph &g, NodeID u, WeightT delta,
       }
       old_dist = dist[wn.v];      // swap failed, recheck dist update & retry
     }
-    #ifdef INNER
-    time_diff.add(me, 1, ORDER_WRITE); 
-    #endif 
+    if (inner)
+      time_diff.add(me, 1, ORDER_WRITE); 
   }
 }
-#else
-void RelaxEdges(const WGraph &g, NodeID u, WeightT delta,
-                pvector<WeightT> &dist, vector <vector<NodeID>> &local_bins) {
-  for (WNode wn : g.out_neigh(u)) { 
-    WeightT old_dist = dist[wn.v];
-    WeightT new_dist = dist[u] + wn.w;
-    while (new_dist < old_dist) {
-      if (compare_and_swap(dist[wn.v], old_dist, new_dist)) { // modify dist
-        size_t dest_bin = new_dist/delta;
-        if (dest_bin >= local_bins.size())
-          local_bins.resize(dest_bin+1);
-        local_bins[dest_bin].push_back(wn.v);
-        break;
-      }
-      old_dist = dist[wn.v];      // swap failed, recheck dist update & retry
-    }
-  }
-}
-#endif 
 
 pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
                            bool logging_enabled = false) {
@@ -287,24 +218,13 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
   size_t shared_indexes[2] = {0, kMaxBin};
   size_t frontier_tails[2] = {1, 0};
   frontier[0] = source;
+  const bool inner = ghost_relax.is(kClassKron) || ghost_relax.is(kClassTwitter); 
+  const bool helper = inner || ghost_relax.is(kClassUrand) || ghost_relax.is(kClassWeb); 
   t.Start();
   #pragma omp parallel
   {
     int me = omp_get_thread_num(); 
-    /*-----pin the main thread to specfic core-----*/ 
-    pthread_t self = pthread_self();
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    // CPU_SET(me, &cpuset);
-    CPU_SET(me*2, &cpuset); // beijing
-      
-    int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-    if (rc != 0)
-    {
-      printf("Failed to pin main thread.\n");
-      exit(1);
-    }
-    /*-----pin the main thread to specfic core-----*/
+    GhostTopology::Get().PinMain(me);
     vector<vector<NodeID> > local_bins(0);
     size_t iter = 0;
     while (shared_indexes[iter&1] != kMaxBin) {
@@ -331,36 +251,32 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
       else 
         head = div*(previous_me+1) + mod; 
       /*-----compute boundary for each pf thread-----*/
-      #if defined(URAND)
-      time_diff.set(me, head, ORDER_WRITE); 
-      thread PF(PrefetchThread_urand_paral, me, &g, dist.begin(), delta, frontier.begin(), 
-                tail, curr_bin_index); // issue PF thread 
-      #elif defined(WEB)
-      time_diff.set(me, head, ORDER_WRITE); 
-      thread PF(PrefetchThread_web_paral, me, &g, dist.begin(), delta, frontier.begin(), 
-                tail, curr_bin_index); // issue PF thread 
-      #elif defined(INNER) 
-      thread PF(PrefetchThread_inner_paral, me, &g, dist.begin(), delta, frontier.begin(), 
-                head, tail, curr_bin_index); // issue PF thread 
-      time_diff.set(me, 0, ORDER_WRITE); 
-      #endif 
+      size_t bin = curr_bin_index; 
+      auto PF = [&] () {
+        if (ghost_relax.is(kClassUrand))
+          PrefetchThread_urand_paral(me, &g, dist.begin(), delta, frontier.begin(), tail, bin); 
+        else if (ghost_relax.is(kClassWeb))
+          PrefetchThread_web_paral(me, &g, dist.begin(), delta, frontier.begin(), tail, bin); 
+        else
+          PrefetchThread_inner_paral(me, &g, dist.begin(), delta, frontier.begin(), head, tail, bin); 
+      }; 
+      if (helper && !inner)
+        time_diff.set(me, head, ORDER_WRITE); 
+      if (helper)
+        GhostPool::Get().Dispatch(me, PF); // issue PF thread 
+      if (inner)
+        time_diff.set(me, 0, ORDER_WRITE); 
       #pragma omp for nowait schedule(static) // schedule(dynamic, 64) 
       for (size_t i=0; i < curr_frontier_tail; i++) {
         NodeID u = frontier[i];
         if (dist[u] >= delta * static_cast<WeightT>(curr_bin_index)) {
-          #ifdef INNER
-          RelaxEdges(me, g, u, delta, dist, local_bins);
-          #else
-          RelaxEdges(g, u, delta, dist, local_bins);
-          #endif
+          RelaxEdges(me, g, u, delta, dist, local_bins, inner);
         } 
-        #if !defined(INNER) 
-        time_diff.set(me, i, ORDER_WRITE); // inner sync 
-        #endif 
+        if (!inner)
+          time_diff.set(me, i, ORDER_WRITE); // inner sync 
       }
-      #if defined(URAND) || defined(WEB) || defined(INNER)
-      PF.join(); // wait PF thread 
-      #endif 
+      if (helper)
+        GhostPool::Get().Wait(me); // wait PF thread 
 
       while (curr_bin_index < local_bins.size() &&
              !local_bins[curr_bin_index].empty() &&
@@ -368,11 +284,7 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
         vector<NodeID> curr_bin_copy = local_bins[curr_bin_index];
         local_bins[curr_bin_index].resize(0);
         for (NodeID u : curr_bin_copy) {
-          #ifdef INNER
-          RelaxEdges(me, g, u, delta, dist, local_bins);
-          #else
-          RelaxEdges(g, u, delta, dist, local_bins);
-          #endif
+          RelaxEdges(me, g, u, delta, dist, local_bins, inner);
         }
       }
       for (size_t i=curr_bin_index; i < local_bins.size(); i++) {
@@ -406,6 +318,9 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
     if (logging_enabled)
       cout << "took " << iter << " iterations" << endl;
   }
+  #ifdef HTPF
+  GhostPool::Get().PrintDispatchStats();
+  #endif 
   return dist;
 }
 
@@ -468,8 +383,13 @@ int main(int argc, char* argv[]) {
             cli.serialize_threshold() - cli.unserialize_threshold() : 0; 
   cout << "sync frequency = " << hyper_param.sync_frequency << ", serialize threshold = " << hyper_param.serialize_threshold 
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
+  GhostThrottle::Get(); // calibrate before anything is timed
   WeightedBuilder b(cli);
   WGraph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("sssp_paral", g, cli, hyper_param); 
+  ghost_relax = ghost_tuning.Config("relax"); 
+  #endif 
   SourcePicker<WGraph> sp(g, cli.start_vertex());
   auto SSSPBound = [&sp, &cli] (const WGraph &g) {
     return DeltaStep(g, sp.PickNext(), cli.delta(), cli.logging_en());
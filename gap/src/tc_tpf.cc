@@ -7,19 +7,24 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <thread>
 
 #include "omp.h" 
 
 #include "benchmark.h"
+#include "bitmap.h"
 #include "builder.h"
 #include "command_line.h"
 #include "graph.h"
+#include "intersect.h"
 #include "pvector.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 /*
 GAP Benchmark Suite
@@ -47,6 +52,19 @@ This implementation relabels the vertices by degree. This optimization is
 beneficial if the average degree is sufficiently high and if the degree
 distribution is sufficiently non-uniform. To decide whether to relabel the
 graph, we use the heuristic in WorthRelabelling.
+
+With a vector ISA (-I, widest the CPU has by default) each (u, v) pair is one
+IntersectCount of u's neighbors below v with v's neighbors, which merges a
+block at a time or gallops on skewed lengths (see intersect.h); -I scalar
+keeps the walk below, as does the ghost trace. Under inner sync main
+advances by the whole prefix of u's list the pair covers.
+
+With -T, vertices of more than T neighbors (hubs) get a bitmap of their
+lower neighbors, built on demand by the first thread to pair with the hub and
+kept for the rest of the count within -M MB (see HubSets). A pair with a hub
+is then one bit probe per neighbor of u below it instead of a walk into the
+hub's list, and the helper skips prefetching those lists. -l reports how many
+pairs and list reads the sets took over.
 */
 
 #define ORDER_READ memory_order_relaxed
@@ -60,9 +78,6 @@ graph, we use the heuristic in WorthRelabelling.
 // #define INNER_MOST
 // #define TUNING
 
-#if defined(KRON) || defined(TWITTERU) //|| defined(WEBU)
-#define INNER
-#endif 
 
 #ifdef TIME
 #define TOTAL_ITER 27197768325
@@ -111,111 +126,229 @@ std::chrono::_V2::system_clock::time_point time_array[TOTAL_ITER/FREQ+100];
 
 using namespace std;
 
-TimeDiff time_diff; 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_count; 
+
+// kron and twitter use inner-most sync, the rest sync per vertex 
+bool InnerSync(const GhostConfig &cfg) {
+  return cfg.is(kClassKron) || cfg.is(kClassTwitter); //|| cfg.is(kClassWeb)
+}
 
-void PrefetchThread(const Graph *g) {
-  #if defined(URAND) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 1, .skip_offset = 7, 
-                               .serialize_threshold = 23, .unserialize_threshold = 15}; 
-  #elif defined(ROADU) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 8, .skip_offset = 7, 
-                               .serialize_threshold = 23, .unserialize_threshold = 18}; 
-  #else
+HyperParam_PfT HyperParam_outer() {
   HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  bool serialize_flag = false; 
-  for (NodeID u=0; u < g->num_nodes(); u++) { 
-    for (NodeID v : g->out_neigh(u)) { 
-      if (serialize_flag) 
-          asm volatile ("serialize\n\t"); 
-      if (v > u)
+  if (ghost_count.is(kClassUrand))
+    hyperparam = {.sync_frequency = 1, .skip_offset = 7, 
+                  .serialize_threshold = 23, .unserialize_threshold = 15}; 
+  else if (ghost_count.is(kClassRoad))
+    hyperparam = {.sync_frequency = 8, .skip_offset = 7, 
+                  .serialize_threshold = 23, .unserialize_threshold = 18}; 
+  return ghost_count.Or(hyperparam); 
+}
+
+// Bitmaps of the lower neighbors (IDs below the hub's own, the only ones a
+// pair can match) of vertices with more than threshold neighbors; each is
+// built by the first thread to ask for it, the others keep walking until it
+// is ready, and it stays for the whole count. A hub whose bitmap would go
+// over the budget is refused and keeps the walk.
+class HubSets {
+  enum SlotState { kEmpty, kBuilding, kReady, kRefused };
+
+  struct Slot {
+    std::atomic<int> state;
+    Bitmap *set;
+    Slot() : state(kEmpty), set(nullptr) {}
+  };
+
+  const Graph &g_;
+  const int64_t threshold_;
+  vector<NodeID> hubs_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<int64_t> bytes_left_;
+  std::atomic<int64_t> num_built_;
+  const int64_t budget_;
+
+  Slot* Find(NodeID v) const {
+    if (threshold_ <= 0 || hubs_.empty() || g_.out_degree(v) <= threshold_)
+      return nullptr;
+    return &slots_[lower_bound(hubs_.begin(), hubs_.end(), v) - hubs_.begin()];
+  }
+
+ public:
+  HubSets(const Graph &g, int64_t threshold, int64_t budget) :
+      g_(g), threshold_(threshold), bytes_left_(budget), num_built_(0),
+      budget_(budget) {
+    if (threshold_ > 0)
+      for (NodeID n=0; n < g.num_nodes(); n++)
+        if (g.out_degree(n) > threshold_)
+          hubs_.push_back(n);
+    slots_.reset(new Slot[hubs_.size()]);
+  }
+
+  ~HubSets() {
+    for (size_t i=0; i < hubs_.size(); i++)
+      delete slots_[i].set;
+  }
+
+  // v's set if v is a hub and it is built (or this call builds it)
+  const Bitmap* Get(NodeID v) {
+    Slot *slot = Find(v);
+    if (slot == nullptr)
+      return nullptr;
+    int state = slot->state.load(std::memory_order_acquire);
+    if (state == kReady)
+      return slot->set;
+    if (state != kEmpty || !slot->state.compare_exchange_strong(state, kBuilding))
+      return nullptr;
+    int64_t bytes = (v / 64 + 1) * sizeof(uint64_t);
+    if (bytes_left_.fetch_sub(bytes) < bytes) {
+      bytes_left_ += bytes;
+      slot->state.store(kRefused);
+      return nullptr;
+    }
+    Bitmap *set = new Bitmap(v + 1);
+    set->reset();
+    for (NodeID w : g_.out_neigh(v)) {
+      if (w >= v)
         break;
-      g->out_neigh(v).prefetch_begin(); 
-      auto it = g->out_neigh(v).begin(); 
-      for (NodeID w : g->out_neigh(u)) { 
-        if (serialize_flag) 
-            asm volatile ("serialize\n\t"); 
-        if (w > v)
-          break;
-        __builtin_prefetch(it); 
-      }
+      set->set_bit(w);
     }
-    if (serialize_flag) 
-      asm volatile ("serialize\n\t"); 
-    sync<NodeID>(u, 1, u, false, time_diff, ORDER_READ, serialize_flag, hyperparam); 
+    slot->set = set;
+    slot->state.store(kReady, std::memory_order_release);
+    num_built_++;
+    return set;
   }
+
+  // for the helper, v's list won't be walked
+  bool ready(NodeID v) const {
+    Slot *slot = Find(v);
+    return slot != nullptr &&
+           slot->state.load(std::memory_order_relaxed) == kReady;
+  }
+
+  int64_t num_hubs() const { return hubs_.size(); }
+  int64_t num_built() const { return num_built_; }
+  int64_t bytes_used() const { return budget_ - bytes_left_; }
+};
+
+// reads of v's list the walk does for any pair (u, v), ending on v or above
+int64_t WalkReads(const Graph &g, NodeID v) {
+  return lower_bound(g.out_neigh(v).begin(), g.out_neigh(v).end(), v) -
+         g.out_neigh(v).begin() + 1;
 }
 
-void PrefetchThread_inner(const Graph *g) { // for kron, twitter, and web (although not mem-intensive)
-  #if defined(KRONU) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 1, .skip_offset = 3, 
-                               .serialize_threshold = 13, .unserialize_threshold = 8}; 
-  #elif defined(TWITTERU) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 30, .skip_offset = 1, 
-                               .serialize_threshold = 1000, .unserialize_threshold = 980}; 
-  #else
-  HyperParam_PfT hyperparam = hyper_param; 
-  #endif 
-  bool serialize_flag = false; 
-  bool prefetch = true; 
-  size_t j = 0; 
-  for (NodeID u=0; u < g->num_nodes(); u++) { 
-    for (NodeID v : g->out_neigh(u)) { 
-      if (serialize_flag) 
-          asm volatile ("serialize\n\t"); 
-      if (v > u)
+void PrefetchThread(const Graph *g, const HubSets *hubs, NodeID u,
+                    GhostLoop<NodeID> &loop) {
+  for (NodeID v : g->out_neigh(u)) { 
+    loop.Pace(); 
+    if (v > u)
+      break;
+    const bool walked = !hubs->ready(v); 
+    if (walked)
+      g->out_neigh(v).prefetch_begin(); 
+    auto it = g->out_neigh(v).begin(); 
+    for (NodeID w : g->out_neigh(u)) { 
+      loop.Pace(); 
+      if (w > v)
         break;
+      if (walked)
+        ghost_prefetch(it); 
+    }
+  }
+}
+
+// inner-most sync: the helper stops prefetching while it trails main
+void PrefetchThread_inner(const Graph *g, const HubSets *hubs, NodeID u,
+                          GhostLoop<NodeID> &loop) { // for kron, twitter, and web (although not mem-intensive)
+  for (NodeID v : g->out_neigh(u)) { 
+    loop.Pace(); 
+    if (v > u)
+      break;
+    const bool walked = !hubs->ready(v); 
+    if (walked)
       g->out_neigh(v).prefetch_begin(); 
-      // #ifdef INNER_MOST
-      auto it = g->out_neigh(v).begin(); 
-      for (NodeID w : g->out_neigh(u)) { 
-        if (serialize_flag) 
-            asm volatile ("serialize\n\t"); 
-        if (w > v)
-          break;
-        if (prefetch)
-          __builtin_prefetch(it); 
-        /*-----inner_most sync-----*/
-        j++; 
-        if (j % hyper_param.sync_frequency == 0 || serialize_flag || (!prefetch)) {
-          size_t main_j = time_diff.read_atomic_main(ORDER_READ); 
-          // time_diff.insert_into_atomic_histogram(main_j, j); 
-          if (main_j >= j) {
-            serialize_flag = false; 
-            prefetch = false; 
-          } else if (j - main_j > hyper_param.serialize_threshold) {
-            serialize_flag = true; 
-            prefetch = true; 
-          } else if (j - main_j < hyper_param.unserialize_threshold) {
-            serialize_flag = false;
-            prefetch = true;  
-          } else {
-            prefetch = true; 
-          }
-        }
-        /*-----inner_most sync-----*/
-      }
+    auto it = g->out_neigh(v).begin(); 
+    for (NodeID w : g->out_neigh(u)) { 
+      if (w > v)
+        break;
+      if (walked && !loop.behind())
+        ghost_prefetch(it); 
+      loop.Step(); 
     }
   }
 }
 
-size_t OrderedCount(const Graph &g) {
+size_t OrderedCount(const Graph &g, VectorISA isa, int64_t hub_degree,
+                    int64_t hub_budget, bool logging_enabled) {
   size_t total = 0;
-  #if defined(HTPF) && !defined(INNER)
-  thread PF(PrefetchThread, &g); 
-  #elif defined(HTPF) && defined(INNER)
-  thread PF(PrefetchThread_inner, &g); 
-  time_diff.set_atomic_main(0, ORDER_WRITE); 
+  HubSets hubs(g, hub_degree, hub_budget);
+  HubSets *hp = &hubs;
+  int64_t num_pairs = 0, hub_pairs = 0, hub_probes = 0;
+  int64_t walk_reads = 0, hub_walk_reads = 0;
+  #ifdef HTPF
+  const bool inner = InnerSync(ghost_count); 
+  HyperParam_PfT hyperparam = HyperParam_outer(); 
+  if (inner) {
+    hyperparam = hyper_param; 
+    if (ghost_count.is(kClassKron))
+      hyperparam = {.sync_frequency = 1, .skip_offset = 3, 
+                    .serialize_threshold = 13, .unserialize_threshold = 8}; 
+    else if (ghost_count.is(kClassTwitter))
+      hyperparam = {.sync_frequency = 30, .skip_offset = 1, 
+                    .serialize_threshold = 1000, .unserialize_threshold = 980}; 
+    hyperparam = ghost_count.Or(hyperparam); 
+  }
+  GhostLoop<NodeID> ghost(0, g.num_nodes(), hyperparam, inner ? kSyncInner : kSyncOuter); 
+  GhostTuning::Attach(ghost, ghost_count); 
+  ghost.set_poll_while_behind(inner); 
+  if (ghost_count.enabled() && inner)
+    ghost.Launch([&g, hp] (NodeID u, GhostLoop<NodeID> &loop) {
+      PrefetchThread_inner(&g, hp, u, loop); 
+    }); 
+  else if (ghost_count.enabled())
+    ghost.Launch([&g, hp] (NodeID u, GhostLoop<NodeID> &loop) {
+      PrefetchThread(&g, hp, u, loop); 
+    }); 
   #endif 
-  #pragma omp parallel for reduction(+ : total) schedule(dynamic, 64)
+  #pragma omp parallel for schedule(dynamic, 64) \
+    reduction(+ : total, num_pairs, hub_pairs, hub_probes, walk_reads, \
+                  hub_walk_reads)
   for (NodeID u=0; u < g.num_nodes(); u++) { 
-    #if defined(HTPF) && !defined(INNER)
-    time_diff.set_atomic_main(u, ORDER_WRITE); 
+    #ifdef HTPF
+    if (!inner)
+      ghost.Publish(u); 
     #endif 
+    size_t below = 0; // neighbors of u before v
     for (NodeID v : g.out_neigh(u)) {
       if (v > u)
         break;
+      const Bitmap *hub_set = hubs.Get(v);
+      if (logging_enabled) {
+        int64_t reads = WalkReads(g, v);
+        num_pairs++;
+        walk_reads += reads;
+        if (hub_set != nullptr) {
+          hub_pairs++;
+          hub_probes += below;
+          hub_walk_reads += reads;
+        }
+      }
+      if (hub_set != nullptr || isa != kISAScalar) {
+        const NodeID *prefix = g.out_neigh(u).begin();
+        if (hub_set != nullptr) {
+          for (size_t i=0; i < below; i++)
+            total += hub_set->get_bit(prefix[i]);
+        } else {
+          total += IntersectCount(isa, prefix, below, g.out_neigh(v).begin(),
+                                  g.out_degree(v));
+        }
+        #ifdef HTPF
+        if (inner)
+          ghost.Advance(below + 1); // the helper steps through v too
+        #endif 
+        below++;
+        continue;
+      }
       auto it = g.out_neigh(v).begin(); 
       for (NodeID w : g.out_neigh(u)) {
         #ifdef TIME
@@ -235,17 +368,32 @@ size_t OrderedCount(const Graph &g) {
           break;
         while (*it < w) 
           it++;
+        ghost_load(it); 
         if (w == *it)
           total++;
-        #if defined(HTPF) && defined(INNER)
-        time_diff.add_atomic_main(1, ORDER_WRITE); // inner most sync 
+        #ifdef HTPF
+        if (inner)
+          ghost.Advance(); // inner most sync 
         #endif 
       }
+      below++;
     }
   }
   #ifdef HTPF
-  PF.join(); 
+  ghost.Join(); 
+  GhostPool::Get().PrintDispatchStats();
+  ghost_tuning.PrintAdapted(); 
   #endif 
+  if (logging_enabled && hub_degree > 0) {
+    cout << "Hub sets: " << hubs.num_built() << " of " << hubs.num_hubs()
+         << " hubs, " << hubs.bytes_used() / (1 << 20) << " MB" << endl;
+    cout << "Hub pairs: " << hub_pairs << " of " << num_pairs << " ("
+         << 100.0 * hub_pairs / max(num_pairs, int64_t(1)) << "%), "
+         << hub_probes << " bit probes" << endl;
+    cout << "List reads replaced: " << hub_walk_reads << " of " << walk_reads
+         << " (" << 100.0 * hub_walk_reads / max(walk_reads, int64_t(1))
+         << "%)" << endl;
+  }
   return total;
 }
 
@@ -271,11 +419,13 @@ bool WorthRelabelling(const Graph &g) {
 
 
 // Uses heuristic to see if worth relabeling
-size_t Hybrid(const Graph &g) {
+size_t Hybrid(const Graph &g, VectorISA isa, int64_t hub_degree,
+              int64_t hub_budget, bool logging_enabled) {
   if (WorthRelabelling(g))
-    return OrderedCount(Builder::RelabelByDegree(g));
+    return OrderedCount(Builder::RelabelByDegree(g), isa, hub_degree,
+                        hub_budget, logging_enabled);
   else
-    return OrderedCount(g);
+    return OrderedCount(g, isa, hub_degree, hub_budget, logging_enabled);
 }
 
 
@@ -310,9 +460,6 @@ bool TCVerifier(const Graph &g, size_t test_total) {
 int main(int argc, char* argv[]) {
   #if defined(HTPF) 
   cout << "HTPF enabled. "; 
-  #if defined(INNER) 
-  cout << "INNER sync enabled.\n"; 
-  #endif 
   #endif 
   #ifdef OMP
   omp_set_num_threads(2); 
@@ -323,9 +470,7 @@ int main(int argc, char* argv[]) {
   array_counter = 0; 
   #endif 
 
-  time_diff.init_atomic(); 
-  // time_diff.init_atomic_histogram(1528870792);
-  CLApp cli(argc, argv, "triangle count");
+  CLTriangle cli(argc, argv, "triangle count");
   if (!cli.ParseArgs())
     return -1;
   /*-------set hyper parameters for inter-thread sync-------*/
@@ -343,11 +488,24 @@ int main(int argc, char* argv[]) {
     cout << "Input graph is directed but tc requires undirected" << endl;
     return -2;
   }
+  #ifdef HTPF
+  ghost_tuning.Init("tc", g, cli, hyper_param); 
+  ghost_count = ghost_tuning.Config("count"); 
+  if (InnerSync(ghost_count))
+    cout << "INNER sync enabled.\n"; 
+  #endif 
   #ifdef TIME
   auto kernel_start = chrono::high_resolution_clock::now();
   #endif 
-  BenchmarkKernel(cli, g, Hybrid, PrintTriangleStats, TCVerifier);
-  // time_diff.print_atomic_histogram(); 
+  VectorISA isa = IntersectISA(cli.vector_isa());
+  #ifdef GHOST_TRACE
+  isa = kISAScalar; // the trace wants main's loads one by one
+  #endif
+  cout << "Intersection: " << ISAName(isa) << endl;
+  auto HybridBound = [isa, &cli] (const Graph &g) {
+    return Hybrid(g, isa, cli.hub_degree(), cli.hub_budget(), cli.logging_en());
+  };
+  BenchmarkKernel(cli, g, HybridBound, PrintTriangleStats, TCVerifier);
   #ifdef TIME
   ofstream myout; 
   myout.open(OUTPUT); 
@@ -23,6 +23,7 @@
 #include "graph.h"
 #include "pvector.h"
 #include "pf_support.h"
+#include "ghost_tuning.h"
 
 /*
 GAP Benchmark Suite
@@ -67,44 +68,28 @@ graph, we use the heuristic in WorthRelabelling.
 // #define OMP
 // #define TIME
 
-// #define KRON
 // #define INNER_MOST
 // #define TUNING
 
-#if defined(KRON) || defined(TWITTERU)
-#define INNER
-#endif 
-
 using namespace std;
 
 OMPSyncAtomic time_diff(NT); 
 OMPSyncAtomic end_flag(NT); 
 HyperParam_PfT hyper_param; 
+GhostTuning ghost_tuning; 
+GhostConfig ghost_count; // kron and twitter sync in the innermost loop 
 
 void PrefetchThread(int me, const Graph *g, NodeID start) {
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
-
-  #if defined(URAND) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 1, .skip_offset = 7, 
-                               .serialize_threshold = 23, .unserialize_threshold = 15}; 
-  #elif defined(ROADU) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 8, .skip_offset = 7, 
-                               .serialize_threshold = 23, .unserialize_threshold = 18}; 
-  #else
+  GhostTopology::Get().PinHelper(me);
+
   HyperParam_PfT hyperparam = hyper_param; 
+  #ifndef TUNING
+  if (ghost_count.is(kClassUrand))
+    hyperparam = {.sync_frequency = 1, .skip_offset = 7, 
+                  .serialize_threshold = 23, .unserialize_threshold = 15}; 
+  else if (ghost_count.is(kClassRoad))
+    hyperparam = {.sync_frequency = 8, .skip_offset = 7, 
+                  .serialize_threshold = 23, .unserialize_threshold = 18}; 
   #endif 
   bool serialize_flag = false; 
   NodeID local_counter = start; 
@@ -113,25 +98,25 @@ void PrefetchThread(int me, const Graph *g, NodeID start) {
     local_counter = u - start; 
     for (NodeID v : g->out_neigh(u)) { 
       if (serialize_flag) 
-          asm volatile ("serialize\n\t"); 
+          ghost_throttle(1); 
       if (v > u)
         break;
       g->out_neigh(v).prefetch_begin(); 
       auto it = g->out_neigh(v).begin(); 
       for (NodeID w : g->out_neigh(u)) { 
         if (serialize_flag) 
-            asm volatile ("serialize\n\t"); 
+            ghost_throttle(1); 
         if (w > v)
           break;
         __builtin_prefetch(it); 
       }
     }
     if (serialize_flag) 
-      asm volatile ("serialize\n\t"); 
+      ghost_throttle(1); 
     sync<NodeID>(u, 1, u, false, time_diff, me, ORDER_READ, serialize_flag, hyperparam); 
     if (local_counter >= CHUNKSIZE) {
       while (true) { 
-        asm volatile ("serialize\n\t"); 
+        ghost_throttle(1); 
         if (time_diff.read(me, ORDER_READ) >= u || end_flag.read(me, ORDER_READ)) 
           break; 
       } // wait until the main thread goes to next chunk 
@@ -145,28 +130,15 @@ void PrefetchThread(int me, const Graph *g, NodeID start) {
 }
 
 void PrefetchThread_inner(int me, const Graph *g, NodeID start) { // for kron, twitter, and web (although not mem-intensive)
-  /*-----pin the pf thread to specfic core-----*/ 
-  pthread_t self = pthread_self();
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  // CPU_SET(me+64, &cpuset); // dublin 
-  CPU_SET((me*2)+1, &cpuset); // beijing 
-    
-  int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-  if (rc != 0)
-  {
-    printf("Failed to pin pf thread.\n");
-    exit(1);
-  }
-  /*-----pin the pf thread to specfic core-----*/
-  #if defined(KRONU) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 1, .skip_offset = 3, 
-                               .serialize_threshold = 13, .unserialize_threshold = 8}; 
-  #elif defined(TWITTERU) && !defined(TUNING)
-  HyperParam_PfT hyperparam = {.sync_frequency = 30, .skip_offset = 1, 
-                               .serialize_threshold = 1000, .unserialize_threshold = 980}; 
-  #else
+  GhostTopology::Get().PinHelper(me);
   HyperParam_PfT hyperparam = hyper_param; 
+  #ifndef TUNING
+  if (ghost_count.is(kClassKron))
+    hyperparam = {.sync_frequency = 1, .skip_offset = 3, 
+                  .serialize_threshold = 13, .unserialize_threshold = 8}; 
+  else if (ghost_count.is(kClassTwitter))
+    hyperparam = {.sync_frequency = 30, .skip_offset = 1, 
+                  .serialize_threshold = 1000, .unserialize_threshold = 980}; 
   #endif 
   bool serialize_flag = false; 
   bool prefetch = true; 
@@ -175,7 +147,7 @@ void PrefetchThread_inner(int me, const Graph *g, NodeID start) { // for kron, t
   for (NodeID u=start; u < g->num_nodes(); u++) { 
     for (NodeID v : g->out_neigh(u)) { 
       if (serialize_flag) 
-          asm volatile ("serialize\n\t"); 
+          ghost_throttle(1); 
       if (v > u)
         break;
       g->out_neigh(v).prefetch_begin(); 
@@ -183,7 +155,7 @@ void PrefetchThread_inner(int me, const Graph *g, NodeID start) { // for kron, t
       auto it = g->out_neigh(v).begin(); 
       for (NodeID w : g->out_neigh(u)) { 
         if (serialize_flag) 
-            asm volatile ("serialize\n\t"); 
+            ghost_throttle(1); 
         if (w > v)
           break;
         if (prefetch)
@@ -214,23 +186,11 @@ void PrefetchThread_inner(int me, const Graph *g, NodeID start) { // for kron, t
 
 size_t OrderedCount(const Graph &g) {
   size_t total = 0;
+  const bool inner = ghost_count.is(kClassKron) || ghost_count.is(kClassTwitter); 
   #pragma omp parallel
   {
     int me = omp_get_thread_num(); 
-    /*-----pin the main thread to specfic core-----*/ 
-    pthread_t self = pthread_self();
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    // CPU_SET(me, &cpuset);
-    CPU_SET(me*2, &cpuset); // beijing
-      
-    int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
-    if (rc != 0)
-    {
-      printf("Failed to pin main thread.\n");
-      exit(1);
-    }
-    /*-----pin the main thread to specfic core-----*/
+    GhostTopology::Get().PinMain(me);
 
     /*-----compute boundary for each pf thread-----*/
     // size_t div = g.num_nodes() / NT; 
@@ -251,20 +211,23 @@ size_t OrderedCount(const Graph &g) {
     //   head = div*(previous_me+1) + mod; 
     /*-----compute boundary for each pf thread-----*/
     
-    #if defined(HTPF) && !defined(INNER)
-    size_t head = me*CHUNKSIZE; 
-    time_diff.set(me, head, ORDER_WRITE); 
-    end_flag.set(me, 0, ORDER_WRITE); 
-    thread PF(PrefetchThread, me, &g, head); 
-    #elif defined(HTPF) && defined(INNER)
+    #ifdef HTPF
     size_t head = me*CHUNKSIZE; 
-    thread PF(PrefetchThread_inner, me, &g, head); 
-    time_diff.set(me, 0, ORDER_WRITE); 
+    thread PF; 
+    if (inner) {
+      PF = thread(PrefetchThread_inner, me, &g, head); 
+      time_diff.set(me, 0, ORDER_WRITE); 
+    } else if (ghost_count.enabled()) {
+      time_diff.set(me, head, ORDER_WRITE); 
+      end_flag.set(me, 0, ORDER_WRITE); 
+      PF = thread(PrefetchThread, me, &g, head); 
+    }
     #endif 
     #pragma omp for reduction(+ : total) schedule(dynamic, CHUNKSIZE)
     for (NodeID u=0; u < g.num_nodes(); u++) { 
-      #if defined(HTPF) && !defined(INNER)
-      time_diff.set(me, u, ORDER_WRITE); 
+      #ifdef HTPF
+      if (!inner)
+        time_diff.set(me, u, ORDER_WRITE); 
       #endif 
       for (NodeID v : g.out_neigh(u)) {
         if (v > u)
@@ -277,15 +240,17 @@ size_t OrderedCount(const Graph &g) {
             it++;
           if (w == *it)
             total++;
-          #if defined(HTPF) && defined(INNER)
-          time_diff.add(me, 1, ORDER_WRITE); // inner most sync 
+          #ifdef HTPF
+          if (inner)
+            time_diff.add(me, 1, ORDER_WRITE); // inner most sync 
           #endif 
         }
       }
     }
     #ifdef HTPF
     end_flag.set(me, 1, ORDER_WRITE); 
-    PF.join(); 
+    if (PF.joinable())
+      PF.join(); 
     #endif 
   }
   return total;
@@ -364,8 +329,13 @@ int main(int argc, char* argv[]) {
   cout << "sync frequency = " << hyper_param.sync_frequency << ", serialize threshold = " << hyper_param.serialize_threshold 
        << ", unserialize threshold = " << hyper_param.unserialize_threshold << ", skip offset = " << hyper_param.skip_offset << endl; 
   /*-------set hyper parameters for inter-thread sync-------*/
+  GhostThrottle::Get(); // calibrate before anything is timed
   Builder b(cli);
   Graph g = b.MakeGraph();
+  #ifdef HTPF
+  ghost_tuning.Init("tc_paral", g, cli, hyper_param); 
+  ghost_count = ghost_tuning.Config("count"); 
+  #endif 
   if (g.directed()) {
     cout << "Input graph is directed but tc requires undirected" << endl;
     return -2;
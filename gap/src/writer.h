@@ -21,6 +21,10 @@ Author: Scott Beamer
 Given filename and graph, writes out the graph to storage
  - Should use WriteGraph(filename, serialized)
  - If serialized, will write out as serialized graph, otherwise, as edgelist
+ - Serialized graphs use the page-aligned v2 layout (see SGHeaderV2) that
+   Reader maps in place, unless the legacy v1 layout is asked for
+ - The v2 layout also keeps the permutation of a reordered graph (-O), the
+   v1 layout drops it
 */
 
 
@@ -36,25 +40,26 @@ class WriterBase {
     }
   }
 
-  void WriteSerializedGraph(std::fstream &out) {
+  void CheckSerializable() {
     if (!std::is_same<NodeID_, SGID>::value) {
-      std::cout << "serialized graphs only allowed for 32b IDs" << std::endl;
+      std::cout << "serialized graphs only allowed for 32b IDs (64b with "
+                << "NODEID64)" << std::endl;
       std::exit(-4);
     }
     if (!std::is_same<DestID_, NodeID_>::value &&
-        !std::is_same<DestID_, NodeWeight<NodeID_, SGID>>::value) {
+        !std::is_same<DestID_, NodeWeight<NodeID_, int32_t>>::value) {
       std::cout << ".wsg only allowed for int32_t weights" << std::endl;
       std::exit(-8);
     }
+  }
+
+  void WriteSerializedGraph(std::fstream &out) {
+    CheckSerializable();
     bool directed = g_.directed();
     SGOffset num_nodes = g_.num_nodes();
     SGOffset edges_to_write = g_.num_edges_directed();
     std::streamsize index_bytes = (num_nodes+1) * sizeof(SGOffset);
-    std::streamsize neigh_bytes;
-    if (std::is_same<DestID_, NodeID_>::value)
-      neigh_bytes = edges_to_write * sizeof(SGID);
-    else
-      neigh_bytes = edges_to_write * sizeof(NodeWeight<NodeID_, SGID>);
+    std::streamsize neigh_bytes = edges_to_write * sizeof(DestID_);
     out.write(reinterpret_cast<char*>(&directed), sizeof(bool));
     out.write(reinterpret_cast<char*>(&edges_to_write), sizeof(SGOffset));
     out.write(reinterpret_cast<char*>(&num_nodes), sizeof(SGOffset));
@@ -68,18 +73,81 @@ class WriterBase {
     }
   }
 
-  void WriteGraph(std::string filename, bool serialized = false) {
+  void PadToPage(std::fstream &out) {
+    SGOffset pos = out.tellp();
+    std::string zeros(SGPageAlign(pos) - pos, '\0');
+    out.write(zeros.data(), zeros.size());
+  }
+
+  void WriteSerializedGraphV2(std::fstream &out) {
+    CheckSerializable();
+    SGHeaderV2 header = {};
+    std::copy(SG_V2_MAGIC, SG_V2_MAGIC + 8, header.magic);
+    header.directed = g_.directed();
+    header.dest_bytes = sizeof(DestID_);
+    header.id_bytes = sizeof(SGID);
+    header.num_nodes = g_.num_nodes();
+    header.num_edges = g_.num_edges_directed();
+    SGOffset index_bytes = (header.num_nodes+1) * sizeof(SGOffset);
+    SGOffset neigh_bytes = header.num_edges * sizeof(DestID_);
+    header.out_offsets = kSGPageBytes;
+    header.out_neighs = header.out_offsets + SGPageAlign(index_bytes);
+    SGOffset end = header.out_neighs + SGPageAlign(neigh_bytes);
+    if (header.directed) {
+      header.in_offsets = end;
+      header.in_neighs = header.in_offsets + SGPageAlign(index_bytes);
+      end = header.in_neighs + SGPageAlign(neigh_bytes);
+    }
+    if (g_.reordered())
+      header.original_ids = end;
+    out.write(reinterpret_cast<char*>(&header), sizeof(header));
+    PadToPage(out);
+    pvector<SGOffset> offsets = g_.VertexOffsets(false);
+    out.write(reinterpret_cast<char*>(offsets.data()), index_bytes);
+    PadToPage(out);
+    out.write(reinterpret_cast<char*>(g_.out_neigh(0).begin()), neigh_bytes);
+    if (header.directed) {
+      PadToPage(out);
+      offsets = g_.VertexOffsets(true);
+      out.write(reinterpret_cast<char*>(offsets.data()), index_bytes);
+      PadToPage(out);
+      out.write(reinterpret_cast<char*>(g_.in_neigh(0).begin()), neigh_bytes);
+    }
+    if (g_.reordered()) {
+      PadToPage(out);
+      pvector<SGID> ids(header.num_nodes);
+      #pragma omp parallel for
+      for (NodeID_ n=0; n < g_.num_nodes(); n++)
+        ids[n] = g_.original_id(n);
+      out.write(reinterpret_cast<char*>(ids.data()),
+                header.num_nodes * sizeof(SGID));
+    }
+  }
+
+  void WriteGraph(std::string filename, bool serialized = false,
+                  bool sg_v1 = false) {
     if (filename == "") {
       std::cout << "No output filename given (Use -h for help)" << std::endl;
       std::exit(-8);
     }
+    std::size_t suff_pos = filename.rfind('.');
+    int suffix_id_bytes = suff_pos == std::string::npos ? 0 :
+                          SGSuffixIDBytes(filename.substr(suff_pos));
+    if (serialized && suffix_id_bytes != 0 &&
+        suffix_id_bytes != sizeof(SGID)) {
+      std::cout << (sizeof(SGID) == 8 ? "NODEID64 builds write .sg64/.wsg64"
+                    : "only NODEID64 builds write .sg64/.wsg64") << std::endl;
+      std::exit(-4);
+    }
     std::fstream file(filename, std::ios::out | std::ios::binary);
     if (!file) {
       std::cout << "Couldn't write to file " << filename << std::endl;
       std::exit(-5);
     }
-    if (serialized)
+    if (serialized && sg_v1)
       WriteSerializedGraph(file);
+    else if (serialized)
+      WriteSerializedGraphV2(file);
     else
       WriteEL(file);
     file.close();
@@ -58,9 +58,50 @@ test-load: test-load-4.gr test-load-4.el test-load-4.wel test-load-4.graph \
 test/out/load-%.out: test/out $(GENERATE_KERNEL)
 	./$(GENERATE_KERNEL) -f test/graphs/$* -n0 > $@
 
+# Serialized round trip, v2 (mapped), legacy v1 and out-of-core built
+#  - NODEID64 builds serialize to .sg64/.wsg64, checked against the same
+#    references
+ifeq ($(NODEID64), 1)
+SG = sg64
+WSG = wsg64
+else
+SG = sg
+WSG = wsg
+endif
+
+test-load: test-load-4.$(SG) test-load-4v1.$(SG) test-load-4ooc.$(SG)
+
+test/out/4.$(SG): test/out converter
+	./converter -f test/graphs/4.el -b $@ > /dev/null
+
+test/out/4v1.$(SG): test/out converter
+	./converter -f test/graphs/4.el -lb $@ > /dev/null
+
+test/out/4ooc.$(SG): test/out converter
+	./converter -f test/graphs/4.el -M 1 -b $@ > /dev/null
+
+# Plain, weighted and symmetrized from one parse (-b -W -U)
+test-load: test-load-4one.$(SG) test-load-4one.$(WSG) test-load-4oneU.$(SG)
+
+test/out/4one.$(SG): test/out converter
+	./converter -f test/graphs/4.el -b $@ \
+		-W test/out/4one.$(WSG) -U test/out/4oneU.$(SG) > /dev/null
+
+test/out/4one.$(WSG) test/out/4oneU.$(SG): test/out/4one.$(SG) ;
+
+test/out/load-4.$(SG).out test/out/load-4v1.$(SG).out \
+		test/out/load-4ooc.$(SG).out test/out/load-4one.$(SG).out \
+		test/out/load-4oneU.$(SG).out: \
+		test/out/load-%.out: \
+		test/out/% $(GENERATE_KERNEL)
+	./$(GENERATE_KERNEL) -f $< -n0 > $@
+
+test/out/load-4one.$(WSG).out: test/out/4one.$(WSG) sssp
+	./sssp -f $< -n0 > $@
+
 .SECONDARY: # want to keep all intermediate files (test outputs)
 test-load-%: test/out/load-%.out
-	@if grep -q "`cat test/reference/graph-$*.out`" $<; \
+	@if grep -q "`cat test/reference/graph-$(patsubst %64,%,$*).out`" $<; \
 		then echo " $(PASS) Load $*"; \
 		else echo " $(FAIL) Load $*"; \
 	fi
@@ -84,3 +125,190 @@ test-verify-%-$(TEST_GRAPH): test/out/verify-%-$(TEST_GRAPH).out
 	fi
 
 test-verify: $(addsuffix -$(TEST_GRAPH), $(addprefix test-verify-, $(KERNELS)))
+
+# Varint compressed CSR (-C), on the kernels that take it
+COMPRESSED_KERNELS = pr_spmv pr_tpf cc_sv
+
+test/out/verify-%-C-$(TEST_GRAPH).out: test/out %
+	./$* -$(TEST_GRAPH) -C -vn1 > $@
+
+test-verify-%-C-$(TEST_GRAPH): test/out/verify-%-C-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify $* -C"; \
+		else echo " $(FAIL) Verify $* -C"; \
+	fi
+
+ifneq ($(NODEID64), 1)  # -C holds 32-bit IDs only
+test-verify: $(addsuffix -C-$(TEST_GRAPH), \
+	$(addprefix test-verify-, $(COMPRESSED_KERNELS)))
+endif
+
+# Vertex reordering (-O), one order per kernel; pr is left out since its
+# Gauss-Seidel sweep converges slower with hubs first and can hit -i20
+REORDER_TESTS = bfs-dbg pr_spmv-hub cc-rcm sssp-gorder bc-degree tc-dbg
+
+test/out/reorder-%-$(TEST_GRAPH).out: test/out bfs pr_spmv cc sssp bc tc
+	./$(firstword $(subst -, ,$*)) -$(TEST_GRAPH) \
+		-O $(lastword $(subst -, ,$*)) -vn1 > $@
+
+test-reorder-%-$(TEST_GRAPH): test/out/reorder-%-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify $* order"; \
+		else echo " $(FAIL) Verify $* order"; \
+	fi
+
+test-verify: $(addsuffix -$(TEST_GRAPH), \
+	$(addprefix test-reorder-, $(REORDER_TESTS)))
+
+# Multi-source BFS with the widest batch (-b256, four words per set)
+test/out/verify-msbfs_tpf-b256-$(TEST_GRAPH).out: test/out msbfs_tpf
+	./msbfs_tpf -$(TEST_GRAPH) -b256 -vn1 > $@
+
+test-verify-msbfs_tpf-b256-$(TEST_GRAPH): \
+		test/out/verify-msbfs_tpf-b256-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify msbfs_tpf -b256"; \
+		else echo " $(FAIL) Verify msbfs_tpf -b256"; \
+	fi
+
+test-verify: test-verify-msbfs_tpf-b256-$(TEST_GRAPH)
+
+# The same without the AVX2 set ops (-I scalar)
+test/out/verify-msbfs_tpf-b256-scalar-$(TEST_GRAPH).out: test/out msbfs_tpf
+	./msbfs_tpf -$(TEST_GRAPH) -b256 -I scalar -vn1 > $@
+
+test-verify-msbfs_tpf-b256-scalar-$(TEST_GRAPH): \
+		test/out/verify-msbfs_tpf-b256-scalar-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify msbfs_tpf -b256 -I scalar"; \
+		else echo " $(FAIL) Verify msbfs_tpf -b256 -I scalar"; \
+	fi
+
+test-verify: test-verify-msbfs_tpf-b256-scalar-$(TEST_GRAPH)
+
+# Propagation blocking with many narrow bins (-B4, 64 bins on g10)
+test/out/verify-pr_pb-B4-$(TEST_GRAPH).out: test/out pr_pb
+	./pr_pb -$(TEST_GRAPH) -B4 -vn1 > $@
+
+test-verify-pr_pb-B4-$(TEST_GRAPH): test/out/verify-pr_pb-B4-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify pr_pb -B4"; \
+		else echo " $(FAIL) Verify pr_pb -B4"; \
+	fi
+
+test-verify: test-verify-pr_pb-B4-$(TEST_GRAPH)
+
+# PageRank pull with each gather path (-I), a path the CPU lacks falls back
+GATHER_ISAS = scalar avx2 avx512
+
+test/out/gather-%-$(TEST_GRAPH).out: test/out pr_tpf
+	./pr_tpf -$(TEST_GRAPH) -I $* -vn1 > $@
+
+test-gather-%-$(TEST_GRAPH): test/out/gather-%-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify pr_tpf -I $*"; \
+		else echo " $(FAIL) Verify pr_tpf -I $*"; \
+	fi
+
+test-verify: $(addsuffix -$(TEST_GRAPH), $(addprefix test-gather-, $(GATHER_ISAS)))
+
+# Triangle counting with each intersection (-I), scalar is the plain walk
+INTERSECT_ISAS = scalar avx2 avx512
+
+test/out/verify-tc-%-$(TEST_GRAPH).out: test/out tc
+	./tc -$(TEST_GRAPH) -I $* -vn1 > $@
+
+test-intersect-%-$(TEST_GRAPH): test/out/verify-tc-%-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify tc -I $*"; \
+		else echo " $(FAIL) Verify tc -I $*"; \
+	fi
+
+test-verify: $(addsuffix -$(TEST_GRAPH), \
+	$(addprefix test-intersect-, $(INTERSECT_ISAS)))
+
+# Triangle counting with hub bitmap sets (-T), and with none fitting (-M 0)
+test/out/verify-tc_tpf-hubs-$(TEST_GRAPH).out: test/out tc_tpf
+	./tc_tpf -$(TEST_GRAPH) -T 16 -vn1 > $@
+
+test/out/verify-tc_tpf-hubs0-$(TEST_GRAPH).out: test/out tc_tpf
+	./tc_tpf -$(TEST_GRAPH) -T 16 -M 0 -vn1 > $@
+
+test-hubs-%-$(TEST_GRAPH): test/out/verify-tc_tpf-%-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify tc_tpf $*"; \
+		else echo " $(FAIL) Verify tc_tpf $*"; \
+	fi
+
+test-verify: test-hubs-hubs-$(TEST_GRAPH) test-hubs-hubs0-$(TEST_GRAPH)
+
+# Ghost builds (-DOMP -DHTPF) of the helper-thread kernels, each run with
+# the kron and urand helpers and with none (-G); bc_tpf's OpenMP variant
+# only matches bc with -DBEST
+GHOST_KERNELS = bc_tpf bfs_tpf cc_tpf pr_tpf sssp_tpf tc_tpf
+GHOST_CLASSES = kron urand off
+
+%-ghost : src/%.cc src/*.h
+	$(CXX) $(CXX_FLAGS) $(PAR_FLAG) -DOMP -DHTPF $< -o $@
+
+bc_tpf-ghost : CXX_FLAGS += -DBEST
+
+.SECONDEXPANSION:
+test/out/ghost-%-$(TEST_GRAPH).out: test/out \
+		$$(firstword $$(subst -, ,$$*))-ghost
+	./$(firstword $(subst -, ,$*))-ghost -$(TEST_GRAPH) \
+		-G $(lastword $(subst -, ,$*)) -vn1 > $@
+
+test-ghost-%-$(TEST_GRAPH): test/out/ghost-%-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $<; \
+		then echo " $(PASS) Verify $(subst -, -G ,$*) (ghost)"; \
+		else echo " $(FAIL) Verify $(subst -, -G ,$*) (ghost)"; \
+	fi
+
+test-verify: $(foreach k, $(GHOST_KERNELS), $(foreach c, $(GHOST_CLASSES), \
+	test-ghost-$(k)-$(c)-$(TEST_GRAPH)))
+
+# Ghost options on bfs_tpf: the tuning database (-c), the adaptive lead
+# band (-y) and telemetry to a csv (-z), each also checked for its effect
+GHOST_CHECK_db = grep -q "in tuning.db" $<
+GHOST_CHECK_adapt = grep -q "adapting to" $<
+GHOST_CHECK_telemetry = grep -q "^phase,label" \
+	test/out/ghost-telemetry-$(TEST_GRAPH).csv
+
+test/out/ghostopt-db-$(TEST_GRAPH).out: test/out bfs_tpf-ghost
+	./bfs_tpf-ghost -$(TEST_GRAPH) -G kron -c tuning.db -vn1 > $@
+
+test/out/ghostopt-adapt-$(TEST_GRAPH).out: test/out bfs_tpf-ghost
+	./bfs_tpf-ghost -$(TEST_GRAPH) -G kron -y 8 -vn1 > $@
+
+test/out/ghostopt-telemetry-$(TEST_GRAPH).out: test/out bfs_tpf-ghost
+	./bfs_tpf-ghost -$(TEST_GRAPH) -G kron \
+		-z test/out/ghost-telemetry-$(TEST_GRAPH).csv -vn1 > $@
+
+test-ghostopt-%-$(TEST_GRAPH): test/out/ghostopt-%-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $< && $(GHOST_CHECK_$*); \
+		then echo " $(PASS) Verify bfs_tpf ghost $*"; \
+		else echo " $(FAIL) Verify bfs_tpf ghost $*"; \
+	fi
+
+test-verify: $(addsuffix -$(TEST_GRAPH), \
+	$(addprefix test-ghostopt-, db adapt telemetry))
+
+# Trace of pr_tpf's kron helper (-DGHOST_TRACE) replayed by ghost_replay,
+# checked for the coverage, lateness and pollution lines of its report
+%-trace : src/%.cc src/*.h
+	$(CXX) $(CXX_FLAGS) -DGHOST_TRACE -DHTPF $< -o $@
+
+test/out/trace-pr_tpf-$(TEST_GRAPH).out: test/out pr_tpf-trace ghost_replay
+	GHOST_TRACE_FILE=test/out/pr_tpf-$(TEST_GRAPH).trace \
+		./pr_tpf-trace -$(TEST_GRAPH) -G kron -vn1 > $@
+	./ghost_replay -f test/out/pr_tpf-$(TEST_GRAPH).trace >> $@
+
+test-trace-%-$(TEST_GRAPH): test/out/trace-%-$(TEST_GRAPH).out
+	@if grep -q "Verification:           PASS" $< && grep -q "^Coverage:" $< \
+			&& grep -q "^Late:" $< && grep -q "^Pollution:" $<; \
+		then echo " $(PASS) Replay $* trace"; \
+		else echo " $(FAIL) Replay $* trace"; \
+	fi
+
+test-verify: test-trace-pr_tpf-$(TEST_GRAPH)
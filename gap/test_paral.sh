@@ -37,9 +37,10 @@ fi
 
 kernel_tpf_name="$kernel_name"_tpf_paral
 graph=benchmark/graphs/$graph_name-sim.$graph_postfix
-graph_macro=$(echo "$graph_name" | tr 'a-z' 'A-Z')
+# the sweep below sets the hyperparameters, -G picks the helper variant
+graph_class=${graph_name%U}
 
-echo "tested graph: $graph_macro"
+echo "tested graph: $graph_name ($graph_class helper)"
 
 if [ "$kernel_name" == "bfs" ]; then
     if [ "$graph_name" == "kron" ]; then
@@ -240,9 +241,12 @@ if [ "$exe_swpf" == "1" ]; then
     rm $kernel_name-swpf
 fi 
 
-# htpf 
+# htpf, one binary per kernel and thread count serves every graph
 if [ "$exe_htpf" == "1" ]; then
-g++ -std=c++11 -fopenmp -pthread -O3 -Wall -w -DCHUNKSIZE=$chunk_size -DTUNING -DHTPF -D$graph_macro -DOMP -DNT=$thread_num src/$kernel_tpf_name.cc -o $kernel_tpf_name
+tpf_bin=$kernel_tpf_name-ghost$thread_num-$chunk_size
+if [ ! -x $tpf_bin ] || [ -n "$(find src -newer $tpf_bin)" ]; then
+	g++ -std=c++11 -fopenmp -pthread -O3 -Wall -w -DCHUNKSIZE=$chunk_size -DTUNING -DHTPF -DOMP -DNT=$thread_num src/$kernel_tpf_name.cc -o $tpf_bin
+fi
 for syncfreq in "${syncfreqs[@]}"
 do
 	for skip in "${skips[@]}"
@@ -254,11 +258,10 @@ do
 				if [ $un_threshold -le $threshold ]; then
 					out_pf="$out_path/$kernel_name-$graph_name-htpf-$syncfreq-$skip-$threshold-$un_threshold.txt"
 					echo "HTPF: $out_pf."
-					taskset -c $homp_cpu_list ./$kernel_tpf_name -f $graph -n $repeat -p $syncfreq -o $threshold -j $skip -q $un_threshold > $out_pf 2>&1 
+					taskset -c $homp_cpu_list ./$tpf_bin -f $graph -n $repeat -G $graph_class -p $syncfreq -o $threshold -j $skip -q $un_threshold > $out_pf 2>&1 
                 fi
 			done 
 		done
 	done 
 done
-rm $kernel_tpf_name
 fi
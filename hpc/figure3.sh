@@ -1,8 +1,9 @@
 #!/usr/bin/bash
 
 #----------only set these parameters----------
-smt_core0=$1
-smt_core1=$2
+smt_pair=($($(dirname "$0")/smt_pair.sh)) # siblings from sysfs unless given
+smt_core0=${1:-${smt_pair[0]}}
+smt_core1=${2:-${smt_pair[1]}}
 #----------only set these parameters----------
 
 out_path=output/figure3
@@ -1,7 +1,8 @@
 #!/usr/bin/bash
 
-smt_core0=$1
-smt_core1=$2
+smt_pair=($($(dirname "$0")/smt_pair.sh)) # siblings from sysfs unless given
+smt_core0=${1:-${smt_pair[0]}}
+smt_core1=${2:-${smt_pair[1]}}
 
 ./test_membw.sh camel $smt_core0 $smt_core1
 ./test_membw.sh kangaroo $smt_core0 $smt_core1
@@ -766,6 +766,177 @@ void PrefetchThread_whole(void *arg) {
     }
 }
 
+/*-----pipelined helper-----*/
+// Resolving array3[hash(array2[hash(array1[i])])] in one step stalls the
+// helper on array2 before it can prefetch array3, which caps its lead.
+// Stage 1 runs PIPE_DIST1 keys ahead of main: it reads array1, prefetches
+// array2 and hands the hashed array2 index to stage 2 through a ring.
+// Stage 2 runs PIPE_DIST2 keys ahead, when that array2 line has arrived,
+// and prefetches array3.
+//  -DPIPELINE=1: one helper interleaves both stages over a private ring
+//  -DPIPELINE=2: one helper per stage, linked by an SPSC ring; stage 1
+//                throttles against main on its own distance, stage 2 holds
+//                each key until main is within PIPE_DIST2 of it
+#ifdef PIPELINE
+#if NARRAYS != 3
+#error "PIPELINE only resolves the NARRAYS=3 chain"
+#endif
+
+#ifndef PIPE_DIST1
+#define PIPE_DIST1 64
+#endif
+
+#ifndef PIPE_DIST2
+#define PIPE_DIST2 8
+#endif
+
+#ifndef PIPE_RING
+#define PIPE_RING 256 // power of two, > PIPE_DIST1 - PIPE_DIST2
+#endif
+_Static_assert((PIPE_RING & (PIPE_RING - 1)) == 0, "PIPE_RING must be a power of two");
+_Static_assert(PIPE_RING > PIPE_DIST1 - PIPE_DIST2, "PIPE_RING too small for the stage gap");
+
+// lead beyond a stage's distance where it starts / stops throttling
+#ifndef PIPE_SER
+#define PIPE_SER 200
+#endif
+
+#ifndef PIPE_UNSER
+#define PIPE_UNSER 80
+#endif
+
+#if PIPELINE == 2
+#define PIPE_HELPERS 2
+#else
+#define PIPE_HELPERS 1
+#endif
+
+typedef struct PipeSlot {
+    int key;        // -1 ends the phase
+    unsigned int index; // hash(array1[key])
+} PipeSlot;
+
+typedef struct PipeRing {
+    _Alignas(64) atomic_size_t head; // written by stage 1
+    _Alignas(64) atomic_size_t tail; // written by stage 2
+    _Alignas(64) PipeSlot slot[PIPE_RING];
+} PipeRing;
+
+PipeRing pipe_ring;
+
+// waits on the ring pause for a while, then give the CPU away, in case
+// the stages share a hardware thread with each other or with main
+#ifndef PIPE_SPIN
+#define PIPE_SPIN 64
+#endif
+
+static inline void pipe_wait(int *spins) {
+    if (++*spins < PIPE_SPIN) {
+        _mm_pause();
+    } else {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+// distance control of one stage at key, returns the key to continue from
+static inline int pipe_sync(int key, int dist, char *serialize_flag) {
+    if (*serialize_flag)
+        __asm__ volatile ("serialize\n\t");
+    if (key % 8 == 0 || *serialize_flag == 1) {
+        int main_iter_ = (int) atomic_load_explicit(&main_iter, memory_order_relaxed);
+        if (key <= main_iter_) { // stage fell behind main
+            *serialize_flag = 0;
+            return main_iter_ + dist;
+        } else if (key - main_iter_ - dist >= PIPE_SER) {
+            *serialize_flag = 1;
+        } else if (key - main_iter_ - dist <= PIPE_UNSER) {
+            *serialize_flag = 0;
+        }
+    }
+    return key;
+}
+
+void PrefetchThread_pipelined() {
+    PipeSlot ring[PIPE_RING];
+    char serialize_flag = 0;
+    for (int k = 0; k < PIPE_RING; k++)
+        ring[k].key = -1;
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (i % SKIP_INDEX == 0)
+            __builtin_prefetch(&array1[i+INDEX1]);
+        /*---stage 1---*/
+        int k1 = i + PIPE_DIST1;
+        if (k1 < NUM_KEYS) {
+            unsigned int index = hash(array1[k1]);
+            __builtin_prefetch(&array2[index]);
+            ring[k1 & (PIPE_RING-1)].key = k1;
+            ring[k1 & (PIPE_RING-1)].index = index;
+        }
+        /*---stage 2---*/
+        int k2 = i + PIPE_DIST2;
+        PipeSlot slot = ring[k2 & (PIPE_RING-1)];
+        if (slot.key == k2 && (k2 & SKIP_AND) >= SKIP_FREQ) // not resolved after a jump
+            __builtin_prefetch(&array3[hash(array2[slot.index])]);
+        i = pipe_sync(i, 0, &serialize_flag);
+    }
+}
+
+static inline void pipe_push(size_t *head, size_t *tail, PipeSlot slot) {
+    int spins = 0;
+    while (*head - *tail == PIPE_RING) { // stage 2 is a whole ring behind
+        pipe_wait(&spins);
+        *tail = atomic_load_explicit(&pipe_ring.tail, memory_order_acquire);
+    }
+    pipe_ring.slot[*head & (PIPE_RING-1)] = slot;
+    atomic_store_explicit(&pipe_ring.head, ++*head, memory_order_release);
+}
+
+void PrefetchStage1() {
+    size_t head = atomic_load_explicit(&pipe_ring.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&pipe_ring.tail, memory_order_acquire);
+    char serialize_flag = 0;
+    for (int k = PIPE_DIST1; k < NUM_KEYS; k++) {
+        if (k % SKIP_INDEX == 0)
+            __builtin_prefetch(&array1[k-PIPE_DIST1+INDEX1]); // as in PIPELINE=1
+        PipeSlot slot = { k, hash(array1[k]) };
+        __builtin_prefetch(&array2[slot.index]);
+        pipe_push(&head, &tail, slot);
+        k = pipe_sync(k, PIPE_DIST1, &serialize_flag);
+    }
+    PipeSlot end = { -1, 0 };
+    pipe_push(&head, &tail, end);
+}
+
+void PrefetchStage2() {
+    size_t tail = atomic_load_explicit(&pipe_ring.tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&pipe_ring.head, memory_order_acquire);
+    char serialize_flag = 0;
+    int next = 0; // keys below were overtaken by main
+    while (1) {
+        int spins = 0;
+        while (tail == head) {
+            pipe_wait(&spins);
+            head = atomic_load_explicit(&pipe_ring.head, memory_order_acquire);
+        }
+        PipeSlot slot = pipe_ring.slot[tail & (PIPE_RING-1)];
+        atomic_store_explicit(&pipe_ring.tail, ++tail, memory_order_release);
+        if (slot.key < 0)
+            break;
+        if (slot.key < next || (slot.key & SKIP_AND) < SKIP_FREQ)
+            continue;
+        // the ring runs PIPE_DIST1 ahead, wait for PIPE_DIST2 so the array2
+        // line has had the stage gap to arrive
+        spins = 0;
+        while (slot.key - (int) atomic_load_explicit(&main_iter, memory_order_relaxed) > PIPE_DIST2)
+            pipe_wait(&spins);
+        __builtin_prefetch(&array3[hash(array2[slot.index])]);
+        next = pipe_sync(slot.key, PIPE_DIST2, &serialize_flag);
+    }
+}
+#endif
+/*-----pipelined helper-----*/
+
 void rank( int iteration, threadpool thpool )
 {
     int i;
@@ -796,7 +967,17 @@ void rank( int iteration, threadpool thpool )
 #endif
         [i] = 0;
 
+    #if defined(PIPELINE)
+    atomic_store_explicit(&main_iter, 0, memory_order_relaxed); // stale from the last rank
+    #endif
+    #if PIPELINE == 2
+    thpool_add_work(thpool, (void*)PrefetchStage1, NULL); // issue both stages 
+    thpool_add_work(thpool, (void*)PrefetchStage2, NULL); 
+    #elif defined(PIPELINE)
+    thpool_add_work(thpool, (void*)PrefetchThread_pipelined, NULL); // issue pf thread 
+    #else
     thpool_add_work(thpool, (void*)PrefetchThread, NULL); // issue pf thread 
+    #endif
 /*  Ranking of all keys occurs in this section:                 */
     for( i=0; i<NUM_KEYS; i++ ) {
 
@@ -1329,7 +1510,12 @@ void rank( int iteration, threadpool thpool )
             atomic_store_explicit(&main_iter, i, memory_order_relaxed); 
         #endif 
     }
+    #if PIPELINE == 2
+    atomic_store_explicit(&main_iter, NUM_KEYS, memory_order_relaxed); // opens stage 2's gate for the last keys
+    thpool_wait(thpool); // the stages share pipe_ring with the next rank
+    #else
     // thpool_wait(thpool); 
+    #endif
 }
 
 
@@ -1362,7 +1548,11 @@ int main( int argc, char **argv )
 
     int             i, iteration, itemp, maxiterations;
     double          timecounter, maxtime;
+    #ifdef PIPELINE
+    threadpool thpool = thpool_init(PIPE_HELPERS); 
+    #else
     threadpool thpool = thpool_init(1); 
+    #endif
     #ifdef PRINT_HISTOGRAM
     histogram_array = (int*) calloc(NUM_KEYS * MAX_ITERATIONS, sizeof(int)); 
     count = 0; 
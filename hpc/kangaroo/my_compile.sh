@@ -16,4 +16,12 @@ gcc -g -Wall -w -O3 -mavx2 -mfma -fPIC -lm kangaroo_tpf.c \
     -DNARRAYS=3 -DNHASH=2 -DNSWPF=0 -pthread -lrt -o bin/kangaroo-tpf
 
 gcc -g -Wall -w -O3 -fPIC -fopenmp -lm kangaroo_omp.c ../nas-common/c_print_results.c \
-    ../nas-common/c_timers.c ../nas-common/wtime.c -DNARRAYS=3 -DNHASH=2 -DNSWPF=0 -pthread -o bin/kangaroo-omp
\ No newline at end of file
+    ../nas-common/c_timers.c ../nas-common/wtime.c -DNARRAYS=3 -DNHASH=2 -DNSWPF=0 -pthread -o bin/kangaroo-omp
+
+gcc -g -Wall -w -O3 -mavx2 -mfma -fPIC -lm kangaroo_tpf.c \
+    ../thpool/thpool.c ../nas-common/c_print_results.c ../nas-common/c_timers.c ../nas-common/wtime.c \
+    -DNARRAYS=3 -DNHASH=2 -DNSWPF=0 -DPIPELINE=1 -pthread -lrt -o bin/kangaroo-tpf-pipe
+
+gcc -g -Wall -w -O3 -mavx2 -mfma -fPIC -lm kangaroo_tpf.c \
+    ../thpool/thpool.c ../nas-common/c_print_results.c ../nas-common/c_timers.c ../nas-common/wtime.c \
+    -DNARRAYS=3 -DNHASH=2 -DNSWPF=0 -DPIPELINE=2 -pthread -lrt -o bin/kangaroo-tpf-pipe2
@@ -0,0 +1,43 @@
+#!/usr/bin/bash
+# prints "main helper" for the first pair of SMT siblings (index $1, default 0)
+# among the CPUs this shell may run on; without SMT two cores are paired
+
+index=${1:-0}
+
+expand() { # "0-1,64" -> 0 1 64
+	tr ',' '\n' | awk -F- '{ hi = ($2 == "") ? $1 : $2; for (c = $1; c <= hi; c++) print c }'
+}
+
+allowed=$(taskset -cp $$ | sed 's/.*: //' | expand)
+
+pairs=()
+singles=()
+seen=" "
+for cpu in $allowed; do
+	case "$seen" in *" $cpu "*) continue ;; esac
+	list=/sys/devices/system/cpu/cpu$cpu/topology/thread_siblings_list
+	sibling=""
+	if [ -r $list ]; then
+		for s in $(expand < $list); do
+			if [ $s != $cpu ] && echo "$allowed" | grep -qx $s; then
+				sibling=$s
+				break
+			fi
+		done
+	fi
+	if [ -n "$sibling" ]; then
+		pairs+=("$cpu $sibling")
+		seen="$seen$cpu $sibling "
+	else
+		singles+=($cpu)
+		seen="$seen$cpu "
+	fi
+done
+for ((i = 0; i + 1 < ${#singles[@]}; i += 2)); do
+	pairs+=("${singles[i]} ${singles[i+1]}")
+done
+if [ $((${#singles[@]} % 2)) == 1 ]; then
+	pairs+=("${singles[-1]} ${singles[-1]}")
+fi
+
+echo ${pairs[$((index % ${#pairs[@]}))]}
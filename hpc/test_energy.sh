@@ -10,8 +10,9 @@ out_path=$(pwd)/output/figure7
 #----------only set these parameters----------
 
 kernel_name=$1
-smt_core0=$2
-smt_core1=$3
+smt_pair=($($(dirname "$0")/smt_pair.sh)) # siblings from sysfs unless given
+smt_core0=${2:-${smt_pair[0]}}
+smt_core1=${3:-${smt_pair[1]}}
 
 kernel_baseline="$kernel_name-no"
 kernel_homp="$kernel_name-omp"